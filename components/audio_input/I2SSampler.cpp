@@ -6,10 +6,25 @@
 
 void I2SSampler::addSample(int16_t sample)
 {
+    if (m_write_blocked)
+    {
+        // a reader is still using the buffer - lose the sample rather than overwrite what they have
+        if (m_audio_buffers[m_current_audio_buffer]->isPinned())
+        {
+            m_dropped_samples.store(m_dropped_samples.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        m_write_blocked = false;
+    }
     // store the sample
     m_write_ring_buffer_accessor->setCurrentSample(sample);
+    // only this task writes the count - it's published after the sample so anyone who sees it can read the sample
+    m_samples_written.store(m_samples_written.load(std::memory_order_relaxed) + 1);
     if (m_write_ring_buffer_accessor->moveToNextSample())
     {
+        // pins are checked as we move into a buffer, after the count that tells readers we've got to it
+        m_current_audio_buffer = (m_current_audio_buffer + 1) % AUDIO_BUFFER_COUNT;
+        m_write_blocked = m_audio_buffers[m_current_audio_buffer]->isPinned();
         // trigger the processor task as we've filled a buffer
         xTaskNotify(m_processor_task_handle, 1, eSetBits);
     }
@@ -49,9 +64,15 @@ I2SSampler::I2SSampler()
         m_audio_buffers[i] = new AudioBuffer();
     }
     m_write_ring_buffer_accessor = new RingBufferAccessor(m_audio_buffers, AUDIO_BUFFER_COUNT);
+    m_current_audio_buffer = 0;
+    m_write_blocked = false;
+    m_samples_written.store(0);
+    m_dropped_samples.store(0);
+    m_processor_task_handle = nullptr;
 }
 
-void I2SSampler::start(i2s_port_t i2s_port, i2s_config_t &i2s_config, TaskHandle_t processor_task_handle)
+void I2SSampler::start(i2s_port_t i2s_port, i2s_config_t &i2s_config, TaskHandle_t processor_task_handle,
+                       UBaseType_t reader_priority, BaseType_t reader_core)
 {
     ESP_LOGI("I2SSampler", "Starting i2s");
     m_i2s_port = i2s_port;
@@ -65,7 +86,7 @@ void I2SSampler::start(i2s_port_t i2s_port, i2s_config_t &i2s_config, TaskHandle
     // set up the I2S configuration from the subclass
     configureI2S();
     // start a task to read samples
-    xTaskCreate(i2sReaderTask, "i2s Reader Task", 4096, this, 1, &m_reader_task_handle);
+    xTaskCreatePinnedToCore(i2sReaderTask, "i2s Reader Task", 4096, this, reader_priority, &m_reader_task_handle, reader_core);
 }
 
 RingBufferAccessor *I2SSampler::getRingBufferReader()
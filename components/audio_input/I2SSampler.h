@@ -4,6 +4,7 @@
 #include <freertos/task.h>
 #include <driver/i2s.h>
 #include <algorithm>
+#include <atomic>
 
 #include "RingBuffer.h"
 
@@ -20,6 +21,11 @@ private:
     RingBufferAccessor *m_write_ring_buffer_accessor;
     // current audio buffer
     int m_current_audio_buffer;
+    // the current audio buffer was pinned when we got to it - samples are dropped until it's released
+    bool m_write_blocked;
+    // samples stored since we started (wrapping at 2^32) and samples dropped because a buffer was pinned
+    std::atomic<uint32_t> m_samples_written;
+    std::atomic<uint32_t> m_dropped_samples;
     // I2S reader task
     TaskHandle_t m_reader_task_handle;
     // processor task
@@ -40,7 +46,8 @@ protected:
 
 public:
     I2SSampler();
-    void start(i2s_port_t i2s_port, i2s_config_t &i2s_config, TaskHandle_t processor_task_handle);
+    void start(i2s_port_t i2s_port, i2s_config_t &i2s_config, TaskHandle_t processor_task_handle,
+               UBaseType_t reader_priority = 1, BaseType_t reader_core = tskNO_AFFINITY);
 
     RingBufferAccessor *getRingBufferReader();
 
@@ -52,6 +59,21 @@ public:
     {
         return AUDIO_BUFFER_COUNT * SAMPLE_BUFFER_SIZE;
     }
+    // the buffer holding the sample at a ring buffer index - pin it to stop the writer coming round and overwriting it
+    AudioBuffer *getAudioBuffer(int index)
+    {
+        return m_audio_buffers[(index / SAMPLE_BUFFER_SIZE) % AUDIO_BUFFER_COUNT];
+    }
+    // the sample at index n of the ring buffer is sample n of the stream (mod the ring buffer size) when the count is
+    // extended past 2^32 by the caller
+    uint32_t getSamplesWritten()
+    {
+        return m_samples_written.load();
+    }
+    uint32_t getDroppedSamples()
+    {
+        return m_dropped_samples.load(std::memory_order_relaxed);
+    }
 
     friend void i2sReaderTask(void *param);
 };
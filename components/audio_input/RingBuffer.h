@@ -2,6 +2,7 @@
 #define _ring_buffer_h_
 
 #include <string.h>
+#include <atomic>
 
 #define SAMPLE_BUFFER_SIZE 1600
 
@@ -9,9 +10,24 @@ class AudioBuffer
 {
 public:
     int16_t samples[SAMPLE_BUFFER_SIZE];
+    // readers still using the samples - the writer won't start filling the buffer again until they are all done
+    std::atomic<int> pins;
     AudioBuffer()
     {
         memset(samples, 0, SAMPLE_BUFFER_SIZE * sizeof(int16_t));
+        pins.store(0);
+    }
+    void pin()
+    {
+        pins.fetch_add(1);
+    }
+    void unpin()
+    {
+        pins.fetch_sub(1);
+    }
+    bool isPinned()
+    {
+        return pins.load() > 0;
     }
 };
 
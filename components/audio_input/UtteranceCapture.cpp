@@ -0,0 +1,154 @@
+#include "esp_log.h"
+#include "UtteranceCapture.h"
+#include <algorithm>
+
+static const char *TAG = "UtteranceCapture";
+
+// samples per millisecond at 16KHz
+#define SAMPLES_PER_MS 16
+
+UtteranceCapture::UtteranceCapture(I2SSampler *sampler, int preroll_ms, int max_ms, int chunk_slots)
+{
+    m_sampler = sampler;
+    uint32_t max_preroll = (AUDIO_BUFFER_COUNT - 2) * SAMPLE_BUFFER_SIZE;
+    m_preroll_samples = std::min((uint32_t)std::max(preroll_ms, 0) * SAMPLES_PER_MS, max_preroll);
+    m_max_samples = std::max(max_ms, 0) * SAMPLES_PER_MS;
+    m_chunks = xQueueCreate(std::max(chunk_slots, 1), sizeof(AudioChunk_t));
+    m_start_requested.store(false);
+    m_stop_requested.store(false);
+    m_stop_written.store(0);
+    m_capturing.store(false);
+    m_last_written = m_sampler->getSamplesWritten();
+    m_written = m_last_written;
+    m_start = 0;
+    m_next = 0;
+    m_end = 0;
+    m_sequence = 0;
+    m_stats = {0, 0, 0, 0, 0};
+}
+
+UtteranceCapture::~UtteranceCapture()
+{
+    // hand back anything the consumer didn't get to
+    AudioChunk_t chunk;
+    while (xQueueReceive(m_chunks, &chunk, 0) == pdPASS)
+    {
+        releaseChunk(chunk);
+    }
+    vQueueDelete(m_chunks);
+}
+
+uint64_t UtteranceCapture::samplesWritten()
+{
+    uint32_t written = m_sampler->getSamplesWritten();
+    m_written += written - m_last_written;
+    m_last_written = written;
+    return m_written;
+}
+
+void UtteranceCapture::start()
+{
+    m_start_requested.store(true);
+}
+
+void UtteranceCapture::stop()
+{
+    m_stop_written.store(m_sampler->getSamplesWritten());
+    m_stop_requested.store(true);
+}
+
+bool UtteranceCapture::queueChunk(AudioBuffer *buffer, int count, bool last)
+{
+    AudioChunk_t chunk = {
+        .buffer = buffer,
+        .samples = buffer ? buffer->samples + m_next % SAMPLE_BUFFER_SIZE : nullptr,
+        .count = count,
+        .sequence = m_sequence,
+        .position = (uint32_t)(m_next - m_start),
+        .last = last};
+    if (xQueueSend(m_chunks, &chunk, 0) != pdPASS)
+    {
+        return false;
+    }
+    m_sequence++;
+    m_stats.chunks++;
+    m_stats.samples += count;
+    if (last)
+    {
+        m_capturing.store(false);
+    }
+    return true;
+}
+
+void UtteranceCapture::update()
+{
+    uint64_t written = samplesWritten();
+    if (m_start_requested.exchange(false) && !m_capturing.load())
+    {
+        // there might not be a whole pre-roll's worth just after start up
+        m_start = written - std::min((uint64_t)m_preroll_samples, written);
+        m_next = m_start;
+        m_end = written + m_max_samples;
+        m_sequence = 0;
+        m_stop_requested.store(false);
+        m_capturing.store(true);
+        m_stats.utterances++;
+        ESP_LOGI(TAG, "Capturing with %u ms of pre-roll", (unsigned)((written - m_start) / SAMPLES_PER_MS));
+    }
+    if (!m_capturing.load())
+    {
+        return;
+    }
+    if (m_stop_requested.exchange(false))
+    {
+        // the writer may have moved on since - count back from where it is now
+        uint32_t since_stop = m_last_written - m_stop_written.load();
+        m_end = std::max(m_start, std::min(m_end, written - since_stop));
+    }
+    uint64_t end = std::min(m_end, written);
+    uint64_t ring_size = m_sampler->getRingBufferSize();
+    while (m_next < end)
+    {
+        if (uxQueueSpacesAvailable(m_chunks) == 0)
+        {
+            // leave the rest in the ring until the consumer catches up
+            m_stats.queue_full++;
+            return;
+        }
+        // chunks never span ring buffers - each one pins just the one buffer
+        uint64_t buffer_start = m_next - m_next % SAMPLE_BUFFER_SIZE;
+        uint64_t chunk_end = std::min(end, buffer_start + SAMPLE_BUFFER_SIZE);
+        AudioBuffer *buffer = m_sampler->getAudioBuffer(buffer_start % ring_size);
+        buffer->pin();
+        // the writer checks the pins as it moves into a buffer - if it had already come round to this one before it
+        // could see our pin the samples have gone
+        if (samplesWritten() - buffer_start >= ring_size)
+        {
+            buffer->unpin();
+            m_stats.dropped_samples += chunk_end - m_next;
+            m_next = chunk_end;
+            continue;
+        }
+        // this is the chunk pinning the buffer - handing it over to the consumer can't fail as only we queue
+        queueChunk(buffer, chunk_end - m_next, chunk_end == m_end);
+        m_next = chunk_end;
+    }
+    if (m_next == m_end && m_capturing.load())
+    {
+        // stopped after everything up to the end had gone, or it was all dropped - let the consumer know it's over
+        queueChunk(nullptr, 0, true);
+    }
+}
+
+bool UtteranceCapture::getChunk(AudioChunk_t *chunk, TickType_t ticks_to_wait)
+{
+    return xQueueReceive(m_chunks, chunk, ticks_to_wait) == pdPASS;
+}
+
+void UtteranceCapture::releaseChunk(const AudioChunk_t &chunk)
+{
+    if (chunk.buffer)
+    {
+        chunk.buffer->unpin();
+    }
+}
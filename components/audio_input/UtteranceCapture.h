@@ -0,0 +1,104 @@
+#ifndef __utterance_capture_h__
+#define __utterance_capture_h__
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "I2SSampler.h"
+
+/**
+ * A piece of an utterance. The samples are still in the sampler's ring buffer,
+ * which is pinned so they can't be overwritten until the chunk is released.
+ **/
+typedef struct
+{
+    // NULL for the empty chunk that ends an utterance stopped after everything had been sent
+    AudioBuffer *buffer;
+    const int16_t *samples;
+    int count;
+    // chunks are numbered from 0 for each utterance, position is the first sample's offset from the start of the
+    // pre-roll - a jump means samples were lost
+    uint32_t sequence;
+    uint32_t position;
+    // the utterance ends with this chunk
+    bool last;
+} AudioChunk_t;
+
+typedef struct
+{
+    uint32_t utterances;
+    uint32_t chunks;
+    uint32_t samples;
+    // samples the writer got to before they could be queued - the consumer wasn't keeping up
+    uint32_t dropped_samples;
+    // updates that found the queue full
+    uint32_t queue_full;
+} UtteranceCaptureStats_t;
+
+/**
+ * Records what's said after the wake word straight out of the sampler's ring
+ * buffer without copying it.
+ *
+ * start() takes the pre-roll - the audio from just before the trigger - and
+ * from then on each update() queues the samples that have arrived since, a
+ * chunk per ring buffer segment, until stop() is called (end of speech) or the
+ * utterance reaches its maximum length. Every queued chunk pins its buffer so
+ * the consumer can take its time with it, and the queue being bounded bounds
+ * how much of the ring can be pinned - if it fills up the samples wait in the
+ * ring and are dropped if the writer comes round to them.
+ *
+ * update() must always be called from the same task - the one the sampler
+ * wakes as each buffer fills. start() and stop() can be called from any task,
+ * and the chunks can be taken and released by one other task.
+ **/
+class UtteranceCapture
+{
+private:
+    I2SSampler *m_sampler;
+    QueueHandle_t m_chunks;
+    uint32_t m_preroll_samples;
+    uint32_t m_max_samples;
+    std::atomic<bool> m_start_requested;
+    std::atomic<bool> m_stop_requested;
+    // the sampler's count of samples written when stop was called
+    std::atomic<uint32_t> m_stop_written;
+    std::atomic<bool> m_capturing;
+    // the sampler's count of samples written, extended to 64 bits so it maps straight on to the ring buffer
+    uint32_t m_last_written;
+    uint64_t m_written;
+    // stream positions of the start of the pre-roll, the next sample to queue and the end of the utterance
+    uint64_t m_start;
+    uint64_t m_next;
+    uint64_t m_end;
+    uint32_t m_sequence;
+    UtteranceCaptureStats_t m_stats;
+
+    uint64_t samplesWritten();
+    bool queueChunk(AudioBuffer *buffer, int count, bool last);
+
+public:
+    // the pre-roll can be at most 900ms - the ring buffer less a couple of buffers for the writer to keep going with
+    UtteranceCapture(I2SSampler *sampler, int preroll_ms, int max_ms, int chunk_slots);
+    ~UtteranceCapture();
+    // the wake word was heard - ignored if we're already capturing
+    void start();
+    // end of speech - the utterance ends with the last sample the sampler has written
+    void stop();
+    bool isCapturing()
+    {
+        return m_capturing.load();
+    }
+    // queue whatever has arrived since the last update - call whenever the sampler has filled a buffer
+    void update();
+    // consumer - wait for the next chunk and hand it back once it's been used
+    bool getChunk(AudioChunk_t *chunk, TickType_t ticks_to_wait);
+    void releaseChunk(const AudioChunk_t &chunk);
+    UtteranceCaptureStats_t getStats()
+    {
+        return m_stats;
+    }
+};
+
+#endif
@@ -1,70 +1,102 @@
 
 #include <Arduino.h>
 #include "driver/i2s.h"
-#include <math.h>
-#include <SPIFFS.h>
-#include <FS.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include <algorithm>
 
 #include "SampleSource.h"
 #include "I2SOutput.h"
 
-// number of frames to try and send at once (a frame is a left and right sample)
-#define NUM_FRAMES_TO_SEND 128
+// zero initialised and never written - silence is sent straight from here
+static Frame_t silence[NUM_FRAMES_TO_SEND];
+
+// renders the next block into frames, returns what to write - frames or silence - and how many bytes of it
+static const Frame_t *renderBlock(SampleSource *sample_generator, I2SOutputStats_t &stats, Frame_t *frames, size_t *bytes)
+{
+    if (sample_generator && sample_generator->available())
+    {
+        int64_t start = esp_timer_get_time();
+        int frames_available = sample_generator->getFrames(frames, NUM_FRAMES_TO_SEND);
+        uint32_t render_us = esp_timer_get_time() - start;
+        stats.blocks++;
+        stats.last_render_us = render_us;
+        stats.max_render_us = std::max(stats.max_render_us, render_us);
+        stats.total_render_us += render_us;
+        if (frames_available > 0)
+        {
+            *bytes = frames_available * sizeof(Frame_t);
+            return frames;
+        }
+    }
+    // no sample generator available - just send silence
+    stats.silent_blocks++;
+    *bytes = sizeof(silence);
+    return silence;
+}
 
 void i2sWriterTask(void *param)
 {
     I2SOutput *output = (I2SOutput *)param;
-    int availableBytes = 0;
-    int buffer_position = 0;
-    Frame_t frames[NUM_FRAMES_TO_SEND];
+    // the block being written and how far through it we are
+    int current = 0;
+    size_t position = 0;
+    // what to write for each block and how many bytes of it - 0 until it has been rendered
+    const Frame_t *blocks[2];
+    size_t block_bytes[2] = {0, 0};
+    blocks[0] = renderBlock(output->m_sample_generator, output->m_stats, output->m_frames[0], &block_bytes[0]);
     while (true)
     {
-        // wait for some data to be requested
+        // wait for a DMA buffer to be played
         i2s_event_t evt;
         if (xQueueReceive(output->m_i2sQueue, &evt, portMAX_DELAY) == pdPASS)
         {
-            if (evt.type == I2S_EVENT_TX_DONE)
+            // take every event that's waiting so none are dropped if rendering ever falls behind
+            bool tx_done = false;
+            do
             {
-                size_t bytesWritten = 0;
-                do
+                if (evt.type == I2S_EVENT_TX_Q_OVF)
                 {
-                    if (availableBytes == 0)
-                    {
-                        // get some frames from the wave file - a frame consists of a 16 bit left and right sample
-                        if (output->m_sample_generator && output->m_sample_generator->available())
-                        {
-                            int frames_available = output->m_sample_generator->getFrames(frames, NUM_FRAMES_TO_SEND);
-                            // how maby bytes do we now have to send
-                            availableBytes = frames_available * sizeof(uint32_t);
-                        }
-                        else
-                        {
-                            // no sample generator available - just send silence
-                            for (int i = 0; i < NUM_FRAMES_TO_SEND; i++)
-                            {
-                                frames[i].left = frames[i].right = 0;
-                            }
-                            availableBytes = NUM_FRAMES_TO_SEND * sizeof(uint32_t);
-                        }
-                        // reset the buffer position back to the start
-                        buffer_position = 0;
-                    }
-                    // do we have something to write?
-                    if (availableBytes > 0)
+                    // the DMA buffers all played out before we refilled them
+                    output->m_stats.underruns++;
+                }
+                tx_done |= evt.type == I2S_EVENT_TX_DONE || evt.type == I2S_EVENT_TX_Q_OVF;
+            } while (xQueueReceive(output->m_i2sQueue, &evt, 0) == pdPASS);
+            if (!tx_done)
+            {
+                continue;
+            }
+            // top up the DMA buffers without waiting - there will be another event when the next one has played
+            size_t bytesWritten = 0;
+            do
+            {
+                i2s_write(output->m_i2sPort, (const uint8_t *)blocks[current] + position, block_bytes[current] - position,
+                          &bytesWritten, 0);
+                position += bytesWritten;
+                if (position == block_bytes[current])
+                {
+                    // the driver has all of this block, move on to the other one
+                    block_bytes[current] = 0;
+                    current = 1 - current;
+                    position = 0;
+                    if (block_bytes[current] == 0)
                     {
-                        // write data to the i2s peripheral
-                        i2s_write(output->m_i2sPort, buffer_position + (uint8_t *)frames,
-                                  availableBytes, &bytesWritten, portMAX_DELAY);
-                        availableBytes -= bytesWritten;
-                        buffer_position += bytesWritten;
+                        // rendering has fallen behind, catch up below and pick up the events that came in meanwhile
+                        break;
                     }
-                } while (bytesWritten > 0);
+                }
+            } while (bytesWritten > 0);
+            // render the next block while the DMA buffers play
+            int next = block_bytes[current] == 0 ? current : 1 - current;
+            if (block_bytes[next] == 0)
+            {
+                blocks[next] = renderBlock(output->m_sample_generator, output->m_stats, output->m_frames[next], &block_bytes[next]);
             }
         }
     }
 }
 
-void I2SOutput::start(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins)
+bool I2SOutput::start(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins)
 {
     // i2s config for writing both channels of I2S
     i2s_config_t i2sConfig = {
@@ -80,6 +112,20 @@ void I2SOutput::start(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins)
         .tx_desc_auto_clear = true,
         .fixed_mclk = 0};
     m_i2sPort = i2sPort;
+    // the driver copies the blocks into its own DMA buffers so they don't have to be DMA capable - keep them in
+    // internal RAM where that copy is quickest, but leave the scarce DMA capable RAM to the drivers
+    for (int i = 0; i < 2; i++)
+    {
+        m_frames[i] = static_cast<Frame_t *>(heap_caps_malloc(sizeof(Frame_t) * NUM_FRAMES_TO_SEND, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    }
+    if (!m_frames[0] || !m_frames[1])
+    {
+        Serial.printf("ERROR: no internal RAM for the i2s output blocks\n");
+        heap_caps_free(m_frames[0]);
+        heap_caps_free(m_frames[1]);
+        m_frames[0] = m_frames[1] = NULL;
+        return false;
+    }
     //install and start i2s driver
     i2s_driver_install(m_i2sPort, &i2sConfig, 4, &m_i2sQueue);
     // set up the i2s pins
@@ -89,6 +135,7 @@ void I2SOutput::start(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins)
     // start a task to write samples to the i2s peripheral
     TaskHandle_t writerTaskHandle;
     xTaskCreate(i2sWriterTask, "i2s Writer Task", 4096, this, 1, &writerTaskHandle);
+    return true;
 }
 
 void I2SOutput::setSampleGenerator(SampleSource *sample_generator)
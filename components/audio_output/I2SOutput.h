@@ -2,12 +2,40 @@
 #define __i2s_output_h__
 
 #include <Arduino.h>
+#include <string.h>
 #include "driver/i2s.h"
+#include "SampleSource.h"
 
-class SampleSource;
+// number of frames to render at once (a frame is a left and right sample)
+#define NUM_FRAMES_TO_SEND 128
+
+/**
+ * What the writer task has been doing - read without a lock so the values can
+ * be a block apart from each other, which is fine for diagnostics
+ **/
+typedef struct
+{
+    // blocks rendered from the sample generator
+    uint32_t blocks;
+    // blocks of silence sent because there was nothing to play
+    uint32_t silent_blocks;
+    // times the DMA ran out of samples and played out a stale buffer
+    uint32_t underruns;
+    // time taken by the sample generator to render a block
+    uint32_t last_render_us;
+    uint32_t max_render_us;
+    uint64_t total_render_us;
+} I2SOutputStats_t;
 
 /**
  * Base Class for both the ADC and I2S sampler
+ *
+ * The sample generator renders straight into one of two blocks in internal
+ * RAM, which the i2s driver copies into its own DMA buffers. While one block
+ * is being handed to the driver the other already holds the next one,
+ * rendered as soon as the block before it went - so rendering happens while
+ * the DMA buffers play rather than when they've run low. Silence comes from a shared block of zeros rather than
+ * zeroing a block each time.
  **/
 class I2SOutput
 {
@@ -20,15 +48,23 @@ private:
     i2s_port_t m_i2sPort;
     // src of samples for us to play
     SampleSource *m_sample_generator;
+    // the ping pong blocks the sample generator renders into
+    Frame_t *m_frames[2];
+    I2SOutputStats_t m_stats;
 
 public:
     I2SOutput()
     {
         m_sample_generator = NULL;
+        m_frames[0] = m_frames[1] = NULL;
+        memset(&m_stats, 0, sizeof(m_stats));
     }
-    void start(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins);
+    // returns false if there isn't the internal RAM for the blocks
+    bool start(i2s_port_t i2sPort, i2s_pin_config_t &i2sPins);
+    // the writer task reads this without a lock - set it once and attach and detach sources on a MixerSource to change what plays
     void setSampleGenerator(SampleSource *sample_generator);
+    I2SOutputStats_t getStats() { return m_stats; }
     friend void i2sWriterTask(void *param);
 };
 
-#endif
\ No newline at end of file
+#endif
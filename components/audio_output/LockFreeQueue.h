@@ -0,0 +1,56 @@
+#ifndef __lock_free_queue_h__
+#define __lock_free_queue_h__
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Fixed size lock-free single producer / single consumer queue of small values.
+ *
+ * The producer and the consumer only share the head and tail counters, so one
+ * task can push while another - the i2s writer task - pops without either of
+ * them ever blocking. push fails if the queue is full and pop if it's empty.
+ **/
+template <typename T, uint32_t Capacity>
+class LockFreeQueue
+{
+private:
+    T m_items[Capacity];
+    // number of items pushed by the producer
+    std::atomic<uint32_t> m_head;
+    // number of items popped by the consumer
+    std::atomic<uint32_t> m_tail;
+
+public:
+    LockFreeQueue()
+    {
+        m_head.store(0);
+        m_tail.store(0);
+    }
+    // producer - false if the queue is full
+    bool push(const T &item)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        m_items[head % Capacity] = item;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    // consumer - false if the queue is empty
+    bool pop(T &item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        item = m_items[tail % Capacity];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
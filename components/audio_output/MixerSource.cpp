@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "MixerSource.h"
+
+// gains are Q24 so the per frame steps of long ramps stay accurate
+#define GAIN_BITS 24
+#define UNITY_GAIN (1 << GAIN_BITS)
+#define MAX_GAIN (4 * UNITY_GAIN)
+// and are dropped to Q14 to multiply the samples - at the maximum gain of 4 that's 65536, and
+// every 16 bit sample times that, plus the rounding, still fits in 32 bits
+#define SAMPLE_GAIN_SHIFT 10
+#define SAMPLE_GAIN_BITS (GAIN_BITS - SAMPLE_GAIN_SHIFT)
+
+static int32_t to_gain(float gain)
+{
+    if (!(gain > 0))
+    {
+        return 0;
+    }
+    return gain >= (float)MAX_GAIN / UNITY_GAIN ? MAX_GAIN : (int32_t)lroundf(gain * UNITY_GAIN);
+}
+
+static inline int16_t saturate(int32_t value)
+{
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+MixerSource::MixerSource()
+{
+    m_channel_count = 0;
+    m_source_frames = static_cast<Frame_t *>(malloc(sizeof(Frame_t) * MIXER_BLOCK_FRAMES));
+    m_mix = static_cast<int32_t *>(malloc(sizeof(int32_t) * 2 * MIXER_BLOCK_FRAMES));
+}
+
+MixerSource::~MixerSource()
+{
+    free(m_source_frames);
+    free(m_mix);
+}
+
+bool MixerSource::attach(SampleSource *source, float gain, int fade_in_frames)
+{
+    Command_t command = {MIXER_ATTACH, source, to_gain(gain), fade_in_frames};
+    return m_commands.push(command);
+}
+
+bool MixerSource::detach(SampleSource *source, int fade_out_frames)
+{
+    Command_t command = {MIXER_DETACH, source, 0, fade_out_frames};
+    return m_commands.push(command);
+}
+
+bool MixerSource::setGain(SampleSource *source, float gain, int ramp_frames)
+{
+    Command_t command = {MIXER_SET_GAIN, source, to_gain(gain), ramp_frames};
+    return m_commands.push(command);
+}
+
+SampleSource *MixerSource::retired()
+{
+    SampleSource *source = NULL;
+    return m_retired.pop(source) ? source : NULL;
+}
+
+void MixerSource::startRamp(Channel_t &channel, int32_t gain, int ramp_frames)
+{
+    channel.target_gain = gain;
+    if (ramp_frames > 0 && gain != channel.gain)
+    {
+        channel.ramp_frames = ramp_frames;
+        channel.gain_step = (gain - channel.gain) / ramp_frames;
+    }
+    else
+    {
+        channel.ramp_frames = 0;
+        channel.gain_step = 0;
+        channel.gain = gain;
+    }
+}
+
+void MixerSource::processCommands()
+{
+    Command_t command;
+    while (m_commands.pop(command))
+    {
+        if (command.type == MIXER_ATTACH)
+        {
+            if (m_channel_count == MIXER_MAX_SOURCES)
+            {
+                // no room for it - hand it straight back unplayed
+                m_retired.push(command.source);
+                continue;
+            }
+            Channel_t &channel = m_channels[m_channel_count++];
+            channel.source = command.source;
+            channel.gain = 0;
+            channel.detaching = false;
+            channel.finished = false;
+            startRamp(channel, command.gain, command.ramp_frames);
+            continue;
+        }
+        // detach or set the gain of the source if it's still playing
+        for (int i = 0; i < m_channel_count; i++)
+        {
+            Channel_t &channel = m_channels[i];
+            if (channel.source != command.source || channel.finished)
+            {
+                continue;
+            }
+            if (command.type == MIXER_DETACH)
+            {
+                channel.detaching = true;
+            }
+            else if (channel.detaching)
+            {
+                // already on its way out
+                break;
+            }
+            startRamp(channel, command.gain, command.ramp_frames);
+            break;
+        }
+    }
+}
+
+void MixerSource::retire(int index)
+{
+    Channel_t &channel = m_channels[index];
+    channel.finished = true;
+    if (!m_retired.push(channel.source))
+    {
+        // the control task hasn't collected the sources it's already been given - try again next block
+        return;
+    }
+    m_channels[index] = m_channels[--m_channel_count];
+}
+
+void MixerSource::mixChannel(Channel_t &channel, int number_frames)
+{
+    if (channel.detaching && channel.ramp_frames == 0 && channel.gain == 0)
+    {
+        // faded out
+        channel.finished = true;
+        return;
+    }
+    int frames = channel.source->available() ? channel.source->getFrames(m_source_frames, number_frames) : 0;
+    if (frames < number_frames)
+    {
+        // the source has run out
+        channel.finished = true;
+    }
+    const Frame_t *input = m_source_frames;
+    int32_t *mix = m_mix;
+    int32_t rounding = 1 << (SAMPLE_GAIN_BITS - 1);
+    if (channel.ramp_frames > 0)
+    {
+        int ramp = std::min(frames, channel.ramp_frames);
+        int32_t gain = channel.gain;
+        for (int i = 0; i < ramp; i++)
+        {
+            int32_t sample_gain = gain >> SAMPLE_GAIN_SHIFT;
+            mix[0] += (input[i].left * sample_gain + rounding) >> SAMPLE_GAIN_BITS;
+            mix[1] += (input[i].right * sample_gain + rounding) >> SAMPLE_GAIN_BITS;
+            mix += 2;
+            gain += channel.gain_step;
+        }
+        channel.ramp_frames -= ramp;
+        channel.gain = channel.ramp_frames == 0 ? channel.target_gain : gain;
+        input += ramp;
+        frames -= ramp;
+        if (channel.detaching && channel.ramp_frames == 0)
+        {
+            // faded out
+            channel.finished = true;
+        }
+    }
+    if (channel.gain == UNITY_GAIN)
+    {
+        for (int i = 0; i < frames; i++)
+        {
+            mix[2 * i] += input[i].left;
+            mix[2 * i + 1] += input[i].right;
+        }
+    }
+    else if (channel.gain != 0)
+    {
+        int32_t sample_gain = channel.gain >> SAMPLE_GAIN_SHIFT;
+        for (int i = 0; i < frames; i++)
+        {
+            mix[2 * i] += (input[i].left * sample_gain + rounding) >> SAMPLE_GAIN_BITS;
+            mix[2 * i + 1] += (input[i].right * sample_gain + rounding) >> SAMPLE_GAIN_BITS;
+        }
+    }
+}
+
+int MixerSource::getFrames(Frame_t *frames, int number_frames)
+{
+    processCommands();
+    for (int start = 0; start < number_frames; start += MIXER_BLOCK_FRAMES)
+    {
+        int block_frames = std::min(number_frames - start, MIXER_BLOCK_FRAMES);
+        memset(m_mix, 0, sizeof(int32_t) * 2 * block_frames);
+        for (int i = 0; i < m_channel_count; i++)
+        {
+            if (!m_channels[i].finished)
+            {
+                mixChannel(m_channels[i], block_frames);
+            }
+        }
+        Frame_t *output = frames + start;
+        for (int i = 0; i < block_frames; i++)
+        {
+            output[i].left = saturate(m_mix[2 * i]);
+            output[i].right = saturate(m_mix[2 * i + 1]);
+        }
+    }
+    // hand back the sources that have finished, going backwards as retire moves the last channel down
+    for (int i = m_channel_count - 1; i >= 0; i--)
+    {
+        if (m_channels[i].finished)
+        {
+            retire(i);
+        }
+    }
+    return number_frames;
+}
+
+bool MixerSource::available()
+{
+    processCommands();
+    return m_channel_count > 0;
+}
@@ -0,0 +1,98 @@
+#ifndef __mixer_source_h__
+#define __mixer_source_h__
+
+#include <stdint.h>
+#include "SampleSource.h"
+#include "LockFreeQueue.h"
+
+// most sources that can play at once
+#define MIXER_MAX_SOURCES 8
+// attach, detach and gain changes that can be waiting for the writer task
+#define MIXER_COMMAND_SLOTS 16
+// frames mixed at a time - the same as I2SOutput sends
+#define MIXER_BLOCK_FRAMES 128
+
+/**
+ * Plays any number of sources at once - prompts, chimes, a TTS stream - each
+ * with its own gain, fading in when it's attached and out when it's detached.
+ *
+ * Set it as the I2SOutput sample generator once and attach and detach sources
+ * from the control task rather than swapping the generator while it plays.
+ * The control task's calls are only queued - the writer task picks them up at
+ * the start of its next block through a lock-free queue - so neither task
+ * ever blocks the other. attach, detach, setGain and retired must all be
+ * called from the same task.
+ *
+ * Sources are owned by the caller. Once the mixer has finished with one -
+ * detached, faded out or run out of frames - it's handed back by retired()
+ * and can be deleted.
+ *
+ * Each block the sources are summed at 32 bits with their gain applied -
+ * plain adds at unity gain, a multiply at any other and a per frame gain
+ * step while ramping - and then saturated to 16 bits in one pass.
+ **/
+class MixerSource : public SampleSource
+{
+private:
+    typedef enum
+    {
+        MIXER_ATTACH,
+        MIXER_DETACH,
+        MIXER_SET_GAIN
+    } CommandType_t;
+
+    typedef struct
+    {
+        CommandType_t type;
+        SampleSource *source;
+        int32_t gain;
+        int ramp_frames;
+    } Command_t;
+
+    typedef struct
+    {
+        SampleSource *source;
+        // Q24 gain now, where it's ramping to and the step per frame
+        int32_t gain;
+        int32_t target_gain;
+        int32_t gain_step;
+        int ramp_frames;
+        // fading out to be retired
+        bool detaching;
+        // finished but not handed back yet because the retired queue was full
+        bool finished;
+    } Channel_t;
+
+    LockFreeQueue<Command_t, MIXER_COMMAND_SLOTS> m_commands;
+    LockFreeQueue<SampleSource *, MIXER_MAX_SOURCES + MIXER_COMMAND_SLOTS> m_retired;
+    Channel_t m_channels[MIXER_MAX_SOURCES];
+    int m_channel_count;
+    // frames from one source and the 32 bit sum of all of them
+    Frame_t *m_source_frames;
+    int32_t *m_mix;
+
+    void processCommands();
+    void startRamp(Channel_t &channel, int32_t gain, int ramp_frames);
+    void mixChannel(Channel_t &channel, int number_frames);
+    void retire(int index);
+
+public:
+    MixerSource();
+    ~MixerSource();
+    // control task - false if the command queue is full and nothing was done
+    // gain is linear, up to 4. fade_in_frames is how long to ramp up from silence.
+    bool attach(SampleSource *source, float gain = 1.0f, int fade_in_frames = 0);
+    // fades the source out over fade_out_frames and then retires it
+    bool detach(SampleSource *source, int fade_out_frames = 0);
+    // ramps the source's gain to gain over ramp_frames
+    bool setGain(SampleSource *source, float gain, int ramp_frames = 0);
+    // the next source the mixer has finished with or NULL if there isn't one
+    SampleSource *retired();
+
+    // writer task - always fills all the frames, with silence after the sources run out
+    int getFrames(Frame_t *frames, int number_frames);
+    // true while there is at least one source playing
+    bool available();
+};
+
+#endif
@@ -0,0 +1,225 @@
+
+#include <Arduino.h>
+#include <sys/socket.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_timer.h"
+#include <algorithm>
+
+#include "AudioCodec.h"
+#include "NetworkSampleSource.h"
+
+// samples per millisecond at 16KHz
+#define SAMPLES_PER_MS 16
+// how long to wait for the player to make room before deciding it has stopped
+#define WRITE_TIMEOUT_MS 2000
+// how long the server can take over the response, including thinking about it
+#define RECEIVE_TIMEOUT_MS 10000
+
+NetworkSampleSource::NetworkSampleSource(int start_threshold_ms, int capacity_ms)
+{
+    // there's always room for the threshold and a frame on top so playback can start
+    m_start_threshold = std::max(start_threshold_ms, 0) * SAMPLES_PER_MS;
+    m_capacity = std::max((uint32_t)std::max(capacity_ms, 0) * SAMPLES_PER_MS, m_start_threshold + STREAM_FRAME_SAMPLES);
+    m_buffer = static_cast<int16_t *>(malloc(sizeof(int16_t) * m_capacity));
+    m_written.store(0);
+    m_read.store(0);
+    m_ended.store(true);
+    m_awaiting_audio.store(false);
+    m_playing = false;
+    m_rebuffering = false;
+    m_next_timestamp = 0;
+    m_awaiting_frame = false;
+    m_request_time = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+NetworkSampleSource::~NetworkSampleSource()
+{
+    free(m_buffer);
+}
+
+void NetworkSampleSource::expectResponse()
+{
+    m_request_time = esp_timer_get_time();
+    m_next_timestamp = 0;
+    m_awaiting_frame = true;
+    m_awaiting_audio.store(true);
+    m_ended.store(false);
+}
+
+// copies samples into the ring, waiting for the writer task to make room
+bool NetworkSampleSource::write(const int16_t *samples, int count)
+{
+    uint32_t written = m_written.load(std::memory_order_relaxed);
+    int waited_ms = 0;
+    while (m_capacity - (written - m_read.load(std::memory_order_acquire)) < (uint32_t)count)
+    {
+        if (waited_ms >= WRITE_TIMEOUT_MS)
+        {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+        waited_ms += 5;
+    }
+    uint32_t position = written % m_capacity;
+    int first = std::min((uint32_t)count, m_capacity - position);
+    if (samples)
+    {
+        memcpy(m_buffer + position, samples, first * sizeof(int16_t));
+        memcpy(m_buffer, samples + first, (count - first) * sizeof(int16_t));
+    }
+    else
+    {
+        memset(m_buffer + position, 0, first * sizeof(int16_t));
+        memset(m_buffer, 0, (count - first) * sizeof(int16_t));
+    }
+    written += count;
+    m_written.store(written, std::memory_order_release);
+    m_stats.max_buffered = std::max(m_stats.max_buffered, written - m_read.load(std::memory_order_relaxed));
+    return true;
+}
+
+bool NetworkSampleSource::pushFrame(const StreamFrameHeader_t &header, const uint8_t *payload)
+{
+    if (m_awaiting_frame)
+    {
+        m_stats.first_frame_us = esp_timer_get_time() - m_request_time;
+        m_awaiting_frame = false;
+    }
+    if (header.samples > STREAM_FRAME_SAMPLES || header.timestamp < m_next_timestamp ||
+        audio_codec_decode((AudioCodec_t)header.codec, payload, header.payload_bytes, m_decoded, header.samples) < 0)
+    {
+        m_stats.bad_frames++;
+        return false;
+    }
+    // keep the timing if the server skipped anything - a frame's worth of silence at a time
+    while (m_next_timestamp < header.timestamp)
+    {
+        int gap = std::min(header.timestamp - m_next_timestamp, (uint32_t)STREAM_FRAME_SAMPLES);
+        if (!write(nullptr, gap))
+        {
+            return false;
+        }
+        m_next_timestamp += gap;
+        m_stats.gap_samples += gap;
+    }
+    if (!write(m_decoded, header.samples))
+    {
+        return false;
+    }
+    m_next_timestamp += header.samples;
+    m_stats.frames++;
+    m_stats.samples += header.samples;
+    return true;
+}
+
+static bool receive_all(int sock, uint8_t *bytes, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t received = recv(sock, bytes, size, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+bool NetworkSampleSource::receive(int sock)
+{
+    struct timeval timeout = {RECEIVE_TIMEOUT_MS / 1000, (RECEIVE_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t header_bytes[STREAM_FRAME_HEADER_BYTES];
+    uint8_t payload[STREAM_FRAME_MAX_PAYLOAD_BYTES];
+    bool ended = false;
+    while (!ended)
+    {
+        StreamFrameHeader_t header;
+        if (!receive_all(sock, header_bytes, STREAM_FRAME_HEADER_BYTES) ||
+            !stream_frame_read_header(header_bytes, &header) || !receive_all(sock, payload, header.payload_bytes))
+        {
+            Serial.printf("Lost the response after %lu samples\n", (unsigned long)m_next_timestamp);
+            break;
+        }
+        if (header.type == STREAM_FRAME_END)
+        {
+            ended = true;
+        }
+        else if (header.type == STREAM_FRAME_AUDIO)
+        {
+            uint32_t bad_frames = m_stats.bad_frames;
+            if (!pushFrame(header, payload) && m_stats.bad_frames == bad_frames)
+            {
+                // the player isn't taking any more
+                break;
+            }
+        }
+    }
+    // play out whatever we've got
+    m_ended.store(true);
+    return ended;
+}
+
+bool NetworkSampleSource::isFinished()
+{
+    return m_ended.load() && m_read.load(std::memory_order_acquire) == m_written.load(std::memory_order_acquire);
+}
+
+bool NetworkSampleSource::available()
+{
+    if (m_playing || m_rebuffering)
+    {
+        return true;
+    }
+    uint32_t buffered = m_written.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed);
+    return buffered > 0 && (buffered >= m_start_threshold || m_ended.load());
+}
+
+int NetworkSampleSource::getFrames(Frame_t *frames, int number_frames)
+{
+    uint32_t read = m_read.load(std::memory_order_relaxed);
+    bool ended = m_ended.load();
+    uint32_t buffered = m_written.load(std::memory_order_acquire) - read;
+    if (!m_playing && buffered > 0 && (buffered >= m_start_threshold || ended))
+    {
+        m_playing = true;
+        m_rebuffering = false;
+        if (m_awaiting_audio.exchange(false))
+        {
+            m_stats.first_audio_us = esp_timer_get_time() - m_request_time;
+        }
+    }
+    int count = m_playing ? std::min((uint32_t)number_frames, buffered) : 0;
+    for (int i = 0; i < count; i++)
+    {
+        int16_t sample = m_buffer[(read + i) % m_capacity];
+        frames[i].left = sample;
+        frames[i].right = sample;
+    }
+    m_read.store(read + count, std::memory_order_release);
+    if (count < number_frames)
+    {
+        if (m_playing && !ended)
+        {
+            // the network has fallen behind - play silence until the buffer has filled back up
+            m_stats.underruns++;
+            m_rebuffering = true;
+        }
+        if (m_rebuffering && ended)
+        {
+            // the rest of the response isn't coming
+            m_rebuffering = false;
+        }
+        if (m_rebuffering)
+        {
+            m_stats.underrun_samples += number_frames - count;
+        }
+        m_playing = false;
+        memset(frames + count, 0, (number_frames - count) * sizeof(Frame_t));
+    }
+    return number_frames;
+}
@@ -0,0 +1,90 @@
+#ifndef __network_sample_source_h__
+#define __network_sample_source_h__
+
+#include <stdint.h>
+#include <atomic>
+#include "SampleSource.h"
+#include "StreamFrame.h"
+
+/**
+ * How playback of the server's responses is going - read without a lock, the
+ * receiving task and the i2s writer task each update their own counts
+ **/
+typedef struct
+{
+    // audio frames and the samples they decoded to
+    uint32_t frames;
+    uint32_t samples;
+    // silence put in for samples the server skipped
+    uint32_t gap_samples;
+    // frames that couldn't be decoded or came out of order
+    uint32_t bad_frames;
+    // times the jitter buffer ran dry part way through a response, and the silence played while it refilled
+    uint32_t underruns;
+    uint32_t underrun_samples;
+    // most samples there have been waiting in the jitter buffer
+    uint32_t max_buffered;
+    // for the last response - from expectResponse to its first frame arriving and to its first sample being played
+    uint32_t first_frame_us;
+    uint32_t first_audio_us;
+} NetworkSourceStats_t;
+
+/**
+ * Plays responses streamed by the server (StreamFrame.h framing, any of the
+ * AudioCodec_t codecs) through a jitter buffer.
+ *
+ * The receiving task decodes each frame as it arrives into a lock-free single
+ * producer / single consumer ring of 16KHz mono samples, waiting for room if
+ * the server sends faster than we play. Playback doesn't start until there's
+ * start_threshold_ms buffered (or the whole response, if it's shorter), which
+ * rides out that much jitter in the network. If the buffer runs dry part way
+ * through, silence is played and counted as an underrun until it has filled
+ * back up to the threshold.
+ *
+ * expectResponse, pushFrame and receive are for the receiving task,
+ * getFrames and available for the i2s writer task.
+ **/
+class NetworkSampleSource : public SampleSource
+{
+private:
+    int16_t *m_buffer;
+    uint32_t m_capacity;
+    uint32_t m_start_threshold;
+    // samples written by the receiving task and read by the writer task since we started
+    std::atomic<uint32_t> m_written;
+    std::atomic<uint32_t> m_read;
+    // the end of the response has been received - play out what's left without waiting for the threshold
+    std::atomic<bool> m_ended;
+    std::atomic<bool> m_awaiting_audio;
+    // writer task - playing, or playing silence part way through a response while the buffer fills back up
+    bool m_playing;
+    bool m_rebuffering;
+    // receiving task - where the next frame should start in the response
+    uint32_t m_next_timestamp;
+    bool m_awaiting_frame;
+    int64_t m_request_time;
+    int16_t m_decoded[STREAM_FRAME_SAMPLES];
+    NetworkSourceStats_t m_stats;
+
+    bool write(const int16_t *samples, int count);
+
+public:
+    NetworkSampleSource(int start_threshold_ms, int capacity_ms);
+    ~NetworkSampleSource();
+    // a new response is on its way - starts the clock for the time to first audio
+    void expectResponse();
+    // one frame from the server - false if it couldn't be decoded or the player has stopped taking samples
+    bool pushFrame(const StreamFrameHeader_t &header, const uint8_t *payload);
+    // reads frames from a connected socket until the end of the response - false if it didn't arrive
+    bool receive(int sock);
+    // the whole of the last response has been received and played - safe from any task
+    bool isFinished();
+    int getFrames(Frame_t *frames, int number_frames);
+    bool available();
+    NetworkSourceStats_t getStats()
+    {
+        return m_stats;
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include <string.h>
+#include "PCMConverter.h"
+
+// the samples are little endian - the top 16 bits are kept and the rest dropped
+static inline int16_t decode_pcm8(const uint8_t *sample)
+{
+    return (int16_t)((sample[0] - 128) * 256);
+}
+
+static inline int16_t decode_pcm16(const uint8_t *sample)
+{
+    return (int16_t)(sample[0] | (sample[1] << 8));
+}
+
+static inline int16_t decode_pcm24(const uint8_t *sample)
+{
+    return (int16_t)(sample[1] | (sample[2] << 8));
+}
+
+static inline int16_t decode_pcm32(const uint8_t *sample)
+{
+    return (int16_t)(sample[2] | (sample[3] << 8));
+}
+
+// full scale is -1 to 1, anything outside that is clipped
+static inline int16_t decode_float32(const uint8_t *sample)
+{
+    float value;
+    memcpy(&value, sample, sizeof(value));
+    value *= 32768.0f;
+    if (value >= 32767.0f)
+    {
+        return 32767;
+    }
+    if (value <= -32768.0f)
+    {
+        return -32768;
+    }
+    return (int16_t)(value < 0 ? value - 0.5f : value + 0.5f);
+}
+
+template <int16_t (*Decode)(const uint8_t *), int SampleBytes>
+static void convert_frames(const uint8_t *input, int number_frames, int num_channels, Frame_t *output)
+{
+    int frame_bytes = num_channels * SampleBytes;
+    if (num_channels == 1)
+    {
+        for (int i = 0; i < number_frames; i++)
+        {
+            int16_t sample = Decode(input + i * SampleBytes);
+            output[i].left = sample;
+            output[i].right = sample;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < number_frames; i++)
+        {
+            output[i].left = Decode(input + i * frame_bytes);
+            output[i].right = Decode(input + i * frame_bytes + SampleBytes);
+        }
+    }
+}
+
+PCMConverter::PCMConverter(int format, int bits_per_sample, int num_channels)
+{
+    m_format = format;
+    m_bits_per_sample = bits_per_sample;
+    m_num_channels = num_channels;
+}
+
+bool PCMConverter::supported() const
+{
+    if (m_num_channels < 1)
+    {
+        return false;
+    }
+    if (m_format == WAVE_FORMAT_IEEE_FLOAT)
+    {
+        return m_bits_per_sample == 32;
+    }
+    return m_format == WAVE_FORMAT_PCM && (m_bits_per_sample == 8 || m_bits_per_sample == 16 ||
+                                           m_bits_per_sample == 24 || m_bits_per_sample == 32);
+}
+
+void PCMConverter::convert(const uint8_t *input, int number_frames, Frame_t *output) const
+{
+    if (m_format == WAVE_FORMAT_IEEE_FLOAT)
+    {
+        convert_frames<decode_float32, 4>(input, number_frames, m_num_channels, output);
+        return;
+    }
+    switch (m_bits_per_sample)
+    {
+    case 8:
+        convert_frames<decode_pcm8, 1>(input, number_frames, m_num_channels, output);
+        break;
+    case 16:
+        if (m_num_channels == 2)
+        {
+            // already interleaved left, right - the same as Frame_t
+            memcpy(output, input, number_frames * sizeof(Frame_t));
+        }
+        else
+        {
+            convert_frames<decode_pcm16, 2>(input, number_frames, m_num_channels, output);
+        }
+        break;
+    case 24:
+        convert_frames<decode_pcm24, 3>(input, number_frames, m_num_channels, output);
+        break;
+    case 32:
+        convert_frames<decode_pcm32, 4>(input, number_frames, m_num_channels, output);
+        break;
+    }
+}
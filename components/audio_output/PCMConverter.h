@@ -0,0 +1,39 @@
+#ifndef __pcm_converter_h__
+#define __pcm_converter_h__
+
+#include <stdint.h>
+#include "SampleSource.h"
+
+// WAVE format tags from the fmt chunk
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+/**
+ * Converts blocks of interleaved samples as they are stored in a WAV file -
+ * 8 bit unsigned, 16, 24 or 32 bit signed or 32 bit float - to 16 bit frames.
+ * The first channel goes to the left and the second to the right, a single
+ * channel is played on both and any others are dropped.
+ *
+ * The format is picked once per block, so the per sample loops are plain
+ * inline code with no calls through function pointers or virtuals.
+ **/
+class PCMConverter
+{
+private:
+    int m_format;
+    int m_bits_per_sample;
+    int m_num_channels;
+
+public:
+    // format is WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT
+    PCMConverter(int format = WAVE_FORMAT_PCM, int bits_per_sample = 16, int num_channels = 1);
+    // true if the format can be converted
+    bool supported() const;
+    // bytes of one frame of the input - all its channels
+    int frameBytes() const { return m_num_channels * m_bits_per_sample / 8; }
+    // converts number_frames frames from input to 16 bit frames in output
+    void convert(const uint8_t *input, int number_frames, Frame_t *output) const;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Resampler.h"
+
+// phases of the filter table - a power of 2 so the phase is the top bits of the fraction
+#define RESAMPLER_PHASE_BITS 6
+#define RESAMPLER_PHASES (1 << RESAMPLER_PHASE_BITS)
+// filter length when upsampling - it grows with the ratio when downsampling to keep the same transition band
+#define RESAMPLER_TAPS 24
+// about 60dB of stop band attenuation
+#define RESAMPLER_KAISER_BETA 6.0
+// pass band edge as a fraction of the lower Nyquist frequency
+#define RESAMPLER_CUTOFF 0.9
+// the coefficients are Q14 so a full scale sample times the sum of the coefficients fits in 32 bits
+#define COEFFICIENT_BITS 14
+
+// zeroth order modified Bessel function of the first kind for the Kaiser window
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; term > 1e-12 * sum; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static inline int16_t saturate(int32_t value)
+{
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+Resampler::Resampler(int input_rate, int output_rate, int block_frames)
+{
+    // cut off in cycles per input frame
+    double scale = output_rate < input_rate ? (double)output_rate / input_rate : 1.0;
+    double cutoff = 0.5 * RESAMPLER_CUTOFF * scale;
+    m_taps = 2 * (int)ceil(RESAMPLER_TAPS / (2 * scale));
+    m_coefficients = static_cast<int16_t *>(malloc(sizeof(int16_t) * (RESAMPLER_PHASES + 1) * m_taps));
+    m_blend = static_cast<int16_t *>(malloc(sizeof(int16_t) * m_taps));
+    // phase p holds the filter for an output frame p / RESAMPLER_PHASES of a frame after input frame
+    // m_taps / 2 - 1 of the ones it covers
+    double half = m_taps / 2.0;
+    double i0_beta = bessel_i0(RESAMPLER_KAISER_BETA);
+    double *phase = static_cast<double *>(malloc(sizeof(double) * m_taps));
+    for (int p = 0; p <= RESAMPLER_PHASES; p++)
+    {
+        double sum = 0;
+        for (int k = 0; k < m_taps; k++)
+        {
+            double t = (double)p / RESAMPLER_PHASES + half - 1 - k;
+            double x = t / half;
+            double window = fabs(x) < 1 ? bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1 - x * x)) / i0_beta : 0;
+            double sinc = t == 0 ? 1.0 : sin(2 * M_PI * cutoff * t) / (2 * M_PI * cutoff * t);
+            phase[k] = 2 * cutoff * sinc * window;
+            sum += phase[k];
+        }
+        // every phase passes DC at unity gain
+        for (int k = 0; k < m_taps; k++)
+        {
+            m_coefficients[p * m_taps + k] = (int16_t)lround(phase[k] / sum * (1 << COEFFICIENT_BITS));
+        }
+    }
+    free(phase);
+
+    m_input_capacity = block_frames + m_taps;
+    m_input = static_cast<Frame_t *>(malloc(sizeof(Frame_t) * m_input_capacity));
+    m_step = input_rate / output_rate;
+    m_step_fraction = (uint32_t)(((uint64_t)(input_rate % output_rate) << 32) / output_rate);
+    reset();
+}
+
+Resampler::~Resampler()
+{
+    free(m_coefficients);
+    free(m_blend);
+    free(m_input);
+}
+
+void Resampler::reset()
+{
+    // start with silence before the first frame so the first output frame lines up with it
+    m_input_frames = m_taps / 2 - 1;
+    memset(m_input, 0, sizeof(Frame_t) * m_input_frames);
+    m_position = m_input_frames;
+    m_fraction = 0;
+}
+
+void Resampler::flush()
+{
+    int frames = m_taps / 2 < inputSpace() ? m_taps / 2 : inputSpace();
+    memset(inputBuffer(), 0, sizeof(Frame_t) * frames);
+    inputAdded(frames);
+}
+
+bool Resampler::available() const
+{
+    return m_position + m_taps / 2 < m_input_frames;
+}
+
+int Resampler::getFrames(Frame_t *frames, int number_frames)
+{
+    int count = 0;
+    while (count < number_frames && available())
+    {
+        const Frame_t *input = m_input + m_position - m_taps / 2 + 1;
+        int phase = m_fraction >> (32 - RESAMPLER_PHASE_BITS);
+        int32_t weight = (m_fraction >> (32 - RESAMPLER_PHASE_BITS - COEFFICIENT_BITS)) & ((1 << COEFFICIENT_BITS) - 1);
+        const int16_t *coefficients = m_coefficients + phase * m_taps;
+        const int16_t *next_coefficients = coefficients + m_taps;
+        for (int k = 0; k < m_taps; k++)
+        {
+            m_blend[k] = coefficients[k] +
+                         (((next_coefficients[k] - coefficients[k]) * weight + (1 << (COEFFICIENT_BITS - 1))) >>
+                          COEFFICIENT_BITS);
+        }
+        int32_t left = 1 << (COEFFICIENT_BITS - 1);
+        int32_t right = 1 << (COEFFICIENT_BITS - 1);
+        for (int k = 0; k < m_taps; k++)
+        {
+            left += input[k].left * m_blend[k];
+            right += input[k].right * m_blend[k];
+        }
+        frames[count].left = saturate(left >> COEFFICIENT_BITS);
+        frames[count].right = saturate(right >> COEFFICIENT_BITS);
+        count++;
+
+        uint32_t fraction = m_fraction + m_step_fraction;
+        m_position += m_step + (fraction < m_fraction ? 1 : 0);
+        m_fraction = fraction;
+    }
+    // drop the input that no output frame needs any more to make room for more
+    int drop = m_position - m_taps / 2 + 1;
+    if (drop > m_input_frames)
+    {
+        drop = m_input_frames;
+    }
+    if (drop > 0)
+    {
+        memmove(m_input, m_input + drop, sizeof(Frame_t) * (m_input_frames - drop));
+        m_input_frames -= drop;
+        m_position -= drop;
+    }
+    return count;
+}
@@ -0,0 +1,60 @@
+#ifndef __resampler_h__
+#define __resampler_h__
+
+#include <stdint.h>
+#include "SampleSource.h"
+
+/**
+ * Polyphase resampler for 16 bit stereo frames, from any input rate to the
+ * output rate (16KHz for I2SOutput).
+ *
+ * The prototype low pass filter is a Kaiser windowed sinc with its cut off at
+ * the lower of the two Nyquist frequencies. It is stored as RESAMPLER_PHASES
+ * phases of Q14 coefficients - an output frame between two phases uses a blend
+ * of their coefficients - so any pair of rates works with the same table size
+ * and there is no need for the rates to have a small common factor.
+ *
+ * The caller writes input frames into inputBuffer() and then pulls resampled
+ * frames with getFrames(). The filter looks ahead by half its length, so the
+ * last few frames only come out once more input arrives - or flush() is called
+ * at the end of the stream.
+ **/
+class Resampler
+{
+private:
+    int m_taps;
+    // (RESAMPLER_PHASES + 1) x m_taps coefficients, the last phase is a copy of the first shifted by one frame
+    int16_t *m_coefficients;
+    // blended coefficients for the current output frame
+    int16_t *m_blend;
+    // input frames, m_input_frames of m_input_capacity are filled
+    Frame_t *m_input;
+    int m_input_capacity;
+    int m_input_frames;
+    // time of the next output frame in input frames - m_position and a 32 bit fraction
+    int m_position;
+    uint32_t m_fraction;
+    // input frames per output frame in the same fixed point
+    int m_step;
+    uint32_t m_step_fraction;
+
+public:
+    // block_frames is how many input frames the caller writes at a time at most
+    Resampler(int input_rate, int output_rate, int block_frames);
+    ~Resampler();
+    // space at the end of the input for more frames
+    Frame_t *inputBuffer() { return m_input + m_input_frames; }
+    int inputSpace() const { return m_input_capacity - m_input_frames; }
+    // call after writing frames to inputBuffer()
+    void inputAdded(int number_frames) { m_input_frames += number_frames; }
+    // adds silence so the frames held back for the look ahead come out
+    void flush();
+    // fills frames with up to number_frames resampled frames, returns how many there were
+    int getFrames(Frame_t *frames, int number_frames);
+    // true if getFrames would return at least one frame
+    bool available() const;
+    // forget all the input
+    void reset();
+};
+
+#endif
@@ -1,99 +1,278 @@
 #include <SPIFFS.h>
 #include <FS.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include "WAVFileReader.h"
 
-typedef struct
-{
-    // RIFF Header
-    char riff_header[4]; // Contains "RIFF"
-    int wav_size;        // Size of the wav portion of the file, which follows the first 8 bytes. File size - 8
-    char wave_header[4]; // Contains "WAVE"
+// the file is read in blocks of up to this many bytes - one filesystem call per block
+// instead of one or two per frame. Large enough for a few i2s writes of mono or stereo.
+#define READ_BUFFER_BYTES 2048
+// and converted into at most this many frames at a time
+#define READ_BUFFER_FRAMES 512
+// the rate I2SOutput plays at
+#define OUTPUT_SAMPLE_RATE 16000
+// the fmt chunk of a WAVE_FORMAT_EXTENSIBLE file, the format tag is the start of the sub format GUID
+#define FMT_CHUNK_BYTES 16
+#define FMT_EXTENSIBLE_CHUNK_BYTES 40
+#define FMT_SUB_FORMAT_OFFSET 24
 
-    // Format Header
-    char fmt_header[4]; // Contains "fmt " (includes trailing space)
-    int fmt_chunk_size; // Should be 16 for PCM
-    short audio_format; // Should be 1 for PCM. 3 for IEEE Float
-    short num_channels;
-    int sample_rate;
-    int byte_rate;          // Number of bytes per second. sample_rate * num_channels * Bytes Per Sample
-    short sample_alignment; // num_channels * Bytes Per Sample
-    short bit_depth;        // Number of bits per sample
+// everything in a RIFF file is little endian
+static inline uint16_t read16(const uint8_t *bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
 
-    // Data
-    char data_header[4]; // Contains "data"
-    int data_bytes;      // Number of bytes in data. Number of samples * num_channels * sample byte size
-    // uint8_t bytes[]; // Remainder of wave file is bytes
-} wav_header_t;
+static inline uint32_t read32(const uint8_t *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
 
 WAVFileReader::WAVFileReader(const char *file_name, bool repeat)
 {
+    m_repeat = repeat;
+    m_frame_bytes = 0;
+    m_sample_rate = 0;
+    m_data_start = 0;
+    m_data_bytes = 0;
+    m_data_position = 0;
+    m_read_buffer = NULL;
+    m_buffer = NULL;
+    m_buffer_capacity = 0;
+    m_buffer_frames = 0;
+    m_buffer_position = 0;
+    m_resampler = NULL;
+    m_flushed = false;
     m_file = SPIFFS.open(file_name, "r");
-    // read the WAV header
-    wav_header_t wav_header;
-    m_file.read((uint8_t *)&wav_header, sizeof(wav_header_t));
-    // sanity check the bit depth
-    if (wav_header.bit_depth != 16)
+    m_valid = readHeader(file_name);
+    if (!m_valid)
     {
-        Serial.printf("ERROR: bit depth %d is not supported please use 16 bit signed integer\n", wav_header.bit_depth);
+        return;
     }
-    if (wav_header.sample_rate != 16000)
+    m_buffer_capacity = std::min(READ_BUFFER_FRAMES, READ_BUFFER_BYTES / m_frame_bytes);
+    m_read_buffer = static_cast<uint8_t *>(malloc(m_buffer_capacity * m_frame_bytes));
+    m_buffer = static_cast<Frame_t *>(malloc(m_buffer_capacity * sizeof(Frame_t)));
+    if (m_sample_rate != OUTPUT_SAMPLE_RATE)
     {
-        Serial.printf("ERROR: bit depth %d is not supported please us 16KHz\n", wav_header.sample_rate);
+        m_resampler = new Resampler(m_sample_rate, OUTPUT_SAMPLE_RATE, m_buffer_capacity);
     }
-
-    Serial.printf("fmt_chunk_size=%d, audio_format=%d, num_channels=%d, sample_rate=%d, sample_alignment=%d, bit_depth=%d, data_bytes=%d\n",
-                  wav_header.fmt_chunk_size, wav_header.audio_format, wav_header.num_channels, wav_header.sample_rate, wav_header.sample_alignment, wav_header.bit_depth, wav_header.data_bytes);
-
-    m_num_channels = wav_header.num_channels;
-    m_repeat = repeat;
+    reset();
 }
 
 WAVFileReader::~WAVFileReader()
 {
     m_file.close();
+    free(m_read_buffer);
+    free(m_buffer);
+    delete m_resampler;
 }
 
-void WAVFileReader::reset()
+bool WAVFileReader::readHeader(const char *file_name)
+{
+    if (!m_file)
+    {
+        Serial.printf("ERROR: could not open %s\n", file_name);
+        return false;
+    }
+    uint32_t file_size = m_file.size();
+    uint8_t header[FMT_EXTENSIBLE_CHUNK_BYTES];
+    if (m_file.read(header, 12) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        Serial.printf("ERROR: %s is not a RIFF WAVE file\n", file_name);
+        return false;
+    }
+    // walk the chunks until we find the data, picking up the format on the way and skipping anything else
+    uint32_t position = 12;
+    bool have_format = false;
+    int format = 0;
+    int num_channels = 0;
+    int block_align = 0;
+    int bits_per_sample = 0;
+    while (true)
+    {
+        if (m_file.read(header, 8) != 8)
+        {
+            Serial.printf("ERROR: %s has no data chunk\n", file_name);
+            return false;
+        }
+        uint32_t chunk_size = read32(header + 4);
+        position += 8;
+        // chunks are padded to an even number of bytes
+        uint32_t next_chunk = position + chunk_size + (chunk_size & 1);
+        if (memcmp(header, "data", 4) == 0)
+        {
+            m_data_start = position;
+            // streaming writers leave the size as 0 or 0xFFFFFFFF - play whatever is there
+            m_data_bytes = position < file_size ? file_size - position : 0;
+            if (chunk_size != 0 && chunk_size < m_data_bytes)
+            {
+                m_data_bytes = chunk_size;
+            }
+            break;
+        }
+        if (memcmp(header, "fmt ", 4) == 0 && chunk_size >= FMT_CHUNK_BYTES)
+        {
+            uint32_t fmt_bytes = std::min(chunk_size, (uint32_t)FMT_EXTENSIBLE_CHUNK_BYTES);
+            if (m_file.read(header, fmt_bytes) != fmt_bytes)
+            {
+                Serial.printf("ERROR: %s has a truncated fmt chunk\n", file_name);
+                return false;
+            }
+            format = read16(header);
+            num_channels = read16(header + 2);
+            m_sample_rate = read32(header + 4);
+            block_align = read16(header + 12);
+            bits_per_sample = read16(header + 14);
+            if (format == WAVE_FORMAT_EXTENSIBLE && fmt_bytes == FMT_EXTENSIBLE_CHUNK_BYTES)
+            {
+                format = read16(header + FMT_SUB_FORMAT_OFFSET);
+            }
+            have_format = true;
+        }
+        position = next_chunk;
+        if (position >= file_size || !m_file.seek(position))
+        {
+            Serial.printf("ERROR: %s has no data chunk\n", file_name);
+            return false;
+        }
+    }
+    if (!have_format)
+    {
+        Serial.printf("ERROR: %s has no fmt chunk before its data\n", file_name);
+        return false;
+    }
+    Serial.printf("audio_format=%d, num_channels=%d, sample_rate=%d, block_align=%d, bits_per_sample=%d, data_bytes=%u\n",
+                  format, num_channels, m_sample_rate, block_align, bits_per_sample, (unsigned)m_data_bytes);
+    m_converter = PCMConverter(format, bits_per_sample, num_channels);
+    m_frame_bytes = m_converter.frameBytes();
+    if (!m_converter.supported() || block_align != m_frame_bytes || m_frame_bytes > READ_BUFFER_BYTES)
+    {
+        Serial.printf("ERROR: format %d with %d bits per sample is not supported please use 8, 16, 24 or 32 bit PCM or 32 bit float\n",
+                      format, bits_per_sample);
+        return false;
+    }
+    if (m_sample_rate <= 0)
+    {
+        Serial.printf("ERROR: sample rate %d is not valid\n", m_sample_rate);
+        return false;
+    }
+    // a partial frame at the end of the data is dropped
+    m_data_bytes -= m_data_bytes % m_frame_bytes;
+    if (m_data_bytes == 0)
+    {
+        Serial.printf("ERROR: %s has no samples\n", file_name);
+        return false;
+    }
+    return true;
+}
+
+void WAVFileReader::rewind()
 {
     // seek to the start of the wav data
-    m_file.seek(44);
+    m_file.seek(m_data_start);
+    m_data_position = 0;
+    // and throw away anything we'd already read
+    m_buffer_frames = 0;
+    m_buffer_position = 0;
+}
+
+void WAVFileReader::reset()
+{
+    if (!m_valid)
+    {
+        return;
+    }
+    rewind();
+    if (m_resampler)
+    {
+        m_resampler->reset();
+    }
+    m_flushed = false;
+}
+
+bool WAVFileReader::fillBuffer()
+{
+    if (m_data_position == m_data_bytes && m_repeat)
+    {
+        // we've reached the end of the data, move back to the start and carry on
+        rewind();
+    }
+    int frames = std::min((uint32_t)m_buffer_capacity, (m_data_bytes - m_data_position) / m_frame_bytes);
+    size_t bytes_read = frames > 0 ? m_file.read(m_read_buffer, frames * m_frame_bytes) : 0;
+    m_buffer_frames = bytes_read / m_frame_bytes;
+    m_buffer_position = 0;
+    m_data_position += m_buffer_frames * m_frame_bytes;
+    if (bytes_read < (size_t)(frames * m_frame_bytes))
+    {
+        // the file is shorter than its header says, stop at what we've got
+        m_data_bytes = m_data_position;
+    }
+    m_converter.convert(m_read_buffer, m_buffer_frames, m_buffer);
+    return m_buffer_frames > 0;
+}
+
+int WAVFileReader::readFrames(Frame_t *frames, int number_frames)
+{
+    // fill the frames from the read buffer, refilling it from the file (and wrapping around if necessary) as it runs out
+    int frames_filled = 0;
+    while (frames_filled < number_frames)
+    {
+        if (m_buffer_position == m_buffer_frames && !fillBuffer())
+        {
+            // we've reached the end of the file, return the number of frames we were able to fill
+            break;
+        }
+        int count = std::min(number_frames - frames_filled, m_buffer_frames - m_buffer_position);
+        memcpy(frames + frames_filled, m_buffer + m_buffer_position, count * sizeof(Frame_t));
+        m_buffer_position += count;
+        frames_filled += count;
+    }
+    return frames_filled;
 }
 
 int WAVFileReader::getFrames(Frame_t *frames, int number_frames)
 {
-    // fill the buffer with data from the file wrapping around if necessary
-    for (int i = 0; i < number_frames; i++)
+    if (!m_valid)
+    {
+        return 0;
+    }
+    if (!m_resampler)
+    {
+        return readFrames(frames, number_frames);
+    }
+    // pull resampled frames, feeding the resampler from the file whenever it runs dry
+    int frames_filled = m_resampler->getFrames(frames, number_frames);
+    while (frames_filled < number_frames)
     {
-        if (m_file.available() == 0)
+        int frames_read = readFrames(m_resampler->inputBuffer(), std::min(m_resampler->inputSpace(), m_buffer_capacity));
+        if (frames_read > 0)
         {
-            if (m_repeat)
-            {
-                // move back to the start of the file and carry on
-                reset();
-            }
-            else
-            {
-                // we've reached the end of the file, return the number of frames we were able to fill
-                return i;
-            }
+            m_resampler->inputAdded(frames_read);
         }
-        // read in the next sample to the left channel
-        m_file.read((uint8_t *)(&frames[i].left), sizeof(int16_t));
-        // if we only have one channel duplicate the sample for the right channel
-        if (m_num_channels == 1)
+        else if (!m_flushed)
         {
-            frames[i].right = frames[i].left;
+            // end of the file, push out the frames the resampler is holding back for its look ahead
+            m_resampler->flush();
+            m_flushed = true;
         }
         else
         {
-            // otherwise read in the right channel sample
-            m_file.read((uint8_t *)(&frames[i].right), sizeof(int16_t));
+            break;
         }
+        frames_filled += m_resampler->getFrames(frames + frames_filled, number_frames - frames_filled);
     }
-    return number_frames;
+    return frames_filled;
 }
 
 bool WAVFileReader::available()
 {
-    return m_file.available() || m_repeat;
+    if (!m_valid)
+    {
+        return false;
+    }
+    if (m_buffer_position < m_buffer_frames || m_data_position < m_data_bytes || m_repeat)
+    {
+        return true;
+    }
+    return m_resampler && (m_resampler->available() || !m_flushed);
 }
\ No newline at end of file
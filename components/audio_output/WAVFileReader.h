@@ -4,13 +4,49 @@
 #include <SPIFFS.h>
 #include <FS.h>
 #include "SampleSource.h"
+#include "PCMConverter.h"
+#include "Resampler.h"
 
+/**
+ * Plays a WAV file from SPIFFS, optionally on repeat.
+ *
+ * The header is read chunk by chunk so files with LIST or fact chunks, or
+ * WAVE_FORMAT_EXTENSIBLE formats, play as well as the canonical 44 byte
+ * header. 8, 16, 24 and 32 bit PCM and 32 bit float, mono or stereo, are
+ * converted to 16 bit frames and anything not at 16KHz is resampled to it.
+ *
+ * The file is read in large blocks, converted a block at a time into m_buffer
+ * and the frames are filled from that
+ **/
 class WAVFileReader : public SampleSource
 {
 private:
-    int m_num_channels;
     bool m_repeat;
+    // false if the file couldn't be opened or its format can't be played - nothing is played
+    bool m_valid;
     File m_file;
+    PCMConverter m_converter;
+    int m_frame_bytes;
+    int m_sample_rate;
+    // where the samples are in the file and how far through them the reads have got
+    uint32_t m_data_start;
+    uint32_t m_data_bytes;
+    uint32_t m_data_position;
+    // samples as they are in the file
+    uint8_t *m_read_buffer;
+    // converted frames that haven't been played yet
+    Frame_t *m_buffer;
+    int m_buffer_capacity;
+    int m_buffer_frames;
+    int m_buffer_position;
+    // NULL if the file is already at the output sample rate
+    Resampler *m_resampler;
+    bool m_flushed;
+
+    bool readHeader(const char *file_name);
+    bool fillBuffer();
+    void rewind();
+    int readFrames(Frame_t *frames, int number_frames);
 
 public:
     WAVFileReader(const char *file_name, bool repeat = false);
@@ -5,6 +5,8 @@
 #include "RingBuffer.h"
 
 #define EPSILON 1e-6
+// the frame energies leave out everything below this - mains hum and rumble, not speech
+#define SPEECH_BAND_START_HZ 250
 
 AudioProcessor::AudioProcessor(int audio_length, int window_size, int step_size, int pooling_size)
 {
@@ -21,6 +23,9 @@ AudioProcessor::AudioProcessor(int audio_length, int window_size, int step_size,
     m_energy_size = m_fft_size / 2 + 1;
     m_fft_output = static_cast<kiss_fft_cpx *>(malloc(sizeof(kiss_fft_cpx) * m_energy_size));
     m_energy = static_cast<float *>(malloc(sizeof(float) * m_energy_size));
+    m_frame_count = (audio_length - window_size + step_size - 1) / step_size;
+    m_frame_energies = static_cast<float *>(calloc(m_frame_count, sizeof(float)));
+    m_speech_band_start = ceilf((float)SPEECH_BAND_START_HZ * m_fft_size / 16000);
     // work out the pooled energy size
     m_pooled_energy_size = ceilf((float)m_energy_size / (float)pooling_size);
     printf("m_pooled_energy_size=%d\n", m_pooled_energy_size);
@@ -36,11 +41,12 @@ AudioProcessor::~AudioProcessor()
     free(m_fft_input);
     free(m_fft_output);
     free(m_energy);
+    free(m_frame_energies);
     delete m_hamming_window;
 }
 
-// takes a normalised array of input samples of window_size length
-void AudioProcessor::get_spectrogram_segment(float *output)
+// takes a normalised array of input samples of window_size length - returns the total energy of the speech band
+float AudioProcessor::get_spectrogram_segment(float *output)
 {
     // apply the hamming window to the samples
     m_hamming_window->applyWindow(m_fft_input);
@@ -50,12 +56,17 @@ void AudioProcessor::get_spectrogram_segment(float *output)
         m_fft_input,
         reinterpret_cast<kiss_fft_cpx *>(m_fft_output));
     // pull out the magnitude squared values
+    float total_energy = 0;
     for (int i = 0; i < m_energy_size; i++)
     {
         const float real = m_fft_output[i].r;
         const float imag = m_fft_output[i].i;
         const float mag_squared = (real * real) + (imag * imag);
         m_energy[i] = mag_squared;
+        if (i >= m_speech_band_start)
+        {
+            total_energy += mag_squared;
+        }
     }
     // reduce the size of the output by pooling with average and same padding
     float *output_src = m_energy;
@@ -79,6 +90,7 @@ void AudioProcessor::get_spectrogram_segment(float *output)
     {
         output[i] = log10f(output[i] + EPSILON);
     }
+    return total_energy;
 }
 
 void AudioProcessor::get_spectrogram(RingBufferAccessor *reader, float *output_spectrogram)
@@ -100,7 +112,10 @@ void AudioProcessor::get_spectrogram(RingBufferAccessor *reader, float *output_s
         max = std::max(max, fabsf(((float)reader->getCurrentSample()) - mean));
         reader->moveToNextSample();
     }
+    // undoes the normalisation for the frame energies
+    float scale = max * max;
     // extract windows of samples moving forward by step size each time and compute the spectrum of the window
+    int frame = 0;
     for (int window_start = startIndex; window_start < startIndex + 16000 - m_window_size; window_start += m_step_size)
     {
         // move the reader to the start of the window
@@ -117,7 +132,12 @@ void AudioProcessor::get_spectrogram(RingBufferAccessor *reader, float *output_s
             m_fft_input[i] = 0;
         }
         // compute the spectrum for the window of samples and write it to the output
-        get_spectrogram_segment(output_spectrogram);
+        float energy = get_spectrogram_segment(output_spectrogram);
+        if (frame < m_frame_count)
+        {
+            // digital silence can't be normalised - it has no energy
+            m_frame_energies[frame++] = 10 * log10f((scale > 0 ? energy * scale : 0) + EPSILON);
+        }
         // move to the next row of the output spectrogram
         output_spectrogram += m_pooled_energy_size;
     }
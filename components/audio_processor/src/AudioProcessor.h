@@ -22,17 +22,31 @@ private:
     int m_energy_size;
     int m_pooled_energy_size;
     float *m_energy;
+    // energy of each window of the last spectrogram, from the bins in the speech band up
+    int m_frame_count;
+    int m_speech_band_start;
+    float *m_frame_energies;
     kiss_fft_cpx *m_fft_output;
     kiss_fftr_cfg m_cfg;
 
     HammingWindow *m_hamming_window;
 
-    void get_spectrogram_segment(float *output_spectrogram_row);
+    float get_spectrogram_segment(float *output_spectrogram_row);
 
 public:
     AudioProcessor(int audio_length, int window_size, int step_size, int pooling_size);
     ~AudioProcessor();
     void get_spectrogram(RingBufferAccessor *reader, float *output_spectrogram);
+    // the energy in dB of each window (row) of the last spectrogram above mains hum, oldest first - taken before the
+    // samples are normalised so they can be compared from one spectrogram to the next
+    int get_frame_count()
+    {
+        return m_frame_count;
+    }
+    const float *get_frame_energies()
+    {
+        return m_frame_energies;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include "Endpointer.h"
+
+// samples per millisecond at 16KHz
+#define SAMPLES_PER_MS 16
+// how far above the noise floor a frame has to be to be speech
+#define SPEECH_MARGIN_DB 6.0f
+// how much of the way to a frame the noise floor moves - down and up for quiet frames, and creeping up for speech
+#define NOISE_FALL_RATE 0.25f
+#define NOISE_RISE_RATE 0.05f
+#define NOISE_CREEP_RATE 0.002f
+// less speech than this doesn't count as the user having said something - it's the tail of the wake word or a knock
+#define MIN_SPEECH_MS 150
+
+Endpointer::Endpointer(int step_samples, int hangover_ms, int no_speech_ms, int max_ms)
+{
+    m_step_samples = step_samples;
+    m_hangover_frames = hangover_ms * SAMPLES_PER_MS / step_samples;
+    m_no_speech_frames = no_speech_ms * SAMPLES_PER_MS / step_samples;
+    m_max_frames = max_ms * SAMPLES_PER_MS / step_samples;
+    m_start_requested.store(false);
+    m_active = false;
+    m_primed = false;
+    m_last_written = 0;
+    m_floor_set = false;
+    m_noise_floor = 0;
+    m_frames = 0;
+    m_speech_frames = 0;
+    m_silent_frames = 0;
+    m_stats = {0, 0, 0, 0, 0, 0, 0};
+}
+
+void Endpointer::start()
+{
+    m_start_requested.store(true);
+}
+
+void Endpointer::end(uint32_t *count)
+{
+    m_active = false;
+    (*count)++;
+    m_stats.speech_ms = m_speech_frames * m_step_samples / SAMPLES_PER_MS;
+    m_stats.length_ms = m_frames * m_step_samples / SAMPLES_PER_MS;
+    m_stats.noise_floor = m_noise_floor;
+}
+
+// returns true if the frame ends the utterance
+bool Endpointer::addFrame(float energy)
+{
+    bool speech = energy > m_noise_floor + SPEECH_MARGIN_DB;
+    float rate = speech ? NOISE_CREEP_RATE : (energy < m_noise_floor ? NOISE_FALL_RATE : NOISE_RISE_RATE);
+    m_noise_floor += (energy - m_noise_floor) * rate;
+    if (!m_active)
+    {
+        return false;
+    }
+    m_frames++;
+    if (speech)
+    {
+        m_speech_frames++;
+        m_silent_frames = 0;
+    }
+    else
+    {
+        m_silent_frames++;
+    }
+    if (m_speech_frames * m_step_samples >= MIN_SPEECH_MS * SAMPLES_PER_MS)
+    {
+        if (m_silent_frames >= m_hangover_frames)
+        {
+            end(&m_stats.ended);
+            return true;
+        }
+    }
+    else if (m_frames >= m_no_speech_frames)
+    {
+        end(&m_stats.no_speech);
+        return true;
+    }
+    if (m_frames >= m_max_frames)
+    {
+        end(&m_stats.capped);
+        return true;
+    }
+    return false;
+}
+
+bool Endpointer::update(const float *energies, int count, uint32_t samples_written)
+{
+    if (count <= 0)
+    {
+        return false;
+    }
+    if (m_start_requested.exchange(false))
+    {
+        m_active = true;
+        m_frames = 0;
+        m_speech_frames = 0;
+        m_silent_frames = 0;
+        m_stats.utterances++;
+    }
+    if (!m_floor_set)
+    {
+        // until the sampler has filled a whole window some of it is the buffer's zeros
+        if (samples_written < (uint32_t)(count + 1) * m_step_samples)
+        {
+            return false;
+        }
+        // start the noise floor from the quietest frame of the first window that's all sound
+        float quietest = energies[0];
+        for (int i = 1; i < count; i++)
+        {
+            quietest = std::min(quietest, energies[i]);
+        }
+        m_noise_floor = quietest;
+        m_floor_set = true;
+    }
+    // the windows overlap - work out how many of the frames at the end of this one haven't been seen yet
+    int new_frames = count;
+    if (!m_primed)
+    {
+        m_primed = true;
+        m_last_written = samples_written;
+    }
+    else
+    {
+        uint32_t since = samples_written - m_last_written;
+        if (since / m_step_samples < (uint32_t)count)
+        {
+            new_frames = since / m_step_samples;
+            m_last_written += new_frames * m_step_samples;
+        }
+        else
+        {
+            // windows have been missed - start again from the end of this one
+            m_last_written = samples_written;
+        }
+    }
+    bool ended = false;
+    for (int i = count - new_frames; i < count; i++)
+    {
+        if (addFrame(energies[i]))
+        {
+            ended = true;
+        }
+    }
+    return ended;
+}
@@ -0,0 +1,77 @@
+#ifndef _endpointer_h_
+#define _endpointer_h_
+
+#include <stdint.h>
+#include <atomic>
+
+typedef struct
+{
+    uint32_t utterances;
+    // how each one ended - the user stopped talking, never started, or went on for too long
+    uint32_t ended;
+    uint32_t no_speech;
+    uint32_t capped;
+    // for the last utterance - how much of it was speech and how long it was, and the noise floor in dB when it ended
+    uint32_t speech_ms;
+    uint32_t length_ms;
+    float noise_floor;
+} EndpointerStats_t;
+
+/**
+ * Works out when the user has stopped talking after the wake word, from the
+ * frame energies the front end (AudioProcessor) has already worked out.
+ *
+ * A frame is speech if it's SPEECH_MARGIN_DB above the noise floor. The
+ * floor starts at the quietest frame of the first window that's all sound
+ * and then follows the frames that aren't speech - quickly down and slowly
+ * up - and creeps up through speech, so a noise that starts and doesn't stop
+ * becomes the floor. The utterance ends once the user has said something and then been
+ * quiet for the hangover, if nothing has been said by no_speech_ms, or when
+ * it reaches max_ms. Each frame is a handful of comparisons.
+ *
+ * update() must always be called from the same task - the front end's.
+ * start() can be called from any task.
+ **/
+class Endpointer
+{
+private:
+    int m_step_samples;
+    int m_hangover_frames;
+    int m_no_speech_frames;
+    int m_max_frames;
+    std::atomic<bool> m_start_requested;
+    bool m_active;
+    // the sampler's count of samples written that the frames looked at so far go up to
+    bool m_primed;
+    uint32_t m_last_written;
+    bool m_floor_set;
+    float m_noise_floor;
+    // since the utterance started
+    int m_frames;
+    int m_speech_frames;
+    int m_silent_frames;
+    EndpointerStats_t m_stats;
+
+    bool addFrame(float energy);
+    void end(uint32_t *count);
+
+public:
+    // step_samples is the front end's step between frames
+    Endpointer(int step_samples, int hangover_ms, int no_speech_ms, int max_ms);
+    // the wake word was heard - the utterance starts with the next update
+    void start();
+    bool isActive()
+    {
+        return m_active;
+    }
+    // the frame energies from the front end's latest window, oldest first, which it took when the sampler had written
+    // samples_written samples - only the frames that are new since the last update are looked at. Returns true, once,
+    // when the utterance has ended
+    bool update(const float *energies, int count, uint32_t samples_written);
+    EndpointerStats_t getStats()
+    {
+        return m_stats;
+    }
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _feature_queue_h_
+#define _feature_queue_h_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+/**
+ * Lock-free single producer / single consumer queue of feature windows
+ *
+ * The front end writes a whole window's spectrogram into the slot from
+ * beginWrite and only then publishes it with commitWrite - the release store
+ * of the head makes every value written to the slot visible to the consumer
+ * that acquires it in beginRead. The inference side reads the oldest
+ * published window in place and hands the slot back with endRead, whose
+ * release store of the tail stops the producer reusing the slot before the
+ * reads are done. The two sides only share the head and tail counters so the
+ * producer and consumer can run on different cores without a lock. Nothing
+ * blocks - callers decide whether to wait or drop when the queue is full or
+ * empty.
+ **/
+class FeatureQueue
+{
+private:
+    float *m_windows;
+    int m_window_size;
+    uint32_t m_slot_count;
+    // number of windows published by the producer
+    std::atomic<uint32_t> m_head;
+    // number of windows released by the consumer
+    std::atomic<uint32_t> m_tail;
+
+public:
+    FeatureQueue(int slot_count, int window_size)
+    {
+        m_window_size = window_size;
+        m_slot_count = slot_count;
+        m_windows = static_cast<float *>(calloc(window_size * slot_count, sizeof(float)));
+        m_head.store(0);
+        m_tail.store(0);
+    }
+    ~FeatureQueue()
+    {
+        free(m_windows);
+    }
+    int getWindowSize()
+    {
+        return m_window_size;
+    }
+    // producer - the slot to fill next or nullptr if every slot is still in use
+    float *beginWrite()
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == m_slot_count)
+        {
+            return nullptr;
+        }
+        return m_windows + (head % m_slot_count) * m_window_size;
+    }
+    // producer - publish the slot returned by beginWrite
+    void commitWrite()
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    // consumer - the oldest published window or nullptr if there isn't one
+    const float *beginRead()
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (m_head.load(std::memory_order_acquire) == tail)
+        {
+            return nullptr;
+        }
+        return m_windows + (tail % m_slot_count) * m_window_size;
+    }
+    // consumer - hand the slot returned by beginRead back to the producer
+    void endRead()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "NeuralNetwork.h"
+#include "WorkerPool.h"
 #include "model.h"
 #include "tensorflow/lite/micro/micro_error_reporter.h"
 #include "tensorflow/lite/micro/micro_interpreter.h"
@@ -6,54 +7,97 @@
 #include "tensorflow/lite/version.h"
 
 uint8_t NeuralNetwork::s_tensor_arena[NeuralNetwork::kArenaSize] __attribute__((aligned(16)));
+tflite::MicroMutableOpResolver<11> NeuralNetwork::s_resolver;
+tflite::ErrorReporter *NeuralNetwork::s_error_reporter = nullptr;
+const tflite::Model *NeuralNetwork::s_model = nullptr;
+tflite::MicroInterpreter *NeuralNetwork::s_interpreter = nullptr;
+WorkerPool *NeuralNetwork::s_worker_pool = nullptr;
+int NeuralNetwork::s_worker_count = 0;
+int NeuralNetwork::s_worker_core = -1;
 
-NeuralNetwork::NeuralNetwork()
+NeuralNetwork::NeuralNetwork(int worker_count, int worker_core)
 {
-    m_error_reporter = new tflite::MicroErrorReporter();
+    input = nullptr;
+    output = nullptr;
 
-    m_tensor_arena = s_tensor_arena;
+    if (s_interpreter && s_worker_count == worker_count && s_worker_core == worker_core)
+    {
+        // the tensors, kernel data and memory plan from last time are still in the arena - only the model's own state
+        // has to start again
+        s_interpreter->ResetVariableTensors();
+    }
+    else if (!createInterpreter(worker_count, worker_core))
+    {
+        return;
+    }
 
-    TF_LITE_REPORT_ERROR(m_error_reporter, "Loading model");
+    input = s_interpreter->input(0);
+    output = s_interpreter->output(0);
+}
 
-    m_model = tflite::GetModel(converted_model_tflite);
-    if (m_model->version() != TFLITE_SCHEMA_VERSION)
+bool NeuralNetwork::createInterpreter(int worker_count, int worker_core)
+{
+    if (!s_error_reporter)
     {
-        TF_LITE_REPORT_ERROR(m_error_reporter, "Model provided is schema version %d not equal to supported version %d.",
-                             m_model->version(), TFLITE_SCHEMA_VERSION);
-        return;
+        s_error_reporter = new tflite::MicroErrorReporter();
+
+        s_resolver.AddConv2D();
+        s_resolver.AddMaxPool2D();
+        // run each Conv2D -> MaxPool2D pair as one kernel without the intermediate tensor
+        s_resolver.AddConv2DMaxPool2D();
+        // depthwise separable models - the 3x3 and 1xN / Nx1 int8 filters have their own kernels
+        s_resolver.AddDepthwiseConv2D();
+        s_resolver.AddFullyConnected();
+        s_resolver.AddMul();
+        s_resolver.AddAdd();
+        s_resolver.AddLogistic();
+        s_resolver.AddReshape();
+        s_resolver.AddQuantize();
+        s_resolver.AddDequantize();
     }
 
-    m_resolver.AddConv2D();
-    m_resolver.AddMaxPool2D();
-    m_resolver.AddFullyConnected();
-    m_resolver.AddMul();
-    m_resolver.AddAdd();
-    m_resolver.AddLogistic();
-    m_resolver.AddReshape();
-    m_resolver.AddQuantize();
-    m_resolver.AddDequantize();
+    // a different number of workers changes the scratch buffers the kernels ask for, so start from scratch
+    delete s_interpreter;
+    s_interpreter = nullptr;
+    delete s_worker_pool;
+    s_worker_pool = nullptr;
 
-    m_interpreter = new tflite::MicroInterpreter(
-        m_model, m_resolver, m_tensor_arena, kArenaSize, m_error_reporter);
+    TF_LITE_REPORT_ERROR(s_error_reporter, "Loading model");
 
-    TfLiteStatus allocate_status = m_interpreter->AllocateTensors();
-    if (allocate_status != kTfLiteOk)
+    s_model = tflite::GetModel(converted_model_tflite);
+    if (s_model->version() != TFLITE_SCHEMA_VERSION)
     {
-        TF_LITE_REPORT_ERROR(m_error_reporter, "AllocateTensors() failed");
-        return;
+        TF_LITE_REPORT_ERROR(s_error_reporter, "Model provided is schema version %d not equal to supported version %d.",
+                             s_model->version(), TFLITE_SCHEMA_VERSION);
+        return false;
     }
 
-    size_t used_bytes = m_interpreter->arena_used_bytes();
-    TF_LITE_REPORT_ERROR(m_error_reporter, "Used bytes %d\n", used_bytes);
+    s_interpreter = new tflite::MicroInterpreter(
+        s_model, s_resolver, s_tensor_arena, kArenaSize, s_error_reporter);
 
-    input = m_interpreter->input(0);
-    output = m_interpreter->output(0);
-}
+    // the kernels size their per-worker scratch buffers when the tensors are allocated
+    if (worker_count > 1)
+    {
+        s_worker_pool = new WorkerPool(worker_count, worker_core);
+        s_interpreter->SetExternalContext(kTfLiteCpuBackendContext, s_worker_pool->external_context());
+    }
 
-NeuralNetwork::~NeuralNetwork()
-{
-    delete m_interpreter;
-    delete m_error_reporter;
+    TfLiteStatus allocate_status = s_interpreter->AllocateTensors();
+    if (allocate_status != kTfLiteOk)
+    {
+        TF_LITE_REPORT_ERROR(s_error_reporter, "AllocateTensors() failed");
+        delete s_interpreter;
+        s_interpreter = nullptr;
+        delete s_worker_pool;
+        s_worker_pool = nullptr;
+        return false;
+    }
+    s_worker_count = worker_count;
+    s_worker_core = worker_core;
+
+    size_t used_bytes = s_interpreter->arena_used_bytes();
+    TF_LITE_REPORT_ERROR(s_error_reporter, "Used bytes %d\n", used_bytes);
+    return true;
 }
 
 float *NeuralNetwork::getInputBuffer()
@@ -61,8 +105,19 @@ float *NeuralNetwork::getInputBuffer()
     return input->data.f;
 }
 
+// number of floats in the input buffer
+int NeuralNetwork::getInputSize()
+{
+    return input->bytes / sizeof(float);
+}
+
 float NeuralNetwork::predict()
 {
-    m_interpreter->Invoke();
+    s_interpreter->Invoke();
     return output->data.f[0];
 }
+
+void NeuralNetwork::resetState()
+{
+    s_interpreter->ResetVariableTensors();
+}
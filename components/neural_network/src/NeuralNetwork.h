@@ -15,27 +15,40 @@ namespace tflite
 } // namespace tflite
 
 struct TfLiteTensor;
+class WorkerPool;
 
 class NeuralNetwork
 {
 private:
+    // tools/arena_report logs what the arena is used for and the smallest size the bundled model runs in
     static const int kArenaSize = 25000;
 
-    tflite::MicroMutableOpResolver<10> m_resolver;
-    tflite::ErrorReporter *m_error_reporter;
-    const tflite::Model *m_model;
-    tflite::MicroInterpreter *m_interpreter;
+    // Everything AllocateTensors builds lives in the static arena, so the interpreter made by the first NeuralNetwork
+    // is kept and handed to every later one instead of parsing and planning the model again
+    static tflite::MicroMutableOpResolver<11> s_resolver;
+    static tflite::ErrorReporter *s_error_reporter;
+    static const tflite::Model *s_model;
+    static tflite::MicroInterpreter *s_interpreter;
+    static WorkerPool *s_worker_pool;
+    static int s_worker_count;
+    static int s_worker_core;
+
+    alignas(16) static uint8_t s_tensor_arena[kArenaSize];
+
     TfLiteTensor *input;
     TfLiteTensor *output;
 
-    alignas(16) static uint8_t s_tensor_arena[kArenaSize];
-    uint8_t *m_tensor_arena;
+    static bool createInterpreter(int worker_count, int worker_core);
 
 public:
-    NeuralNetwork();
-    ~NeuralNetwork();
+    // worker_count > 1 splits the convolution and fully connected layers across that many tasks, the extra ones
+    // pinned to worker_core (-1 leaves them unpinned)
+    NeuralNetwork(int worker_count = 1, int worker_core = -1);
     float *getInputBuffer();
+    int getInputSize();
     float predict();
+    // clear any variable tensors the model keeps between predictions - the bundled model has none
+    void resetState();
 };
 
 #endif
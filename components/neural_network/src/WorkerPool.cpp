@@ -0,0 +1,135 @@
+#include "WorkerPool.h"
+
+#ifdef ESP_PLATFORM
+
+// The helpers run at the inference task's priority - no higher, so the i2s
+// reader (priority 6) can always preempt them to keep the audio coming in.
+#define WORKER_PRIORITY 5
+#define WORKER_STACK_SIZE 4096
+
+WorkerPool::WorkerPool(int num_threads, int core)
+{
+    m_num_threads = num_threads;
+    m_task = nullptr;
+    m_data = nullptr;
+    m_done = xSemaphoreCreateCounting(num_threads, 0);
+    m_workers = new Worker[num_threads];
+    // worker 0 is the calling task
+    for (int i = 1; i < num_threads; i++)
+    {
+        m_workers[i].pool = this;
+        m_workers[i].index = i;
+        m_workers[i].start = xSemaphoreCreateBinary();
+        xTaskCreatePinnedToCore(workerTask, "nn_worker", WORKER_STACK_SIZE, &m_workers[i], WORKER_PRIORITY,
+                                &m_workers[i].task_handle, core < 0 ? tskNO_AFFINITY : core);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    for (int i = 1; i < m_num_threads; i++)
+    {
+        vTaskDelete(m_workers[i].task_handle);
+        vSemaphoreDelete(m_workers[i].start);
+    }
+    vSemaphoreDelete(m_done);
+    delete[] m_workers;
+}
+
+void WorkerPool::workerTask(void *param)
+{
+    Worker *worker = static_cast<Worker *>(param);
+    WorkerPool *pool = worker->pool;
+    while (true)
+    {
+        xSemaphoreTake(worker->start, portMAX_DELAY);
+        pool->m_task(pool->m_data, worker->index);
+        xSemaphoreGive(pool->m_done);
+    }
+}
+
+void WorkerPool::Run(void (*task)(void *data, int worker), void *data)
+{
+    m_task = task;
+    m_data = data;
+    for (int i = 1; i < m_num_threads; i++)
+    {
+        xSemaphoreGive(m_workers[i].start);
+    }
+    task(data, 0);
+    // wait for everyone else to finish their share
+    for (int i = 1; i < m_num_threads; i++)
+    {
+        xSemaphoreTake(m_done, portMAX_DELAY);
+    }
+}
+
+#else
+
+WorkerPool::WorkerPool(int num_threads, int core)
+{
+    m_num_threads = num_threads;
+    m_task = nullptr;
+    m_data = nullptr;
+    m_generation = 0;
+    m_pending = 0;
+    m_stop = false;
+    // worker 0 is the calling thread
+    for (int i = 1; i < num_threads; i++)
+    {
+        m_workers.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i].join();
+    }
+}
+
+void WorkerPool::workerLoop(int worker)
+{
+    unsigned int generation = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_start.wait(lock, [&]() { return m_stop || m_generation != generation; });
+        if (m_stop)
+        {
+            return;
+        }
+        generation = m_generation;
+        lock.unlock();
+        m_task(m_data, worker);
+        lock.lock();
+        if (--m_pending == 0)
+        {
+            m_done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::Run(void (*task)(void *data, int worker), void *data)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = task;
+        m_data = data;
+        m_pending = m_num_threads - 1;
+        m_generation++;
+    }
+    m_start.notify_all();
+    task(data, 0);
+    // wait for everyone else to finish their share
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_pending == 0; });
+}
+
+#endif
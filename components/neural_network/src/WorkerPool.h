@@ -0,0 +1,67 @@
+#ifndef __WorkerPool__
+#define __WorkerPool__
+
+#include "tensorflow/lite/micro/micro_thread_pool.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+/**
+ * Workers the neural network kernels split their output rows/channels across
+ *
+ * Worker 0 is whichever task calls Run (the one running Invoke), the others are
+ * FreeRTOS tasks on the ESP32 or std::threads on the host. On the ESP32 the
+ * helpers can be pinned to a core - it should be one the caller isn't on and
+ * that nothing busier than the inference task is using, or every Run waits
+ * for the helpers to get a time slice. Each Run hands the
+ * same task to every worker and only returns once they have all finished it,
+ * so a layer never overlaps the next one.
+ **/
+class WorkerPool : public tflite::MicroThreadPool
+{
+private:
+    int m_num_threads;
+    void (*m_task)(void *data, int worker);
+    void *m_data;
+#ifdef ESP_PLATFORM
+    struct Worker
+    {
+        WorkerPool *pool;
+        int index;
+        TaskHandle_t task_handle;
+        SemaphoreHandle_t start;
+    };
+    Worker *m_workers;
+    SemaphoreHandle_t m_done;
+    static void workerTask(void *param);
+#else
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    unsigned int m_generation;
+    int m_pending;
+    bool m_stop;
+    void workerLoop(int worker);
+#endif
+
+public:
+    // core is the one the helper tasks are pinned to, -1 leaves them unpinned (and is all the host does)
+    WorkerPool(int num_threads, int core = -1);
+    ~WorkerPool();
+    int num_threads() const override
+    {
+        return m_num_threads;
+    }
+    void Run(void (*task)(void *data, int worker), void *data) override;
+};
+
+#endif
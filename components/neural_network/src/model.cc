@@ -1,4 +1,8 @@
-unsigned char converted_model_tflite[] = {
+#include "model.h"
+
+// const so the model stays in flash-mapped .rodata instead of being copied
+// into RAM-backed .data at boot. Aligned for the flatbuffer scalar accesses.
+alignas(16) const unsigned char converted_model_tflite[] = {
     0x20, 0x00, 0x00, 0x00, 0x54, 0x46, 0x4c, 0x33, 0x00, 0x00, 0x00, 0x00, 
     0x14, 0x00, 0x20, 0x00, 0x1c, 0x00, 0x18, 0x00, 0x14, 0x00, 0x10, 0x00, 
     0x0c, 0x00, 0x00, 0x00, 0x08, 0x00, 0x04, 0x00, 0x14, 0x00, 0x00, 0x00, 
@@ -3582,4 +3586,4 @@ unsigned char converted_model_tflite[] = {
     0x00, 0x00, 0x04, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x72, 0x00, 0x00, 0x00, 
     0x00, 0x00, 0x00, 0x72, 
 };
-unsigned int converted_model_tflite_len = 42976;
+const unsigned int converted_model_tflite_len = 42976;
@@ -1,7 +1,7 @@
 #ifndef __converted_model_h__
 #define __converted_model_h__
 
-extern unsigned char converted_model_tflite[];
-extern unsigned int converted_model_tflite_len;
+extern const unsigned char converted_model_tflite[];
+extern const unsigned int converted_model_tflite_len;
 
-#endif
\ No newline at end of file
+#endif
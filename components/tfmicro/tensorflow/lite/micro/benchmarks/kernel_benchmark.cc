@@ -0,0 +1,773 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <string.h>
+
+#include <algorithm>
+#include <initializer_list>
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/internal/quantization_util.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/add.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/mul.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/pooling.h"
+#include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/kernels/padding.h"
+#include "tensorflow/lite/micro/benchmarks/micro_benchmark.h"
+#include "tensorflow/lite/micro/kernels/kernel_runner.h"
+#include "tensorflow/lite/micro/kernels/micro_ops.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
+#include "tensorflow/lite/micro/micro_op_fusion.h"
+#include "tensorflow/lite/micro/micro_time.h"
+
+namespace tflite {
+namespace {
+
+// Holds the tensors of one layer. Big enough for the largest layer below, the
+// MUL/ADD on the 99x43x4 output of the first convolution.
+constexpr int kLayerBufferSize = 40 * 1024;
+constexpr int kMaxTensors = 4;
+
+// Builds the tensors of one layer in a static buffer, filled with
+// pseudo-random values. Constant tensors (weights, bias) stand in for the
+// model's flatbuffer and are not counted as arena.
+class LayerBuilder {
+ public:
+  LayerBuilder() : next_(buffer_), tensor_count_(0), activation_bytes_(0) {}
+
+  // A per-tensor quantized int8 activation.
+  int AddInt8(std::initializer_list<int> shape, float scale, int zero_point) {
+    TfLiteTensor* tensor = AddTensor(kTfLiteInt8, shape, kTfLiteArenaRw);
+    tensor->params = {scale, zero_point};
+    tensor->quantization = {kTfLiteAffineQuantization,
+                            AffineQuantization(scale, zero_point, 1)};
+    return tensor_count_ - 1;
+  }
+
+  // An int8 weight tensor, per-channel quantized along `quantized_dimension`
+  // the way the converter quantizes conv filters.
+  int AddInt8Weights(std::initializer_list<int> shape, float scale,
+                     int quantized_dimension) {
+    TfLiteTensor* tensor = AddTensor(kTfLiteInt8, shape, kTfLiteMmapRo);
+    const int channels = tensor->dims->data[quantized_dimension];
+    tensor->params = {scale, 0};
+    TfLiteAffineQuantization* quantization =
+        AffineQuantization(scale, 0, channels);
+    quantization->quantized_dimension = quantized_dimension;
+    tensor->quantization = {kTfLiteAffineQuantization, quantization};
+    return tensor_count_ - 1;
+  }
+
+  // An int32 bias of `channels`, quantized to input scale * weight scale.
+  int AddBias(int channels, float scale) {
+    TfLiteTensor* tensor = AddTensor(kTfLiteInt32, {channels}, kTfLiteMmapRo);
+    tensor->params = {scale, 0};
+    tensor->quantization = {kTfLiteAffineQuantization,
+                            AffineQuantization(scale, 0, channels)};
+    return tensor_count_ - 1;
+  }
+
+  int AddFloat(std::initializer_list<int> shape) {
+    TfLiteTensor* tensor = AddTensor(kTfLiteFloat32, shape, kTfLiteArenaRw);
+    for (size_t i = 0; i < tensor->bytes / sizeof(float); ++i) {
+      tensor->data.f[i] = static_cast<int8_t>(NextRandom()) / 16.0f;
+    }
+    return tensor_count_ - 1;
+  }
+
+  TfLiteIntArray* Indices(std::initializer_list<int> indices) {
+    return IntArray(indices);
+  }
+
+  TfLiteTensor* tensors() { return tensors_; }
+  int tensor_count() const { return tensor_count_; }
+  size_t activation_bytes() const { return activation_bytes_; }
+  bool ok() const { return next_ != nullptr; }
+
+ private:
+  uint8_t NextRandom() {
+    seed_ = seed_ * 1103515245 + 12345;
+    return static_cast<uint8_t>(seed_ >> 16);
+  }
+
+  void* Allocate(size_t bytes) {
+    if (next_ == nullptr) {
+      return nullptr;
+    }
+    uint8_t* result = AlignPointerUp(next_, 16);
+    if (result + bytes > buffer_ + kLayerBufferSize) {
+      next_ = nullptr;
+      return nullptr;
+    }
+    next_ = result + bytes;
+    return result;
+  }
+
+  TfLiteIntArray* IntArray(std::initializer_list<int> values) {
+    TfLiteIntArray* array = static_cast<TfLiteIntArray*>(
+        Allocate(TfLiteIntArrayGetSizeInBytes(values.size())));
+    if (array != nullptr) {
+      array->size = values.size();
+      int i = 0;
+      for (int value : values) {
+        array->data[i++] = value;
+      }
+    }
+    return array;
+  }
+
+  TfLiteAffineQuantization* AffineQuantization(float scale, int zero_point,
+                                               int channels) {
+    TfLiteAffineQuantization* quantization =
+        static_cast<TfLiteAffineQuantization*>(
+            Allocate(sizeof(TfLiteAffineQuantization)));
+    TfLiteFloatArray* scales = static_cast<TfLiteFloatArray*>(
+        Allocate(sizeof(TfLiteFloatArray) + channels * sizeof(float)));
+    TfLiteIntArray* zero_points = static_cast<TfLiteIntArray*>(
+        Allocate(TfLiteIntArrayGetSizeInBytes(channels)));
+    if (quantization == nullptr || scales == nullptr ||
+        zero_points == nullptr) {
+      return nullptr;
+    }
+    scales->size = channels;
+    zero_points->size = channels;
+    for (int i = 0; i < channels; ++i) {
+      scales->data[i] = scale;
+      zero_points->data[i] = zero_point;
+    }
+    quantization->scale = scales;
+    quantization->zero_point = zero_points;
+    quantization->quantized_dimension = 0;
+    return quantization;
+  }
+
+  TfLiteTensor* AddTensor(TfLiteType type, std::initializer_list<int> shape,
+                          TfLiteAllocationType allocation_type) {
+    static TfLiteTensor dummy;
+    if (tensor_count_ == kMaxTensors) {
+      next_ = nullptr;
+      return &dummy;
+    }
+    TfLiteTensor* tensor = &tensors_[tensor_count_++];
+    memset(tensor, 0, sizeof(*tensor));
+    tensor->type = type;
+    tensor->allocation_type = allocation_type;
+    tensor->dims = IntArray(shape);
+    size_t type_size = 0;
+    TfLiteTypeSizeOf(type, &type_size);
+    tensor->bytes = type_size;
+    for (int dim : shape) {
+      tensor->bytes *= dim;
+    }
+    tensor->data.raw = static_cast<char*>(Allocate(tensor->bytes));
+    if (tensor->data.raw == nullptr || tensor->dims == nullptr) {
+      return &dummy;
+    }
+    for (size_t i = 0; i < tensor->bytes; ++i) {
+      tensor->data.uint8[i] = NextRandom();
+    }
+    if (allocation_type == kTfLiteArenaRw) {
+      activation_bytes_ += tensor->bytes;
+    }
+    return tensor;
+  }
+
+  alignas(16) static uint8_t buffer_[kLayerBufferSize];
+  uint8_t* next_;
+  TfLiteTensor tensors_[kMaxTensors];
+  int tensor_count_;
+  size_t activation_bytes_;
+  uint32_t seed_ = 1;
+};
+
+alignas(16) uint8_t LayerBuilder::buffer_[kLayerBufferSize];
+
+// Prepares the kernel once, times `invocations` calls to it and reports them.
+// Arena is what the layer would take in the interpreter's arena: its
+// activations plus the kernel's persistent and scratch buffers.
+TfLiteStatus RunKernel(ErrorReporter* error_reporter, const char* name,
+                       const TfLiteRegistration& registration,
+                       LayerBuilder* layer, TfLiteIntArray* inputs,
+                       TfLiteIntArray* outputs, void* builtin_data,
+                       int64_t macs, int cpu_mhz, int invocations) {
+  if (!layer->ok() || inputs == nullptr || outputs == nullptr) {
+    TF_LITE_REPORT_ERROR(error_reporter, "%s: tensors do not fit in %d bytes",
+                         name, kLayerBufferSize);
+    return kTfLiteError;
+  }
+  micro::KernelRunner runner(registration, layer->tensors(),
+                             layer->tensor_count(), inputs, outputs,
+                             builtin_data, error_reporter);
+  TF_LITE_ENSURE_STATUS(runner.InitAndPrepare());
+  // Warm up the caches before timing anything.
+  TF_LITE_ENSURE_STATUS(runner.Invoke());
+  const int32_t start = GetCurrentTimeTicks();
+  for (int i = 0; i < invocations; ++i) {
+    TF_LITE_ENSURE_STATUS(runner.Invoke());
+  }
+  const int32_t ticks = TicksBetween(start, GetCurrentTimeTicks());
+  ReportBenchmark(error_reporter, name, ticks, invocations, cpu_mhz, macs,
+                  layer->activation_bytes() + runner.arena_used_bytes());
+  return kTfLiteOk;
+}
+
+// The layers of the wake word model (components/neural_network/src/model.cc):
+// a 99x43 spectrogram through two 3x3x4 SAME convolutions with ReLU, each
+// followed by a 2x2 max pool, then fully connected 960 -> 40 -> 1.
+constexpr float kInputScale = 0.0274f;
+constexpr int kInputZeroPoint = -18;
+constexpr float kActivationScale = 0.0196f;
+constexpr int kActivationZeroPoint = -128;
+constexpr float kWeightScale = 0.0071f;
+constexpr float kLogitScale = 0.183332f;
+constexpr int kLogitZeroPoint = 21;
+
+struct ConvLayer {
+  const char* name;
+  const char* pool_name;
+  const char* fused_name;
+  int height;
+  int width;
+  int input_channels;
+  float input_scale;
+  int input_zero_point;
+};
+
+constexpr int kChannels = 4;
+constexpr int kKernelSize = 3;
+
+const ConvLayer kConvLayers[] = {
+    {"CONV_2D 99x43x1 -> 99x43x4", "MAX_POOL_2D 99x43x4 -> 49x21x4",
+     "CONV_2D_MAX_POOL_2D 99x43x1 -> 49x21x4", 99, 43, 1, kInputScale,
+     kInputZeroPoint},
+    {"CONV_2D 49x21x4 -> 49x21x4", "MAX_POOL_2D 49x21x4 -> 24x10x4",
+     "CONV_2D_MAX_POOL_2D 49x21x4 -> 24x10x4", 49, 21, kChannels,
+     kActivationScale, kActivationZeroPoint},
+};
+
+TfLiteConvParams ConvParams() {
+  TfLiteConvParams params = {};
+  params.padding = kTfLitePaddingSame;
+  params.stride_width = 1;
+  params.stride_height = 1;
+  params.activation = kTfLiteActRelu;
+  params.dilation_width_factor = 1;
+  params.dilation_height_factor = 1;
+  return params;
+}
+
+TfLitePoolParams PoolParams() {
+  TfLitePoolParams params = {};
+  params.padding = kTfLitePaddingValid;
+  params.stride_width = 2;
+  params.stride_height = 2;
+  params.filter_width = 2;
+  params.filter_height = 2;
+  params.activation = kTfLiteActNone;
+  return params;
+}
+
+TfLiteStatus RunConvLayer(ErrorReporter* error_reporter, const ConvLayer& conv,
+                          int cpu_mhz, int invocations) {
+  const int pooled_height = conv.height / 2;
+  const int pooled_width = conv.width / 2;
+  const int64_t macs = static_cast<int64_t>(conv.height) * conv.width *
+                       kChannels * kKernelSize * kKernelSize *
+                       conv.input_channels;
+  {
+    LayerBuilder layer;
+    layer.AddInt8({1, conv.height, conv.width, conv.input_channels},
+                  conv.input_scale, conv.input_zero_point);
+    layer.AddInt8Weights(
+        {kChannels, kKernelSize, kKernelSize, conv.input_channels},
+        kWeightScale, 0);
+    layer.AddBias(kChannels, conv.input_scale * kWeightScale);
+    layer.AddInt8({1, conv.height, conv.width, kChannels}, kActivationScale,
+                  kActivationZeroPoint);
+    TfLiteConvParams params = ConvParams();
+    const TfLiteRegistration registration = ops::micro::Register_CONV_2D();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, conv.name, registration, &layer,
+        layer.Indices({0, 1, 2}), layer.Indices({3}), &params, macs,
+        cpu_mhz, invocations));
+  }
+  {
+    LayerBuilder layer;
+    layer.AddInt8({1, conv.height, conv.width, kChannels}, kActivationScale,
+                  kActivationZeroPoint);
+    layer.AddInt8({1, pooled_height, pooled_width, kChannels},
+                  kActivationScale, kActivationZeroPoint);
+    TfLitePoolParams params = PoolParams();
+    const TfLiteRegistration registration = ops::micro::Register_MAX_POOL_2D();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, conv.pool_name, registration, &layer,
+        layer.Indices({0}), layer.Indices({1}), &params, 0, cpu_mhz,
+        invocations));
+  }
+  {
+    LayerBuilder layer;
+    layer.AddInt8({1, conv.height, conv.width, conv.input_channels},
+                  conv.input_scale, conv.input_zero_point);
+    layer.AddInt8Weights(
+        {kChannels, kKernelSize, kKernelSize, conv.input_channels},
+        kWeightScale, 0);
+    layer.AddBias(kChannels, conv.input_scale * kWeightScale);
+    layer.AddInt8({1, pooled_height, pooled_width, kChannels},
+                  kActivationScale, kActivationZeroPoint);
+    TfLiteConv2DMaxPool2DParams params = {ConvParams(), PoolParams()};
+    const TfLiteRegistration registration =
+        ops::micro::Register_CONV_2D_MAX_POOL_2D();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, conv.fused_name, registration, &layer,
+        layer.Indices({0, 1, 2}), layer.Indices({3}), &params, macs,
+        cpu_mhz, invocations));
+  }
+  return kTfLiteOk;
+}
+
+// Output of the reference kernels that the checked layers below are compared
+// against, as big as the largest of them.
+constexpr int kReferenceOutputSize = 20 * 1024;
+int8_t reference_output[kReferenceOutputSize];
+
+// Times `invocations` calls to a reference kernel, which writes
+// reference_output, and fails if that differs from the output of the layer
+// that ran before it.
+template <typename ReferenceKernel>
+TfLiteStatus RunReference(ErrorReporter* error_reporter, const char* name,
+                          const char* reference_name,
+                          const TfLiteTensor* output, int64_t macs,
+                          int cpu_mhz, int invocations,
+                          const ReferenceKernel& reference_kernel) {
+  if (output->bytes > sizeof(reference_output)) {
+    TF_LITE_REPORT_ERROR(error_reporter, "%s: too big for the reference",
+                         name);
+    return kTfLiteError;
+  }
+  const int32_t start = GetCurrentTimeTicks();
+  for (int i = 0; i < invocations; ++i) {
+    reference_kernel();
+  }
+  const int32_t ticks = TicksBetween(start, GetCurrentTimeTicks());
+  ReportBenchmark(error_reporter, reference_name, ticks, invocations, cpu_mhz,
+                  macs, 0);
+  if (memcmp(reference_output, output->data.int8, output->bytes) != 0) {
+    TF_LITE_REPORT_ERROR(error_reporter,
+                         "%s: output differs from the reference kernel",
+                         name);
+    return kTfLiteError;
+  }
+  return kTfLiteOk;
+}
+
+// MUL and ADD are registered for the batch norm scale and offset that
+// FoldConstantOperators() normally folds away, so they run per channel on the
+// first convolution's output. The same shape layers are the other int8 fast
+// path in add.cc and mul.cc. Every layer is checked against the reference
+// broadcast kernel, which handles any pair of shapes.
+struct ElementwiseLayer {
+  const char* name;
+  const char* reference_name;
+  bool add;
+  int height;
+  int width;
+  int channels;
+  bool channel_broadcast;
+};
+
+const ElementwiseLayer kElementwiseLayers[] = {
+    {"MUL 99x43x4 * 4", "  reference", false, 99, 43, kChannels, true},
+    {"ADD 99x43x4 + 4", "  reference", true, 99, 43, kChannels, true},
+    {"MUL 49x21x8 * 49x21x8", "  reference", false, 49, 21, 8, false},
+    {"ADD 49x21x8 + 49x21x8", "  reference", true, 49, 21, 8, false},
+};
+
+TfLiteStatus RunElementwiseLayer(ErrorReporter* error_reporter,
+                                 const ElementwiseLayer& elementwise,
+                                 int cpu_mhz, int invocations) {
+  const float input2_scale =
+      elementwise.add ? kActivationScale : kWeightScale;
+  LayerBuilder layer;
+  layer.AddInt8(
+      {1, elementwise.height, elementwise.width, elementwise.channels},
+      kActivationScale, kActivationZeroPoint);
+  if (elementwise.channel_broadcast) {
+    layer.AddInt8Weights({1, 1, 1, elementwise.channels}, input2_scale, 3);
+  } else {
+    layer.AddInt8(
+        {1, elementwise.height, elementwise.width, elementwise.channels},
+        input2_scale, 0);
+  }
+  layer.AddInt8(
+      {1, elementwise.height, elementwise.width, elementwise.channels},
+      kActivationScale, kActivationZeroPoint);
+  TfLiteMulParams mul_params = {kTfLiteActNone};
+  TfLiteAddParams add_params = {};
+  add_params.activation = kTfLiteActNone;
+  const TfLiteRegistration registration = elementwise.add
+                                              ? ops::micro::Register_ADD()
+                                              : ops::micro::Register_MUL();
+  TF_LITE_ENSURE_STATUS(RunKernel(
+      error_reporter, elementwise.name, registration, &layer,
+      layer.Indices({0, 1}), layer.Indices({2}),
+      elementwise.add ? static_cast<void*>(&add_params)
+                      : static_cast<void*>(&mul_params),
+      0, cpu_mhz, invocations));
+
+  // The same layer through the reference kernel, with the parameters worked
+  // out the way add.cc and mul.cc do.
+  const TfLiteTensor* input1 = &layer.tensors()[0];
+  const TfLiteTensor* input2 = &layer.tensors()[1];
+  const TfLiteTensor* output = &layer.tensors()[2];
+  ArithmeticParams op_params = {};
+  op_params.input1_offset = -kActivationZeroPoint;
+  op_params.input2_offset = 0;
+  op_params.output_offset = kActivationZeroPoint;
+  op_params.quantized_activation_min = -128;
+  op_params.quantized_activation_max = 127;
+  if (elementwise.add) {
+    op_params.left_shift = 20;
+    const double twice_max_input_scale =
+        2 * static_cast<double>(std::max(kActivationScale, input2_scale));
+    QuantizeMultiplierSmallerThanOneExp(
+        static_cast<double>(kActivationScale) / twice_max_input_scale,
+        &op_params.input1_multiplier, &op_params.input1_shift);
+    QuantizeMultiplierSmallerThanOneExp(
+        static_cast<double>(input2_scale) / twice_max_input_scale,
+        &op_params.input2_multiplier, &op_params.input2_shift);
+    QuantizeMultiplierSmallerThanOneExp(
+        twice_max_input_scale /
+            ((1 << op_params.left_shift) *
+             static_cast<double>(kActivationScale)),
+        &op_params.output_multiplier, &op_params.output_shift);
+    return RunReference(
+        error_reporter, elementwise.name, elementwise.reference_name, output,
+        0, cpu_mhz, invocations, [&]() {
+          reference_integer_ops::BroadcastAdd4DSlow(
+              op_params, GetTensorShape(input1), GetTensorData<int8_t>(input1),
+              GetTensorShape(input2), GetTensorData<int8_t>(input2),
+              GetTensorShape(output), reference_output);
+        });
+  }
+  QuantizeMultiplier(static_cast<double>(kActivationScale) *
+                         static_cast<double>(input2_scale) /
+                         static_cast<double>(kActivationScale),
+                     &op_params.output_multiplier, &op_params.output_shift);
+  return RunReference(
+      error_reporter, elementwise.name, elementwise.reference_name, output, 0,
+      cpu_mhz, invocations, [&]() {
+        reference_integer_ops::BroadcastMul4DSlow(
+            op_params, GetTensorShape(input1), GetTensorData<int8_t>(input1),
+            GetTensorShape(input2), GetTensorData<int8_t>(input2),
+            GetTensorShape(output), reference_output);
+      });
+}
+
+// Pooling layers for the int8 fast paths in pooling.cc. They pool a ReLU
+// output with the zero point in the middle of the int8 range, so the
+// activation clamps half of the values.
+struct PoolLayer {
+  const char* name;
+  const char* reference_name;
+  bool average;
+  int height;
+  int width;
+  int channels;
+  int filter_size;
+  int stride;
+  TfLitePadding padding;
+};
+
+const PoolLayer kPoolLayers[] = {
+    {"MAX_POOL_2D 2x2/2 49x21x16", "  reference", false, 49, 21, 16, 2, 2,
+     kTfLitePaddingValid},
+    {"MAX_POOL_2D 3x3/2 49x21x16 SAME", "  reference", false, 49, 21, 16, 3,
+     2, kTfLitePaddingSame},
+    {"AVERAGE_POOL_2D 2x2/2 49x21x16", "  reference", true, 49, 21, 16, 2, 2,
+     kTfLitePaddingValid},
+    {"AVERAGE_POOL_2D 3x3/1 25x20x32 SAME", "  reference", true, 25, 20, 32,
+     3, 1, kTfLitePaddingSame},
+};
+
+TfLiteStatus RunPoolLayer(ErrorReporter* error_reporter, const PoolLayer& pool,
+                          int cpu_mhz, int invocations) {
+  int output_height, output_width;
+  const TfLitePaddingValues padding = ComputePaddingHeightWidth(
+      pool.stride, pool.stride, 1, 1, pool.height, pool.width,
+      pool.filter_size, pool.filter_size, pool.padding, &output_height,
+      &output_width);
+  LayerBuilder layer;
+  layer.AddInt8({1, pool.height, pool.width, pool.channels}, kActivationScale,
+                0);
+  layer.AddInt8({1, output_height, output_width, pool.channels},
+                kActivationScale, 0);
+  TfLitePoolParams params = {};
+  params.padding = pool.padding;
+  params.stride_width = pool.stride;
+  params.stride_height = pool.stride;
+  params.filter_width = pool.filter_size;
+  params.filter_height = pool.filter_size;
+  params.activation = kTfLiteActRelu;
+  const TfLiteRegistration registration =
+      pool.average ? ops::micro::Register_AVERAGE_POOL_2D()
+                   : ops::micro::Register_MAX_POOL_2D();
+  TF_LITE_ENSURE_STATUS(RunKernel(error_reporter, pool.name, registration,
+                                  &layer, layer.Indices({0}),
+                                  layer.Indices({1}), &params, 0, cpu_mhz,
+                                  invocations));
+
+  const TfLiteTensor* input = &layer.tensors()[0];
+  const TfLiteTensor* output = &layer.tensors()[1];
+  tflite::PoolParams op_params = {};
+  op_params.stride_height = pool.stride;
+  op_params.stride_width = pool.stride;
+  op_params.filter_height = pool.filter_size;
+  op_params.filter_width = pool.filter_size;
+  op_params.padding_values.height = padding.height;
+  op_params.padding_values.width = padding.width;
+  op_params.quantized_activation_min = 0;
+  op_params.quantized_activation_max = 127;
+  return RunReference(
+      error_reporter, pool.name, pool.reference_name, output, 0, cpu_mhz,
+      invocations, [&]() {
+        if (pool.average) {
+          reference_integer_ops::AveragePool(
+              op_params, GetTensorShape(input), GetTensorData<int8_t>(input),
+              GetTensorShape(output), reference_output);
+        } else {
+          reference_integer_ops::MaxPool(
+              op_params, GetTensorShape(input), GetTensorData<int8_t>(input),
+              GetTensorShape(output), reference_output);
+        }
+      });
+}
+
+// Depthwise layers of a depthwise separable model on the same spectrogram,
+// one for each of the specialized int8 kernels in depthwise_conv.cc. The 48
+// channel layers leave a partial block of channels. Every layer also runs the
+// reference kernel, which has to give the same output bit for bit.
+struct DepthwiseLayer {
+  const char* name;
+  const char* reference_name;
+  int height;
+  int width;
+  int channels;
+  int filter_height;
+  int filter_width;
+  int stride;
+};
+
+const DepthwiseLayer kDepthwiseLayers[] = {
+    {"DEPTHWISE_CONV_2D 3x3/1 25x20x32", "  reference", 25, 20, 32, 3, 3, 1},
+    {"DEPTHWISE_CONV_2D 3x3/2 49x21x16", "  reference", 49, 21, 16, 3, 3, 2},
+    {"DEPTHWISE_CONV_2D 1x5/1 24x10x48", "  reference", 24, 10, 48, 1, 5, 1},
+    {"DEPTHWISE_CONV_2D 5x1/1 24x10x48", "  reference", 24, 10, 48, 5, 1, 1},
+};
+
+// Multipliers of the reference kernel, enough for the layers above.
+constexpr int kMaxDepthwiseChannels = 64;
+
+TfLiteStatus RunDepthwiseLayer(ErrorReporter* error_reporter,
+                               const DepthwiseLayer& depthwise, int cpu_mhz,
+                               int invocations) {
+  const int output_height =
+      (depthwise.height + depthwise.stride - 1) / depthwise.stride;
+  const int output_width =
+      (depthwise.width + depthwise.stride - 1) / depthwise.stride;
+  const int64_t macs = static_cast<int64_t>(output_height) * output_width *
+                       depthwise.channels * depthwise.filter_height *
+                       depthwise.filter_width;
+  LayerBuilder layer;
+  layer.AddInt8({1, depthwise.height, depthwise.width, depthwise.channels},
+                kActivationScale, kActivationZeroPoint);
+  layer.AddInt8Weights(
+      {1, depthwise.filter_height, depthwise.filter_width, depthwise.channels},
+      kWeightScale, 3);
+  layer.AddBias(depthwise.channels, kActivationScale * kWeightScale);
+  layer.AddInt8({1, output_height, output_width, depthwise.channels},
+                kActivationScale, kActivationZeroPoint);
+  TfLiteDepthwiseConvParams params = {};
+  params.padding = kTfLitePaddingSame;
+  params.stride_width = depthwise.stride;
+  params.stride_height = depthwise.stride;
+  params.depth_multiplier = 1;
+  params.activation = kTfLiteActRelu;
+  params.dilation_width_factor = 1;
+  params.dilation_height_factor = 1;
+  const TfLiteRegistration registration =
+      ops::micro::Register_DEPTHWISE_CONV_2D();
+  TF_LITE_ENSURE_STATUS(RunKernel(
+      error_reporter, depthwise.name, registration, &layer,
+      layer.Indices({0, 1, 2}), layer.Indices({3}), &params, macs, cpu_mhz,
+      invocations));
+
+  // The same layer through the reference kernel. All channels share one
+  // scale, so they share the multiplier too.
+  const TfLiteTensor* input = &layer.tensors()[0];
+  const TfLiteTensor* filter = &layer.tensors()[1];
+  const TfLiteTensor* bias = &layer.tensors()[2];
+  const TfLiteTensor* output = &layer.tensors()[3];
+  static int32_t multipliers[kMaxDepthwiseChannels];
+  static int32_t shifts[kMaxDepthwiseChannels];
+  if (depthwise.channels > kMaxDepthwiseChannels) {
+    TF_LITE_REPORT_ERROR(error_reporter, "%s: too big for the reference",
+                         depthwise.name);
+    return kTfLiteError;
+  }
+  int multiplier_shift;
+  QuantizeMultiplier(static_cast<double>(kActivationScale) *
+                         static_cast<double>(kWeightScale) /
+                         static_cast<double>(kActivationScale),
+                     &multipliers[0], &multiplier_shift);
+  for (int c = 0; c < depthwise.channels; ++c) {
+    multipliers[c] = multipliers[0];
+    shifts[c] = multiplier_shift;
+  }
+  int unused_height, unused_width;
+  const TfLitePaddingValues padding = ComputePaddingHeightWidth(
+      depthwise.stride, depthwise.stride, 1, 1, depthwise.height,
+      depthwise.width, depthwise.filter_height, depthwise.filter_width,
+      kTfLitePaddingSame, &unused_height, &unused_width);
+  DepthwiseParams op_params = {};
+  op_params.padding_type = PaddingType::kSame;
+  op_params.padding_values.width = padding.width;
+  op_params.padding_values.height = padding.height;
+  op_params.stride_width = depthwise.stride;
+  op_params.stride_height = depthwise.stride;
+  op_params.dilation_width_factor = 1;
+  op_params.dilation_height_factor = 1;
+  op_params.depth_multiplier = 1;
+  op_params.input_offset = -kActivationZeroPoint;
+  op_params.output_offset = kActivationZeroPoint;
+  // ReLU with the output zero point at the bottom of the int8 range.
+  op_params.quantized_activation_min = kActivationZeroPoint;
+  op_params.quantized_activation_max = 127;
+  return RunReference(
+      error_reporter, depthwise.name, depthwise.reference_name, output, macs,
+      cpu_mhz, invocations, [&]() {
+        reference_integer_ops::DepthwiseConvPerChannel(
+            op_params, multipliers, shifts, GetTensorShape(input),
+            GetTensorData<int8_t>(input), GetTensorShape(filter),
+            GetTensorData<int8_t>(filter), GetTensorShape(bias),
+            GetTensorData<int32_t>(bias), GetTensorShape(output),
+            reference_output);
+      });
+}
+
+TfLiteStatus RunFullyConnectedLayer(ErrorReporter* error_reporter,
+                                    const char* name, int input_size,
+                                    int output_size, float input_scale,
+                                    int input_zero_point, float output_scale,
+                                    int output_zero_point,
+                                    TfLiteFusedActivation activation,
+                                    int cpu_mhz, int invocations) {
+  LayerBuilder layer;
+  layer.AddInt8({1, input_size}, input_scale, input_zero_point);
+  layer.AddInt8Weights({output_size, input_size}, kWeightScale, 0);
+  layer.AddBias(output_size, input_scale * kWeightScale);
+  layer.AddInt8({1, output_size}, output_scale, output_zero_point);
+  TfLiteFullyConnectedParams params = {};
+  params.activation = activation;
+  params.weights_format = kTfLiteFullyConnectedWeightsFormatDefault;
+  const TfLiteRegistration registration =
+      ops::micro::Register_FULLY_CONNECTED();
+  return RunKernel(error_reporter, name, registration, &layer,
+                   layer.Indices({0, 1, 2}), layer.Indices({3}),
+                   &params, static_cast<int64_t>(input_size) * output_size,
+                   cpu_mhz, invocations);
+}
+
+TfLiteStatus RunOtherLayers(ErrorReporter* error_reporter, int cpu_mhz,
+                            int invocations) {
+  {
+    LayerBuilder layer;
+    layer.AddFloat({1, 99, 43, 1});
+    layer.AddInt8({1, 99, 43, 1}, kInputScale, kInputZeroPoint);
+    const TfLiteRegistration registration = ops::micro::Register_QUANTIZE();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, "QUANTIZE 99x43x1", registration, &layer,
+        layer.Indices({0}), layer.Indices({1}), nullptr, 0, cpu_mhz,
+        invocations));
+  }
+  {
+    LayerBuilder layer;
+    layer.AddInt8({1, 24, 10, kChannels}, kActivationScale,
+                  kActivationZeroPoint);
+    layer.AddInt8({1, 960}, kActivationScale, kActivationZeroPoint);
+    TfLiteReshapeParams params = {{1, 960}, 2};
+    const TfLiteRegistration registration = ops::micro::Register_RESHAPE();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, "RESHAPE 24x10x4 -> 960", registration, &layer,
+        layer.Indices({0}), layer.Indices({1}), &params, 0, cpu_mhz,
+        invocations));
+  }
+  TF_LITE_ENSURE_STATUS(RunFullyConnectedLayer(
+      error_reporter, "FULLY_CONNECTED 960 -> 40", 960, 40, kActivationScale,
+      kActivationZeroPoint, kActivationScale, kActivationZeroPoint,
+      kTfLiteActRelu, cpu_mhz, invocations));
+  TF_LITE_ENSURE_STATUS(RunFullyConnectedLayer(
+      error_reporter, "FULLY_CONNECTED 40 -> 1", 40, 1, kActivationScale,
+      kActivationZeroPoint, kLogitScale, kLogitZeroPoint, kTfLiteActNone,
+      cpu_mhz, invocations));
+  {
+    LayerBuilder layer;
+    layer.AddInt8({1, 1}, kLogitScale, kLogitZeroPoint);
+    layer.AddInt8({1, 1}, 1.0f / 256, -128);
+    const TfLiteRegistration registration = ops::micro::Register_LOGISTIC();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, "LOGISTIC 1", registration, &layer,
+        layer.Indices({0}), layer.Indices({1}), nullptr, 0, cpu_mhz,
+        invocations));
+  }
+  {
+    LayerBuilder layer;
+    layer.AddInt8({1, 1}, 1.0f / 256, -128);
+    layer.AddFloat({1, 1});
+    const TfLiteRegistration registration = ops::micro::Register_DEQUANTIZE();
+    TF_LITE_ENSURE_STATUS(RunKernel(
+        error_reporter, "DEQUANTIZE 1", registration, &layer,
+        layer.Indices({0}), layer.Indices({1}), nullptr, 0, cpu_mhz,
+        invocations));
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace
+
+TfLiteStatus RunKernelBenchmarks(ErrorReporter* error_reporter, int cpu_mhz,
+                                 int invocations) {
+  for (const ConvLayer& conv : kConvLayers) {
+    TF_LITE_ENSURE_STATUS(
+        RunConvLayer(error_reporter, conv, cpu_mhz, invocations));
+  }
+  for (const ElementwiseLayer& elementwise : kElementwiseLayers) {
+    TF_LITE_ENSURE_STATUS(RunElementwiseLayer(error_reporter, elementwise,
+                                              cpu_mhz, invocations));
+  }
+  for (const PoolLayer& pool : kPoolLayers) {
+    TF_LITE_ENSURE_STATUS(
+        RunPoolLayer(error_reporter, pool, cpu_mhz, invocations));
+  }
+  for (const DepthwiseLayer& depthwise : kDepthwiseLayers) {
+    TF_LITE_ENSURE_STATUS(
+        RunDepthwiseLayer(error_reporter, depthwise, cpu_mhz, invocations));
+  }
+  return RunOtherLayers(error_reporter, cpu_mhz, invocations);
+}
+
+}  // namespace tflite
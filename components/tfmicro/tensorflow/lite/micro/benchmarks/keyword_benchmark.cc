@@ -0,0 +1,145 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <string.h>
+
+#include "tensorflow/lite/core/api/profiler.h"
+#include "tensorflow/lite/micro/benchmarks/keyword_scrambled_model_data.h"
+#include "tensorflow/lite/micro/benchmarks/micro_benchmark.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/micro/micro_string.h"
+#include "tensorflow/lite/micro/micro_time.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+namespace {
+
+constexpr int kKeywordArenaSize = 24 * 1024;
+constexpr int kMaxOps = 16;
+
+// Adds up the ticks spent in each operator the interpreter invokes.
+class OpTickProfiler : public Profiler {
+ public:
+  OpTickProfiler() { memset(ticks_, 0, sizeof(ticks_)); }
+
+  uint32_t BeginEvent(const char* tag, EventType event_type,
+                      int64_t event_metadata1,
+                      int64_t event_metadata2) override {
+    op_ = static_cast<int>(event_metadata1);
+    start_ = GetCurrentTimeTicks();
+    return 0;
+  }
+
+  void EndEvent(uint32_t event_handle) override {
+    const int32_t ticks = TicksBetween(start_, GetCurrentTimeTicks());
+    if (op_ >= 0 && op_ < kMaxOps) {
+      ticks_[op_] += ticks;
+    }
+  }
+
+  int64_t ticks(int op) const { return ticks_[op]; }
+
+ private:
+  int64_t ticks_[kMaxOps];
+  int op_ = 0;
+  int32_t start_ = 0;
+};
+
+int64_t ElementCount(const Model* model, int tensor_index) {
+  const Tensor* tensor =
+      model->subgraphs()->Get(0)->tensors()->Get(tensor_index);
+  int64_t count = 1;
+  for (unsigned int i = 0; i < tensor->shape()->size(); ++i) {
+    count *= tensor->shape()->Get(i);
+  }
+  return count;
+}
+
+// Multiply-accumulates of one invocation of the node, batch size 1.
+int64_t CountMacs(const Model* model, const NodeAndRegistration& op) {
+  const TfLiteIntArray* inputs = op.node.inputs;
+  switch (op.registration->builtin_code) {
+    case BuiltinOperator_FULLY_CONNECTED:
+      return ElementCount(model, inputs->data[1]);
+    case BuiltinOperator_SVDF:
+      // feature filter over the input, time filter over the memory
+      return ElementCount(model, inputs->data[1]) +
+             ElementCount(model, inputs->data[2]);
+    default:
+      return 0;
+  }
+}
+
+}  // namespace
+
+TfLiteStatus RunKeywordBenchmark(ErrorReporter* error_reporter, int cpu_mhz,
+                                 int invocations) {
+  alignas(16) static uint8_t tensor_arena[kKeywordArenaSize];
+  const Model* model = GetModel(g_keyword_scrambled_model_data);
+
+  MicroMutableOpResolver<5> resolver;
+  resolver.AddDequantize();
+  resolver.AddFullyConnected();
+  resolver.AddQuantize();
+  resolver.AddSoftmax();
+  resolver.AddSvdf();
+
+  OpTickProfiler profiler;
+  MicroInterpreter interpreter(model, resolver, tensor_arena,
+                               kKeywordArenaSize, error_reporter, &profiler);
+  TF_LITE_ENSURE_STATUS(interpreter.AllocateTensors());
+  if (interpreter.operators_size() > kMaxOps) {
+    TF_LITE_REPORT_ERROR(error_reporter, "Keyword model has %d ops, max %d",
+                         static_cast<int>(interpreter.operators_size()),
+                         kMaxOps);
+    return kTfLiteError;
+  }
+
+  // The model is scrambled, any input exercises the same code paths.
+  TfLiteTensor* input = interpreter.input(0);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < input->bytes; ++i) {
+    seed = seed * 1103515245 + 12345;
+    input->data.uint8[i] = static_cast<uint8_t>(seed >> 16);
+  }
+
+  // Warm up the caches before timing anything.
+  TF_LITE_ENSURE_STATUS(interpreter.Invoke());
+  profiler = OpTickProfiler();
+  const int32_t start = GetCurrentTimeTicks();
+  for (int i = 0; i < invocations; ++i) {
+    TF_LITE_ENSURE_STATUS(interpreter.Invoke());
+  }
+  const int32_t total_ticks = TicksBetween(start, GetCurrentTimeTicks());
+
+  int64_t total_macs = 0;
+  for (size_t i = 0; i < interpreter.operators_size(); ++i) {
+    const NodeAndRegistration op = interpreter.node_and_registration(i);
+    const int64_t macs = CountMacs(model, op);
+    total_macs += macs;
+    char name[48];
+    MicroSnprintf(name, sizeof(name), "op %d %s", static_cast<int>(i),
+                  EnumNameBuiltinOperator(static_cast<BuiltinOperator>(
+                      op.registration->builtin_code)));
+    ReportBenchmark(error_reporter, name, profiler.ticks(i), invocations,
+                    cpu_mhz, macs, 0);
+  }
+  ReportBenchmark(error_reporter, "keyword model", total_ticks, invocations,
+                  cpu_mhz, total_macs, interpreter.arena_used_bytes());
+  return kTfLiteOk;
+}
+
+}  // namespace tflite
@@ -0,0 +1,48 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/micro/benchmarks/micro_benchmark.h"
+
+#include "tensorflow/lite/micro/micro_string.h"
+#include "tensorflow/lite/micro/micro_time.h"
+
+namespace tflite {
+
+void ReportBenchmark(ErrorReporter* error_reporter, const char* name,
+                     int64_t total_ticks, int invocations, int cpu_mhz,
+                     int64_t macs, size_t arena_bytes) {
+  const int64_t cycles = total_ticks * cpu_mhz * 1000000 /
+                         (static_cast<int64_t>(ticks_per_second()) *
+                          invocations);
+  char line[128];
+  // MicroSnprintf counts the terminator in what it returns.
+  int length = MicroSnprintf(line, sizeof(line), "%s: %d cycles/op", name,
+                             static_cast<int>(cycles)) - 1;
+  if (macs > 0 && cycles > 0) {
+    // No precision in MicroSnprintf, so print hundredths by hand.
+    const int macs_per_100_cycles = static_cast<int>(macs * 100 / cycles);
+    length += MicroSnprintf(line + length, sizeof(line) - length,
+                            ", %d.%d%d MACs/cycle", macs_per_100_cycles / 100,
+                            macs_per_100_cycles / 10 % 10,
+                            macs_per_100_cycles % 10) - 1;
+  }
+  if (arena_bytes > 0) {
+    MicroSnprintf(line + length, sizeof(line) - length, ", %d arena bytes",
+                  static_cast<int>(arena_bytes));
+  }
+  TF_LITE_REPORT_ERROR(error_reporter, "%s", line);
+}
+
+}  // namespace tflite
@@ -0,0 +1,65 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_MICRO_BENCHMARKS_MICRO_BENCHMARK_H_
+#define TENSORFLOW_LITE_MICRO_BENCHMARKS_MICRO_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/core/api/error_reporter.h"
+
+namespace tflite {
+
+// Micro-benchmarks to measure kernel optimizations in isolation. They are
+// compiled into the component (and dropped by the linker unless called), so
+// the same code runs on the ESP32 and on the host, see
+// tools/kernel_benchmark/kernel_benchmark.cc. Every line reports:
+//
+//   cycles/op   average over `invocations`, the micro_time ticks scaled to
+//               cycles of a cpu_mhz clock
+//   MACs/cycle  multiply-accumulates per cycle, for the ops that do any
+//   arena       bytes of tensor arena the op needs
+//
+// Results go to the error reporter, which is how TF Micro logs on the device.
+
+// Runs the bundled keyword benchmark model (keyword_scrambled_model_data.cc)
+// end to end and reports every layer and the whole invocation.
+TfLiteStatus RunKeywordBenchmark(ErrorReporter* error_reporter, int cpu_mhz,
+                                 int invocations);
+
+// Runs each kernel the wake word NeuralNetwork registers through KernelRunner
+// on the layer shapes of our model, one kernel at a time. The elementwise,
+// pooling and depthwise layers that have int8 fast paths are checked bit for
+// bit against the reference kernels and fail the benchmark if they differ.
+TfLiteStatus RunKernelBenchmarks(ErrorReporter* error_reporter, int cpu_mhz,
+                                 int invocations);
+
+// Ticks between two GetCurrentTimeTicks() readings, safe across the wrap.
+inline int32_t TicksBetween(int32_t start, int32_t end) {
+  return static_cast<int32_t>(static_cast<uint32_t>(end) -
+                              static_cast<uint32_t>(start));
+}
+
+// Logs one line of results. `macs` is per invocation; the MACs/cycle and arena
+// columns are left out when `macs` or `arena_bytes` is 0.
+void ReportBenchmark(ErrorReporter* error_reporter, const char* name,
+                     int64_t total_ticks, int invocations, int cpu_mhz,
+                     int64_t macs, size_t arena_bytes);
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_BENCHMARKS_MICRO_BENCHMARK_H_
@@ -0,0 +1,55 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/micro/kernels/activation_lut.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+
+namespace tflite {
+namespace micro {
+
+TfLiteStatus PopulateInt8Lut(TfLiteContext* context,
+                             const TfLiteTensor* input,
+                             const TfLiteTensor* output,
+                             double (*transform)(double), int8_t** lut) {
+  TF_LITE_ENSURE_TYPES_EQ(context, input->type, kTfLiteInt8);
+  TF_LITE_ENSURE_TYPES_EQ(context, output->type, kTfLiteInt8);
+  TFLITE_DCHECK(context->AllocatePersistentBuffer != nullptr);
+  *lut = static_cast<int8_t*>(
+      context->AllocatePersistentBuffer(context, kInt8LutSize));
+  TF_LITE_ENSURE(context, *lut != nullptr);
+
+  const double input_scale = input->params.scale;
+  const double output_scale = output->params.scale;
+  for (int value = std::numeric_limits<int8_t>::min();
+       value <= std::numeric_limits<int8_t>::max(); ++value) {
+    const double real = input_scale * (value - input->params.zero_point);
+    const double quantized = std::round(transform(real) / output_scale) +
+                             output->params.zero_point;
+    const double clamped =
+        std::min(std::max(quantized, -128.0), 127.0);
+    (*lut)[static_cast<uint8_t>(value)] = static_cast<int8_t>(clamped);
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace micro
+}  // namespace tflite
@@ -0,0 +1,103 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_MICRO_KERNELS_ACTIVATION_LUT_H_
+#define TENSORFLOW_LITE_MICRO_KERNELS_ACTIVATION_LUT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "tensorflow/lite/c/common.h"
+
+namespace tflite {
+namespace micro {
+
+// Fast logistic and tanh used by the LOGISTIC and TANH kernels.
+//
+// int8: every one of the 256 possible inputs is mapped through the exact
+// function and requantized once in Prepare, Eval is a single table lookup per
+// element. Entries are correctly rounded, i.e. at most 0.5 LSB from the exact
+// result.
+//
+// float: exp is evaluated with a polynomial instead of calling into libm. The
+// bounds below hold for all inputs and are checked against double precision
+// by tools/activation_benchmark.
+constexpr float kFastLogisticMaxError = 3.0e-7f;
+constexpr float kFastTanhMaxError = 3.0e-7f;
+
+constexpr int kInt8LutSize = 256;
+
+// exp(x) for x in [-87, 88], larger inputs are clamped to that range. The
+// relative error is below 3.0e-7.
+inline float FastExp(float x) {
+  x = std::min(std::max(x, -87.0f), 88.0f);
+  // exp(x) = 2^n * e^y with n = round(x / ln(2)) and |y| <= ln(2) / 2. Adding
+  // 1.5 * 2^23 rounds to an integer and leaves n in the low mantissa bits, so
+  // there are no branches or float to int conversions and the kernel loops can
+  // be vectorized.
+  constexpr float kShifter = 12582912.0f;
+  const float shifted = x * 1.44269504f + kShifter;  // log2(e)
+  const float n = shifted - kShifter;
+  // ln(2) split in two (Cody-Waite) so that y stays exact for large n.
+  const float y = (x - n * 0.693145752f) - n * 1.42860677e-6f;
+  // e^y, Taylor series to degree 6. The truncation error is below 1.2e-7
+  // relative, i.e. float rounding.
+  const float p =
+      1.0f +
+      y * (1.0f +
+           y * (0.5f +
+                y * (1.0f / 6.0f +
+                     y * (1.0f / 24.0f +
+                          y * (1.0f / 120.0f + y * (1.0f / 720.0f))))));
+  // 2^n built directly in the exponent field, n is in [-125, 127] here.
+  int32_t bits;
+  std::memcpy(&bits, &shifted, sizeof(bits));
+  bits = (bits - 0x4B400000 + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+inline float FastLogistic(float x) { return 1.0f / (1.0f + FastExp(-x)); }
+
+// tanh(x) = 1 - 2 / (exp(2x) + 1), which keeps the absolute error small around
+// 0. Saturates to +-1 where tanh rounds to it in float anyway.
+inline float FastTanh(float x) {
+  if (x > 9.0f) return 1.0f;
+  if (x < -9.0f) return -1.0f;
+  return 1.0f - 2.0f / (FastExp(2.0f * x) + 1.0f);
+}
+
+// Allocates a table from the persistent arena and fills it with
+// transform(input) requantized to the output tensor's parameters, for every
+// int8 input value. Must be called from Prepare.
+TfLiteStatus PopulateInt8Lut(TfLiteContext* context,
+                             const TfLiteTensor* input,
+                             const TfLiteTensor* output,
+                             double (*transform)(double), int8_t** lut);
+
+// Maps size int8 elements through a table from PopulateInt8Lut().
+inline void LookupInt8(const int8_t* lut, int size, const int8_t* input,
+                       int8_t* output) {
+  for (int i = 0; i < size; ++i) {
+    output[i] = lut[static_cast<uint8_t>(input[i])];
+  }
+}
+
+}  // namespace micro
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_KERNELS_ACTIVATION_LUT_H_
@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/lite/kernels/internal/reference/add.h"
 
+#include <algorithm>
+
 #include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
@@ -24,6 +26,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/op_macros.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/kernels/requantize.h"
 #include "tensorflow/lite/micro/memory_helpers.h"
 
 namespace tflite {
@@ -35,8 +38,21 @@ constexpr int kInputTensor1 = 0;
 constexpr int kInputTensor2 = 1;
 constexpr int kOutputTensor = 0;
 
+// The int8 kernel picked in Prepare. The same shape and per channel broadcast
+// cases loop over the data directly, kInt8Block elements at a time; the rest
+// goes through the reference broadcast with its Offset() index math for every
+// element. The per channel broadcast is used for up to kInt8Block channels.
+constexpr int kInt8Block = 64;
+
+enum class Int8Kernel {
+  kReference,
+  kSameShape,
+  kChannelBroadcast,
+};
+
 struct OpData {
   bool requires_broadcast;
+  Int8Kernel int8_kernel;
 
   // These fields are used in both the general 8-bit -> 8bit quantized path,
   // and the special 16-bit -> 16bit quantized path
@@ -65,6 +81,16 @@ TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteAddParams* params,
                              const TfLiteTensor* input2, TfLiteTensor* output,
                              OpData* data) {
   data->requires_broadcast = !HaveSameShapes(input1, input2);
+  data->int8_kernel = Int8Kernel::kReference;
+  if (output->type == kTfLiteInt8) {
+    if (!data->requires_broadcast) {
+      data->int8_kernel = Int8Kernel::kSameShape;
+    } else if (tflite::micro::IsChannelBroadcast(input1, input2) &&
+               SizeOfDimension(input1, NumDimensions(input1) - 1) <=
+                   kInt8Block) {
+      data->int8_kernel = Int8Kernel::kChannelBroadcast;
+    }
+  }
 
   if (output->type == kTfLiteUInt8 || output->type == kTfLiteInt8) {
     // 8bit -> 8bit general quantized path, with general rescalings
@@ -104,6 +130,88 @@ TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteAddParams* params,
   return kTfLiteOk;
 }
 
+// Scales one input of the int8 add to the common scale of the two.
+inline int32_t ScaleInputInt8(const OpData* data, int8_t value, int32_t offset,
+                              int32_t multiplier, int shift) {
+  return MultiplyByQuantizedMultiplierSmallerThanOneExp(
+      (offset + value) * (1 << data->left_shift), multiplier, shift);
+}
+
+inline void RequantizeSumsInt8(const OpData* data, const int32_t* raw_sums,
+                               int size, int8_t* output_data) {
+  tflite::micro::RequantizeInt8(
+      raw_sums, size, data->output_multiplier, data->output_shift,
+      data->output_offset, data->output_activation_min,
+      data->output_activation_max, output_data);
+}
+
+// Same as reference_integer_ops::Add, but the output stage of a block of
+// elements is done together with RequantizeInt8. The output shift from
+// QuantizeMultiplierSmallerThanOneExp is never positive, where
+// MultiplyByQuantizedMultiplier and the SmallerThanOneExp variant agree.
+void AddInt8(const OpData* data, int size, const int8_t* input1_data,
+             const int8_t* input2_data, int8_t* output_data) {
+  int32_t raw_sums[kInt8Block];
+  for (int i0 = 0; i0 < size; i0 += kInt8Block) {
+    const int block = std::min(kInt8Block, size - i0);
+    for (int i = 0; i < block; ++i) {
+      raw_sums[i] =
+          ScaleInputInt8(data, input1_data[i0 + i], data->input1_offset,
+                         data->input1_multiplier, data->input1_shift) +
+          ScaleInputInt8(data, input2_data[i0 + i], data->input2_offset,
+                         data->input2_multiplier, data->input2_shift);
+    }
+    RequantizeSumsInt8(data, raw_sums, block, output_data + i0);
+  }
+}
+
+// AddInt8 with input2 holding one value per channel. Those are scaled once
+// instead of for every pixel.
+void AddInt8ChannelBroadcast(const OpData* data, int size, int channels,
+                             const int8_t* input1_data,
+                             const int8_t* input2_data, int8_t* output_data) {
+  TFLITE_DCHECK_LE(channels, kInt8Block);
+  int32_t scaled_input2[kInt8Block];
+  for (int c = 0; c < channels; ++c) {
+    scaled_input2[c] =
+        ScaleInputInt8(data, input2_data[c], data->input2_offset,
+                       data->input2_multiplier, data->input2_shift);
+  }
+  int32_t raw_sums[kInt8Block];
+  int channel = 0;
+  for (int i0 = 0; i0 < size; i0 += kInt8Block) {
+    const int block = std::min(kInt8Block, size - i0);
+    for (int i = 0; i < block; ++i) {
+      raw_sums[i] =
+          ScaleInputInt8(data, input1_data[i0 + i], data->input1_offset,
+                         data->input1_multiplier, data->input1_shift) +
+          scaled_input2[channel];
+      if (++channel == channels) {
+        channel = 0;
+      }
+    }
+    RequantizeSumsInt8(data, raw_sums, block, output_data + i0);
+  }
+}
+
+// Runs the int8 kernel selected in Prepare, other than the reference one.
+void EvalAddInt8(const OpData* data, const TfLiteEvalTensor* input1,
+                 const TfLiteEvalTensor* input2, TfLiteEvalTensor* output) {
+  const int8_t* input1_data = tflite::micro::GetTensorData<int8_t>(input1);
+  const int8_t* input2_data = tflite::micro::GetTensorData<int8_t>(input2);
+  int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  if (data->int8_kernel == Int8Kernel::kSameShape) {
+    AddInt8(data, output_shape.FlatSize(), input1_data, input2_data,
+            output_data);
+  } else {
+    AddInt8ChannelBroadcast(
+        data, output_shape.FlatSize(),
+        output_shape.Dims(output_shape.DimensionsCount() - 1), input1_data,
+        input2_data, output_data);
+  }
+}
+
 void EvalAdd(TfLiteContext* context, TfLiteNode* node, TfLiteAddParams* params,
              const OpData* data, const TfLiteEvalTensor* input1,
              const TfLiteEvalTensor* input2, TfLiteEvalTensor* output) {
@@ -133,7 +241,9 @@ TfLiteStatus EvalAddQuantized(TfLiteContext* context, TfLiteNode* node,
                               const TfLiteEvalTensor* input1,
                               const TfLiteEvalTensor* input2,
                               TfLiteEvalTensor* output) {
-  if (output->type == kTfLiteUInt8 || output->type == kTfLiteInt8) {
+  if (data->int8_kernel != Int8Kernel::kReference) {
+    EvalAddInt8(data, input1, input2, output);
+  } else if (output->type == kTfLiteUInt8 || output->type == kTfLiteInt8) {
     tflite::ArithmeticParams op_params;
     op_params.left_shift = data->left_shift;
     op_params.input1_offset = data->input1_offset;
@@ -160,13 +270,13 @@ TfLiteStatus EvalAddQuantized(TfLiteContext* context, TfLiteNode* node,
             tflite::micro::GetTensorShape(output),
             tflite::micro::GetTensorData<int8_t>(output));
       } else {
-        reference_integer_ops::Add(
-            op_params, tflite::micro::GetTensorShape(input1),
-            tflite::micro::GetTensorData<int8_t>(input1),
-            tflite::micro::GetTensorShape(input2),
-            tflite::micro::GetTensorData<int8_t>(input2),
-            tflite::micro::GetTensorShape(output),
-            tflite::micro::GetTensorData<int8_t>(output));
+        AddInt8(data,
+                MatchingElementsSize(tflite::micro::GetTensorShape(input1),
+                                     tflite::micro::GetTensorShape(input2),
+                                     tflite::micro::GetTensorShape(output)),
+                tflite::micro::GetTensorData<int8_t>(input1),
+                tflite::micro::GetTensorData<int8_t>(input2),
+                tflite::micro::GetTensorData<int8_t>(output));
       }
     } else {
       if (need_broadcast) {
@@ -19,11 +19,15 @@ limitations under the License.
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/kernels/internal/common.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
-#include "tensorflow/lite/kernels/internal/reference/integer_ops/conv.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/padding.h"
+#include "tensorflow/lite/micro/kernels/conv_int8.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+#include "tensorflow/lite/micro/kernels/streaming_rows.h"
+#endif
+#include "tensorflow/lite/micro/micro_thread_pool.h"
 
 namespace tflite {
 namespace ops {
@@ -62,6 +66,12 @@ struct OpData {
   // uint8_t these would be 0 and 255.
   int32_t output_activation_min;
   int32_t output_activation_max;
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  // Only set for the streaming registration, see streaming_rows.h.
+  bool streaming;
+  tflite::micro::StreamingRowCache* row_cache;
+#endif
 };
 
 inline PaddingType RuntimePaddingType(TfLitePadding padding) {
@@ -119,9 +129,28 @@ TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteNode* node,
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   TFLITE_DCHECK(context->AllocatePersistentBuffer != nullptr);
-  return context->AllocatePersistentBuffer(context, sizeof(OpData));
+  void* raw = context->AllocatePersistentBuffer(context, sizeof(OpData));
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (raw != nullptr) {
+    OpData* data = static_cast<OpData*>(raw);
+    data->streaming = false;
+    data->row_cache = nullptr;
+  }
+#endif
+  return raw;
 }
 
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+void* InitStreaming(TfLiteContext* context, const char* buffer,
+                    size_t length) {
+  void* raw = Init(context, buffer, length);
+  if (raw != nullptr) {
+    static_cast<OpData*>(raw)->streaming = true;
+  }
+  return raw;
+}
+#endif
+
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TFLITE_DCHECK(node->user_data != nullptr);
   TFLITE_DCHECK(node->builtin_data != nullptr);
@@ -179,6 +208,16 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   data->filter_zero_point = filter->params.zero_point;
   data->output_zero_point = output->params.zero_point;
 
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (data->streaming &&
+      (input->type == kTfLiteInt8 || input->type == kTfLiteFloat32)) {
+    TF_LITE_ENSURE_STATUS(tflite::micro::AllocateStreamingRowCache(
+        context, input, output, params->stride_height,
+        (filter_height - 1) * params->dilation_height_factor + 1,
+        data->padding.height, &data->row_cache));
+  }
+#endif
+
   return kTfLiteOk;
 }  // namespace conv
 
@@ -226,7 +265,15 @@ void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
                              const TfLiteEvalTensor* filter,
                              const TfLiteEvalTensor* bias,
                              TfLiteEvalTensor* output,
-                             TfLiteEvalTensor* im2col) {
+                             TfLiteEvalTensor* im2col, int output_row_begin,
+                             int output_row_end) {
+  // Only output rows [output_row_begin, output_row_end) are computed. The
+  // kernel is handed a shorter output that starts at output_row_begin, with
+  // the padding moved up to match.
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_row_size = output_shape.FlatSize() / output_shape.Dims(1);
+  output_shape.SetDim(1, output_row_end - output_row_begin);
+
   // TODO(b/154032858): Investigate removing extra copies.
   ConvParams op_params;
   op_params.input_offset = -data.input_zero_point;
@@ -235,36 +282,44 @@ void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
   op_params.stride_width = params->stride_width;
   op_params.dilation_height_factor = params->dilation_height_factor;
   op_params.dilation_width_factor = params->dilation_width_factor;
-  op_params.padding_values.height = data.padding.height;
+  op_params.padding_values.height =
+      data.padding.height - output_row_begin * params->stride_height;
   op_params.padding_values.width = data.padding.width;
   op_params.quantized_activation_min = data.output_activation_min;
   op_params.quantized_activation_max = data.output_activation_max;
 
-  reference_integer_ops::ConvPerChannel(
+  tflite::micro::ConvPerChannelInt8(
       op_params, data.per_channel_output_multiplier,
       data.per_channel_output_shift, tflite::micro::GetTensorShape(input),
       tflite::micro::GetTensorData<int8_t>(input),
       tflite::micro::GetTensorShape(filter),
       tflite::micro::GetTensorData<int8_t>(filter),
       tflite::micro::GetTensorShape(bias),
-      tflite::micro::GetTensorData<int32_t>(bias),
-      tflite::micro::GetTensorShape(output),
-      tflite::micro::GetTensorData<int8_t>(output));
+      tflite::micro::GetTensorData<int32_t>(bias), output_shape,
+      tflite::micro::GetTensorData<int8_t>(output) +
+          output_row_begin * output_row_size);
 }
 
 void EvalFloat(TfLiteContext* context, TfLiteNode* node,
                TfLiteConvParams* params, const OpData& data,
                const TfLiteEvalTensor* input, const TfLiteEvalTensor* filter,
                const TfLiteEvalTensor* bias, TfLiteEvalTensor* im2col,
-               TfLiteEvalTensor* hwcn_weights, TfLiteEvalTensor* output) {
+               TfLiteEvalTensor* hwcn_weights, TfLiteEvalTensor* output,
+               int output_row_begin, int output_row_end) {
   float output_activation_min, output_activation_max;
   CalculateActivationRange(params->activation, &output_activation_min,
                            &output_activation_max);
+  // See EvalQuantizedPerChannel for how the row range is selected.
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_row_size = output_shape.FlatSize() / output_shape.Dims(1);
+  output_shape.SetDim(1, output_row_end - output_row_begin);
+
   // TODO(b/154032858): Investigate removing extra copies.
   ConvParams op_params;
   op_params.padding_type = RuntimePaddingType(params->padding);
   op_params.padding_values.width = data.padding.width;
-  op_params.padding_values.height = data.padding.height;
+  op_params.padding_values.height =
+      data.padding.height - output_row_begin * params->stride_height;
   op_params.stride_width = params->stride_width;
   op_params.stride_height = params->stride_height;
   op_params.dilation_width_factor = params->dilation_width_factor;
@@ -277,9 +332,9 @@ void EvalFloat(TfLiteContext* context, TfLiteNode* node,
                       tflite::micro::GetTensorShape(filter),
                       tflite::micro::GetTensorData<float>(filter),
                       tflite::micro::GetTensorShape(bias),
-                      tflite::micro::GetTensorData<float>(bias),
-                      tflite::micro::GetTensorShape(output),
-                      tflite::micro::GetTensorData<float>(output),
+                      tflite::micro::GetTensorData<float>(bias), output_shape,
+                      tflite::micro::GetTensorData<float>(output) +
+                          output_row_begin * output_row_size,
                       tflite::micro::GetTensorShape(im2col),
                       tflite::micro::GetTensorData<float>(im2col));
 }
@@ -301,14 +356,52 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   TFLITE_DCHECK(node->user_data != nullptr);
   const OpData& data = *(static_cast<const OpData*>(node->user_data));
 
+  // When streaming, rows that are unchanged since the last invocation are
+  // copied from the cache and only the rest of the output is computed.
+  const int output_rows = output->dims->data[1];
+  int reused_begin = 0;
+  int reused_end = 0;
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (data.row_cache != nullptr) {
+    tflite::micro::ReuseStreamingRows(
+        data.row_cache, tflite::micro::GetTensorData<uint8_t>(input),
+        tflite::micro::GetTensorData<uint8_t>(output), &reused_begin,
+        &reused_end);
+  }
+#endif
+
+  // Output rows are independent, so each range that has to be computed is
+  // split across the thread pool. Only a single batch can be split by rows.
+  const int max_workers =
+      output->dims->data[0] == 1 ? GetMicroThreadCount(context) : 1;
+  auto eval_float = [&](int worker, int row_begin, int row_end) {
+    EvalFloat(context, node, params, data, input, filter, bias, nullptr,
+              nullptr, output, row_begin, row_end);
+  };
+  auto eval_per_channel = [&](int worker, int row_begin, int row_end) {
+    EvalQuantizedPerChannel(context, node, params, data, input, filter, bias,
+                            output, nullptr, row_begin, row_end);
+  };
+
   switch (input->type) {  // Already know in/out types are same.
     case kTfLiteFloat32:
-      EvalFloat(context, node, params, data, input, filter, bias, nullptr,
-                nullptr, output);
+      if (reused_begin > 0) {
+        ParallelFor(context, 0, reused_begin, eval_float, max_workers);
+      }
+      if (reused_end < output_rows) {
+        ParallelFor(context, reused_end, output_rows, eval_float,
+                    max_workers);
+      }
       break;
     case kTfLiteInt8:
-      EvalQuantizedPerChannel(context, node, params, data, input, filter, bias,
-                              output, nullptr);
+      if (reused_begin > 0) {
+        ParallelFor(context, 0, reused_begin, eval_per_channel,
+                    max_workers);
+      }
+      if (reused_end < output_rows) {
+        ParallelFor(context, reused_end, output_rows, eval_per_channel,
+                    max_workers);
+      }
       break;
     case kTfLiteUInt8:
       EvalQuantized(context, node, params, data, input, filter, bias, nullptr,
@@ -319,6 +412,14 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
                          TfLiteTypeGetName(input->type), input->type);
       return kTfLiteError;
   }
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (data.row_cache != nullptr) {
+    tflite::micro::UpdateStreamingRowCache(
+        data.row_cache, tflite::micro::GetTensorData<uint8_t>(input),
+        tflite::micro::GetTensorData<uint8_t>(output));
+  }
+#endif
   return kTfLiteOk;
 }
 
@@ -335,6 +436,19 @@ TfLiteRegistration Register_CONV_2D() {
           /*version=*/0};
 }
 
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+TfLiteRegistration Register_CONV_2D_STREAMING() {
+  return {/*init=*/conv::InitStreaming,
+          /*free=*/nullptr,
+          /*prepare=*/conv::Prepare,
+          /*invoke=*/conv::Eval,
+          /*profiling_string=*/nullptr,
+          /*builtin_code=*/0,
+          /*custom_name=*/nullptr,
+          /*version=*/0};
+}
+#endif
+
 }  // namespace micro
 }  // namespace ops
 }  // namespace tflite
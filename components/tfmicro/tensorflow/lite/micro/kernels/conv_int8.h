@@ -0,0 +1,123 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_MICRO_KERNELS_CONV_INT8_H_
+#define TENSORFLOW_LITE_MICRO_KERNELS_CONV_INT8_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/types.h"
+#include "tensorflow/lite/micro/kernels/requantize.h"
+
+namespace tflite {
+namespace micro {
+
+// Same as reference_integer_ops::ConvPerChannel, and bit exact with it, but
+// the accumulators of a block of output channels are collected for each output
+// pixel and requantized together with RequantizeInt8PerChannel. Used by
+// CONV_2D and CONV_2D_MAX_POOL_2D.
+inline void ConvPerChannelInt8(
+    const ConvParams& params, const int32_t* output_multiplier,
+    const int32_t* output_shift, const RuntimeShape& input_shape,
+    const int8_t* input_data, const RuntimeShape& filter_shape,
+    const int8_t* filter_data, const RuntimeShape& bias_shape,
+    const int32_t* bias_data, const RuntimeShape& output_shape,
+    int8_t* output_data) {
+  constexpr int kChannelBlock = 32;
+  const int32_t input_offset = params.input_offset;
+  const int stride_width = params.stride_width;
+  const int stride_height = params.stride_height;
+  const int dilation_width_factor = params.dilation_width_factor;
+  const int dilation_height_factor = params.dilation_height_factor;
+  const int pad_width = params.padding_values.width;
+  const int pad_height = params.padding_values.height;
+
+  TFLITE_DCHECK_LE(params.quantized_activation_min,
+                   params.quantized_activation_max);
+  TFLITE_DCHECK_EQ(input_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(filter_shape.DimensionsCount(), 4);
+  TFLITE_DCHECK_EQ(output_shape.DimensionsCount(), 4);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int input_depth = MatchingDim(input_shape, 3, filter_shape, 3);
+  const int output_depth = MatchingDim(filter_shape, 0, output_shape, 3);
+  if (bias_data) {
+    TFLITE_DCHECK_EQ(bias_shape.FlatSize(), output_depth);
+  }
+
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int filter_height = filter_shape.Dims(1);
+  const int filter_width = filter_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int filter_channel_size = filter_height * filter_width * input_depth;
+
+  int32_t acc[kChannelBlock];
+  for (int batch = 0; batch < batches; ++batch) {
+    const int8_t* input_batch =
+        input_data + batch * input_height * input_width * input_depth;
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      const int in_y_origin = (out_y * stride_height) - pad_height;
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        const int in_x_origin = (out_x * stride_width) - pad_width;
+        int8_t* output_pixel =
+            output_data +
+            ((batch * output_height + out_y) * output_width + out_x) *
+                output_depth;
+        for (int c0 = 0; c0 < output_depth; c0 += kChannelBlock) {
+          const int block = std::min(kChannelBlock, output_depth - c0);
+          for (int c = 0; c < block; ++c) {
+            const int8_t* filter_channel =
+                filter_data + (c0 + c) * filter_channel_size;
+            int32_t sum = 0;
+            for (int filter_y = 0; filter_y < filter_height; ++filter_y) {
+              const int in_y = in_y_origin + dilation_height_factor * filter_y;
+              if (in_y < 0 || in_y >= input_height) {
+                continue;
+              }
+              for (int filter_x = 0; filter_x < filter_width; ++filter_x) {
+                const int in_x = in_x_origin + dilation_width_factor * filter_x;
+                if (in_x < 0 || in_x >= input_width) {
+                  continue;
+                }
+                const int8_t* in =
+                    input_batch + (in_y * input_width + in_x) * input_depth;
+                const int8_t* f =
+                    filter_channel +
+                    (filter_y * filter_width + filter_x) * input_depth;
+                for (int in_channel = 0; in_channel < input_depth;
+                     ++in_channel) {
+                  sum += f[in_channel] * (in[in_channel] + input_offset);
+                }
+              }
+            }
+            acc[c] = bias_data ? sum + bias_data[c0 + c] : sum;
+          }
+          RequantizeInt8PerChannel(acc, block, output_multiplier + c0,
+                                   output_shift + c0, params.output_offset,
+                                   params.quantized_activation_min,
+                                   params.quantized_activation_max,
+                                   output_pixel + c0);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace micro
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_KERNELS_CONV_INT8_H_
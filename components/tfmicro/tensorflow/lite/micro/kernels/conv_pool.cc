@@ -0,0 +1,383 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// CONV_2D followed by MAX_POOL_2D as a single kernel. Nodes are set up by
+// FuseOperators() in micro_op_fusion.h when the model is loaded.
+//
+// Instead of writing the whole conv output to the arena and reading it back in
+// the pool, the conv rows under one row of pooling windows are computed into a
+// small scratch tile and pooled straight away. Max pooling commutes with the
+// requantization and the activation clamp (both are monotonic), so the result
+// is bit exact with running the two ops separately.
+//
+// With a MicroThreadPool the output rows are split across the workers, each
+// with a tile of its own.
+
+#include <algorithm>
+#include <limits>
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/kernels/internal/reference/conv.h"
+#include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+#include "tensorflow/lite/kernels/padding.h"
+#include "tensorflow/lite/micro/kernels/conv_int8.h"
+#include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
+#include "tensorflow/lite/micro/micro_op_fusion.h"
+#include "tensorflow/lite/micro/micro_thread_pool.h"
+
+namespace tflite {
+namespace ops {
+namespace micro {
+namespace conv_pool {
+
+constexpr int kInputTensor = 0;
+constexpr int kFilterTensor = 1;
+constexpr int kBiasTensor = 2;
+constexpr int kOutputTensor = 0;
+
+// Conv is quantized along dimension 0:
+// https://www.tensorflow.org/lite/performance/quantization_spec
+constexpr int kConvQuantizedDimension = 0;
+
+// Every worker needs a tile scratch buffer and an op can only request
+// internal::kMaxScratchBuffersPerOp of them.
+constexpr int kMaxWorkers = 4;
+
+struct OpData {
+  TfLitePaddingValues conv_padding;
+  TfLitePaddingValues pool_padding;
+
+  // Size of the (never materialized) conv output.
+  int conv_height;
+  int conv_width;
+
+  int32_t input_zero_point;
+  int32_t output_zero_point;
+
+  // Per channel output multiplier and shift.
+  int32_t* per_channel_output_multiplier;
+  int32_t* per_channel_output_shift;
+
+  // Both fused activations combined into one range.
+  int32_t output_activation_min;
+  int32_t output_activation_max;
+  float float_activation_min;
+  float float_activation_max;
+
+  // Each holds the conv rows under one row of pooling windows, one per
+  // worker.
+  int tile_buffer_indices[kMaxWorkers];
+  int tile_count;
+};
+
+void* Init(TfLiteContext* context, const char* buffer, size_t length) {
+  TFLITE_DCHECK(context->AllocatePersistentBuffer != nullptr);
+  return context->AllocatePersistentBuffer(context, sizeof(OpData));
+}
+
+TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
+  TFLITE_DCHECK(node->user_data != nullptr);
+  TFLITE_DCHECK(node->builtin_data != nullptr);
+
+  OpData* data = static_cast<OpData*>(node->user_data);
+  const auto* params =
+      static_cast<const TfLiteConv2DMaxPool2DParams*>(node->builtin_data);
+
+  const TfLiteTensor* input = GetInput(context, node, kInputTensor);
+  TF_LITE_ENSURE(context, input != nullptr);
+  const TfLiteTensor* filter = GetInput(context, node, kFilterTensor);
+  TF_LITE_ENSURE(context, filter != nullptr);
+  const TfLiteTensor* bias = GetOptionalInputTensor(context, node, kBiasTensor);
+  TfLiteTensor* output = GetOutput(context, node, kOutputTensor);
+  TF_LITE_ENSURE(context, output != nullptr);
+  TF_LITE_ENSURE_EQ(context, input->type, output->type);
+  TF_LITE_ENSURE_EQ(context, input->dims->data[0], 1);
+
+  data->conv_padding = ComputePaddingHeightWidth(
+      params->conv.stride_height, params->conv.stride_width,
+      params->conv.dilation_height_factor, params->conv.dilation_width_factor,
+      input->dims->data[1], input->dims->data[2], filter->dims->data[1],
+      filter->dims->data[2], params->conv.padding, &data->conv_height,
+      &data->conv_width);
+
+  int output_height, output_width;
+  data->pool_padding = ComputePaddingHeightWidth(
+      params->pool.stride_height, params->pool.stride_width,
+      /*dilation_rate_height=*/1,
+      /*dilation_rate_width=*/1, data->conv_height, data->conv_width,
+      params->pool.filter_height, params->pool.filter_width,
+      params->pool.padding, &output_height, &output_width);
+  TF_LITE_ENSURE_EQ(context, output->dims->data[1], output_height);
+  TF_LITE_ENSURE_EQ(context, output->dims->data[2], output_width);
+
+  const int channels = filter->dims->data[kConvQuantizedDimension];
+  TF_LITE_ENSURE_EQ(context, output->dims->data[3], channels);
+
+  if (input->type == kTfLiteInt8) {
+    TF_LITE_ENSURE_EQ(context, filter->quantization.type,
+                      kTfLiteAffineQuantization);
+    const auto* affine_quantization =
+        static_cast<TfLiteAffineQuantization*>(filter->quantization.params);
+    TF_LITE_ENSURE(context, affine_quantization);
+    TF_LITE_ENSURE(context, affine_quantization->scale);
+    TF_LITE_ENSURE(context, affine_quantization->zero_point);
+    TF_LITE_ENSURE(context, affine_quantization->scale->size == 1 ||
+                                affine_quantization->scale->size == channels);
+
+    data->per_channel_output_multiplier =
+        static_cast<int32_t*>(context->AllocatePersistentBuffer(
+            context, channels * sizeof(int32_t)));
+    data->per_channel_output_shift =
+        static_cast<int32_t*>(context->AllocatePersistentBuffer(
+            context, channels * sizeof(int32_t)));
+    TF_LITE_ENSURE(context, data->per_channel_output_multiplier != nullptr);
+    TF_LITE_ENSURE(context, data->per_channel_output_shift != nullptr);
+
+    // Max pooling does not requantize, so the pool output has the
+    // quantization of the conv output and the conv can requantize to it.
+    int32_t output_multiplier;
+    int output_shift;
+    TF_LITE_ENSURE_STATUS(tflite::PopulateConvolutionQuantizationParams(
+        context, input, filter, bias, output, params->conv.activation,
+        &output_multiplier, &output_shift, &data->output_activation_min,
+        &data->output_activation_max, data->per_channel_output_multiplier,
+        reinterpret_cast<int*>(data->per_channel_output_shift), channels));
+
+    int32_t pool_activation_min, pool_activation_max;
+    TF_LITE_ENSURE_STATUS(CalculateActivationRangeQuantized(
+        context, params->pool.activation, output, &pool_activation_min,
+        &pool_activation_max));
+    data->output_activation_min =
+        std::max(data->output_activation_min, pool_activation_min);
+    data->output_activation_max =
+        std::min(data->output_activation_max, pool_activation_max);
+  } else if (input->type == kTfLiteFloat32) {
+    float pool_activation_min, pool_activation_max;
+    CalculateActivationRange(params->conv.activation,
+                             &data->float_activation_min,
+                             &data->float_activation_max);
+    CalculateActivationRange(params->pool.activation, &pool_activation_min,
+                             &pool_activation_max);
+    data->float_activation_min =
+        std::max(data->float_activation_min, pool_activation_min);
+    data->float_activation_max =
+        std::min(data->float_activation_max, pool_activation_max);
+  } else {
+    TF_LITE_KERNEL_LOG(context, "Type %s (%d) not supported.",
+                       TfLiteTypeGetName(input->type), input->type);
+    return kTfLiteError;
+  }
+
+  data->input_zero_point = input->params.zero_point;
+  data->output_zero_point = output->params.zero_point;
+
+  size_t type_size;
+  TF_LITE_ENSURE_STATUS(TfLiteTypeSizeOf(input->type, &type_size));
+  const size_t tile_bytes =
+      params->pool.filter_height * data->conv_width * channels * type_size;
+  data->tile_count = std::min(GetMicroThreadCount(context), kMaxWorkers);
+  for (int i = 0; i < data->tile_count; ++i) {
+    TF_LITE_ENSURE_STATUS(context->RequestScratchBufferInArena(
+        context, tile_bytes, &data->tile_buffer_indices[i]));
+  }
+  return kTfLiteOk;
+}
+
+// Computes conv output rows [row_begin, row_end) into tile. The kernel is
+// handed an output of just those rows with the padding moved up.
+void ConvRows(const TfLiteConv2DMaxPool2DParams& params, const OpData& data,
+              const TfLiteEvalTensor* input, const TfLiteEvalTensor* filter,
+              const TfLiteEvalTensor* bias, int row_begin, int row_end,
+              int8_t* tile) {
+  const int channels = filter->dims->data[kConvQuantizedDimension];
+  const RuntimeShape tile_shape(
+      {1, row_end - row_begin, data.conv_width, channels});
+
+  ConvParams op_params;
+  op_params.input_offset = -data.input_zero_point;
+  op_params.output_offset = data.output_zero_point;
+  op_params.stride_height = params.conv.stride_height;
+  op_params.stride_width = params.conv.stride_width;
+  op_params.dilation_height_factor = params.conv.dilation_height_factor;
+  op_params.dilation_width_factor = params.conv.dilation_width_factor;
+  op_params.padding_values.height =
+      data.conv_padding.height - row_begin * params.conv.stride_height;
+  op_params.padding_values.width = data.conv_padding.width;
+  op_params.quantized_activation_min = data.output_activation_min;
+  op_params.quantized_activation_max = data.output_activation_max;
+
+  tflite::micro::ConvPerChannelInt8(
+      op_params, data.per_channel_output_multiplier,
+      data.per_channel_output_shift, tflite::micro::GetTensorShape(input),
+      tflite::micro::GetTensorData<int8_t>(input),
+      tflite::micro::GetTensorShape(filter),
+      tflite::micro::GetTensorData<int8_t>(filter),
+      tflite::micro::GetTensorShape(bias),
+      tflite::micro::GetTensorData<int32_t>(bias), tile_shape, tile);
+}
+
+void ConvRows(const TfLiteConv2DMaxPool2DParams& params, const OpData& data,
+              const TfLiteEvalTensor* input, const TfLiteEvalTensor* filter,
+              const TfLiteEvalTensor* bias, int row_begin, int row_end,
+              float* tile) {
+  const int channels = filter->dims->data[kConvQuantizedDimension];
+  const RuntimeShape tile_shape(
+      {1, row_end - row_begin, data.conv_width, channels});
+
+  ConvParams op_params;
+  op_params.padding_type = PaddingType::kNone;
+  op_params.padding_values.height =
+      data.conv_padding.height - row_begin * params.conv.stride_height;
+  op_params.padding_values.width = data.conv_padding.width;
+  op_params.stride_height = params.conv.stride_height;
+  op_params.stride_width = params.conv.stride_width;
+  op_params.dilation_height_factor = params.conv.dilation_height_factor;
+  op_params.dilation_width_factor = params.conv.dilation_width_factor;
+  op_params.float_activation_min = data.float_activation_min;
+  op_params.float_activation_max = data.float_activation_max;
+
+  reference_ops::Conv(op_params, tflite::micro::GetTensorShape(input),
+                      tflite::micro::GetTensorData<float>(input),
+                      tflite::micro::GetTensorShape(filter),
+                      tflite::micro::GetTensorData<float>(filter),
+                      tflite::micro::GetTensorShape(bias),
+                      tflite::micro::GetTensorData<float>(bias), tile_shape,
+                      tile, RuntimeShape(), nullptr);
+}
+
+// Pools one output row from the conv rows in tile, which start at conv row
+// tile_row_begin. The activation has already been applied by the conv.
+template <typename T>
+void MaxPoolRow(const TfLiteConv2DMaxPool2DParams& params, const OpData& data,
+                int channels, int output_width, int tile_row_begin,
+                int tile_row_end, const T* tile, T* output_row) {
+  for (int out_x = 0; out_x < output_width; ++out_x) {
+    const int in_x_origin =
+        out_x * params.pool.stride_width - data.pool_padding.width;
+    const int in_x_begin = std::max(0, in_x_origin);
+    const int in_x_end =
+        std::min(data.conv_width, in_x_origin + params.pool.filter_width);
+    for (int channel = 0; channel < channels; ++channel) {
+      T max = std::numeric_limits<T>::lowest();
+      for (int in_y = tile_row_begin; in_y < tile_row_end; ++in_y) {
+        const T* tile_row =
+            tile + (in_y - tile_row_begin) * data.conv_width * channels;
+        for (int in_x = in_x_begin; in_x < in_x_end; ++in_x) {
+          max = std::max(max, tile_row[in_x * channels + channel]);
+        }
+      }
+      output_row[out_x * channels + channel] = max;
+    }
+  }
+}
+
+// Computes output rows [out_y_begin, out_y_end) using tile.
+template <typename T>
+void EvalRows(const TfLiteConv2DMaxPool2DParams& params, const OpData& data,
+              const TfLiteEvalTensor* input, const TfLiteEvalTensor* filter,
+              const TfLiteEvalTensor* bias, TfLiteEvalTensor* output,
+              int out_y_begin, int out_y_end, T* tile) {
+  const int output_width = output->dims->data[2];
+  const int channels = output->dims->data[3];
+  const int output_row_size = output_width * channels;
+
+  for (int out_y = out_y_begin; out_y < out_y_end; ++out_y) {
+    const int in_y_origin =
+        out_y * params.pool.stride_height - data.pool_padding.height;
+    const int row_begin = std::max(0, in_y_origin);
+    const int row_end =
+        std::min(data.conv_height, in_y_origin + params.pool.filter_height);
+    ConvRows(params, data, input, filter, bias, row_begin, row_end, tile);
+    MaxPoolRow(params, data, channels, output_width, row_begin, row_end,
+               static_cast<const T*>(tile),
+               tflite::micro::GetTensorData<T>(output) +
+                   out_y * output_row_size);
+  }
+}
+
+TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
+  TFLITE_DCHECK(node->user_data != nullptr);
+  TFLITE_DCHECK(node->builtin_data != nullptr);
+  const OpData& data = *(static_cast<const OpData*>(node->user_data));
+  const auto& params =
+      *(static_cast<const TfLiteConv2DMaxPool2DParams*>(node->builtin_data));
+
+  const TfLiteEvalTensor* input =
+      tflite::micro::GetEvalInput(context, node, kInputTensor);
+  const TfLiteEvalTensor* filter =
+      tflite::micro::GetEvalInput(context, node, kFilterTensor);
+  const TfLiteEvalTensor* bias =
+      (NumInputs(node) == 3)
+          ? tflite::micro::GetEvalInput(context, node, kBiasTensor)
+          : nullptr;
+  TfLiteEvalTensor* output =
+      tflite::micro::GetEvalOutput(context, node, kOutputTensor);
+
+  void* tiles[kMaxWorkers];
+  for (int i = 0; i < data.tile_count; ++i) {
+    tiles[i] = context->GetScratchBuffer(context, data.tile_buffer_indices[i]);
+    TFLITE_DCHECK(tiles[i] != nullptr);
+  }
+
+  // Output rows are independent, each worker computes a band of them in its
+  // own tile.
+  const int output_height = output->dims->data[1];
+  switch (input->type) {
+    case kTfLiteFloat32:
+      ParallelFor(
+          context, 0, output_height,
+          [&](int worker, int out_y_begin, int out_y_end) {
+            EvalRows(params, data, input, filter, bias, output, out_y_begin,
+                     out_y_end, static_cast<float*>(tiles[worker]));
+          },
+          data.tile_count);
+      break;
+    case kTfLiteInt8:
+      ParallelFor(
+          context, 0, output_height,
+          [&](int worker, int out_y_begin, int out_y_end) {
+            EvalRows(params, data, input, filter, bias, output, out_y_begin,
+                     out_y_end, static_cast<int8_t*>(tiles[worker]));
+          },
+          data.tile_count);
+      break;
+    default:
+      TF_LITE_KERNEL_LOG(context, "Type %s (%d) not supported.",
+                         TfLiteTypeGetName(input->type), input->type);
+      return kTfLiteError;
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace conv_pool
+
+TfLiteRegistration Register_CONV_2D_MAX_POOL_2D() {
+  return {/*init=*/conv_pool::Init,
+          /*free=*/nullptr,
+          /*prepare=*/conv_pool::Prepare,
+          /*invoke=*/conv_pool::Eval,
+          /*profiling_string=*/nullptr,
+          /*builtin_code=*/0,
+          /*custom_name=*/nullptr,
+          /*version=*/0};
+}
+
+}  // namespace micro
+}  // namespace ops
+}  // namespace tflite
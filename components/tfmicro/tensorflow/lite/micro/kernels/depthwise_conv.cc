@@ -13,8 +13,25 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+// Besides the reference kernels, int8 depthwise convolutions with a depth
+// multiplier of 1 and no dilation have specialized kernels for the filters of
+// depthwise separable models: 3x3 with stride 1 or 2, and 1xN / Nx1. They are
+// picked in Prepare.
+//
+// The reference kernel walks channels in the outermost loop and recomputes
+// every index and bounds check per tap. The specialized kernels instead keep
+// the accumulators of a block of channels for one output pixel and add in
+// each filter tap as a loop over contiguous channels (NHWC input, 1HWC
+// filter). For output pixels whose filter window lies inside the input the
+// input offset is folded into the bias in Prepare, so the inner loop is a
+// plain int8 x int8 multiply-accumulate. The block is then requantized with
+// RequantizeInt8PerChannel. Integer accumulation and the same per channel
+// requantization make the result bit exact with the reference.
+
 #include "tensorflow/lite/kernels/internal/reference/integer_ops/depthwise_conv.h"
 
+#include <algorithm>
+
 #include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/kernels/internal/common.h"
@@ -25,6 +42,8 @@ limitations under the License.
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/padding.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/kernels/requantize.h"
+#include "tensorflow/lite/micro/micro_thread_pool.h"
 
 namespace tflite {
 namespace ops {
@@ -41,6 +60,17 @@ constexpr int kOutputTensor = 0;
 // https://www.tensorflow.org/lite/performance/quantization_spec
 constexpr int kDepthwiseConvQuantizedDimension = 3;
 
+// Channels accumulated together by the specialized kernels. The accumulators
+// live on the stack.
+constexpr int kChannelBlock = 32;
+
+enum class Int8Kernel {
+  kReference,
+  k3x3,
+  k1xN,
+  kNx1,
+};
+
 struct OpData {
   TfLitePaddingValues padding;
 
@@ -61,6 +91,13 @@ struct OpData {
   // uint8_t these would be 0 and 255.
   int32_t output_activation_min;
   int32_t output_activation_max;
+
+  // Specialized int8 kernel, or kReference to run the reference kernel.
+  Int8Kernel int8_kernel;
+  // Per channel bias plus input offset times the sum of the filter, used by
+  // the specialized kernels for output pixels whose filter window is entirely
+  // inside the input.
+  int32_t* interior_bias;
 };
 
 TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteNode* node,
@@ -101,6 +138,140 @@ TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+Int8Kernel SelectInt8Kernel(const TfLiteDepthwiseConvParams* params,
+                            const TfLiteTensor* input,
+                            const TfLiteTensor* filter,
+                            const TfLiteTensor* bias,
+                            const TfLiteTensor* output) {
+  // The interior bias is computed from the filter and bias in Prepare.
+  if (input->type != kTfLiteInt8 || !IsConstantTensor(filter) ||
+      (bias != nullptr && !IsConstantTensor(bias))) {
+    return Int8Kernel::kReference;
+  }
+  if (params->depth_multiplier != 1 || params->dilation_width_factor != 1 ||
+      params->dilation_height_factor != 1 ||
+      SizeOfDimension(input, 3) != SizeOfDimension(output, 3)) {
+    return Int8Kernel::kReference;
+  }
+  const int filter_height = SizeOfDimension(filter, 1);
+  const int filter_width = SizeOfDimension(filter, 2);
+  if (filter_height == 3 && filter_width == 3 && params->stride_height <= 2 &&
+      params->stride_width <= 2) {
+    return Int8Kernel::k3x3;
+  }
+  if (filter_height == 1) {
+    return Int8Kernel::k1xN;
+  }
+  if (filter_width == 1) {
+    return Int8Kernel::kNx1;
+  }
+  return Int8Kernel::kReference;
+}
+
+// Every input value contributes (input + input_offset) * filter, so over a
+// full filter window the input offset adds input_offset * sum(filter).
+void CalculateInteriorBias(const TfLiteTensor* filter, const TfLiteTensor* bias,
+                           int32_t input_offset, int32_t* interior_bias) {
+  const int channels = SizeOfDimension(filter, 3);
+  const int taps = SizeOfDimension(filter, 1) * SizeOfDimension(filter, 2);
+  const int8_t* filter_data = GetTensorData<int8_t>(filter);
+  for (int channel = 0; channel < channels; ++channel) {
+    int32_t filter_sum = 0;
+    for (int tap = 0; tap < taps; ++tap) {
+      filter_sum += filter_data[tap * channels + channel];
+    }
+    interior_bias[channel] =
+        (bias != nullptr ? GetTensorData<int32_t>(bias)[channel] : 0) +
+        input_offset * filter_sum;
+  }
+}
+
+// Output rows [output_row_begin, output_row_end) of one batch with a
+// specialized kernel. A filter dimension of 0 is only known at run time.
+template <int kFilterHeight, int kFilterWidth>
+void DepthwiseConvInt8Rows(const TfLiteDepthwiseConvParams* params,
+                           const OpData& data, const RuntimeShape& input_shape,
+                           const int8_t* input_data,
+                           const RuntimeShape& filter_shape,
+                           const int8_t* filter_data, const int32_t* bias_data,
+                           const RuntimeShape& output_shape,
+                           int8_t* output_data, int output_row_begin,
+                           int output_row_end) {
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int channels = input_shape.Dims(3);
+  const int filter_height =
+      kFilterHeight > 0 ? kFilterHeight : filter_shape.Dims(1);
+  const int filter_width =
+      kFilterWidth > 0 ? kFilterWidth : filter_shape.Dims(2);
+  const int output_width = output_shape.Dims(2);
+  const int stride_height = params->stride_height;
+  const int stride_width = params->stride_width;
+  const int32_t input_offset = -data.input_zero_point;
+  const int32_t output_offset = data.output_zero_point;
+
+  int32_t acc[kChannelBlock];
+  for (int out_y = output_row_begin; out_y < output_row_end; ++out_y) {
+    const int in_y_origin = out_y * stride_height - data.padding.height;
+    const int filter_y_begin = std::max(0, -in_y_origin);
+    const int filter_y_end =
+        std::min(filter_height, input_height - in_y_origin);
+    int8_t* output_row = output_data + out_y * output_width * channels;
+    for (int out_x = 0; out_x < output_width; ++out_x) {
+      const int in_x_origin = out_x * stride_width - data.padding.width;
+      const int filter_x_begin = std::max(0, -in_x_origin);
+      const int filter_x_end =
+          std::min(filter_width, input_width - in_x_origin);
+      const bool interior = filter_y_begin == 0 &&
+                            filter_y_end == filter_height &&
+                            filter_x_begin == 0 && filter_x_end == filter_width;
+      const int8_t* input_origin =
+          input_data + (in_y_origin * input_width + in_x_origin) * channels;
+      for (int c0 = 0; c0 < channels; c0 += kChannelBlock) {
+        const int block = std::min(kChannelBlock, channels - c0);
+        if (interior) {
+          // Constant trip counts for the fixed filter sizes, so the taps are
+          // unrolled.
+          for (int c = 0; c < block; ++c) {
+            acc[c] = data.interior_bias[c0 + c];
+          }
+          for (int fy = 0; fy < filter_height; ++fy) {
+            for (int fx = 0; fx < filter_width; ++fx) {
+              const int8_t* in =
+                  input_origin + (fy * input_width + fx) * channels + c0;
+              const int8_t* f =
+                  filter_data + (fy * filter_width + fx) * channels + c0;
+              for (int c = 0; c < block; ++c) {
+                acc[c] += f[c] * in[c];
+              }
+            }
+          }
+        } else {
+          for (int c = 0; c < block; ++c) {
+            acc[c] = bias_data != nullptr ? bias_data[c0 + c] : 0;
+          }
+          for (int fy = filter_y_begin; fy < filter_y_end; ++fy) {
+            for (int fx = filter_x_begin; fx < filter_x_end; ++fx) {
+              const int8_t* in =
+                  input_origin + (fy * input_width + fx) * channels + c0;
+              const int8_t* f =
+                  filter_data + (fy * filter_width + fx) * channels + c0;
+              for (int c = 0; c < block; ++c) {
+                acc[c] += f[c] * (in[c] + input_offset);
+              }
+            }
+          }
+        }
+        tflite::micro::RequantizeInt8PerChannel(
+            acc, block, data.per_channel_output_multiplier + c0,
+            data.per_channel_output_shift + c0, output_offset,
+            data.output_activation_min, data.output_activation_max,
+            output_row + out_x * channels + c0);
+      }
+    }
+  }
+}
+
 }  // namespace
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
@@ -167,22 +338,42 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   data->filter_zero_point = filter->params.zero_point;
   data->output_zero_point = output->params.zero_point;
 
+  const TfLiteTensor* bias = GetOptionalInputTensor(context, node, kBiasTensor);
+  data->int8_kernel = SelectInt8Kernel(params, input, filter, bias, output);
+  data->interior_bias = nullptr;
+  if (data->int8_kernel != Int8Kernel::kReference) {
+    data->interior_bias =
+        reinterpret_cast<int32_t*>(context->AllocatePersistentBuffer(
+            context, num_channels * sizeof(int32_t)));
+    TF_LITE_ENSURE(context, data->interior_bias != nullptr);
+    CalculateInteriorBias(filter, bias, -data->input_zero_point,
+                          data->interior_bias);
+  }
+
   return kTfLiteOk;
 }
 
+// Only output rows [output_row_begin, output_row_end) of a single batch are
+// computed. The reference kernel is handed a shorter output that starts at
+// output_row_begin, with the padding moved up to match.
 void EvalFloat(TfLiteContext* context, TfLiteNode* node,
                TfLiteDepthwiseConvParams* params, const OpData& data,
                const TfLiteEvalTensor* input, const TfLiteEvalTensor* filter,
-               const TfLiteEvalTensor* bias, TfLiteEvalTensor* output) {
+               const TfLiteEvalTensor* bias, TfLiteEvalTensor* output,
+               int output_row_begin, int output_row_end) {
   float output_activation_min, output_activation_max;
   CalculateActivationRange(params->activation, &output_activation_min,
                            &output_activation_max);
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_row_size = output_shape.FlatSize() / output_shape.Dims(1);
+  output_shape.SetDim(1, output_row_end - output_row_begin);
 
   tflite::DepthwiseParams op_params;
   // Padding type is ignored, but still set.
   op_params.padding_type = PaddingType::kSame;
   op_params.padding_values.width = data.padding.width;
-  op_params.padding_values.height = data.padding.height;
+  op_params.padding_values.height =
+      data.padding.height - output_row_begin * params->stride_height;
   op_params.stride_width = params->stride_width;
   op_params.stride_height = params->stride_height;
   op_params.dilation_width_factor = params->dilation_width_factor;
@@ -197,9 +388,9 @@ void EvalFloat(TfLiteContext* context, TfLiteNode* node,
       tflite::micro::GetTensorShape(filter),
       tflite::micro::GetTensorData<float>(filter),
       tflite::micro::GetTensorShape(bias),
-      tflite::micro::GetTensorData<float>(bias),
-      tflite::micro::GetTensorShape(output),
-      tflite::micro::GetTensorData<float>(output));
+      tflite::micro::GetTensorData<float>(bias), output_shape,
+      tflite::micro::GetTensorData<float>(output) +
+          output_row_begin * output_row_size);
 }
 
 void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
@@ -207,11 +398,61 @@ void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
                              const OpData& data, const TfLiteEvalTensor* input,
                              const TfLiteEvalTensor* filter,
                              const TfLiteEvalTensor* bias,
-                             TfLiteEvalTensor* output) {
+                             TfLiteEvalTensor* output, int output_row_begin,
+                             int output_row_end) {
+  if (data.int8_kernel != Int8Kernel::kReference) {
+    const RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+    const RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+    const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+    const int8_t* filter_data = tflite::micro::GetTensorData<int8_t>(filter);
+    const int32_t* bias_data =
+        bias != nullptr ? tflite::micro::GetTensorData<int32_t>(bias) : nullptr;
+    const int input_batch_size = input_shape.FlatSize() / input_shape.Dims(0);
+    const int output_batch_size =
+        output_shape.FlatSize() / output_shape.Dims(0);
+    // The rows are only split for a single batch, otherwise they cover all of
+    // every batch.
+    for (int batch = 0; batch < output_shape.Dims(0); ++batch) {
+      const int8_t* input_data = tflite::micro::GetTensorData<int8_t>(input) +
+                                 batch * input_batch_size;
+      int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output) +
+                            batch * output_batch_size;
+      switch (data.int8_kernel) {
+        case Int8Kernel::k3x3:
+          DepthwiseConvInt8Rows<3, 3>(params, data, input_shape, input_data,
+                                      filter_shape, filter_data, bias_data,
+                                      output_shape, output_data,
+                                      output_row_begin, output_row_end);
+          break;
+        case Int8Kernel::k1xN:
+          DepthwiseConvInt8Rows<1, 0>(params, data, input_shape, input_data,
+                                      filter_shape, filter_data, bias_data,
+                                      output_shape, output_data,
+                                      output_row_begin, output_row_end);
+          break;
+        case Int8Kernel::kNx1:
+          DepthwiseConvInt8Rows<0, 1>(params, data, input_shape, input_data,
+                                      filter_shape, filter_data, bias_data,
+                                      output_shape, output_data,
+                                      output_row_begin, output_row_end);
+          break;
+        case Int8Kernel::kReference:
+          break;
+      }
+    }
+    return;
+  }
+
+  // See EvalFloat for how the row range is selected.
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_row_size = output_shape.FlatSize() / output_shape.Dims(1);
+  output_shape.SetDim(1, output_row_end - output_row_begin);
+
   DepthwiseParams op_params;
   op_params.padding_type = PaddingType::kSame;
   op_params.padding_values.width = data.padding.width;
-  op_params.padding_values.height = data.padding.height;
+  op_params.padding_values.height =
+      data.padding.height - output_row_begin * params->stride_height;
   op_params.stride_width = params->stride_width;
   op_params.stride_height = params->stride_height;
   op_params.dilation_width_factor = params->dilation_width_factor;
@@ -220,9 +461,8 @@ void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
   op_params.input_offset = -data.input_zero_point;
   op_params.weights_offset = 0;
   op_params.output_offset = data.output_zero_point;
-  // TODO(b/130439627): Use calculated value for clamping.
-  op_params.quantized_activation_min = std::numeric_limits<int8_t>::min();
-  op_params.quantized_activation_max = std::numeric_limits<int8_t>::max();
+  op_params.quantized_activation_min = data.output_activation_min;
+  op_params.quantized_activation_max = data.output_activation_max;
 
   reference_integer_ops::DepthwiseConvPerChannel(
       op_params, data.per_channel_output_multiplier,
@@ -231,9 +471,9 @@ void EvalQuantizedPerChannel(TfLiteContext* context, TfLiteNode* node,
       tflite::micro::GetTensorShape(filter),
       tflite::micro::GetTensorData<int8_t>(filter),
       tflite::micro::GetTensorShape(bias),
-      tflite::micro::GetTensorData<int32_t>(bias),
-      tflite::micro::GetTensorShape(output),
-      tflite::micro::GetTensorData<int8_t>(output));
+      tflite::micro::GetTensorData<int32_t>(bias), output_shape,
+      tflite::micro::GetTensorData<int8_t>(output) +
+          output_row_begin * output_row_size);
 }
 
 void EvalQuantized(TfLiteContext* context, TfLiteNode* node,
@@ -296,13 +536,30 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
   // TODO(aselle): Consider whether float conv and quantized conv should be
   // separate ops to avoid dispatch overhead here.
+  // Output rows are independent, so they are split across the thread pool.
+  // Only a single batch can be split by rows.
+  const int output_rows = output->dims->data[1];
+  const int max_workers =
+      output->dims->data[0] == 1 ? GetMicroThreadCount(context) : 1;
+
   switch (input->type) {  // Already know in/out types are same.
     case kTfLiteFloat32:
-      EvalFloat(context, node, params, data, input, filter, bias, output);
+      ParallelFor(
+          context, 0, output_rows,
+          [&](int worker, int row_begin, int row_end) {
+            EvalFloat(context, node, params, data, input, filter, bias, output,
+                      row_begin, row_end);
+          },
+          max_workers);
       break;
     case kTfLiteInt8:
-      EvalQuantizedPerChannel(context, node, params, data, input, filter, bias,
-                              output);
+      ParallelFor(
+          context, 0, output_rows,
+          [&](int worker, int row_begin, int row_end) {
+            EvalQuantizedPerChannel(context, node, params, data, input, filter,
+                                    bias, output, row_begin, row_end);
+          },
+          max_workers);
       break;
     case kTfLiteUInt8:
       EvalQuantized(context, node, params, data, input, filter, bias, output);
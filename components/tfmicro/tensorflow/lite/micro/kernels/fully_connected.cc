@@ -15,14 +15,17 @@ limitations under the License.
 
 #include "tensorflow/lite/kernels/internal/reference/fully_connected.h"
 
+#include <algorithm>
+
 #include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/kernels/internal/common.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
-#include "tensorflow/lite/kernels/internal/reference/integer_ops/fully_connected.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/kernels/requantize.h"
+#include "tensorflow/lite/micro/micro_thread_pool.h"
 
 namespace tflite {
 namespace ops {
@@ -108,32 +111,61 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
                          filter, bias, output, data);
 }
 
-TfLiteStatus EvalQuantizedInt8(TfLiteContext* context, TfLiteNode* node,
-                               const OpData& data,
-                               const TfLiteEvalTensor* input,
-                               const TfLiteEvalTensor* filter,
-                               const TfLiteEvalTensor* bias,
-                               TfLiteEvalTensor* output) {
-  tflite::FullyConnectedParams op_params;
-  op_params.input_offset = -data.input_zero_point;
-  op_params.weights_offset = -data.filter_zero_point;
-  op_params.output_offset = data.output_zero_point;
-  op_params.output_multiplier = data.output_multiplier;
-  // TODO(b/138810107): Figure out whether output shift should be inverted
-  op_params.output_shift = -data.output_shift;
-  op_params.quantized_activation_min = data.output_activation_min;
-  op_params.quantized_activation_max = data.output_activation_max;
+// Narrows the filter and output shapes to output units [unit_begin, unit_end)
+// of a single batch and returns the offset of the first filter row. Each unit
+// is one row of the filter and one bias value, so the reference kernel can be
+// handed just those.
+int SliceOutputUnits(int unit_begin, int unit_end, RuntimeShape* filter_shape,
+                     RuntimeShape* output_shape) {
+  const int filter_dims = filter_shape->DimensionsCount();
+  filter_shape->SetDim(filter_dims - 2, unit_end - unit_begin);
+  output_shape->SetDim(output_shape->DimensionsCount() - 1,
+                       unit_end - unit_begin);
+  return unit_begin * filter_shape->Dims(filter_dims - 1);
+}
 
-  reference_integer_ops::FullyConnected(
-      op_params, tflite::micro::GetTensorShape(input),
-      tflite::micro::GetTensorData<int8_t>(input),
-      tflite::micro::GetTensorShape(filter),
-      tflite::micro::GetTensorData<int8_t>(filter),
-      tflite::micro::GetTensorShape(bias),
-      tflite::micro::GetTensorData<int32_t>(bias),
-      tflite::micro::GetTensorShape(output),
-      tflite::micro::GetTensorData<int8_t>(output));
-  return kTfLiteOk;
+// Same arithmetic as reference_integer_ops::FullyConnected, but the
+// accumulators of a block of output units are requantized together with
+// RequantizeInt8.
+void EvalQuantizedInt8(const OpData& data, const TfLiteEvalTensor* input,
+                       const TfLiteEvalTensor* filter,
+                       const TfLiteEvalTensor* bias, TfLiteEvalTensor* output,
+                       int unit_begin, int unit_end) {
+  constexpr int kUnitBlock = 32;
+  const RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int accum_depth = filter_shape.Dims(filter_shape.DimensionsCount() - 1);
+  const int output_depth =
+      output_shape.Dims(output_shape.DimensionsCount() - 1);
+  const int batches = output_shape.FlatSize() / output_depth;
+  const int8_t* input_data = tflite::micro::GetTensorData<int8_t>(input);
+  const int8_t* filter_data = tflite::micro::GetTensorData<int8_t>(filter);
+  const int32_t* bias_data = tflite::micro::GetTensorData<int32_t>(bias);
+  int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output);
+  const int32_t input_offset = -data.input_zero_point;
+  const int32_t filter_offset = -data.filter_zero_point;
+
+  int32_t acc[kUnitBlock];
+  for (int b = 0; b < batches; ++b) {
+    const int8_t* batch_input = input_data + b * accum_depth;
+    for (int u0 = unit_begin; u0 < unit_end; u0 += kUnitBlock) {
+      const int block = std::min(kUnitBlock, unit_end - u0);
+      for (int u = 0; u < block; ++u) {
+        const int8_t* unit_filter = filter_data + (u0 + u) * accum_depth;
+        int32_t sum = 0;
+        for (int d = 0; d < accum_depth; ++d) {
+          sum += (unit_filter[d] + filter_offset) *
+                 (batch_input[d] + input_offset);
+        }
+        acc[u] = bias_data != nullptr ? sum + bias_data[u0 + u] : sum;
+      }
+      // TODO(b/138810107): Figure out whether output shift should be inverted
+      tflite::micro::RequantizeInt8(
+          acc, block, data.output_multiplier, -data.output_shift,
+          data.output_zero_point, data.output_activation_min,
+          data.output_activation_max, output_data + b * output_depth + u0);
+    }
+  }
 }
 
 TfLiteStatus EvalQuantized(TfLiteContext* context, TfLiteNode* node,
@@ -181,11 +213,14 @@ TfLiteStatus EvalQuantized(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
-TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
-                       TfLiteFusedActivation activation,
-                       const TfLiteEvalTensor* input,
-                       const TfLiteEvalTensor* filter,
-                       const TfLiteEvalTensor* bias, TfLiteEvalTensor* output) {
+void EvalFloat(TfLiteFusedActivation activation, const TfLiteEvalTensor* input,
+               const TfLiteEvalTensor* filter, const TfLiteEvalTensor* bias,
+               TfLiteEvalTensor* output, int unit_begin, int unit_end) {
+  RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int filter_offset =
+      SliceOutputUnits(unit_begin, unit_end, &filter_shape, &output_shape);
+  const float* bias_data = tflite::micro::GetTensorData<float>(bias);
   float output_activation_min, output_activation_max;
   CalculateActivationRange(activation, &output_activation_min,
                            &output_activation_max);
@@ -194,14 +229,12 @@ TfLiteStatus EvalFloat(TfLiteContext* context, TfLiteNode* node,
   op_params.float_activation_max = output_activation_max;
   tflite::reference_ops::FullyConnected(
       op_params, tflite::micro::GetTensorShape(input),
-      tflite::micro::GetTensorData<float>(input),
-      tflite::micro::GetTensorShape(filter),
-      tflite::micro::GetTensorData<float>(filter),
+      tflite::micro::GetTensorData<float>(input), filter_shape,
+      tflite::micro::GetTensorData<float>(filter) + filter_offset,
       tflite::micro::GetTensorShape(bias),
-      tflite::micro::GetTensorData<float>(bias),
-      tflite::micro::GetTensorShape(output),
-      tflite::micro::GetTensorData<float>(output));
-  return kTfLiteOk;
+      bias_data == nullptr ? nullptr : bias_data + unit_begin,
+      output_shape,
+      tflite::micro::GetTensorData<float>(output) + unit_begin);
 }
 
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
@@ -221,14 +254,35 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   TFLITE_DCHECK(node->user_data != nullptr);
   const OpData& data = *(static_cast<const OpData*>(node->user_data));
 
+  // With a single batch the output units are independent, so they are
+  // split across the thread pool. Larger batches run on this thread.
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_depth =
+      output_shape.Dims(output_shape.DimensionsCount() - 1);
+  const int max_workers = output_shape.FlatSize() == output_depth
+                              ? GetMicroThreadCount(context)
+                              : 1;
+
   // Checks in Prepare ensure input, output and filter types are all the same.
   switch (input->type) {
     case kTfLiteFloat32:
-      return EvalFloat(context, node, params->activation, input, filter, bias,
-                       output);
+      ParallelFor(
+          context, 0, output_depth,
+          [&](int worker, int unit_begin, int unit_end) {
+            EvalFloat(params->activation, input, filter, bias, output,
+                      unit_begin, unit_end);
+          },
+          max_workers);
+      return kTfLiteOk;
     case kTfLiteInt8:
-      return EvalQuantizedInt8(context, node, data, input, filter, bias,
-                               output);
+      ParallelFor(
+          context, 0, output_depth,
+          [&](int worker, int unit_begin, int unit_end) {
+            EvalQuantizedInt8(data, input, filter, bias, output, unit_begin,
+                              unit_end);
+          },
+          max_workers);
+      return kTfLiteOk;
 
     case kTfLiteUInt8:
       return EvalQuantized(context, node, data, input, filter, bias, output);
@@ -59,6 +59,7 @@ TfLiteStatus KernelRunner::InitAndPrepare(const char* init_data) {
   if (registration_.prepare) {
     TF_LITE_ENSURE_STATUS(registration_.prepare(&context_, &node_));
   }
+  allocator_->ResetTempAllocations();
   return kTfLiteOk;
 }
 
@@ -68,6 +69,9 @@ TfLiteStatus KernelRunner::Invoke() {
                          "TfLiteRegistration missing invoke function pointer!");
     return kTfLiteError;
   }
+  // The eval tensors handed out by GetEvalTensor() only live for one call, so
+  // a kernel can be invoked any number of times without running out of arena.
+  allocator_->ResetTempAllocations();
   return registration_.invoke(&context_, &node_);
 }
 
@@ -46,6 +46,10 @@ class KernelRunner {
   // passed into the constructor of this class.
   TfLiteStatus Invoke();
 
+  // Bytes of the runner's arena the kernel holds on to: its persistent
+  // buffers and scratch buffers. The tensors passed in are not counted.
+  size_t arena_used_bytes() const { return allocator_->GetUsedBytes(); }
+
  protected:
   static TfLiteTensor* GetTensor(const struct TfLiteContext* context,
                                  int tensor_index);
@@ -27,6 +27,27 @@ bool HaveSameShapes(const TfLiteEvalTensor* input1,
   return TfLiteIntArrayEqual(input1->dims, input2->dims);
 }
 
+bool IsChannelBroadcast(const TfLiteTensor* input1,
+                        const TfLiteTensor* input2) {
+  TFLITE_DCHECK(input1 != nullptr);
+  TFLITE_DCHECK(input2 != nullptr);
+  const TfLiteIntArray* dims1 = input1->dims;
+  const TfLiteIntArray* dims2 = input2->dims;
+  if (dims1->size == 0 || dims2->size == 0 || dims2->size > dims1->size) {
+    return false;
+  }
+  const int channels = dims1->data[dims1->size - 1];
+  if (channels == 0 || dims2->data[dims2->size - 1] != channels) {
+    return false;
+  }
+  for (int i = 0; i < dims2->size - 1; ++i) {
+    if (dims2->data[i] != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
 const RuntimeShape GetTensorShape(const TfLiteEvalTensor* tensor) {
   if (tensor == nullptr || tensor->dims == nullptr) {
     return RuntimeShape();
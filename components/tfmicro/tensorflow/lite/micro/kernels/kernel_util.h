@@ -69,6 +69,13 @@ const RuntimeShape GetTensorShape(const TfLiteEvalTensor* tensor);
 bool HaveSameShapes(const TfLiteEvalTensor* input1,
                     const TfLiteEvalTensor* input2);
 
+// Return true if input2 holds one value per channel (the last dimension of
+// input1) and is broadcast across all the other dimensions of input1, like
+// [1, 1, 1, C] or [C] against [N, H, W, C]. The output then has input1's
+// shape and input2 repeats every C elements.
+bool IsChannelBroadcast(const TfLiteTensor* input1,
+                        const TfLiteTensor* input2);
+
 }  // namespace micro
 }  // namespace tflite
 
@@ -38,6 +38,12 @@ TfLiteRegistration Register_CEIL();
 // TODO(b/160234179): Change custom OPs to also return by value.
 TfLiteRegistration* Register_CIRCULAR_BUFFER();
 TfLiteRegistration Register_CONV_2D();
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+// Streaming variant that reuses rows across invocations, see streaming_rows.h.
+TfLiteRegistration Register_CONV_2D_STREAMING();
+#endif
+// Fused CONV_2D -> MAX_POOL_2D, see micro_op_fusion.h.
+TfLiteRegistration Register_CONV_2D_MAX_POOL_2D();
 TfLiteRegistration Register_CONCATENATION();
 TfLiteRegistration Register_COS();
 TfLiteRegistration Register_DEPTHWISE_CONV_2D();
@@ -57,6 +63,10 @@ TfLiteRegistration Register_LOGICAL_OR();
 TfLiteRegistration Register_LOGISTIC();
 TfLiteRegistration Register_MAXIMUM();
 TfLiteRegistration Register_MAX_POOL_2D();
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+// Streaming variant that reuses rows across invocations, see streaming_rows.h.
+TfLiteRegistration Register_MAX_POOL_2D_STREAMING();
+#endif
 TfLiteRegistration Register_MEAN();
 TfLiteRegistration Register_MINIMUM();
 TfLiteRegistration Register_MUL();
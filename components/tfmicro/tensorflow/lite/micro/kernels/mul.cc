@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/lite/kernels/internal/reference/mul.h"
 
+#include <algorithm>
+
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/kernels/internal/quantization_util.h"
 #include "tensorflow/lite/kernels/internal/reference/integer_ops/mul.h"
@@ -22,6 +24,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/kernels/requantize.h"
 #include "tensorflow/lite/micro/memory_helpers.h"
 
 namespace tflite {
@@ -34,7 +37,18 @@ constexpr int kInput1Tensor = 0;
 constexpr int kInput2Tensor = 1;
 constexpr int kOutputTensor = 0;
 
+// The int8 kernel picked in Prepare, as in add.cc.
+constexpr int kInt8Block = 64;
+
+enum class Int8Kernel {
+  kReference,
+  kSameShape,
+  kChannelBroadcast,
+};
+
 struct OpData {
+  Int8Kernel int8_kernel;
+
   int32_t input1_zero_point;
   int32_t input2_zero_point;
 
@@ -62,6 +76,17 @@ TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteNode* node,
 
   TF_LITE_ENSURE_TYPES_EQ(context, input1->type, input2->type);
 
+  data->int8_kernel = Int8Kernel::kReference;
+  if (output->type == kTfLiteInt8) {
+    if (HaveSameShapes(input1, input2)) {
+      data->int8_kernel = Int8Kernel::kSameShape;
+    } else if (tflite::micro::IsChannelBroadcast(input1, input2) &&
+               SizeOfDimension(input1, NumDimensions(input1) - 1) <=
+                   kInt8Block) {
+      data->int8_kernel = Int8Kernel::kChannelBroadcast;
+    }
+  }
+
   if (output->type == kTfLiteUInt8 || output->type == kTfLiteInt8) {
     TF_LITE_ENSURE_STATUS(CalculateActivationRangeQuantized(
         context, params->activation, output, &data->output_activation_min,
@@ -85,11 +110,82 @@ TfLiteStatus CalculateOpData(TfLiteContext* context, TfLiteNode* node,
   return kTfLiteOk;
 }
 
+inline void RequantizeProductsInt8(const OpData* data,
+                                   const int32_t* products, int size,
+                                   int8_t* output_data) {
+  tflite::micro::RequantizeInt8(
+      products, size, data->output_multiplier, data->output_shift,
+      data->output_zero_point, data->output_activation_min,
+      data->output_activation_max, output_data);
+}
+
+// Same as reference_integer_ops::Mul for int8, but the products of a block of
+// elements are requantized together with RequantizeInt8.
+void MulInt8(const OpData* data, int size, const int8_t* input1_data,
+             const int8_t* input2_data, int8_t* output_data) {
+  int32_t products[kInt8Block];
+  for (int i0 = 0; i0 < size; i0 += kInt8Block) {
+    const int block = std::min(kInt8Block, size - i0);
+    for (int i = 0; i < block; ++i) {
+      products[i] = (input1_data[i0 + i] - data->input1_zero_point) *
+                    (input2_data[i0 + i] - data->input2_zero_point);
+    }
+    RequantizeProductsInt8(data, products, block, output_data + i0);
+  }
+}
+
+// MulInt8 with input2 holding one value per channel.
+void MulInt8ChannelBroadcast(const OpData* data, int size, int channels,
+                             const int8_t* input1_data,
+                             const int8_t* input2_data, int8_t* output_data) {
+  TFLITE_DCHECK_LE(channels, kInt8Block);
+  int32_t input2_values[kInt8Block];
+  for (int c = 0; c < channels; ++c) {
+    input2_values[c] = input2_data[c] - data->input2_zero_point;
+  }
+  int32_t products[kInt8Block];
+  int channel = 0;
+  for (int i0 = 0; i0 < size; i0 += kInt8Block) {
+    const int block = std::min(kInt8Block, size - i0);
+    for (int i = 0; i < block; ++i) {
+      products[i] = (input1_data[i0 + i] - data->input1_zero_point) *
+                    input2_values[channel];
+      if (++channel == channels) {
+        channel = 0;
+      }
+    }
+    RequantizeProductsInt8(data, products, block, output_data + i0);
+  }
+}
+
+// Runs the int8 kernel selected in Prepare, other than the reference one.
+void EvalMulInt8(const OpData* data, const TfLiteEvalTensor* input1,
+                 const TfLiteEvalTensor* input2, TfLiteEvalTensor* output) {
+  const int8_t* input1_data = tflite::micro::GetTensorData<int8_t>(input1);
+  const int8_t* input2_data = tflite::micro::GetTensorData<int8_t>(input2);
+  int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  if (data->int8_kernel == Int8Kernel::kSameShape) {
+    MulInt8(data, output_shape.FlatSize(), input1_data, input2_data,
+            output_data);
+  } else {
+    MulInt8ChannelBroadcast(
+        data, output_shape.FlatSize(),
+        output_shape.Dims(output_shape.DimensionsCount() - 1), input1_data,
+        input2_data, output_data);
+  }
+}
+
 }  // namespace
 
 void EvalQuantized(TfLiteContext* context, TfLiteNode* node, const OpData* data,
                    const TfLiteEvalTensor* input1,
                    const TfLiteEvalTensor* input2, TfLiteEvalTensor* output) {
+  if (data->int8_kernel != Int8Kernel::kReference) {
+    EvalMulInt8(data, input1, input2, output);
+    return;
+  }
+
   tflite::ArithmeticParams op_params = {};
   op_params.quantized_activation_min = data->output_activation_min;
   op_params.quantized_activation_max = data->output_activation_max;
@@ -114,13 +210,13 @@ void EvalQuantized(TfLiteContext* context, TfLiteNode* node, const OpData* data,
           tflite::micro::GetTensorShape(output),
           tflite::micro::GetTensorData<int8_t>(output));
     } else {
-      reference_integer_ops::Mul(op_params,
-                                 tflite::micro::GetTensorShape(input1),
-                                 tflite::micro::GetTensorData<int8_t>(input1),
-                                 tflite::micro::GetTensorShape(input2),
-                                 tflite::micro::GetTensorData<int8_t>(input2),
-                                 tflite::micro::GetTensorShape(output),
-                                 tflite::micro::GetTensorData<int8_t>(output));
+      MulInt8(data,
+              MatchingElementsSize(tflite::micro::GetTensorShape(input1),
+                                   tflite::micro::GetTensorShape(input2),
+                                   tflite::micro::GetTensorShape(output)),
+              tflite::micro::GetTensorData<int8_t>(input1),
+              tflite::micro::GetTensorData<int8_t>(input2),
+              tflite::micro::GetTensorData<int8_t>(output));
     }
   } else if (output->type == kTfLiteUInt8) {
     if (need_broadcast) {
@@ -14,12 +14,28 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/lite/kernels/internal/reference/pooling.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
 #include "tensorflow/lite/c/builtin_op_data.h"
 #include "tensorflow/lite/kernels/internal/reference/integer_ops/pooling.h"
 #include "tensorflow/lite/kernels/internal/tensor_ctypes.h"
 #include "tensorflow/lite/kernels/kernel_util.h"
 #include "tensorflow/lite/kernels/padding.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+#include "tensorflow/lite/micro/kernels/streaming_rows.h"
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TF_LITE_MICRO_POOLING_NEON
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define TF_LITE_MICRO_POOLING_SSE4
+#endif
 
 namespace tflite {
 namespace ops {
@@ -31,12 +47,31 @@ namespace {
 constexpr int kInputTensor = 0;
 constexpr int kOutputTensor = 0;
 
+// The int8 kernel picked in Prepare. The NHWC fast paths walk the input with
+// pointers and pool whole pixels at a time, every channel at once, instead of
+// computing an Offset() for every element of every window like the reference
+// kernels. MAX_POOL_2D has them for the common 2x2 and 3x3 windows, with the
+// window size known at compile time; AVERAGE_POOL_2D for any window.
+enum class Int8Kernel {
+  kReference,
+  kMax2x2,
+  kMax3x3,
+  kAverage,
+};
+
 struct OpData {
   TfLitePaddingValues padding;
+  Int8Kernel int8_kernel;
   int32_t activation_min;
   int32_t activation_max;
   float activation_min_f32;
   float activation_max_f32;
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  // Only set for the streaming registration, see streaming_rows.h.
+  bool streaming;
+  tflite::micro::StreamingRowCache* row_cache;
+#endif
 };
 
 TfLiteStatus CalculateOpData(const TfLiteContext* context,
@@ -58,6 +93,175 @@ TfLiteStatus CalculateOpData(const TfLiteContext* context,
   return kTfLiteOk;
 }
 
+Int8Kernel SelectInt8Kernel(const TfLitePoolParams* params,
+                            const TfLiteTensor* input, bool average) {
+  if (input->type != kTfLiteInt8) {
+    return Int8Kernel::kReference;
+  }
+  if (average) {
+    return Int8Kernel::kAverage;
+  }
+  if (params->filter_height == 2 && params->filter_width == 2) {
+    return Int8Kernel::kMax2x2;
+  }
+  if (params->filter_height == 3 && params->filter_width == 3) {
+    return Int8Kernel::kMax3x3;
+  }
+  return Int8Kernel::kReference;
+}
+
+// output[i] = max(output[i], input[i]) for a pixel's channels, 16 at a time
+// where there are SIMD instructions for it.
+inline void MaxInt8(const int8_t* input, int size, int8_t* output) {
+  int i = 0;
+#if defined(TF_LITE_MICRO_POOLING_NEON)
+  for (; i + 16 <= size; i += 16) {
+    vst1q_s8(output + i, vmaxq_s8(vld1q_s8(output + i), vld1q_s8(input + i)));
+  }
+#elif defined(TF_LITE_MICRO_POOLING_SSE4)
+  for (; i + 16 <= size; i += 16) {
+    __m128i* out = reinterpret_cast<__m128i*>(output + i);
+    _mm_storeu_si128(
+        out, _mm_max_epi8(_mm_loadu_si128(out),
+                          _mm_loadu_si128(
+                              reinterpret_cast<const __m128i*>(input + i))));
+  }
+#endif
+  for (; i < size; ++i) {
+    output[i] = std::max(output[i], input[i]);
+  }
+}
+
+inline void ClampInt8(int size, int32_t activation_min, int32_t activation_max,
+                      int8_t* output) {
+  if (activation_min <= std::numeric_limits<int8_t>::min() &&
+      activation_max >= std::numeric_limits<int8_t>::max()) {
+    return;
+  }
+  const int8_t low = static_cast<int8_t>(activation_min);
+  const int8_t high = static_cast<int8_t>(activation_max);
+  for (int i = 0; i < size; ++i) {
+    output[i] = std::min(std::max(output[i], low), high);
+  }
+}
+
+// Same as reference_integer_ops::MaxPool for a kFilterHeight x kFilterWidth
+// window, for output rows [output_row_begin, output_row_end).
+template <int kFilterHeight, int kFilterWidth>
+void MaxPoolInt8(const TfLitePoolParams* params, const OpData* data,
+                 const TfLiteEvalTensor* input, TfLiteEvalTensor* output,
+                 int output_row_begin, int output_row_end) {
+  const RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int output_row_size = output_width * depth;
+  const int8_t* input_data = tflite::micro::GetTensorData<int8_t>(input);
+  int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output);
+
+  for (int batch = 0; batch < batches; ++batch) {
+    const int8_t* input_batch =
+        input_data + batch * input_height * input_width * depth;
+    for (int out_y = output_row_begin; out_y < output_row_end; ++out_y) {
+      const int in_y_origin =
+          out_y * params->stride_height - data->padding.height;
+      int8_t* output_row =
+          output_data + (batch * output_height + out_y) * output_row_size;
+      memset(output_row, std::numeric_limits<int8_t>::lowest(),
+             output_row_size);
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        const int in_x_origin =
+            out_x * params->stride_width - data->padding.width;
+        int8_t* output_pixel = output_row + out_x * depth;
+        for (int filter_y = 0; filter_y < kFilterHeight; ++filter_y) {
+          const int in_y = in_y_origin + filter_y;
+          if (in_y < 0 || in_y >= input_height) {
+            continue;
+          }
+          const int8_t* input_row = input_batch + in_y * input_width * depth;
+          for (int filter_x = 0; filter_x < kFilterWidth; ++filter_x) {
+            const int in_x = in_x_origin + filter_x;
+            if (in_x < 0 || in_x >= input_width) {
+              continue;
+            }
+            MaxInt8(input_row + in_x * depth, depth, output_pixel);
+          }
+        }
+      }
+      ClampInt8(output_row_size, data->activation_min, data->activation_max,
+                output_row);
+    }
+  }
+}
+
+// Same as reference_integer_ops::AveragePool. The sums of a block of channels
+// are kept in int32 while the window is walked a pixel at a time.
+void AveragePoolInt8(const TfLitePoolParams* params, const OpData* data,
+                     const TfLiteEvalTensor* input, TfLiteEvalTensor* output) {
+  constexpr int kChannelBlock = 32;
+  const RuntimeShape input_shape = tflite::micro::GetTensorShape(input);
+  const RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int batches = MatchingDim(input_shape, 0, output_shape, 0);
+  const int depth = MatchingDim(input_shape, 3, output_shape, 3);
+  const int input_height = input_shape.Dims(1);
+  const int input_width = input_shape.Dims(2);
+  const int output_height = output_shape.Dims(1);
+  const int output_width = output_shape.Dims(2);
+  const int8_t* input_data = tflite::micro::GetTensorData<int8_t>(input);
+  int8_t* output_data = tflite::micro::GetTensorData<int8_t>(output);
+
+  int32_t acc[kChannelBlock];
+  for (int batch = 0; batch < batches; ++batch) {
+    const int8_t* input_batch =
+        input_data + batch * input_height * input_width * depth;
+    for (int out_y = 0; out_y < output_height; ++out_y) {
+      const int in_y_origin =
+          out_y * params->stride_height - data->padding.height;
+      const int in_y_begin = std::max(0, in_y_origin);
+      const int in_y_end =
+          std::min(input_height, in_y_origin + params->filter_height);
+      for (int out_x = 0; out_x < output_width; ++out_x) {
+        const int in_x_origin =
+            out_x * params->stride_width - data->padding.width;
+        const int in_x_begin = std::max(0, in_x_origin);
+        const int in_x_end =
+            std::min(input_width, in_x_origin + params->filter_width);
+        const int filter_count =
+            (in_y_end - in_y_begin) * (in_x_end - in_x_begin);
+        int8_t* output_pixel =
+            output_data +
+            ((batch * output_height + out_y) * output_width + out_x) * depth;
+        for (int c0 = 0; c0 < depth; c0 += kChannelBlock) {
+          const int block = std::min(kChannelBlock, depth - c0);
+          std::fill(acc, acc + block, 0);
+          for (int in_y = in_y_begin; in_y < in_y_end; ++in_y) {
+            for (int in_x = in_x_begin; in_x < in_x_end; ++in_x) {
+              const int8_t* in =
+                  input_batch + (in_y * input_width + in_x) * depth + c0;
+              for (int c = 0; c < block; ++c) {
+                acc[c] += in[c];
+              }
+            }
+          }
+          for (int c = 0; c < block; ++c) {
+            // Round to the closest integer value, as the reference does.
+            int32_t value =
+                acc[c] > 0 ? (acc[c] + filter_count / 2) / filter_count
+                           : (acc[c] - filter_count / 2) / filter_count;
+            value = std::max(value, data->activation_min);
+            value = std::min(value, data->activation_max);
+            output_pixel[c0 + c] = static_cast<int8_t>(value);
+          }
+        }
+      }
+    }
+  }
+}
+
 void AverageEvalFloat(const TfLiteContext* context, const TfLiteNode* node,
                       const TfLitePoolParams* params, const OpData* data,
                       const TfLiteEvalTensor* input, TfLiteEvalTensor* output) {
@@ -82,6 +286,11 @@ void AverageEvalQuantized(TfLiteContext* context, const TfLiteNode* node,
                           TfLiteEvalTensor* output) {
   TFLITE_DCHECK(input->type == kTfLiteUInt8 || input->type == kTfLiteInt8);
 
+  if (data->int8_kernel == Int8Kernel::kAverage) {
+    AveragePoolInt8(params, data, input, output);
+    return;
+  }
+
   PoolParams op_params;
   op_params.stride_height = params->stride_height;
   op_params.stride_width = params->stride_width;
@@ -106,33 +315,62 @@ void AverageEvalQuantized(TfLiteContext* context, const TfLiteNode* node,
   }
 }
 
+// Only output rows [output_row_begin, output_row_end) are computed. The
+// reference kernels are handed a shorter output that starts at
+// output_row_begin, with the padding moved up to match.
 void MaxEvalFloat(TfLiteContext* context, TfLiteNode* node,
                   TfLitePoolParams* params, const OpData* data,
-                  const TfLiteEvalTensor* input, TfLiteEvalTensor* output) {
+                  const TfLiteEvalTensor* input, TfLiteEvalTensor* output,
+                  int output_row_begin, int output_row_end) {
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_row_size = output_shape.FlatSize() / output_shape.Dims(1);
+  output_shape.SetDim(1, output_row_end - output_row_begin);
+
   tflite::PoolParams op_params;
   op_params.stride_height = params->stride_height;
   op_params.stride_width = params->stride_width;
   op_params.filter_height = params->filter_height;
   op_params.filter_width = params->filter_width;
-  op_params.padding_values.height = data->padding.height;
+  op_params.padding_values.height =
+      data->padding.height - output_row_begin * params->stride_height;
   op_params.padding_values.width = data->padding.width;
   op_params.float_activation_min = data->activation_min_f32;
   op_params.float_activation_max = data->activation_max_f32;
   reference_ops::MaxPool(op_params, tflite::micro::GetTensorShape(input),
                          tflite::micro::GetTensorData<float>(input),
-                         tflite::micro::GetTensorShape(output),
-                         tflite::micro::GetTensorData<float>(output));
+                         output_shape,
+                         tflite::micro::GetTensorData<float>(output) +
+                             output_row_begin * output_row_size);
 }
 
 void MaxEvalQuantized(TfLiteContext* context, TfLiteNode* node,
                       TfLitePoolParams* params, const OpData* data,
-                      const TfLiteEvalTensor* input, TfLiteEvalTensor* output) {
+                      const TfLiteEvalTensor* input, TfLiteEvalTensor* output,
+                      int output_row_begin, int output_row_end) {
+  switch (data->int8_kernel) {
+    case Int8Kernel::kMax2x2:
+      MaxPoolInt8<2, 2>(params, data, input, output, output_row_begin,
+                        output_row_end);
+      return;
+    case Int8Kernel::kMax3x3:
+      MaxPoolInt8<3, 3>(params, data, input, output, output_row_begin,
+                        output_row_end);
+      return;
+    default:
+      break;
+  }
+
+  RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+  const int output_row_size = output_shape.FlatSize() / output_shape.Dims(1);
+  output_shape.SetDim(1, output_row_end - output_row_begin);
+
   tflite::PoolParams op_params;
   op_params.stride_height = params->stride_height;
   op_params.stride_width = params->stride_width;
   op_params.filter_height = params->filter_height;
   op_params.filter_width = params->filter_width;
-  op_params.padding_values.height = data->padding.height;
+  op_params.padding_values.height =
+      data->padding.height - output_row_begin * params->stride_height;
   op_params.padding_values.width = data->padding.width;
   op_params.quantized_activation_min = data->activation_min;
   op_params.quantized_activation_max = data->activation_max;
@@ -140,14 +378,15 @@ void MaxEvalQuantized(TfLiteContext* context, TfLiteNode* node,
   if (input->type == kTfLiteUInt8) {
     reference_ops::MaxPool(op_params, tflite::micro::GetTensorShape(input),
                            tflite::micro::GetTensorData<uint8_t>(input),
-                           tflite::micro::GetTensorShape(output),
-                           tflite::micro::GetTensorData<uint8_t>(output));
+                           output_shape,
+                           tflite::micro::GetTensorData<uint8_t>(output) +
+                               output_row_begin * output_row_size);
   } else {
     reference_integer_ops::MaxPool(
         op_params, tflite::micro::GetTensorShape(input),
-        tflite::micro::GetTensorData<int8_t>(input),
-        tflite::micro::GetTensorShape(output),
-        tflite::micro::GetTensorData<int8_t>(output));
+        tflite::micro::GetTensorData<int8_t>(input), output_shape,
+        tflite::micro::GetTensorData<int8_t>(output) +
+            output_row_begin * output_row_size);
   }
 }
 }  // namespace
@@ -193,28 +432,84 @@ TfLiteStatus MaxEval(TfLiteContext* context, TfLiteNode* node) {
   TfLiteEvalTensor* output =
       tflite::micro::GetEvalOutput(context, node, kOutputTensor);
 
+  // When streaming, rows that are unchanged since the last invocation are
+  // copied from the cache and only the rest of the output is computed.
+  const int output_rows = output->dims->data[1];
+  int reused_begin = 0;
+  int reused_end = 0;
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (data->row_cache != nullptr) {
+    tflite::micro::ReuseStreamingRows(
+        data->row_cache, tflite::micro::GetTensorData<uint8_t>(input),
+        tflite::micro::GetTensorData<uint8_t>(output), &reused_begin,
+        &reused_end);
+  }
+#endif
+
   switch (input->type) {
     case kTfLiteFloat32:
-      MaxEvalFloat(context, node, params, data, input, output);
+      if (reused_begin > 0) {
+        MaxEvalFloat(context, node, params, data, input, output, 0,
+                     reused_begin);
+      }
+      if (reused_end < output_rows) {
+        MaxEvalFloat(context, node, params, data, input, output, reused_end,
+                     output_rows);
+      }
       break;
     case kTfLiteUInt8:
     case kTfLiteInt8:
-      MaxEvalQuantized(context, node, params, data, input, output);
+      if (reused_begin > 0) {
+        MaxEvalQuantized(context, node, params, data, input, output, 0,
+                         reused_begin);
+      }
+      if (reused_end < output_rows) {
+        MaxEvalQuantized(context, node, params, data, input, output,
+                         reused_end, output_rows);
+      }
       break;
     default:
       TF_LITE_KERNEL_LOG(context, "Type %s not currently supported.",
                          TfLiteTypeGetName(input->type));
       return kTfLiteError;
   }
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (data->row_cache != nullptr) {
+    tflite::micro::UpdateStreamingRowCache(
+        data->row_cache, tflite::micro::GetTensorData<uint8_t>(input),
+        tflite::micro::GetTensorData<uint8_t>(output));
+  }
+#endif
   return kTfLiteOk;
 }
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   TFLITE_DCHECK(context->AllocatePersistentBuffer != nullptr);
-  return context->AllocatePersistentBuffer(context, sizeof(OpData));
+  void* raw = context->AllocatePersistentBuffer(context, sizeof(OpData));
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (raw != nullptr) {
+    OpData* data = static_cast<OpData*>(raw);
+    data->streaming = false;
+    data->row_cache = nullptr;
+  }
+#endif
+  return raw;
 }
 
-TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+void* InitStreaming(TfLiteContext* context, const char* buffer,
+                    size_t length) {
+  void* raw = Init(context, buffer, length);
+  if (raw != nullptr) {
+    static_cast<OpData*>(raw)->streaming = true;
+  }
+  return raw;
+}
+#endif
+
+TfLiteStatus PreparePooling(TfLiteContext* context, TfLiteNode* node,
+                            bool average) {
   TFLITE_DCHECK(node->builtin_data != nullptr);
   auto* params = reinterpret_cast<TfLitePoolParams*>(node->builtin_data);
 
@@ -236,16 +531,33 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
                                       &data->activation_min,
                                       &data->activation_max);
   }
+  data->int8_kernel = SelectInt8Kernel(params, input, average);
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+  if (data->streaming) {
+    TF_LITE_ENSURE_STATUS(tflite::micro::AllocateStreamingRowCache(
+        context, input, output, params->stride_height, params->filter_height,
+        data->padding.height, &data->row_cache));
+  }
+#endif
 
   return kTfLiteOk;
 }
 
+TfLiteStatus AveragePrepare(TfLiteContext* context, TfLiteNode* node) {
+  return PreparePooling(context, node, /*average=*/true);
+}
+
+TfLiteStatus MaxPrepare(TfLiteContext* context, TfLiteNode* node) {
+  return PreparePooling(context, node, /*average=*/false);
+}
+
 }  // namespace pooling
 
 TfLiteRegistration Register_AVERAGE_POOL_2D() {
   return {/*init=*/pooling::Init,
           /*free=*/nullptr,
-          /*prepare=*/pooling::Prepare,
+          /*prepare=*/pooling::AveragePrepare,
           /*invoke=*/pooling::AverageEval,
           /*profiling_string=*/nullptr,
           /*builtin_code=*/0,
@@ -256,13 +568,26 @@ TfLiteRegistration Register_AVERAGE_POOL_2D() {
 TfLiteRegistration Register_MAX_POOL_2D() {
   return {/*init=*/pooling::Init,
           /*free=*/nullptr,
-          /*prepare=*/pooling::Prepare,
+          /*prepare=*/pooling::MaxPrepare,
+          /*invoke=*/pooling::MaxEval,
+          /*profiling_string=*/nullptr,
+          /*builtin_code=*/0,
+          /*custom_name=*/nullptr,
+          /*version=*/0};
+}
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+TfLiteRegistration Register_MAX_POOL_2D_STREAMING() {
+  return {/*init=*/pooling::InitStreaming,
+          /*free=*/nullptr,
+          /*prepare=*/pooling::MaxPrepare,
           /*invoke=*/pooling::MaxEval,
           /*profiling_string=*/nullptr,
           /*builtin_code=*/0,
           /*custom_name=*/nullptr,
           /*version=*/0};
 }
+#endif
 
 }  // namespace micro
 }  // namespace ops
@@ -0,0 +1,186 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_MICRO_KERNELS_REQUANTIZE_H_
+#define TENSORFLOW_LITE_MICRO_KERNELS_REQUANTIZE_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "fixedpoint/fixedpoint.h"
+#include "tensorflow/lite/kernels/internal/common.h"
+
+namespace tflite {
+namespace micro {
+
+// Output stage of the int8 kernels over a whole row of int32 accumulators:
+//
+//   output[i] = clamp(MultiplyByQuantizedMultiplier(acc[i], multiplier, shift)
+//                     + output_offset, activation_min, activation_max)
+//
+// The kernels accumulate a row (or a block of channels) first and requantize
+// it in one call instead of one element at a time, so the shifts are split
+// into left and right once per row and the loop has no branches.
+//
+// When gemmlowp detects SSE4.1 or NEON, four lanes at a time go through
+// gemmlowp's fixedpoint SIMD specializations of the same
+// SaturatingRoundingDoublingHighMul and RoundingDivideByPOT that
+// MultiplyByQuantizedMultiplier uses, so the result is bit identical to the
+// scalar loop. Everything else, including the ESP32, runs the scalar loop.
+
+#if defined(GEMMLOWP_NEON) || defined(GEMMLOWP_SSE4)
+#define TF_LITE_MICRO_SIMD_REQUANTIZE
+#endif
+
+namespace requantize_internal {
+
+inline int8_t RequantizeOne(int32_t acc, int32_t multiplier, int left_shift,
+                            int right_shift, int32_t output_offset,
+                            int32_t activation_min, int32_t activation_max) {
+  int32_t value = gemmlowp::RoundingDivideByPOT(
+      gemmlowp::SaturatingRoundingDoublingHighMul(acc * (1 << left_shift),
+                                                  multiplier),
+      right_shift);
+  value += output_offset;
+  value = std::max(value, activation_min);
+  value = std::min(value, activation_max);
+  return static_cast<int8_t>(value);
+}
+
+#ifdef TF_LITE_MICRO_SIMD_REQUANTIZE
+#ifdef GEMMLOWP_NEON
+using Int32x4 = int32x4_t;
+
+inline Int32x4 LoadInt32x4(const int32_t* values) { return vld1q_s32(values); }
+
+// The lanes are already clamped to the int8 range, so narrowing is exact.
+inline void StoreInt8x4(Int32x4 values, int8_t* output) {
+  const int16x4_t narrow = vmovn_s32(values);
+  const int8x8_t bytes = vmovn_s16(vcombine_s16(narrow, narrow));
+  const int32_t packed = vget_lane_s32(vreinterpret_s32_s8(bytes), 0);
+  memcpy(output, &packed, sizeof(packed));
+}
+#else
+using Int32x4 = __m128i;
+
+inline Int32x4 LoadInt32x4(const int32_t* values) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+}
+
+inline void StoreInt8x4(Int32x4 values, int8_t* output) {
+  const __m128i narrow = _mm_packs_epi32(values, values);
+  const int32_t packed = _mm_cvtsi128_si32(_mm_packs_epi16(narrow, narrow));
+  memcpy(output, &packed, sizeof(packed));
+}
+#endif
+
+inline void RequantizeFour(Int32x4 acc, Int32x4 multiplier, int left_shift,
+                           int right_shift, Int32x4 output_offset,
+                           Int32x4 activation_min, Int32x4 activation_max,
+                           int8_t* output) {
+  using gemmlowp::MaskIfGreaterThan;
+  using gemmlowp::MaskIfLessThan;
+  using gemmlowp::SelectUsingMask;
+  Int32x4 value = gemmlowp::RoundingDivideByPOT(
+      gemmlowp::SaturatingRoundingDoublingHighMul(
+          gemmlowp::ShiftLeft(acc, left_shift), multiplier),
+      right_shift);
+  value = gemmlowp::Add(value, output_offset);
+  value = SelectUsingMask(MaskIfLessThan(value, activation_min),
+                          activation_min, value);
+  value = SelectUsingMask(MaskIfGreaterThan(value, activation_max),
+                          activation_max, value);
+  StoreInt8x4(value, output);
+}
+#endif  // TF_LITE_MICRO_SIMD_REQUANTIZE
+
+}  // namespace requantize_internal
+
+// Requantizes `size` accumulators that share one multiplier and shift, as in
+// FULLY_CONNECTED, ADD and MUL.
+inline void RequantizeInt8(const int32_t* acc, int size, int32_t multiplier,
+                           int shift, int32_t output_offset,
+                           int32_t activation_min, int32_t activation_max,
+                           int8_t* output) {
+  const int left_shift = shift > 0 ? shift : 0;
+  const int right_shift = shift > 0 ? 0 : -shift;
+  int i = 0;
+#ifdef TF_LITE_MICRO_SIMD_REQUANTIZE
+  using requantize_internal::Int32x4;
+  const Int32x4 multiplier_x4 = gemmlowp::Dup<Int32x4>(multiplier);
+  const Int32x4 offset_x4 = gemmlowp::Dup<Int32x4>(output_offset);
+  const Int32x4 min_x4 = gemmlowp::Dup<Int32x4>(activation_min);
+  const Int32x4 max_x4 = gemmlowp::Dup<Int32x4>(activation_max);
+  for (; i + 4 <= size; i += 4) {
+    requantize_internal::RequantizeFour(
+        requantize_internal::LoadInt32x4(acc + i), multiplier_x4, left_shift,
+        right_shift, offset_x4, min_x4, max_x4, output + i);
+  }
+#endif
+  for (; i < size; ++i) {
+    output[i] = requantize_internal::RequantizeOne(
+        acc[i], multiplier, left_shift, right_shift, output_offset,
+        activation_min, activation_max);
+  }
+}
+
+// Requantizes `size` accumulators of consecutive channels with the per channel
+// multipliers and shifts of CONV_2D and DEPTHWISE_CONV_2D. The SIMD loop needs
+// the same shift across four channels, which neighbouring channels of similar
+// scale usually have. Groups that don't are done one channel at a time.
+inline void RequantizeInt8PerChannel(const int32_t* acc, int size,
+                                     const int32_t* multiplier,
+                                     const int32_t* shift,
+                                     int32_t output_offset,
+                                     int32_t activation_min,
+                                     int32_t activation_max, int8_t* output) {
+  int i = 0;
+#ifdef TF_LITE_MICRO_SIMD_REQUANTIZE
+  using requantize_internal::Int32x4;
+  const Int32x4 offset_x4 = gemmlowp::Dup<Int32x4>(output_offset);
+  const Int32x4 min_x4 = gemmlowp::Dup<Int32x4>(activation_min);
+  const Int32x4 max_x4 = gemmlowp::Dup<Int32x4>(activation_max);
+  for (; i + 4 <= size; i += 4) {
+    const int group_shift = shift[i];
+    if (shift[i + 1] == group_shift && shift[i + 2] == group_shift &&
+        shift[i + 3] == group_shift) {
+      requantize_internal::RequantizeFour(
+          requantize_internal::LoadInt32x4(acc + i),
+          requantize_internal::LoadInt32x4(multiplier + i),
+          group_shift > 0 ? group_shift : 0, group_shift > 0 ? 0 : -group_shift,
+          offset_x4, min_x4, max_x4, output + i);
+      continue;
+    }
+    for (int j = i; j < i + 4; ++j) {
+      output[j] = requantize_internal::RequantizeOne(
+          acc[j], multiplier[j], shift[j] > 0 ? shift[j] : 0,
+          shift[j] > 0 ? 0 : -shift[j], output_offset, activation_min,
+          activation_max);
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    output[i] = requantize_internal::RequantizeOne(
+        acc[i], multiplier[i], shift[i] > 0 ? shift[i] : 0,
+        shift[i] > 0 ? 0 : -shift[i], output_offset, activation_min,
+        activation_max);
+  }
+}
+
+}  // namespace micro
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_KERNELS_REQUANTIZE_H_
@@ -0,0 +1,127 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/micro/kernels/streaming_rows.h"
+
+#ifdef TF_LITE_MICRO_STREAMING_ROWS
+
+#include <algorithm>
+#include <cstring>
+
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "tensorflow/lite/kernels/kernel_util.h"
+
+namespace tflite {
+namespace micro {
+
+namespace {
+
+// Finds the smallest multiple of the stride that the previous input has to be
+// shifted up by to give the current input. Returns -1 if there is none.
+int FindRowShift(const StreamingRowCache* cache, const uint8_t* input) {
+  const int rows = cache->input_rows;
+  const int row_bytes = cache->input_row_bytes;
+  for (int shift = 0; shift < rows; shift += cache->stride) {
+    const uint8_t* previous = cache->input + shift * row_bytes;
+    // Check the first row before comparing the whole overlap.
+    if (memcmp(input, previous, row_bytes) == 0 &&
+        memcmp(input, previous, (rows - shift) * row_bytes) == 0) {
+      return shift;
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+TfLiteStatus AllocateStreamingRowCache(TfLiteContext* context,
+                                       const TfLiteTensor* input,
+                                       const TfLiteTensor* output, int stride,
+                                       int filter_extent, int padding,
+                                       StreamingRowCache** cache) {
+  *cache = nullptr;
+  if (NumDimensions(input) != 4 || NumDimensions(output) != 4 ||
+      SizeOfDimension(input, 0) != 1) {
+    return kTfLiteOk;
+  }
+  StreamingRowCache* result = static_cast<StreamingRowCache*>(
+      context->AllocatePersistentBuffer(context, sizeof(StreamingRowCache)));
+  TF_LITE_ENSURE(context, result != nullptr);
+  result->input_rows = SizeOfDimension(input, 1);
+  result->input_row_bytes = input->bytes / result->input_rows;
+  result->output_rows = SizeOfDimension(output, 1);
+  result->output_row_bytes = output->bytes / result->output_rows;
+  result->stride = stride;
+  result->filter_extent = filter_extent;
+  result->padding = padding;
+  result->valid = false;
+  result->input = static_cast<uint8_t*>(
+      context->AllocatePersistentBuffer(context, input->bytes));
+  TF_LITE_ENSURE(context, result->input != nullptr);
+  result->output = static_cast<uint8_t*>(
+      context->AllocatePersistentBuffer(context, output->bytes));
+  TF_LITE_ENSURE(context, result->output != nullptr);
+  *cache = result;
+  return kTfLiteOk;
+}
+
+void ReuseStreamingRows(const StreamingRowCache* cache, const uint8_t* input,
+                        uint8_t* output, int* reused_begin, int* reused_end) {
+  *reused_begin = 0;
+  *reused_end = 0;
+  if (!cache->valid) {
+    return;
+  }
+  const int shift = FindRowShift(cache, input);
+  if (shift < 0) {
+    return;
+  }
+  int first = 0;
+  int last = cache->output_rows - 1;
+  if (shift > 0) {
+    // Output row o reads input rows [o * stride - padding,
+    // o * stride - padding + filter_extent). They must all be real rows of
+    // the overlap, i.e. not padding in either window.
+    const int last_input_row =
+        cache->input_rows - shift - cache->filter_extent + cache->padding;
+    if (last_input_row < 0) {
+      return;
+    }
+    first = (cache->padding + cache->stride - 1) / cache->stride;
+    last = std::min(last_input_row / cache->stride,
+                    cache->output_rows - 1 - shift / cache->stride);
+    if (first > last) {
+      return;
+    }
+  }
+  const int row_bytes = cache->output_row_bytes;
+  memcpy(output + first * row_bytes,
+         cache->output + (first + shift / cache->stride) * row_bytes,
+         (last - first + 1) * row_bytes);
+  *reused_begin = first;
+  *reused_end = last + 1;
+}
+
+void UpdateStreamingRowCache(StreamingRowCache* cache, const uint8_t* input,
+                             const uint8_t* output) {
+  memcpy(cache->input, input, cache->input_rows * cache->input_row_bytes);
+  memcpy(cache->output, output, cache->output_rows * cache->output_row_bytes);
+  cache->valid = true;
+}
+
+}  // namespace micro
+}  // namespace tflite
+
+#endif  // TF_LITE_MICRO_STREAMING_ROWS
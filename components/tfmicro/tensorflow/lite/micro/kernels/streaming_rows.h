@@ -0,0 +1,82 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_LITE_MICRO_KERNELS_STREAMING_ROWS_H_
+#define TENSORFLOW_LITE_MICRO_KERNELS_STREAMING_ROWS_H_
+
+#include <cstdint>
+
+#include "tensorflow/lite/c/common.h"
+
+namespace tflite {
+namespace micro {
+
+// Streaming support for time-causal layers (Conv2D, MaxPool2D) that run on a
+// sliding window of rows, e.g. a spectrogram where each invocation drops the
+// oldest rows and appends new ones at the bottom.
+//
+// The cache keeps a copy of the previous input and output of the layer in
+// persistent arena memory. On each invocation the new input is compared with
+// the previous one to find how many rows it has been shifted up by. Output
+// rows whose receptive field lies entirely in rows that are present in both
+// windows are copied from the previous output, only the remaining rows (the
+// new rows at the bottom and the ones touching padding) have to be computed.
+// Rows are only reused when the input rows are bit identical, so the result
+// always matches a full evaluation of the window.
+//
+// Only built when TF_LITE_MICRO_STREAMING_ROWS is defined. The cache doubles
+// the arena a layer needs, and the rows only stay bit identical if the
+// front end leaves rows alone once they are computed, which the per-window
+// normalisation in this project's AudioProcessor doesn't, so the product
+// build leaves it out and tools/streaming_equivalence checks it on the host.
+struct StreamingRowCache {
+  uint8_t* input;
+  uint8_t* output;
+  int input_rows;
+  int input_row_bytes;
+  int output_rows;
+  int output_row_bytes;
+  // Height geometry of the layer: stride, dilated filter extent and the
+  // padding added above the first row.
+  int stride;
+  int filter_extent;
+  int padding;
+  bool valid;
+};
+
+// Allocates the cache for a layer with the given input and output tensors.
+// Must be called from Prepare. Sets *cache to nullptr if the tensors can't be
+// streamed (batch size other than 1).
+TfLiteStatus AllocateStreamingRowCache(TfLiteContext* context,
+                                       const TfLiteTensor* input,
+                                       const TfLiteTensor* output, int stride,
+                                       int filter_extent, int padding,
+                                       StreamingRowCache** cache);
+
+// Copies the output rows that can be reused from the previous invocation into
+// `output`. On return the rows in [*reused_begin, *reused_end) are valid and
+// everything outside that range still has to be computed. The range is empty
+// when nothing could be reused.
+void ReuseStreamingRows(const StreamingRowCache* cache, const uint8_t* input,
+                        uint8_t* output, int* reused_begin, int* reused_end);
+
+// Remembers the input and output of this invocation for the next one.
+void UpdateStreamingRowCache(StreamingRowCache* cache, const uint8_t* input,
+                             const uint8_t* output);
+
+}  // namespace micro
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_KERNELS_STREAMING_ROWS_H_
@@ -39,91 +39,96 @@ struct OpData {
   // shift value - typically between [-32, 32].
   int effective_scale_1_b;
   int effective_scale_2_b;
-  int scratch_tensor_index;
-  int scratch_output_tensor_index;
 
   // Cached tensor zero point values for quantized operations.
   int input_zero_point;
   int output_zero_point;
+
+  // Each filter's row of the activation state is a ring buffer of memory_size
+  // entries instead of being shifted left every invocation. This is the slot
+  // of the oldest entry, which the next activation overwrites.
+  int state_index;
+
+  // input_zero_point * sum(row) for each row of weights_feature, so the
+  // feature matmul runs on the raw int8 input.
+  int32_t* feature_zero_point_sums;
 };
 
 /**
  * This version of SVDF is specific to TFLite Micro. It contains the following
  * differences between the TFLite version:
  *
- * 1.) Scratch tensor allocation - scratch tensors must be known ahead of time
- * for the Micro interpreter.
- * 2.) Output dimensions - the TFLite version determines output size and runtime
+ * 1.) Output dimensions - the TFLite version determines output size and runtime
  * and resizes the output tensor. Micro runtime does not support tensor
  * resizing.
+ *
+ * It is also written for streaming, one invocation per hop:
+ *
+ * 1.) The activation state is a ring buffer indexed by OpData::state_index
+ * rather than memmoved by one entry per invocation. The entries of a row are
+ * rotated by state_index compared to the TFLite layout.
+ * 2.) The time weights dot product, the rank reduction, bias and requantize
+ * are done per unit in one pass, so no scratch buffers are needed.
+ * 3.) The int8 feature matmul has the input zero point folded out of the inner
+ * loop and accumulates four products at a time.
+ *
+ * Integer results are identical to the reference kernel and float results
+ * sum in the same order, so they are identical too.
  */
-static inline void ApplyTimeWeightsBiasAndActivation(
-    int batch_size, int memory_size, int num_filters, int num_units, int rank,
-    const float* const __restrict__ weights_time_ptr,
-    const float* const __restrict__ bias_ptr, TfLiteFusedActivation activation,
-    float* const __restrict__ state_ptr, float* const __restrict__ scratch_ptr,
-    float* const __restrict__ output_ptr) {
-  // Compute matmul(activation_state, weights_time).
-  for (int b = 0; b < batch_size; ++b) {
-    // Perform batched vector dot product:
-    float* scratch_ptr_batch = scratch_ptr + b * num_filters;
-    const float* vector1_ptr = weights_time_ptr;
-    const float* vector2_ptr = state_ptr + b * memory_size * num_filters;
-    for (int i = 0; i < num_filters; ++i) {
-      *scratch_ptr_batch = 0.f;
-      for (int j = 0; j < memory_size; ++j) {
-        *scratch_ptr_batch += *vector1_ptr++ * *vector2_ptr++;
-      }
-      scratch_ptr_batch++;
-    }
-  }
 
-  // Initialize output with bias if provided.
-  if (bias_ptr) {
-    // VectorBatchVectorAssign
-    for (int i = 0; i < batch_size; ++i) {
-      float* output_data = output_ptr + i * num_units;
-      const float* bias_data = bias_ptr;
-      for (int j = 0; j < num_units; ++j) {
-        *output_data++ = *bias_data++;
-      }
-    }
-  } else {
-    float* output_data = output_ptr;
-    for (int i = 0; i < batch_size * num_units; ++i) {
-      *output_data++ = 0.0f;
-    }
+// Dot product of a and b, four independent accumulators to keep the
+// multiplier busy. Integer addition is exact, so the order does not matter.
+template <typename T>
+inline int32_t DotProduct(const T* __restrict__ a, const T* __restrict__ b,
+                          int size) {
+  int32_t acc0 = 0;
+  int32_t acc1 = 0;
+  int32_t acc2 = 0;
+  int32_t acc3 = 0;
+  int i = 0;
+  for (; i <= size - 4; i += 4) {
+    acc0 += a[i] * b[i];
+    acc1 += a[i + 1] * b[i + 1];
+    acc2 += a[i + 2] * b[i + 2];
+    acc3 += a[i + 3] * b[i + 3];
+  }
+  for (; i < size; ++i) {
+    acc0 += a[i] * b[i];
   }
+  return acc0 + acc1 + acc2 + acc3;
+}
 
-  // Reduction sum.
-  for (int b = 0; b < batch_size; ++b) {
-    float* output_ptr_batch = output_ptr + b * num_units;
-    float* scratch_ptr_batch = scratch_ptr + b * num_filters;
+// Dot product of a filter's time weights with its row of the activation
+// state, oldest entry first. `oldest` is the ring buffer slot of the oldest
+// entry, so the row is read in two contiguous runs.
+inline int32_t TimeDotProduct(const int16_t* weights, const int16_t* state,
+                              int memory_size, int oldest) {
+  const int first_run = memory_size - oldest;
+  return DotProduct(weights, state + oldest, first_run) +
+         DotProduct(weights + first_run, state, oldest);
+}
 
-    // Reduction sum vector
-    for (int i = 0; i < num_units; ++i) {
-      for (int j = 0; j < rank; j++) {
-        output_ptr_batch[i] += *scratch_ptr_batch++;
-      }
-    }
+// Float version, summed oldest to newest like the reference kernel.
+inline float TimeDotProduct(const float* weights, const float* state,
+                            int memory_size, int oldest) {
+  const int first_run = memory_size - oldest;
+  float dot_prod = 0.0f;
+  for (int j = 0; j < first_run; ++j) {
+    dot_prod += weights[j] * state[oldest + j];
   }
-
-  // Apply activation.
-  for (int b = 0; b < batch_size; ++b) {
-    float* output_ptr_batch = output_ptr + b * num_units;
-    for (int i = 0; i < num_units; ++i) {
-      *output_ptr_batch = ActivationValFloat(activation, *output_ptr_batch);
-      ++output_ptr_batch;
-    }
+  for (int j = 0; j < oldest; ++j) {
+    dot_prod += weights[first_run + j] * state[j];
   }
+  return dot_prod;
 }
 
-inline void EvalFloatSVDF(
-    TfLiteContext* context, TfLiteNode* node, const TfLiteEvalTensor* input,
-    const TfLiteEvalTensor* weights_feature,
-    const TfLiteEvalTensor* weights_time, const TfLiteEvalTensor* bias,
-    const TfLiteSVDFParams* params, int scratch_tensor_index,
-    TfLiteEvalTensor* activation_state, TfLiteEvalTensor* output) {
+inline void EvalFloatSVDF(const TfLiteEvalTensor* input,
+                          const TfLiteEvalTensor* weights_feature,
+                          const TfLiteEvalTensor* weights_time,
+                          const TfLiteEvalTensor* bias,
+                          const TfLiteSVDFParams* params,
+                          TfLiteEvalTensor* activation_state,
+                          TfLiteEvalTensor* output, OpData* data) {
   const int rank = params->rank;
   const int batch_size = input->dims->data[0];
   const int input_size = input->dims->data[1];
@@ -137,68 +142,48 @@ inline void EvalFloatSVDF(
       tflite::micro::GetTensorData<float>(weights_time);
   const float* bias_ptr = tflite::micro::GetTensorData<float>(bias);
   const float* input_ptr = tflite::micro::GetTensorData<float>(input);
-
   float* state_ptr = tflite::micro::GetTensorData<float>(activation_state);
-
-  TFLITE_DCHECK(context != nullptr);
-  TFLITE_DCHECK(context->GetScratchBuffer != nullptr);
-
-  float* scratch_ptr = static_cast<float*>(
-      context->GetScratchBuffer(context, scratch_tensor_index));
-
   float* output_ptr = tflite::micro::GetTensorData<float>(output);
 
-  // Left shift the activation_state.
-  {
-    float* new_state_start = state_ptr;
-    const float* old_state_start = state_ptr + 1;
-    const float* old_state_end =
-        state_ptr + batch_size * num_filters * memory_size;
-    while (old_state_start != old_state_end) {
-      *new_state_start++ = *old_state_start++;
+  const int newest = data->state_index;
+  const int oldest = newest + 1 == memory_size ? 0 : newest + 1;
+  for (int b = 0; b < batch_size; ++b) {
+    const float* input_batch = input_ptr + b * input_size;
+    float* state_batch = state_ptr + b * num_filters * memory_size;
+
+    // Compute conv1d(inputs, weights_feature) into the newest slot.
+    const float* matrix_ptr = weights_feature_ptr;
+    for (int f = 0; f < num_filters; ++f) {
+      float dot_prod = 0.0f;
+      for (int k = 0; k < input_size; ++k) {
+        dot_prod += *matrix_ptr++ * input_batch[k];
+      }
+      state_batch[f * memory_size + newest] = dot_prod;
     }
-  }
 
-  // Note: no need to clear the latest activation, matmul is not accumulative.
-
-  // Compute conv1d(inputs, weights_feature).
-  // The activation_state's rightmost column is used to save current cycle
-  // activation. This is achieved by starting at state_ptr[memory_size - 1] and
-  // having the stride equal to memory_size.
-
-  // Perform batched matrix vector multiply operation:
-  {
-    const float* matrix = weights_feature_ptr;
-    const float* vector = input_ptr;
-    float* result = &state_ptr[memory_size - 1];
-    float* result_in_batch = result;
-    for (int i = 0; i < batch_size; ++i) {
-      const float* matrix_ptr = matrix;
-      for (int j = 0; j < num_filters; ++j) {
-        float dot_prod = 0.0f;
-        const float* vector_in_batch = vector + i * input_size;
-        for (int k = 0; k < input_size; ++k) {
-          dot_prod += *matrix_ptr++ * *vector_in_batch++;
-        }
-        *result_in_batch = dot_prod;
-        result_in_batch += memory_size;
+    // matmul(activation_state, weights_time), reduced over the rank.
+    float* output_batch = output_ptr + b * num_units;
+    for (int u = 0; u < num_units; ++u) {
+      float sum = bias_ptr ? bias_ptr[u] : 0.0f;
+      for (int r = 0; r < rank; ++r) {
+        const int f = u * rank + r;
+        sum += TimeDotProduct(weights_time_ptr + f * memory_size,
+                              state_batch + f * memory_size, memory_size,
+                              oldest);
       }
+      output_batch[u] = ActivationValFloat(params->activation, sum);
     }
   }
-
-  ApplyTimeWeightsBiasAndActivation(
-      batch_size, memory_size, num_filters, num_units, rank, weights_time_ptr,
-      bias_ptr, params->activation, state_ptr, scratch_ptr, output_ptr);
+  data->state_index = oldest;
 }
 
-void EvalIntegerSVDF(TfLiteContext* context, TfLiteNode* node,
-                     const TfLiteEvalTensor* input_tensor,
+void EvalIntegerSVDF(const TfLiteEvalTensor* input_tensor,
                      const TfLiteEvalTensor* weights_feature_tensor,
                      const TfLiteEvalTensor* weights_time_tensor,
                      const TfLiteEvalTensor* bias_tensor,
                      const TfLiteSVDFParams* params,
                      TfLiteEvalTensor* activation_state_tensor,
-                     TfLiteEvalTensor* output_tensor, const OpData& data) {
+                     TfLiteEvalTensor* output_tensor, OpData* data) {
   const int n_rank = params->rank;
   const int n_batch = input_tensor->dims->data[0];
   const int n_input = input_tensor->dims->data[1];
@@ -206,133 +191,59 @@ void EvalIntegerSVDF(TfLiteContext* context, TfLiteNode* node,
   const int n_unit = n_filter / n_rank;
   const int n_memory = weights_time_tensor->dims->data[1];
 
-  TFLITE_DCHECK(context != nullptr);
-  TFLITE_DCHECK(context->GetScratchBuffer != nullptr);
-
-  int32_t* scratch_tensor = static_cast<int32_t*>(
-      context->GetScratchBuffer(context, data.scratch_tensor_index));
-  int32_t* scratch_output_tensor = static_cast<int32_t*>(
-      context->GetScratchBuffer(context, data.scratch_output_tensor_index));
-
-  // Shift states.
-  int16_t* const state_ptr =
+  const int8_t* input = tflite::micro::GetTensorData<int8_t>(input_tensor);
+  const int8_t* weight_feature =
+      tflite::micro::GetTensorData<int8_t>(weights_feature_tensor);
+  const int16_t* weight_time =
+      tflite::micro::GetTensorData<int16_t>(weights_time_tensor);
+  const int32_t* bias =
+      bias_tensor ? tflite::micro::GetTensorData<int32_t>(bias_tensor)
+                  : nullptr;
+  int16_t* state =
       tflite::micro::GetTensorData<int16_t>(activation_state_tensor);
-
-  // Left shift the activation_state.
-  {
-    int16_t* new_state_start = state_ptr;
-    const int16_t* old_state_start = state_ptr + 1;
-    const int16_t* old_state_end = state_ptr + n_batch * n_filter * n_memory;
-    while (old_state_start != old_state_end) {
-      *new_state_start++ = *old_state_start++;
-    }
-  }
-
-  // Note: no need to clear the latest activation, matmul is not accumulative.
-
-  // Feature matmul.
-  {
-    int16_t* state =
-        tflite::micro::GetTensorData<int16_t>(activation_state_tensor);
-    const int8_t* input = tflite::micro::GetTensorData<int8_t>(input_tensor);
-    const int8_t* weight_feature =
-        tflite::micro::GetTensorData<int8_t>(weights_feature_tensor);
-    const int32_t output_max = std::numeric_limits<int16_t>::max();
-    const int32_t output_min = std::numeric_limits<int16_t>::min();
-    int16_t* result_in_batch = state + (n_memory - 1);
-    for (int b = 0; b < n_batch; b++) {
-      const int8_t* matrix_ptr = weight_feature;
-      for (int r = 0; r < n_filter; r++) {
-        int32_t dot_prod = 0;
-        const int8_t* vector_in_batch = input + b * n_input;
-        for (int c = 0; c < n_input; c++) {
-          dot_prod +=
-              *matrix_ptr++ * (*vector_in_batch++ - data.input_zero_point);
-        }
-        dot_prod = MultiplyByQuantizedMultiplier(
-            dot_prod, data.effective_scale_1_a, data.effective_scale_1_b);
-        dot_prod = std::min(std::max(output_min, dot_prod), output_max);
-        // This assumes state is symmetrically quantized. Otherwise last bit of
-        // state should be initialized to its zero point and accumulate the
-        // dot_prod.
-        // Equivalent as the following:
-        //     result_in_batch = zero point, which happens to be zero.
-        //     result_in_batch += dot_prod_56.
-        *result_in_batch = dot_prod;
-        result_in_batch += n_memory;
-      }
-    }
-  }
-
-  // Time.
-  {
-    for (int b = 0; b < n_batch; ++b) {
-      int32_t* scratch_ptr_batch = scratch_tensor + b * n_filter;
-
-      // Perform batched vector dot product:
-      const int16_t* vector1_ptr =
-          tflite::micro::GetTensorData<int16_t>(weights_time_tensor);
-      const int16_t* vector2_ptr =
-          tflite::micro::GetTensorData<int16_t>(activation_state_tensor) +
-          b * n_memory * n_filter;
-
-      for (int i = 0; i < n_filter; i++) {
-        *scratch_ptr_batch = 0;
-        for (int j = 0; j < n_memory; j++) {
-          *scratch_ptr_batch += *vector1_ptr++ * *vector2_ptr++;
-        }
-        scratch_ptr_batch++;
-      }
-    }
-  }
-
-  // Reduce, add bias, rescale, activation.
-  {
-    // Add bias.
-    if (bias_tensor) {
-      // Vector batch assign:
-      const int32_t* bias_data =
-          tflite::micro::GetTensorData<int32_t>(bias_tensor);
-      for (int i = 0; i < n_batch; ++i) {
-        int32_t* output_ptr = scratch_output_tensor + i * n_unit;
-        const int32_t* bias_ptr = bias_data;
-        for (int j = 0; j < n_unit; ++j) {
-          *output_ptr++ = *bias_ptr++;
-        }
-      }
-    } else {
-      int32_t* output_ptr = scratch_output_tensor;
-      for (int i = 0; i < n_batch * n_unit; ++i) {
-        *output_ptr++ = 0;
-      }
-    }
-
-    // Reduce.
-    for (int b = 0; b < n_batch; ++b) {
-      int32_t* output_temp_ptr = scratch_output_tensor + b * n_unit;
-      int32_t* scratch_ptr_batch = scratch_tensor + b * n_filter;
-
-      // Reduction sum vector
-      for (int i = 0; i < n_unit; ++i) {
-        for (int j = 0; j < n_rank; ++j) {
-          output_temp_ptr[i] += *scratch_ptr_batch++;
-        }
-      }
+  int8_t* output = tflite::micro::GetTensorData<int8_t>(output_tensor);
+
+  const int newest = data->state_index;
+  const int oldest = newest + 1 == n_memory ? 0 : newest + 1;
+  for (int b = 0; b < n_batch; ++b) {
+    const int8_t* input_batch = input + b * n_input;
+    int16_t* state_batch = state + b * n_filter * n_memory;
+
+    // Feature matmul into the newest slot.
+    const int32_t state_max = std::numeric_limits<int16_t>::max();
+    const int32_t state_min = std::numeric_limits<int16_t>::min();
+    for (int f = 0; f < n_filter; ++f) {
+      int32_t dot_prod =
+          DotProduct(weight_feature + f * n_input, input_batch, n_input) -
+          data->feature_zero_point_sums[f];
+      dot_prod = MultiplyByQuantizedMultiplier(
+          dot_prod, data->effective_scale_1_a, data->effective_scale_1_b);
+      dot_prod = std::min(std::max(state_min, dot_prod), state_max);
+      // This assumes state is symmetrically quantized. Otherwise the slot
+      // should be initialized to its zero point and accumulate dot_prod.
+      state_batch[f * n_memory + newest] = static_cast<int16_t>(dot_prod);
     }
 
-    // Rescale.
+    // Time matmul, reduce over the rank, add bias, rescale.
     const int32_t output_max = std::numeric_limits<int8_t>::max();
     const int32_t output_min = std::numeric_limits<int8_t>::min();
-    for (int i = 0; i < n_batch * n_unit; ++i) {
-      int32_t x1 = scratch_output_tensor[i];
-      int32_t x2 = MultiplyByQuantizedMultiplier(x1, data.effective_scale_2_a,
-                                                 data.effective_scale_2_b);
-      int32_t x3 = x2 + data.output_zero_point;
-      int32_t x4 = std::min(std::max(output_min, x3), output_max);
-      tflite::micro::GetTensorData<int8_t>(output_tensor)[i] =
-          static_cast<int8_t>(x4);
+    int8_t* output_batch = output + b * n_unit;
+    for (int u = 0; u < n_unit; ++u) {
+      int32_t sum = bias ? bias[u] : 0;
+      for (int r = 0; r < n_rank; ++r) {
+        const int f = u * n_rank + r;
+        sum += TimeDotProduct(weight_time + f * n_memory,
+                              state_batch + f * n_memory, n_memory, oldest);
+      }
+      int32_t x = MultiplyByQuantizedMultiplier(
+                      sum, data->effective_scale_2_a,
+                      data->effective_scale_2_b) +
+                  data->output_zero_point;
+      output_batch[u] =
+          static_cast<int8_t>(std::min(std::max(output_min, x), output_max));
     }
   }
+  data->state_index = oldest;
 }
 
 }  // namespace
@@ -427,6 +338,9 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 
   TFLITE_DCHECK(node->user_data != nullptr);
   OpData* data = static_cast<OpData*>(node->user_data);
+  // A zeroed state is the same in any rotation, so this stays in step with
+  // ResetVariableTensors() without being reset itself.
+  data->state_index = 0;
 
   if (input->type == kTfLiteInt8) {
     TF_LITE_ENSURE_EQ(context, weights_feature->type, kTfLiteInt8);
@@ -460,18 +374,21 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
     data->input_zero_point = input->params.zero_point;
     data->output_zero_point = output->params.zero_point;
 
-    TFLITE_DCHECK(context->RequestScratchBufferInArena != nullptr);
-
-    const TfLiteStatus scratch_status = context->RequestScratchBufferInArena(
-        context, batch_size * num_filters * sizeof(int32_t),
-        &(data->scratch_tensor_index));
-    TF_LITE_ENSURE_OK(context, scratch_status);
-
-    const TfLiteStatus scratch_output_status =
-        context->RequestScratchBufferInArena(
-            context, batch_size * num_units * sizeof(int32_t),
-            &(data->scratch_output_tensor_index));
-    TF_LITE_ENSURE_OK(context, scratch_output_status);
+    // weights_feature is constant, fold the input zero point out of the
+    // feature matmul once here.
+    TF_LITE_ENSURE(context, weights_feature->data.int8 != nullptr);
+    data->feature_zero_point_sums =
+        static_cast<int32_t*>(context->AllocatePersistentBuffer(
+            context, num_filters * sizeof(int32_t)));
+    TF_LITE_ENSURE(context, data->feature_zero_point_sums != nullptr);
+    for (int f = 0; f < num_filters; ++f) {
+      const int8_t* row = weights_feature->data.int8 + f * input_size;
+      int32_t row_sum = 0;
+      for (int k = 0; k < input_size; ++k) {
+        row_sum += row[k];
+      }
+      data->feature_zero_point_sums[f] = row_sum * data->input_zero_point;
+    }
   } else {
     TF_LITE_ENSURE_EQ(context, weights_feature->type, kTfLiteFloat32);
     TF_LITE_ENSURE_EQ(context, weights_time->type, kTfLiteFloat32);
@@ -480,12 +397,6 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
       TF_LITE_ENSURE_EQ(context, bias->type, kTfLiteFloat32);
     }
     TF_LITE_ENSURE_TYPES_EQ(context, output->type, kTfLiteFloat32);
-
-    TFLITE_DCHECK(context->RequestScratchBufferInArena != nullptr);
-    const TfLiteStatus scratch_status = context->RequestScratchBufferInArena(
-        context, batch_size * num_filters * sizeof(float),
-        &(data->scratch_tensor_index));
-    TF_LITE_ENSURE_OK(context, scratch_status);
   }
 
   return kTfLiteOk;
@@ -494,7 +405,7 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   auto* params = reinterpret_cast<TfLiteSVDFParams*>(node->builtin_data);
   TFLITE_DCHECK(node->user_data != nullptr);
-  const OpData& data = *(static_cast<const OpData*>(node->user_data));
+  OpData* data = static_cast<OpData*>(node->user_data);
 
   const TfLiteEvalTensor* input =
       tflite::micro::GetEvalInput(context, node, kInputTensor);
@@ -513,16 +424,15 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 
   switch (weights_feature->type) {
     case kTfLiteFloat32: {
-      EvalFloatSVDF(context, node, input, weights_feature, weights_time, bias,
-                    params, data.scratch_tensor_index, activation_state,
-                    output);
+      EvalFloatSVDF(input, weights_feature, weights_time, bias, params,
+                    activation_state, output, data);
       return kTfLiteOk;
       break;
     }
 
     case kTfLiteInt8: {
-      EvalIntegerSVDF(context, node, input, weights_feature, weights_time, bias,
-                      params, activation_state, output, data);
+      EvalIntegerSVDF(input, weights_feature, weights_time, bias, params,
+                      activation_state, output, data);
       return kTfLiteOk;
       break;
     }
@@ -15,9 +15,61 @@ limitations under the License.
 
 #include "tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
 
+#include <cstring>
+#include <limits>
+
 namespace tflite {
 
-// Simple stable in-place sort function. Not time-efficient for large arrays.
+namespace {
+
+// last_time_tree_ leaf of a buffer that hasn't been placed yet.
+constexpr int kNotPlaced = std::numeric_limits<int>::min();
+
+// Above 1/kMaxActiveFraction of the placed buffers, going through all of them
+// in offset order is cheaper than sorting the simultaneously active ones.
+constexpr int kMaxActiveFraction = 16;
+
+template <typename LessThan>
+void SiftDown(int* ids, int root, int size, const LessThan& less) {
+  while (true) {
+    int largest = root;
+    const int left = 2 * root + 1;
+    const int right = left + 1;
+    if ((left < size) && less(ids[largest], ids[left])) {
+      largest = left;
+    }
+    if ((right < size) && less(ids[largest], ids[right])) {
+      largest = right;
+    }
+    if (largest == root) {
+      return;
+    }
+    const int id_temp = ids[root];
+    ids[root] = ids[largest];
+    ids[largest] = id_temp;
+    root = largest;
+  }
+}
+
+// O(N log N) in-place sort of buffer ids into ascending order. Not stable, so
+// the comparisons need to order every pair of distinct ids.
+template <typename LessThan>
+void HeapSort(int* ids, int size, const LessThan& less) {
+  for (int i = size / 2 - 1; i >= 0; --i) {
+    SiftDown(ids, i, size, less);
+  }
+  for (int i = size - 1; i > 0; --i) {
+    const int id_temp = ids[0];
+    ids[0] = ids[i];
+    ids[i] = id_temp;
+    SiftDown(ids, 0, i, less);
+  }
+}
+
+}  // namespace
+
+// Simple stable in-place sort function. Not time-efficient for large arrays,
+// so the planner itself uses HeapSort() instead.
 // Would normally be in an anonymous namespace to keep it private, but we want
 // to be able to test it externally.
 void ReverseSortInPlace(int* values, int* ids, int size) {
@@ -48,14 +100,20 @@ GreedyMemoryPlanner::GreedyMemoryPlanner(unsigned char* scratch_buffer,
   requirements_ = reinterpret_cast<BufferRequirements*>(next_free);
   next_free += sizeof(BufferRequirements) * max_buffer_count_;
 
-  buffer_sizes_sorted_ = reinterpret_cast<int*>(next_free);
+  buffer_ids_sorted_ = reinterpret_cast<int*>(next_free);
   next_free += sizeof(int) * max_buffer_count_;
 
-  buffer_ids_sorted_ = reinterpret_cast<int*>(next_free);
+  buffers_by_first_time_ = reinterpret_cast<int*>(next_free);
   next_free += sizeof(int) * max_buffer_count_;
 
-  buffers_sorted_by_offset_ = reinterpret_cast<ListEntry*>(next_free);
-  next_free += sizeof(ListEntry) * max_buffer_count_;
+  last_time_tree_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * 2 * max_buffer_count_;
+
+  active_buffer_ids_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * max_buffer_count_;
+
+  buffers_by_offset_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * max_buffer_count_;
 
   buffer_offsets_ = reinterpret_cast<int*>(next_free);
 }
@@ -94,47 +152,135 @@ TfLiteStatus GreedyMemoryPlanner::AddBuffer(
   return kTfLiteOk;
 }
 
-bool GreedyMemoryPlanner::DoesEntryOverlapInTime(
-    const GreedyMemoryPlanner::ListEntry* entry, const int first_time_used,
-    const int last_time_used) const {
-  const BufferRequirements* entry_requirements =
-      &requirements_[entry->requirements_index];
-  if (entry_requirements->first_time_used > last_time_used) {
-    return false;
+void GreedyMemoryPlanner::MarkBufferPlaced(int buffer_id) {
+  const BufferRequirements* placed = &requirements_[buffer_id];
+  const int offset = buffer_offsets_[buffer_id];
+
+  // Insert it into buffers_by_offset_ after any buffers at the same offset.
+  int low = 0;
+  int high = placed_buffer_count_;
+  while (low < high) {
+    const int middle = (low + high) / 2;
+    if (buffer_offsets_[buffers_by_offset_[middle]] <= offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  memmove(&buffers_by_offset_[low + 1], &buffers_by_offset_[low],
+          sizeof(int) * (placed_buffer_count_ - low));
+  buffers_by_offset_[low] = buffer_id;
+  ++placed_buffer_count_;
+
+  // Find the buffer's leaf. buffers_by_first_time_ is ordered by
+  // first_time_used and then by id, so a binary search finds it.
+  low = 0;
+  high = buffer_count_ - 1;
+  while (low < high) {
+    const int middle = (low + high) / 2;
+    const int middle_id = buffers_by_first_time_[middle];
+    const int middle_first_time_used = requirements_[middle_id].first_time_used;
+    if ((middle_first_time_used < placed->first_time_used) ||
+        ((middle_first_time_used == placed->first_time_used) &&
+         (middle_id < buffer_id))) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
   }
-  if (first_time_used > entry_requirements->last_time_used) {
-    return false;
+  int node = buffer_count_ + low;
+  last_time_tree_[node] = placed->last_time_used;
+  while (node > 1) {
+    node /= 2;
+    const int left = last_time_tree_[2 * node];
+    const int right = last_time_tree_[2 * node + 1];
+    last_time_tree_[node] = (left > right) ? left : right;
   }
-  return true;
 }
 
-GreedyMemoryPlanner::ListEntry*
-GreedyMemoryPlanner::NextSimultaneouslyActiveBuffer(
-    const GreedyMemoryPlanner::ListEntry* start, const int first_time_used,
-    const int last_time_used) {
-  ListEntry* result = nullptr;
-  ListEntry* candidate_next_entry;
-  if (start == nullptr) {
-    candidate_next_entry = &buffers_sorted_by_offset_[first_entry_index_];
-  } else {
-    if (start->next_entry_index == -1) {
-      return nullptr;
+bool GreedyMemoryPlanner::CollectActiveBuffers(int node,
+                                               const int first_time_used,
+                                               int max_active_count,
+                                               int* active_count) {
+  // Nothing placed below this node is still in use by first_time_used.
+  if (last_time_tree_[node] < first_time_used) {
+    return true;
+  }
+  if (node >= buffer_count_) {
+    if (*active_count == max_active_count) {
+      return false;
     }
-    candidate_next_entry = &buffers_sorted_by_offset_[start->next_entry_index];
+    active_buffer_ids_[*active_count] =
+        buffers_by_first_time_[node - buffer_count_];
+    ++(*active_count);
+    return true;
   }
-  do {
-    if (DoesEntryOverlapInTime(candidate_next_entry, first_time_used,
-                               last_time_used)) {
-      result = candidate_next_entry;
-      break;
+  return CollectActiveBuffers(2 * node, first_time_used, max_active_count,
+                              active_count) &&
+         CollectActiveBuffers(2 * node + 1, first_time_used,
+                              max_active_count, active_count);
+}
+
+int GreedyMemoryPlanner::FindSimultaneouslyActiveBuffers(
+    const int first_time_used, const int last_time_used) {
+  // The buffers that are first used no later than last_time_used are a
+  // prefix of buffers_by_first_time_.
+  int prefix_length = 0;
+  int high = buffer_count_;
+  while (prefix_length < high) {
+    const int middle = (prefix_length + high) / 2;
+    if (requirements_[buffers_by_first_time_[middle]].first_time_used <=
+        last_time_used) {
+      prefix_length = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  // Of those, collect the placed ones still in use at first_time_used,
+  // walking the tree nodes that exactly cover the prefix. Sorting them by
+  // offset only pays off while they're a small part of everything placed, so
+  // give up on the tree once there are more than that.
+  const int max_active_count = placed_buffer_count_ / kMaxActiveFraction;
+  int active_count = 0;
+  bool collected = true;
+  int left = buffer_count_;
+  int right = buffer_count_ + prefix_length;
+  while (collected && (left < right)) {
+    if (left & 1) {
+      collected = CollectActiveBuffers(left, first_time_used, max_active_count,
+                                       &active_count);
+      ++left;
     }
-    if (candidate_next_entry->next_entry_index == -1) {
-      break;
+    if (collected && (right & 1)) {
+      --right;
+      collected = CollectActiveBuffers(right, first_time_used,
+                                       max_active_count, &active_count);
     }
-    candidate_next_entry =
-        &buffers_sorted_by_offset_[candidate_next_entry->next_entry_index];
-  } while (true);
-  return result;
+    left /= 2;
+    right /= 2;
+  }
+  if (collected) {
+    const int* offsets = buffer_offsets_;
+    HeapSort(active_buffer_ids_, active_count, [offsets](int a, int b) {
+      return offsets[a] < offsets[b];
+    });
+    return active_count;
+  }
+
+  // Most of the placed buffers are in use at the same time as this one, so
+  // filter the offset-ordered list of all of them instead.
+  active_count = 0;
+  for (int i = 0; i < placed_buffer_count_; ++i) {
+    const int placed_id = buffers_by_offset_[i];
+    const BufferRequirements* placed = &requirements_[placed_id];
+    if ((placed->first_time_used <= last_time_used) &&
+        (placed->last_time_used >= first_time_used)) {
+      active_buffer_ids_[active_count] = placed_id;
+      ++active_count;
+    }
+  }
+  return active_count;
 }
 
 void GreedyMemoryPlanner::CalculateOffsetsIfNeeded() {
@@ -154,159 +300,121 @@ void GreedyMemoryPlanner::CalculateOffsetsIfNeeded() {
   for (int i = 0; i < buffer_count_; ++i) {
     if (requirements_[i].offline_offset == kOnlinePlannedBuffer) {
       idx_from_tail--;
-      buffer_sizes_sorted_[idx_from_tail] = requirements_[i].size;
       buffer_ids_sorted_[idx_from_tail] = i;
       buffer_offsets_[i] = -1;
     } else {
-      buffer_sizes_sorted_[idx_from_head] = requirements_[i].size;
       buffer_ids_sorted_[idx_from_head] = i;
       buffer_offsets_[i] = requirements_[i].offline_offset;
       idx_from_head++;
     }
+    buffers_by_first_time_[i] = i;
   }
 
-  // This sorting algorithm is naive, and may end up taking a very long time
-  // with hundreds of buffers. Do not sort the offline planned offsets.
-  ReverseSortInPlace(&buffer_sizes_sorted_[idx_from_head],
-                     &buffer_ids_sorted_[idx_from_head],
-                     buffer_count_ - idx_from_head);
+  // Do not sort the offline planned offsets. Buffers of the same size stay in
+  // descending id order, the order they were collected in above.
+  const BufferRequirements* requirements = requirements_;
+  HeapSort(&buffer_ids_sorted_[idx_from_head], buffer_count_ - idx_from_head,
+           [requirements](int a, int b) {
+             if (requirements[a].size != requirements[b].size) {
+               return requirements[a].size > requirements[b].size;
+             }
+             return a > b;
+           });
+  HeapSort(buffers_by_first_time_, buffer_count_,
+           [requirements](int a, int b) {
+             if (requirements[a].first_time_used !=
+                 requirements[b].first_time_used) {
+               return requirements[a].first_time_used <
+                      requirements[b].first_time_used;
+             }
+             return a < b;
+           });
+  for (int i = 0; i < 2 * buffer_count_; ++i) {
+    last_time_tree_[i] = kNotPlaced;
+  }
+  placed_buffer_count_ = 0;
 
-  // Initialize the first entry to the first buffer in
-  // buffer_ids_sorted_.
+  // Work through the buffers to find a good gap to place each one.
   //   - If there are no offline planned offsets, the largest buffer will be
-  //     first, and the buffers will be handled in size order.
+  //     first and go at offset zero, and the buffers will be handled in size
+  //     order.
   //   - If offline offsets are present, these will be handled first in order
   //     for the greedy algorithm to utilized gaps in the offline plan.
-  first_entry_index_ = 0;
-  next_free_entry_ = 1;
-  ListEntry* first_entry = &buffers_sorted_by_offset_[first_entry_index_];
-  first_entry->next_entry_index = -1;  // to mark the entry as end of list
-  int buffer_id = buffer_ids_sorted_[0];
-  first_entry->requirements_index = buffer_id;
-  if (requirements_[buffer_id].offline_offset == kOnlinePlannedBuffer) {
-    buffer_offsets_[buffer_id] = 0;
-  }
-  first_entry->offset = buffer_offsets_[buffer_id];
-
-  // Work through the rest of the buffers to find a good gap to place each one.
-  for (int i = 1; i < buffer_count_; ++i) {
+  for (int i = 0; i < buffer_count_; ++i) {
     // The id is the order the buffer was originally added by the client.
-    buffer_id = buffer_ids_sorted_[i];
+    const int buffer_id = buffer_ids_sorted_[i];
     // Look at what size and time range the buffer needs to be active.
     BufferRequirements* wanted_requirements = &requirements_[buffer_id];
     const int wanted_size = wanted_requirements->size;
-    const int wanted_first_time_used = wanted_requirements->first_time_used;
-    const int wanted_last_time_used = wanted_requirements->last_time_used;
-
-    // Find the first buffer that's active in our time range. All placed
-    // buffers are stored in the order of their starting position in the arena
-    // so that it's easy to find the next buffer in memory, and so the gap.
-    // The candidate_entry variable holds the buffer that we're considering
-    // placing the current buffer after.
 
     int candidate_offset = 0;
-    // Loop through the offset-ordered list of buffers, looking for gaps.
     if (wanted_requirements->offline_offset == kOnlinePlannedBuffer) {
-      ListEntry* prior_entry = nullptr;
-      while (true) {
-        // Find out what the next active buffer is.
-        ListEntry* next_entry = NextSimultaneouslyActiveBuffer(
-            prior_entry, wanted_first_time_used, wanted_last_time_used);
-
-        if (prior_entry) {
-          BufferRequirements* candidate_requirements =
-              &requirements_[prior_entry->requirements_index];
-          const int prior_entry_offset =
-              prior_entry->offset + candidate_requirements->size;
-          if (prior_entry_offset > candidate_offset) {
-            candidate_offset = prior_entry_offset;
-          }
-        }
-        if (next_entry == nullptr) {
-          // We're at the end of the list, so we can always append the buffer
-          // here.
-          break;
-        }
+      // Find the buffers that are active in our time range, in the order of
+      // their starting position in the arena so it's easy to find the gaps
+      // between them.
+      const int active_count = FindSimultaneouslyActiveBuffers(
+          wanted_requirements->first_time_used,
+          wanted_requirements->last_time_used);
+      for (int j = 0; j < active_count; ++j) {
+        const int active_id = active_buffer_ids_[j];
         // Find out how much space there is between us and the next buffer.
-        const int gap = next_entry->offset - candidate_offset;
+        const int gap = buffer_offsets_[active_id] - candidate_offset;
         if (gap >= wanted_size) {
           // This entry has a big enough gap between it and the next, so
           // use it!
           break;
         }
         // The gap wasn't big enough, so move on to another candidate.
-        prior_entry = next_entry;
+        const int active_end_offset =
+            buffer_offsets_[active_id] + requirements_[active_id].size;
+        if (active_end_offset > candidate_offset) {
+          candidate_offset = active_end_offset;
+        }
       }
     } else {
       // Offline planned offset are to be considered constant
       candidate_offset = wanted_requirements->offline_offset;
     }
-    // At this point, we've either found a gap (possibly at the end of the
-    // list) and want to place the buffer there, or there are no other active
-    // buffers in this time range and so we can put it at offset zero.
-    // Record the buffer's offset in our plan.
+    // At this point, we've either found a gap (possibly after the last active
+    // buffer) and want to place the buffer there, or there are no other
+    // active buffers in this time range and so we can put it at offset zero.
+    // Record the buffer's offset in our plan, so that subsequent passes can
+    // fit in their buffers around it.
     buffer_offsets_[buffer_id] = candidate_offset;
-    // Add the newly-placed buffer to our offset-ordered list, so that
-    // subsequent passes can fit in their buffers around it.
-    ListEntry* new_entry = &buffers_sorted_by_offset_[next_free_entry_];
-    new_entry->offset = candidate_offset;
-    new_entry->requirements_index = buffer_id;
-    const int new_entry_index = next_free_entry_;
-    ++next_free_entry_;
-
-    if (first_entry->offset > candidate_offset) {
-      // The new entry offset is smaller than the first entry offset =>
-      // replace the first entry
-      first_entry = new_entry;
-      first_entry->next_entry_index = first_entry_index_;
-      first_entry_index_ = new_entry_index;
-    } else {
-      ListEntry* current_entry = first_entry;
-      // Make sure that we insert the buffer at the correct place in the
-      // buffer-offset-ordered list
-      while (true) {
-        const int next_entry_index = current_entry->next_entry_index;
-        if (next_entry_index == -1) {
-          // We're at the end of the list, so just add the new entry here.
-          current_entry->next_entry_index = new_entry_index;
-          new_entry->next_entry_index = -1;
-          break;
-        }
-        // not at the end of the list -> take a look at next entry
-        ListEntry* next_entry = &buffers_sorted_by_offset_[next_entry_index];
-        if (next_entry->offset > candidate_offset) {
-          // We're at the right spot to do an insertion and retain the sorting
-          // order, so place the new entry here.
-          new_entry->next_entry_index = current_entry->next_entry_index;
-          current_entry->next_entry_index = new_entry_index;
-          break;
-        }
-        current_entry = next_entry;
-      }
-    }
+    MarkBufferPlaced(buffer_id);
   }
 }
 
 size_t GreedyMemoryPlanner::GetMaximumMemorySize() {
   CalculateOffsetsIfNeeded();
-  if (buffer_count_ == 0) {
-    return 0;
-  }
-  ListEntry* entry = &buffers_sorted_by_offset_[first_entry_index_];
   size_t max_size = 0;
-  while (entry) {
-    BufferRequirements* requirements =
-        &requirements_[entry->requirements_index];
+  for (int i = 0; i < buffer_count_; ++i) {
     // TODO(b/148246793): Update all size and offset variables types from
     //                    int to size_t
-    const size_t current_size = entry->offset + requirements->size;
+    const size_t current_size = buffer_offsets_[i] + requirements_[i].size;
     if (current_size > max_size) {
       max_size = current_size;
     }
-    if (entry->next_entry_index == -1) {
-      break;
+  }
+  return max_size;
+}
+
+size_t GreedyMemoryPlanner::GetMaximumLiveMemorySize() {
+  // The most memory is live at the time some buffer is first used, so only
+  // those times need checking.
+  size_t max_size = 0;
+  for (int i = 0; i < buffer_count_; ++i) {
+    const int time = requirements_[i].first_time_used;
+    size_t live_size = 0;
+    for (int j = 0; j < buffer_count_; ++j) {
+      if ((requirements_[j].first_time_used <= time) &&
+          (requirements_[j].last_time_used >= time)) {
+        live_size += requirements_[j].size;
+      }
+    }
+    if (live_size > max_size) {
+      max_size = live_size;
     }
-    entry = &buffers_sorted_by_offset_[entry->next_entry_index];
   }
   return max_size;
 }
@@ -35,6 +35,9 @@ constexpr int kOnlinePlannedBuffer = -1;
 //  - The largest buffer is placed at offset zero.
 //  - The rest of the buffers are looped through in descending size order.
 //  - The other buffers that need to be in memory at the same time are found.
+//    The buffers are indexed by when they're first used, with a max tree over
+//    when the placed ones are last used, so only the buffers that really are
+//    active at the same time are visited rather than every placed buffer.
 //  - The first gap between simultaneously active buffers that the current
 //    buffer fits into will be used.
 //  - If no large-enough gap is found, the current buffer is placed after the
@@ -53,7 +56,7 @@ class GreedyMemoryPlanner : public MemoryPlanner {
   // this scratch memory, so you should enlarge it if you see an error when
   // calling AddBuffer(). The memory can be reused once you're done with the
   // planner, as long as you copy the calculated offsets to another location.
-  // Each buffer requires about 36 bytes of scratch.
+  // Each buffer requires about 44 bytes of scratch.
   GreedyMemoryPlanner(unsigned char* scratch_buffer, int scratch_buffer_size);
   ~GreedyMemoryPlanner() override;
 
@@ -71,6 +74,12 @@ class GreedyMemoryPlanner : public MemoryPlanner {
   // memory arena you'd need to allocate to hold these buffers.
   size_t GetMaximumMemorySize() override;
 
+  // Returns the most memory that buffers in use at the same time need. No plan
+  // can need a smaller arena than this, so the difference to
+  // GetMaximumMemorySize() is what the gaps in this plan cost. This is an
+  // O(N^2) complexity operation, so only use it for reporting.
+  size_t GetMaximumLiveMemorySize();
+
   // How many buffers have been recorded.
   int GetBufferCount() override;
 
@@ -87,34 +96,34 @@ class GreedyMemoryPlanner : public MemoryPlanner {
   // is an O(N^2) complexity operation, so only use for testing.
   bool DoAnyBuffersOverlap(ErrorReporter* error_reporter);
 
-  // Used to store a list of buffers ordered by their offset.
-  struct ListEntry {
-    int offset;
-    int requirements_index;
-    int next_entry_index;
-  };
-
   // Number of bytes required in order to plan a buffer.
   static size_t per_buffer_size() {
     const int per_buffer_size =
         sizeof(BufferRequirements) +  // requirements_
-        sizeof(int) +                 // buffer_sizes_sorted_
         sizeof(int) +                 // buffer_ids_sorted_
-        sizeof(ListEntry) +           // buffers_sorted_by_offset_
+        sizeof(int) +                 // buffers_by_first_time_
+        sizeof(int) * 2 +             // last_time_tree_
+        sizeof(int) +                 // active_buffer_ids_
+        sizeof(int) +                 // buffers_by_offset_
         sizeof(int);                  // buffer_offsets_;
     return per_buffer_size;
   }
 
  private:
-  // Whether a buffer is active in a given time range.
-  bool DoesEntryOverlapInTime(const ListEntry* entry, const int first_time_used,
-                              const int last_time_used) const;
+  // Records that a buffer has been given its offset, so it's found by
+  // FindSimultaneouslyActiveBuffers() from now on.
+  void MarkBufferPlaced(int buffer_id);
+
+  // Fills active_buffer_ids_ with the placed buffers that are active in a
+  // given time range, ordered by their offset, and returns how many there are.
+  int FindSimultaneouslyActiveBuffers(const int first_time_used,
+                                      const int last_time_used);
 
-  // Walks the list to return the next buffer that is active in a given time
-  // range, or a null pointer if there are none.
-  ListEntry* NextSimultaneouslyActiveBuffer(const ListEntry* start,
-                                            const int first_time_used,
-                                            const int last_time_used);
+  // Adds the placed buffers under a node of last_time_tree_ that are still in
+  // use at first_time_used to active_buffer_ids_. Returns false if that would
+  // take it past max_active_count.
+  bool CollectActiveBuffers(int node, const int first_time_used,
+                            int max_active_count, int* active_count);
 
   // If there isn't an up to date plan, calculate a new one.
   void CalculateOffsetsIfNeeded();
@@ -136,18 +145,24 @@ class GreedyMemoryPlanner : public MemoryPlanner {
 
   // Working arrays used during the layout algorithm.
   BufferRequirements* requirements_;
-  // buffer_sizes_sorted_ and buffer_ids_sorted_ are sorted according to:
+  // buffer_ids_sorted_ is sorted according to:
   //   {
   //     offline planned buffers,
   //     online planned buffers sorted by size
   //   }
-  int* buffer_sizes_sorted_;
   int* buffer_ids_sorted_;
-  ListEntry* buffers_sorted_by_offset_;
-  int next_free_entry_;    // Index of the next free entry of
-                           // buffers_sorted_by_offset_
-  int first_entry_index_;  // Index of the first entry (smallest offset) of
-                           // buffers_sorted_by_offset_
+  // Every buffer ordered by first_time_used, so the buffers that start before
+  // a given time are a prefix of it.
+  int* buffers_by_first_time_;
+  // Max tree over buffers_by_first_time_. Leaves hold the last_time_used of
+  // the placed buffers (and a value below any time for the others), every
+  // inner node the largest leaf below it.
+  int* last_time_tree_;
+  // The simultaneously active buffers of the buffer being placed.
+  int* active_buffer_ids_;
+  // The placed buffers ordered by their offset.
+  int* buffers_by_offset_;
+  int placed_buffer_count_;
 
   // Stores the outcome of the plan, the location of each buffer in the arena.
   int* buffer_offsets_;
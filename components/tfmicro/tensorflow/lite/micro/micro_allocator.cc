@@ -29,6 +29,7 @@ limitations under the License.
 #include "tensorflow/lite/micro/memory_helpers.h"
 #include "tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
 #include "tensorflow/lite/micro/memory_planner/memory_planner.h"
+#include "tensorflow/lite/micro/micro_op_fusion.h"
 #include "tensorflow/lite/micro/micro_op_resolver.h"
 #include "tensorflow/lite/micro/simple_memory_allocator.h"
 #include "tensorflow/lite/schema/schema_generated.h"
@@ -162,8 +163,11 @@ class AllocationInfoBuilder {
   TfLiteStatus GetOfflinePlannedOffsets(
       const Model* model, const int32_t** offline_planner_offsets);
 
-  // Add allocaiton information for the tensors.
+  // Add allocaiton information for the tensors. Lifetimes are taken from the
+  // node inputs and outputs rather than the flatbuffer operators, so that
+  // nodes rewritten by FuseOperators() are planned as they will run.
   TfLiteStatus AddTensors(const SubGraph* subgraph,
+                          const NodeAndRegistration* node_and_registrations,
                           const int32_t* offline_offsets,
                           TfLiteEvalTensor* eval_tensors);
 
@@ -199,10 +203,11 @@ TfLiteStatus AllocationInfoBuilder::Allocate() {
   return kTfLiteOk;
 }
 
-TfLiteStatus AllocationInfoBuilder::AddTensors(const SubGraph* subgraph,
-                                               const int32_t* offline_offsets,
-                                               TfLiteEvalTensor* eval_tensors) {
+TfLiteStatus AllocationInfoBuilder::AddTensors(
+    const SubGraph* subgraph, const NodeAndRegistration* node_and_registrations,
+    const int32_t* offline_offsets, TfLiteEvalTensor* eval_tensors) {
   TFLITE_DCHECK(eval_tensors != nullptr);
+  TFLITE_DCHECK(node_and_registrations != nullptr);
 
   // Set up allocation info for all tensors.
   for (size_t i = 0; i < tensor_count_; ++i) {
@@ -238,9 +243,9 @@ TfLiteStatus AllocationInfoBuilder::AddTensors(const SubGraph* subgraph,
 
   // Figure out when the first and last use of each tensor is.
   for (int i = (subgraph->operators()->size() - 1); i >= 0; --i) {
-    const auto* op = subgraph->operators()->Get(i);
-    for (size_t n = 0; n < op->inputs()->size(); ++n) {
-      const int tensor_index = op->inputs()->Get(n);
+    const TfLiteNode& node = node_and_registrations[i].node;
+    for (int n = 0; n < node.inputs->size; ++n) {
+      const int tensor_index = node.inputs->data[n];
       AllocationInfo* current = &info_[tensor_index];
 
       // TODO(b/166484865): Figure out a more general solution.
@@ -248,8 +253,8 @@ TfLiteStatus AllocationInfoBuilder::AddTensors(const SubGraph* subgraph,
       // operator input.
       // In case operator input(s) are not in subgraph inputs initialize them.
       if (current->first_created == 0) {
-        for (size_t op_input = 0; op_input < op->inputs()->size(); ++op_input) {
-          const int op_tensor_index = op->inputs()->Get(op_input);
+        for (int op_input = 0; op_input < node.inputs->size; ++op_input) {
+          const int op_tensor_index = node.inputs->data[op_input];
           AllocationInfo* op_current = &info_[op_tensor_index];
           if (op_current->needs_allocating && op_current->first_created == -1) {
             op_current->first_created = i;
@@ -261,8 +266,8 @@ TfLiteStatus AllocationInfoBuilder::AddTensors(const SubGraph* subgraph,
         current->last_used = i;
       }
     }
-    for (size_t n = 0; n < op->outputs()->size(); ++n) {
-      const int tensor_index = op->outputs()->Get(n);
+    for (int n = 0; n < node.outputs->size; ++n) {
+      const int tensor_index = node.outputs->data[n];
       AllocationInfo* current = &info_[tensor_index];
       if ((current->first_created == -1) || (current->first_created > i)) {
         current->first_created = i;
@@ -278,6 +283,12 @@ TfLiteStatus AllocationInfoBuilder::AddTensors(const SubGraph* subgraph,
     if (is_read_only) {
       current->needs_allocating = false;
     }
+    // Intermediates of fused nodes are not touched by any node.
+    const bool is_unused =
+        (current->first_created == -1) && (current->last_used == -1);
+    if (is_unused) {
+      current->needs_allocating = false;
+    }
     const bool has_partial_lifetime =
         !is_read_only &&
         ((current->first_created == -1) || (current->last_used == -1));
@@ -676,6 +687,13 @@ TfLiteStatus MicroAllocator::StartModelAllocation(
       AllocateNodeAndRegistrations(model, node_and_registrations));
   TF_LITE_ENSURE_STATUS(PrepareNodeAndRegistrationDataFromFlatbuffer(
       model, op_resolver, *node_and_registrations));
+  TF_LITE_ENSURE_STATUS(FoldConstantOperators(
+      GetSubGraphFromModel(model), memory_allocator_, error_reporter_,
+      *eval_tensors, *node_and_registrations));
+  TF_LITE_ENSURE_STATUS(FuseOperators(GetSubGraphFromModel(model), op_resolver,
+                                      memory_allocator_, error_reporter_,
+                                      *node_and_registrations));
+  node_and_registrations_ = *node_and_registrations;
 
   return kTfLiteOk;
 }
@@ -1045,7 +1063,8 @@ TfLiteStatus MicroAllocator::CommitStaticMemoryPlan(
     TF_LITE_ENSURE_STATUS(
         builder.GetOfflinePlannedOffsets(model, &offline_planner_offsets));
     TF_LITE_ENSURE_STATUS(
-        builder.AddTensors(subgraph, offline_planner_offsets, eval_tensors));
+        builder.AddTensors(subgraph, node_and_registrations_,
+                           offline_planner_offsets, eval_tensors));
     TF_LITE_ENSURE_STATUS(builder.AddScratchBuffers(scratch_buffer_handles_));
     const AllocationInfo* allocation_info = builder.Finish();
 
@@ -1058,6 +1077,12 @@ TfLiteStatus MicroAllocator::CommitStaticMemoryPlan(
     GreedyMemoryPlanner planner(planner_arena, remaining_arena_size);
     TF_LITE_ENSURE_STATUS(
         CreatePlan(error_reporter_, &planner, allocation_info, builder.Size()));
+    // The allocation info sits in the tail of tmp_allocator, the planner only
+    // uses the start of planner_arena.
+    RecordMemoryPlan(&planner,
+                     tmp_allocator.GetTailUsedBytes() +
+                         planner.GetBufferCount() *
+                             GreedyMemoryPlanner::per_buffer_size());
 
     size_t actual_available_arena_size =
         memory_allocator_->GetAvailableMemory(kBufferAlignment);
@@ -67,6 +67,8 @@ typedef struct {
   const TfLiteRegistration* registration;
 } NodeAndRegistration;
 
+class GreedyMemoryPlanner;
+
 // Allocator responsible for allocating memory for all intermediate tensors
 // necessary to invoke a model.
 //
@@ -230,6 +232,19 @@ class MicroAllocator {
   // Returns the first subgraph from the model.
   const SubGraph* GetSubGraphFromModel(const Model* model);
 
+  // Called by CommitStaticMemoryPlan() with the plan for the non-persistent
+  // buffers before it is committed. planning_bytes is how much of the arena
+  // working out the plan took. Does nothing here, it is there for
+  // RecordingMicroAllocator to audit the plan.
+  virtual void RecordMemoryPlan(GreedyMemoryPlanner* planner,
+                                size_t planning_bytes) {}
+
+  // Returns the scratch buffers requested so far, GetScratchBufferCount() of
+  // them.
+  const internal::ScratchBufferHandle* scratch_buffer_handles() const {
+    return scratch_buffer_handles_;
+  }
+
  private:
   // Commits a memory plan for all non-persistent buffer allocations in the
   // 'head' section of the memory arena. The eval_tensors pointer is the list of
@@ -245,6 +260,10 @@ class MicroAllocator {
   ErrorReporter* error_reporter_;
   bool model_is_allocating_;
 
+  // Nodes of the model being allocated, as handed out by
+  // StartModelAllocation(). The memory plan follows their inputs and outputs.
+  NodeAndRegistration* node_and_registrations_ = nullptr;
+
   // Points to the first allocated scratch buffer handle.
   // Scratch buffer handles are placed in the head during `Prepare` stage and
   // then moved to the tail for static memory plan.
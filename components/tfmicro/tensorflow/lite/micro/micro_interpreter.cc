@@ -110,6 +110,25 @@ TfLiteEvalTensor* ContextHelper::GetEvalTensor(
   return &helper->eval_tensors_[tensor_idx];
 }
 
+TfLiteExternalContext* ContextHelper::GetExternalContext(
+    struct TfLiteContext* context, TfLiteExternalContextType type) {
+  ContextHelper* helper = static_cast<ContextHelper*>(context->impl_);
+  if (type < 0 || type >= kTfLiteMaxExternalContexts) {
+    return nullptr;
+  }
+  return helper->external_contexts_[type];
+}
+
+void ContextHelper::SetExternalContext(struct TfLiteContext* context,
+                                       TfLiteExternalContextType type,
+                                       TfLiteExternalContext* ctx) {
+  ContextHelper* helper = static_cast<ContextHelper*>(context->impl_);
+  if (type < 0 || type >= kTfLiteMaxExternalContexts) {
+    return;
+  }
+  helper->external_contexts_[type] = ctx;
+}
+
 void ContextHelper::SetNodeIndex(int idx) {
   if (scratch_buffer_count_ != 0) {
     TF_LITE_REPORT_ERROR(error_reporter_,
@@ -213,6 +232,8 @@ void MicroInterpreter::Init(tflite::Profiler* profiler) {
   context_.ReportError = context_helper_.ReportOpError;
   context_.GetTensor = context_helper_.GetTensor;
   context_.GetEvalTensor = context_helper_.GetEvalTensor;
+  context_.GetExternalContext = context_helper_.GetExternalContext;
+  context_.SetExternalContext = context_helper_.SetExternalContext;
   context_.recommended_num_threads = 1;
   context_.profiler = profiler;
 
@@ -414,6 +435,11 @@ TfLiteStatus MicroInterpreter::Invoke() {
   return kTfLiteOk;
 }
 
+void MicroInterpreter::SetExternalContext(TfLiteExternalContextType type,
+                                          TfLiteExternalContext* ctx) {
+  context_.SetExternalContext(&context_, type, ctx);
+}
+
 TfLiteTensor* MicroInterpreter::input(size_t index) {
   const size_t length = inputs_size();
   if (index >= length) {
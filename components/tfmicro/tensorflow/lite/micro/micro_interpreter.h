@@ -55,6 +55,11 @@ class ContextHelper {
                                  int tensor_idx);
   static TfLiteEvalTensor* GetEvalTensor(const struct TfLiteContext* context,
                                          int tensor_idx);
+  static TfLiteExternalContext* GetExternalContext(
+      struct TfLiteContext* context, TfLiteExternalContextType type);
+  static void SetExternalContext(struct TfLiteContext* context,
+                                 TfLiteExternalContextType type,
+                                 TfLiteExternalContext* ctx);
   // Commits all scratch buffer allocations to MicroAllocator.
   TfLiteStatus CommitScratchBuffers();
 
@@ -77,6 +82,8 @@ class ContextHelper {
 
   size_t scrach_buffer_sizes_[kMaxScratchBuffersPerOp];
   size_t scratch_buffer_count_ = 0;
+
+  TfLiteExternalContext* external_contexts_[kTfLiteMaxExternalContexts] = {};
 };
 
 }  // namespace internal
@@ -162,6 +169,13 @@ class MicroInterpreter {
   // Reset all variable tensors to the default value.
   TfLiteStatus ResetVariableTensors();
 
+  // Makes an external context available to the kernels, e.g. a
+  // MicroThreadPool (see micro_thread_pool.h). The context must outlive the
+  // interpreter. Kernels may look it up in Prepare, so set it before
+  // AllocateTensors().
+  void SetExternalContext(TfLiteExternalContextType type,
+                          TfLiteExternalContext* ctx);
+
   TfLiteStatus initialization_status() const { return initialization_status_; }
 
   size_t operators_size() const { return subgraph_->operators()->size(); }
@@ -25,6 +25,7 @@ limitations under the License.
 #include "tensorflow/lite/kernels/op_macros.h"
 #include "tensorflow/lite/micro/compatibility.h"
 #include "tensorflow/lite/micro/kernels/micro_ops.h"
+#include "tensorflow/lite/micro/micro_op_fusion.h"
 #include "tensorflow/lite/micro/micro_op_resolver.h"
 #include "tensorflow/lite/schema/schema_generated.h"
 
@@ -149,9 +150,20 @@ class MicroMutableOpResolver : public MicroOpResolver {
                       ParseConcatenation);
   }
 
-  TfLiteStatus AddConv2D() {
-    return AddBuiltin(BuiltinOperator_CONV_2D,
-                      tflite::ops::micro::Register_CONV_2D(), ParseConv2D);
+  // Kernel variants such as Register_CONV_2D_STREAMING() can be passed in
+  // instead of the default registration.
+  TfLiteStatus AddConv2D(const TfLiteRegistration& registration =
+                             tflite::ops::micro::Register_CONV_2D()) {
+    return AddBuiltin(BuiltinOperator_CONV_2D, registration, ParseConv2D);
+  }
+
+  // Opts in to running CONV_2D -> MAX_POOL_2D pairs as one fused kernel, see
+  // micro_op_fusion.h. Needs AddConv2D() and AddMaxPool2D() as well for the
+  // ops that can not be fused.
+  TfLiteStatus AddConv2DMaxPool2D() {
+    TfLiteRegistration registration =
+        tflite::ops::micro::Register_CONV_2D_MAX_POOL_2D();
+    return AddCustom(kConv2DMaxPool2DOpName, &registration);
   }
 
   TfLiteStatus AddCos() {
@@ -254,9 +266,9 @@ class MicroMutableOpResolver : public MicroOpResolver {
                       tflite::ops::micro::Register_MAXIMUM(), ParseMaximum);
   }
 
-  TfLiteStatus AddMaxPool2D() {
-    return AddBuiltin(BuiltinOperator_MAX_POOL_2D,
-                      tflite::ops::micro::Register_MAX_POOL_2D(), ParsePool);
+  TfLiteStatus AddMaxPool2D(const TfLiteRegistration& registration =
+                                tflite::ops::micro::Register_MAX_POOL_2D()) {
+    return AddBuiltin(BuiltinOperator_MAX_POOL_2D, registration, ParsePool);
   }
 
   TfLiteStatus AddMean() {
@@ -0,0 +1,336 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/lite/micro/micro_op_fusion.h"
+
+#include <cstring>
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/core/api/error_reporter.h"
+#include "tensorflow/lite/kernels/internal/compatibility.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
+#include "tensorflow/lite/micro/micro_utils.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+
+namespace {
+
+// Registration of a node whose work has been folded into another node. All
+// function pointers are null so Init, Prepare and Invoke skip the node.
+const TfLiteRegistration kFusedAwayRegistration = {
+    /*init=*/nullptr,
+    /*free=*/nullptr,
+    /*prepare=*/nullptr,
+    /*invoke=*/nullptr,
+    /*profiling_string=*/nullptr,
+    /*builtin_code=*/BuiltinOperator_CUSTOM,
+    /*custom_name=*/"FUSED",
+    /*version=*/0};
+
+bool IsBuiltin(const NodeAndRegistration& node_and_registration,
+               BuiltinOperator op) {
+  return node_and_registration.registration->builtin_code == op;
+}
+
+// Inputs and outputs of a node that has been fused away, the same empty
+// array idiom as kZeroLengthIntArray in micro_allocator.cc.
+const TfLiteIntArray kNoTensors = {0, {}};
+
+// Leaves the node in the list but takes it out of the graph.
+void RemoveNode(NodeAndRegistration* node_and_registration) {
+  // Nothing writes to a node's arrays, it's only const for the empty one.
+  TfLiteIntArray* no_tensors = const_cast<TfLiteIntArray*>(&kNoTensors);
+  node_and_registration->registration = &kFusedAwayRegistration;
+  node_and_registration->node.inputs = no_tensors;
+  node_and_registration->node.outputs = no_tensors;
+  node_and_registration->node.builtin_data = nullptr;
+}
+
+bool IntArrayContains(const TfLiteIntArray* array, int value) {
+  for (int i = 0; i < array->size; ++i) {
+    if (array->data[i] == value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsSubgraphOutput(const SubGraph* subgraph, int tensor_index) {
+  for (size_t i = 0; i < subgraph->outputs()->size(); ++i) {
+    if (subgraph->outputs()->Get(i) == tensor_index) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the index of the only node reading tensor_index, or -1 if there are
+// none or more than one.
+int FindSoleConsumer(const SubGraph* subgraph,
+                     const NodeAndRegistration* node_and_registrations,
+                     int tensor_index) {
+  int consumer = -1;
+  for (size_t i = 0; i < subgraph->operators()->size(); ++i) {
+    if (IntArrayContains(node_and_registrations[i].node.inputs,
+                         tensor_index)) {
+      if (consumer != -1) {
+        return -1;
+      }
+      consumer = i;
+    }
+  }
+  return consumer;
+}
+
+// The fused kernel handles single batch float and int8 tensors, the same as
+// the reference MAX_POOL_2D does for int8.
+bool IsFusableTensor(const Tensor* tensor) {
+  return (tensor->type() == TensorType_FLOAT32 ||
+          tensor->type() == TensorType_INT8) &&
+         !tensor->is_variable() && tensor->shape() != nullptr &&
+         tensor->shape()->size() == 4 && tensor->shape()->Get(0) == 1;
+}
+
+// Returns the fused activation of a node FoldConstantOperators() works on.
+TfLiteFusedActivation* GetActivation(
+    NodeAndRegistration* node_and_registration) {
+  void* builtin_data = node_and_registration->node.builtin_data;
+  switch (node_and_registration->registration->builtin_code) {
+    case BuiltinOperator_CONV_2D:
+      return &static_cast<TfLiteConvParams*>(builtin_data)->activation;
+    case BuiltinOperator_FULLY_CONNECTED:
+      return &static_cast<TfLiteFullyConnectedParams*>(builtin_data)
+                  ->activation;
+    case BuiltinOperator_MUL:
+      return &static_cast<TfLiteMulParams*>(builtin_data)->activation;
+    case BuiltinOperator_ADD:
+      return &static_cast<TfLiteAddParams*>(builtin_data)->activation;
+    default:
+      return nullptr;
+  }
+}
+
+bool IsFloatTensor(const SubGraph* subgraph, int tensor_index) {
+  return subgraph->tensors()->Get(tensor_index)->type() == TensorType_FLOAT32;
+}
+
+// Constant tensors are the ones backed by a flatbuffer buffer.
+bool IsConstantTensor(const SubGraph* subgraph,
+                      const TfLiteEvalTensor* eval_tensors, int tensor_index) {
+  return eval_tensors[tensor_index].data.data != nullptr &&
+         !subgraph->tensors()->Get(tensor_index)->is_variable();
+}
+
+// Replaces the data of a constant float tensor with a copy in the persistent
+// section of the arena, so that it can be modified.
+float* MakeWritableCopy(SimpleMemoryAllocator* allocator,
+                        TfLiteEvalTensor* eval_tensor) {
+  size_t bytes;
+  if (TfLiteEvalTensorByteLength(eval_tensor, &bytes) != kTfLiteOk) {
+    return nullptr;
+  }
+  uint8_t* copy = allocator->AllocateFromTail(bytes, alignof(float));
+  if (copy == nullptr) {
+    return nullptr;
+  }
+  std::memcpy(copy, eval_tensor->data.data, bytes);
+  eval_tensor->data.data = copy;
+  return reinterpret_cast<float*>(copy);
+}
+
+// Finds the constant operand of a MUL or ADD consuming tensor_index that can
+// be folded into the output channels of the producer. It has to hold either a
+// single value or one value per channel along the last dimension.
+int FindFoldableOperand(const SubGraph* subgraph,
+                        const TfLiteEvalTensor* eval_tensors,
+                        const NodeAndRegistration& consumer, int tensor_index,
+                        int channels) {
+  if ((!IsBuiltin(consumer, BuiltinOperator_MUL) &&
+       !IsBuiltin(consumer, BuiltinOperator_ADD)) ||
+      consumer.node.inputs->size != 2 || consumer.node.outputs->size != 1) {
+    return -1;
+  }
+  const int operand = consumer.node.inputs->data[0] == tensor_index
+                          ? consumer.node.inputs->data[1]
+                          : consumer.node.inputs->data[0];
+  if (operand == tensor_index || !IsFloatTensor(subgraph, operand) ||
+      !IsConstantTensor(subgraph, eval_tensors, operand)) {
+    return -1;
+  }
+  const TfLiteIntArray& dims = *eval_tensors[operand].dims;
+  const int count = ElementCount(dims);
+  const auto* shape = subgraph->tensors()->Get(tensor_index)->shape();
+  if (shape == nullptr || dims.size > static_cast<int>(shape->size())) {
+    return -1;
+  }
+  if (count == 1 ||
+      (count == channels && dims.data[dims.size - 1] == channels)) {
+    return operand;
+  }
+  return -1;
+}
+
+}  // namespace
+
+TfLiteStatus FoldConstantOperators(
+    const SubGraph* subgraph, SimpleMemoryAllocator* allocator,
+    ErrorReporter* error_reporter, TfLiteEvalTensor* eval_tensors,
+    NodeAndRegistration* node_and_registrations) {
+  TFLITE_DCHECK(subgraph != nullptr);
+  TFLITE_DCHECK(eval_tensors != nullptr);
+  TFLITE_DCHECK(node_and_registrations != nullptr);
+
+  for (size_t i = 0; i < subgraph->operators()->size(); ++i) {
+    NodeAndRegistration& producer = node_and_registrations[i];
+    if ((!IsBuiltin(producer, BuiltinOperator_CONV_2D) &&
+         !IsBuiltin(producer, BuiltinOperator_FULLY_CONNECTED)) ||
+        producer.node.inputs->size != 3 || producer.node.outputs->size != 1) {
+      continue;
+    }
+    const int filter_index = producer.node.inputs->data[1];
+    const int bias_index = producer.node.inputs->data[2];
+    if (bias_index < 0 || !IsFloatTensor(subgraph, filter_index) ||
+        !IsFloatTensor(subgraph, bias_index) ||
+        !IsConstantTensor(subgraph, eval_tensors, filter_index) ||
+        !IsConstantTensor(subgraph, eval_tensors, bias_index) ||
+        FindSoleConsumer(subgraph, node_and_registrations, filter_index) !=
+            static_cast<int>(i) ||
+        FindSoleConsumer(subgraph, node_and_registrations, bias_index) !=
+            static_cast<int>(i)) {
+      continue;
+    }
+    // Both CONV_2D (OHWI) and FULLY_CONNECTED (OI) filters have the output
+    // channels as the outermost dimension.
+    const int channels = eval_tensors[filter_index].dims->data[0];
+    const int channel_size =
+        ElementCount(*eval_tensors[filter_index].dims) / channels;
+    float* filter = nullptr;
+    float* bias = nullptr;
+
+    // Fold consumers one by one, e.g. the MUL and then the ADD of a batch
+    // norm. A fused activation has to be applied after all of them.
+    while (*GetActivation(&producer) == kTfLiteActNone) {
+      const int output_index = producer.node.outputs->data[0];
+      if (IsSubgraphOutput(subgraph, output_index)) {
+        break;
+      }
+      const int consumer_index =
+          FindSoleConsumer(subgraph, node_and_registrations, output_index);
+      if (consumer_index <= static_cast<int>(i)) {
+        break;
+      }
+      NodeAndRegistration& consumer = node_and_registrations[consumer_index];
+      const int operand_index = FindFoldableOperand(
+          subgraph, eval_tensors, consumer, output_index, channels);
+      if (operand_index < 0) {
+        break;
+      }
+
+      if (filter == nullptr) {
+        filter = MakeWritableCopy(allocator, &eval_tensors[filter_index]);
+        bias = MakeWritableCopy(allocator, &eval_tensors[bias_index]);
+        if (filter == nullptr || bias == nullptr) {
+          TF_LITE_REPORT_ERROR(error_reporter,
+                               "Failed to allocate memory to fold node %d",
+                               consumer_index);
+          return kTfLiteError;
+        }
+      }
+      const float* operand =
+          static_cast<const float*>(eval_tensors[operand_index].data.data);
+      const bool per_channel =
+          ElementCount(*eval_tensors[operand_index].dims) == channels;
+      for (int channel = 0; channel < channels; ++channel) {
+        const float value = operand[per_channel ? channel : 0];
+        if (IsBuiltin(consumer, BuiltinOperator_MUL)) {
+          float* channel_filter = filter + channel * channel_size;
+          for (int j = 0; j < channel_size; ++j) {
+            channel_filter[j] *= value;
+          }
+          bias[channel] *= value;
+        } else {
+          bias[channel] += value;
+        }
+      }
+
+      *GetActivation(&producer) = *GetActivation(&consumer);
+      producer.node.outputs = consumer.node.outputs;
+      RemoveNode(&consumer);
+    }
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus FuseOperators(const SubGraph* subgraph,
+                           const MicroOpResolver& op_resolver,
+                           SimpleMemoryAllocator* allocator,
+                           ErrorReporter* error_reporter,
+                           NodeAndRegistration* node_and_registrations) {
+  TFLITE_DCHECK(subgraph != nullptr);
+  TFLITE_DCHECK(node_and_registrations != nullptr);
+
+  const TfLiteRegistration* conv_max_pool =
+      op_resolver.FindOp(kConv2DMaxPool2DOpName);
+  if (conv_max_pool == nullptr) {
+    return kTfLiteOk;
+  }
+
+  for (size_t i = 0; i < subgraph->operators()->size(); ++i) {
+    NodeAndRegistration& conv = node_and_registrations[i];
+    if (!IsBuiltin(conv, BuiltinOperator_CONV_2D) ||
+        conv.node.outputs->size != 1) {
+      continue;
+    }
+    const int intermediate = conv.node.outputs->data[0];
+    if (!IsFusableTensor(subgraph->tensors()->Get(intermediate)) ||
+        IsSubgraphOutput(subgraph, intermediate)) {
+      continue;
+    }
+    const int consumer =
+        FindSoleConsumer(subgraph, node_and_registrations, intermediate);
+    if (consumer <= static_cast<int>(i)) {
+      continue;
+    }
+    NodeAndRegistration& pool = node_and_registrations[consumer];
+    if (!IsBuiltin(pool, BuiltinOperator_MAX_POOL_2D) ||
+        pool.node.inputs->size != 1 || pool.node.outputs->size != 1 ||
+        subgraph->tensors()->Get(pool.node.outputs->data[0])->type() !=
+            subgraph->tensors()->Get(intermediate)->type()) {
+      continue;
+    }
+
+    auto* params = reinterpret_cast<TfLiteConv2DMaxPool2DParams*>(
+        allocator->AllocateFromTail(sizeof(TfLiteConv2DMaxPool2DParams),
+                                    alignof(TfLiteConv2DMaxPool2DParams)));
+    if (params == nullptr) {
+      TF_LITE_REPORT_ERROR(error_reporter,
+                           "Failed to allocate memory to fuse node %d", i);
+      return kTfLiteError;
+    }
+    params->conv = *static_cast<TfLiteConvParams*>(conv.node.builtin_data);
+    params->pool = *static_cast<TfLitePoolParams*>(pool.node.builtin_data);
+
+    conv.registration = conv_max_pool;
+    conv.node.outputs = pool.node.outputs;
+    conv.node.builtin_data = params;
+
+    RemoveNode(&pool);
+  }
+  return kTfLiteOk;
+}
+
+}  // namespace tflite
@@ -0,0 +1,73 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_MICRO_MICRO_OP_FUSION_H_
+#define TENSORFLOW_LITE_MICRO_MICRO_OP_FUSION_H_
+
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/core/api/error_reporter.h"
+#include "tensorflow/lite/micro/micro_allocator.h"
+#include "tensorflow/lite/micro/micro_op_resolver.h"
+#include "tensorflow/lite/micro/simple_memory_allocator.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace tflite {
+
+// Name the fused CONV_2D -> MAX_POOL_2D kernel is registered under. Fusion is
+// opt-in: it only happens when the op resolver has a registration for this
+// name (see MicroMutableOpResolver::AddConv2DMaxPool2D()).
+constexpr char kConv2DMaxPool2DOpName[] = "CONV_2D_MAX_POOL_2D";
+
+// Builtin data of a fused CONV_2D -> MAX_POOL_2D node. The fused kernel
+// applies both fused activations, the pool's after the conv's.
+typedef struct {
+  TfLiteConvParams conv;
+  TfLitePoolParams pool;
+} TfLiteConv2DMaxPool2DParams;
+
+// Folds a MUL or ADD with a constant operand into the CONV_2D or
+// FULLY_CONNECTED that produces its other operand, e.g. the scale and offset
+// of a batch norm that was not folded by the converter. The model is read only,
+// so the filter and bias are copied into the persistent section of the arena
+// and modified there. The MUL/ADD node is taken out of the graph the same way
+// as the pool in FuseOperators().
+//
+// Only float models are folded at load time. Quantized models are folded
+// offline by tools/model_folder, which rewrites the quantization parameters
+// instead of the weights.
+TfLiteStatus FoldConstantOperators(const SubGraph* subgraph,
+                                   SimpleMemoryAllocator* allocator,
+                                   ErrorReporter* error_reporter,
+                                   TfLiteEvalTensor* eval_tensors,
+                                   NodeAndRegistration* node_and_registrations);
+
+// Rewrites the node list built from the flatbuffer so that every CONV_2D whose
+// output is only read by a MAX_POOL_2D is run as a single fused node. The
+// CONV_2D node takes over the pool's output and parameters, and the MAX_POOL_2D
+// node is left without inputs, outputs or an invoke function so that the
+// interpreter skips it. The intermediate tensor is then not referenced by any
+// node and is not allocated by the memory planner.
+//
+// Needs to run before the kernels' Init and Prepare, since those see the
+// rewritten nodes.
+TfLiteStatus FuseOperators(const SubGraph* subgraph,
+                           const MicroOpResolver& op_resolver,
+                           SimpleMemoryAllocator* allocator,
+                           ErrorReporter* error_reporter,
+                           NodeAndRegistration* node_and_registrations);
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_MICRO_OP_FUSION_H_
@@ -0,0 +1,43 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/lite/micro/micro_thread_pool.h"
+
+namespace tflite {
+
+MicroThreadPool::MicroThreadPool() {
+  context_.base.type = kTfLiteCpuBackendContext;
+  context_.base.Refresh = nullptr;
+  context_.pool = this;
+}
+
+MicroThreadPool* GetMicroThreadPool(TfLiteContext* context) {
+  if (context->GetExternalContext == nullptr) {
+    return nullptr;
+  }
+  TfLiteExternalContext* external_context =
+      context->GetExternalContext(context, kTfLiteCpuBackendContext);
+  if (external_context == nullptr) {
+    return nullptr;
+  }
+  // Only MicroThreadPool registers a kTfLiteCpuBackendContext in TF Micro.
+  return reinterpret_cast<MicroThreadPool::Context*>(external_context)->pool;
+}
+
+int GetMicroThreadCount(TfLiteContext* context) {
+  MicroThreadPool* pool = GetMicroThreadPool(context);
+  return pool == nullptr ? 1 : pool->num_threads();
+}
+
+}  // namespace tflite
@@ -0,0 +1,105 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_LITE_MICRO_MICRO_THREAD_POOL_H_
+#define TENSORFLOW_LITE_MICRO_MICRO_THREAD_POOL_H_
+
+#include <limits>
+
+#include "tensorflow/lite/c/common.h"
+
+namespace tflite {
+
+// A fixed set of workers the heavier kernels (CONV_2D, DEPTHWISE_CONV_2D,
+// FULLY_CONNECTED and the fused CONV_2D_MAX_POOL_2D) split their output across.
+// TF Micro has no threading of its own, so the application implements this for
+// its platform (FreeRTOS tasks, std::thread, ...) and registers it with
+//
+//   interpreter.SetExternalContext(kTfLiteCpuBackendContext,
+//                                  pool.external_context());
+//
+// before AllocateTensors(), since kernels size their per-worker scratch
+// buffers in Prepare. Without a pool every kernel runs on the calling thread.
+//
+// Workers only ever compute: they don't touch the allocator, the error
+// reporter or the profiler, so none of those need to be thread safe.
+class MicroThreadPool {
+ public:
+  MicroThreadPool();
+  virtual ~MicroThreadPool() {}
+
+  // Number of workers, counting the thread that calls Run().
+  virtual int num_threads() const = 0;
+
+  // Calls task(data, worker) once for every worker in [0, num_threads()) and
+  // returns when all of them have returned. Worker 0 runs on the calling
+  // thread.
+  virtual void Run(void (*task)(void* data, int worker), void* data) = 0;
+
+  TfLiteExternalContext* external_context() { return &context_.base; }
+
+ private:
+  friend MicroThreadPool* GetMicroThreadPool(TfLiteContext* context);
+
+  struct Context {
+    TfLiteExternalContext base;
+    MicroThreadPool* pool;
+  } context_;
+};
+
+// The pool registered with the interpreter, or nullptr.
+MicroThreadPool* GetMicroThreadPool(TfLiteContext* context);
+
+// Number of workers a kernel can split its work across, at least 1.
+int GetMicroThreadCount(TfLiteContext* context);
+
+// Runs fn(worker, begin, end) over a static partition of [begin, end) into
+// contiguous ranges, one per worker, at most max_workers of them (kernels with
+// per-worker scratch buffers pass the number they allocated). Returns when
+// every range is done. Without a pool, or with a single item, fn runs once on
+// the calling thread with the whole range.
+template <typename Fn>
+void ParallelFor(TfLiteContext* context, int begin, int end, const Fn& fn,
+                 int max_workers = std::numeric_limits<int>::max()) {
+  MicroThreadPool* pool = GetMicroThreadPool(context);
+  int workers = pool == nullptr ? 1 : pool->num_threads();
+  if (workers > max_workers) workers = max_workers;
+  if (workers > end - begin) workers = end - begin;
+  if (workers <= 1) {
+    fn(0, begin, end);
+    return;
+  }
+
+  struct Task {
+    const Fn* fn;
+    int begin;
+    int end;
+    int workers;
+
+    static void Run(void* data, int worker) {
+      const Task* task = static_cast<const Task*>(data);
+      if (worker >= task->workers) return;
+      const int count = task->end - task->begin;
+      const int range_begin = task->begin + count * worker / task->workers;
+      const int range_end = task->begin + count * (worker + 1) / task->workers;
+      (*task->fn)(worker, range_begin, range_end);
+    }
+  };
+  Task task = {&fn, begin, end, workers};
+  pool->Run(Task::Run, &task);
+}
+
+}  // namespace tflite
+
+#endif  // TENSORFLOW_LITE_MICRO_MICRO_THREAD_POOL_H_
@@ -13,32 +13,34 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
-// Reference implementation of timer functions.  Platforms are not required to
-// implement these timer methods, but they are required to enable profiling.
-
-// On platforms that have a POSIX stack or C library, it can be written using
-// methods from <sys/time.h> or clock() from <time.h>.
-
-// To add an equivalent function for your own platform, create your own
-// implementation file, and place it in a subfolder with named after the OS
-// you're targeting. For example, see the Cortex M bare metal version in
-// tensorflow/lite/micro/bluepill/micro_time.cc or the mbed one on
-// tensorflow/lite/micro/mbed/micro_time.cc.
+// Timer functions used by the profiler and the benchmarks in benchmarks/.
+//
+// On the ESP32 the tick is the microsecond of esp_timer, everywhere else (the
+// host builds of the benchmarks and tools) it is the microsecond of the
+// std::chrono steady clock. The count wraps after about 35 minutes, so only
+// the difference of two nearby readings means anything.
 
 #include "tensorflow/lite/micro/micro_time.h"
 
+#if defined(ESP_PLATFORM)
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
 namespace tflite {
 
-// Reference implementation of the ticks_per_second() function that's required
-// for a platform to support Tensorflow Lite for Microcontrollers profiling.
-// This returns 0 by default because timing is an optional feature that builds
-// without errors on platforms that do not need it.
-int32_t ticks_per_second() { return 0; }
-
-// Reference implementation of the GetCurrentTimeTicks() function that's
-// required for a platform to support Tensorflow Lite for Microcontrollers
-// profiling. This returns 0 by default because timing is an optional feature
-// that builds without errors on platforms that do not need it.
-int32_t GetCurrentTimeTicks() { return 0; }
+int32_t ticks_per_second() { return 1000000; }
+
+int32_t GetCurrentTimeTicks() {
+#if defined(ESP_PLATFORM)
+  return static_cast<int32_t>(esp_timer_get_time());
+#else
+  return static_cast<int32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
 
 }  // namespace tflite
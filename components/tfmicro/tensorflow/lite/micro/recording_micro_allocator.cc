@@ -18,11 +18,20 @@ limitations under the License.
 #include "tensorflow/lite/core/api/error_reporter.h"
 #include "tensorflow/lite/kernels/internal/compatibility.h"
 #include "tensorflow/lite/micro/compatibility.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
+#include "tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
 #include "tensorflow/lite/micro/micro_allocator.h"
 #include "tensorflow/lite/micro/recording_simple_memory_allocator.h"
 
 namespace tflite {
 
+namespace {
+
+// Same alignment as MicroAllocator gives its buffers.
+constexpr size_t kBufferAlignment = 16;
+
+}  // namespace
+
 RecordingMicroAllocator::RecordingMicroAllocator(
     RecordingSimpleMemoryAllocator* recording_memory_allocator,
     ErrorReporter* error_reporter)
@@ -101,6 +110,88 @@ void RecordingMicroAllocator::PrintAllocations() const {
                           "Operator runtime data", "OpData structs");
 }
 
+RecordedArenaUsage RecordingMicroAllocator::GetRecordedArenaUsage() const {
+  const RecordingSimpleMemoryAllocator* memory = recording_memory_allocator_;
+  RecordedArenaUsage usage = {};
+  usage.head_bytes = memory->GetHeadUsedBytes();
+  usage.tail_bytes = memory->GetTailUsedBytes();
+  usage.arena_bytes =
+      usage.head_bytes + usage.tail_bytes + memory->GetAvailableMemory(1);
+  usage.peak_head_bytes = memory->GetPeakHeadUsedBytes();
+  if (memory_plan_recorded_) {
+    // The peak was reset once the kernels had been prepared.
+    usage.peak_prepare_temp_bytes = peak_prepare_temp_bytes_;
+    usage.peak_invoke_temp_bytes = memory->GetPeakTempBytes();
+  } else {
+    usage.peak_prepare_temp_bytes = memory->GetPeakTempBytes();
+  }
+  usage.planning_bytes = planning_bytes_;
+  usage.plan_live_bytes = plan_live_bytes_;
+  usage.plan_gap_bytes = plan_bytes_ - plan_live_bytes_;
+
+  usage.scratch_buffer_count = GetScratchBufferCount();
+  const internal::ScratchBufferHandle* handles = scratch_buffer_handles();
+  for (size_t i = 0; i < usage.scratch_buffer_count; ++i) {
+    usage.scratch_buffer_bytes += handles[i].bytes;
+  }
+
+  // The recording allocators live in the tail and are bigger than the ones a
+  // MicroInterpreter creates, so the difference isn't needed. It is rounded
+  // down as it shifts the padding of everything allocated after them.
+  const size_t recording_bytes =
+      ((sizeof(RecordingMicroAllocator) - sizeof(MicroAllocator)) +
+       (sizeof(RecordingSimpleMemoryAllocator) -
+        sizeof(SimpleMemoryAllocator))) /
+      kBufferAlignment * kBufferAlignment;
+  size_t required_bytes = usage.tail_bytes + usage.peak_head_bytes;
+  if (commit_required_bytes_ > required_bytes) {
+    required_bytes = commit_required_bytes_;
+  }
+  usage.required_bytes =
+      AlignSizeUp(required_bytes - recording_bytes, kBufferAlignment);
+  return usage;
+}
+
+void RecordingMicroAllocator::PrintArenaUsage() const {
+#ifndef TF_LITE_STRIP_ERROR_STRINGS
+  const RecordedArenaUsage usage = GetRecordedArenaUsage();
+  ErrorReporter* reporter = error_reporter();
+  TF_LITE_REPORT_ERROR(reporter, "[RecordingMicroAllocator] arena %u bytes",
+                       usage.arena_bytes);
+  TF_LITE_REPORT_ERROR(reporter,
+                       "[RecordingMicroAllocator] head %u bytes (peak %u)",
+                       usage.head_bytes, usage.peak_head_bytes);
+  TF_LITE_REPORT_ERROR(reporter, "[RecordingMicroAllocator] tail %u bytes",
+                       usage.tail_bytes);
+  TF_LITE_REPORT_ERROR(
+      reporter,
+      "[RecordingMicroAllocator] peak temp %u bytes preparing, %u bytes "
+      "invoking",
+      usage.peak_prepare_temp_bytes, usage.peak_invoke_temp_bytes);
+  TF_LITE_REPORT_ERROR(reporter,
+                       "[RecordingMicroAllocator] planning took %u bytes",
+                       usage.planning_bytes);
+  TF_LITE_REPORT_ERROR(
+      reporter,
+      "[RecordingMicroAllocator] plan %u bytes live at once, %u bytes of gaps",
+      usage.plan_live_bytes, usage.plan_gap_bytes);
+  const internal::ScratchBufferHandle* handles = scratch_buffer_handles();
+  for (size_t i = 0; i < usage.scratch_buffer_count; ++i) {
+    TF_LITE_REPORT_ERROR(
+        reporter,
+        "[RecordingMicroAllocator] scratch buffer %u: op %d requested %u bytes",
+        i, handles[i].node_idx, handles[i].bytes);
+  }
+  TF_LITE_REPORT_ERROR(
+      reporter,
+      "[RecordingMicroAllocator] %u scratch buffers requested %u bytes",
+      usage.scratch_buffer_count, usage.scratch_buffer_bytes);
+  TF_LITE_REPORT_ERROR(
+      reporter, "[RecordingMicroAllocator] required arena size %u bytes",
+      usage.required_bytes);
+#endif
+}
+
 void RecordingMicroAllocator::PrintRecordedAllocation(
     RecordedAllocationType allocation_type, const char* allocation_name,
     const char* allocation_description) const {
@@ -207,6 +298,27 @@ TfLiteStatus RecordingMicroAllocator::PopulateTfLiteTensorFromFlatbuffer(
   return status;
 }
 
+void RecordingMicroAllocator::RecordMemoryPlan(GreedyMemoryPlanner* planner,
+                                               size_t planning_bytes) {
+  planning_bytes_ = planning_bytes;
+  plan_bytes_ = planner->GetMaximumMemorySize();
+  plan_live_bytes_ = planner->GetMaximumLiveMemorySize();
+  // Working out the plan takes the arena up to the tail, and committing it
+  // needs room for the plan beside whatever the head already holds (the
+  // scratch buffer handles). The tail grows a bit more after this.
+  const size_t head_bytes = AlignSizeUp(
+      recording_memory_allocator_->GetHeadUsedBytes(), kBufferAlignment);
+  const size_t commit_bytes = head_bytes + plan_bytes_;
+  commit_required_bytes_ =
+      recording_memory_allocator_->GetTailUsedBytes() +
+      (commit_bytes > planning_bytes ? commit_bytes : planning_bytes);
+  // Every kernel has been prepared, so the temp allocations from here on are
+  // the ones made while invoking.
+  peak_prepare_temp_bytes_ = recording_memory_allocator_->GetPeakTempBytes();
+  recording_memory_allocator_->ResetPeakTempBytes();
+  memory_plan_recorded_ = true;
+}
+
 RecordedAllocation RecordingMicroAllocator::SnapshotAllocationUsage() const {
   return {/*requested_bytes=*/recording_memory_allocator_->GetRequestedBytes(),
           /*used_bytes=*/recording_memory_allocator_->GetUsedBytes(),
@@ -43,6 +43,35 @@ struct RecordedAllocation {
   size_t count;
 };
 
+// Arena usage of a whole model, for sizing the tensor arena from data rather
+// than guessing. All sizes are in bytes.
+struct RecordedArenaUsage {
+  // Size of the arena the allocator was created with.
+  size_t arena_bytes;
+  // Non-persistent buffers (the memory plan) at the start of the arena.
+  size_t head_bytes;
+  // Persistent allocations at the end of the arena.
+  size_t tail_bytes;
+  // The most the head with the temp allocations on top of it ever took up.
+  size_t peak_head_bytes;
+  // The longest chain of temp allocations while the kernels were being
+  // prepared, and after that (during Invoke()).
+  size_t peak_prepare_temp_bytes;
+  size_t peak_invoke_temp_bytes;
+  // Arena taken up while working out the memory plan.
+  size_t planning_bytes;
+  // The most memory the planned buffers that are in use at the same time
+  // need, and how much more than that the plan takes up because of the gaps
+  // between them.
+  size_t plan_live_bytes;
+  size_t plan_gap_bytes;
+  // Scratch buffers requested by the kernels.
+  size_t scratch_buffer_count;
+  size_t scratch_buffer_bytes;
+  // The smallest arena the model can be allocated and invoked in.
+  size_t required_bytes;
+};
+
 // Utility subclass of MicroAllocator that records all allocations
 // inside the arena. A summary of allocations can be logged through the
 // ErrorReporter by invoking LogAllocations(). This special allocator requires
@@ -66,6 +95,14 @@ class RecordingMicroAllocator : public MicroAllocator {
   // defined in RecordedAllocationType.
   void PrintAllocations() const;
 
+  // Returns the usage of the arena as a whole. The temp allocations made by
+  // Invoke() are included once the model has been invoked.
+  RecordedArenaUsage GetRecordedArenaUsage() const;
+
+  // Logs out through the ErrorReporter the RecordedArenaUsage and the scratch
+  // buffers each operator requested.
+  void PrintArenaUsage() const;
+
  protected:
   TfLiteStatus AllocateNodeAndRegistrations(
       const Model* model,
@@ -90,6 +127,8 @@ class RecordingMicroAllocator : public MicroAllocator {
                                                   TfLiteTensor* tensor,
                                                   int tensor_index,
                                                   bool allocate_temp) override;
+  void RecordMemoryPlan(GreedyMemoryPlanner* planner,
+                        size_t planning_bytes) override;
 
  private:
   RecordingMicroAllocator(RecordingSimpleMemoryAllocator* memory_allocator,
@@ -103,7 +142,7 @@ class RecordingMicroAllocator : public MicroAllocator {
   void RecordAllocationUsage(const RecordedAllocation& snapshotted_allocation,
                              RecordedAllocation& recorded_allocation);
 
-  const RecordingSimpleMemoryAllocator* recording_memory_allocator_;
+  RecordingSimpleMemoryAllocator* recording_memory_allocator_;
 
   RecordedAllocation recorded_tflite_eval_tensor_data_ = {};
   RecordedAllocation recorded_persistent_tflite_tensor_data_ = {};
@@ -112,6 +151,13 @@ class RecordingMicroAllocator : public MicroAllocator {
   RecordedAllocation recorded_node_and_registration_array_data_ = {};
   RecordedAllocation recorded_op_data_ = {};
 
+  bool memory_plan_recorded_ = false;
+  size_t planning_bytes_ = 0;
+  size_t plan_bytes_ = 0;
+  size_t plan_live_bytes_ = 0;
+  size_t commit_required_bytes_ = 0;
+  size_t peak_prepare_temp_bytes_ = 0;
+
   TF_LITE_REMOVE_VIRTUAL_DELETE
 };
 
@@ -27,7 +27,9 @@ RecordingSimpleMemoryAllocator::RecordingSimpleMemoryAllocator(
       requested_head_bytes_(0),
       requested_tail_bytes_(0),
       used_bytes_(0),
-      alloc_count_(0) {}
+      alloc_count_(0),
+      peak_head_used_bytes_(0),
+      peak_temp_bytes_(0) {}
 
 RecordingSimpleMemoryAllocator::~RecordingSimpleMemoryAllocator() {}
 
@@ -57,6 +59,18 @@ size_t RecordingSimpleMemoryAllocator::GetAllocatedCount() const {
   return alloc_count_;
 }
 
+size_t RecordingSimpleMemoryAllocator::GetPeakHeadUsedBytes() const {
+  return peak_head_used_bytes_;
+}
+
+size_t RecordingSimpleMemoryAllocator::GetPeakTempBytes() const {
+  return peak_temp_bytes_;
+}
+
+void RecordingSimpleMemoryAllocator::ResetPeakTempBytes() {
+  peak_temp_bytes_ = 0;
+}
+
 TfLiteStatus RecordingSimpleMemoryAllocator::EnsureHeadSize(size_t size,
                                                             size_t alignment) {
   const uint8_t* previous_head = GetHead();
@@ -64,6 +78,9 @@ TfLiteStatus RecordingSimpleMemoryAllocator::EnsureHeadSize(size_t size,
   if (status == kTfLiteOk) {
     used_bytes_ += GetHead() - previous_head;
     requested_head_bytes_ = size;
+    if (GetHeadUsedBytes() > peak_head_used_bytes_) {
+      peak_head_used_bytes_ = GetHeadUsedBytes();
+    }
   }
   return status;
 }
@@ -80,4 +97,20 @@ uint8_t* RecordingSimpleMemoryAllocator::AllocateFromTail(size_t size,
   return result;
 }
 
+uint8_t* RecordingSimpleMemoryAllocator::AllocateTemp(size_t size,
+                                                      size_t alignment) {
+  uint8_t* result = SimpleMemoryAllocator::AllocateTemp(size, alignment);
+  if (result != nullptr) {
+    const size_t temp_bytes = result + size - GetHead();
+    if (temp_bytes > peak_temp_bytes_) {
+      peak_temp_bytes_ = temp_bytes;
+    }
+    const size_t head_used_bytes = result + size - GetBufferHead();
+    if (head_used_bytes > peak_head_used_bytes_) {
+      peak_head_used_bytes_ = head_used_bytes;
+    }
+  }
+  return result;
+}
+
 }  // namespace tflite
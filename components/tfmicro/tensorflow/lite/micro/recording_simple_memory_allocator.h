@@ -47,14 +47,26 @@ class RecordingSimpleMemoryAllocator : public SimpleMemoryAllocator {
   // Returns the number of alloc calls from the head or tail.
   size_t GetAllocatedCount() const;
 
+  // Returns the most bytes the head together with the chain of temp
+  // allocations on top of it has taken up from the start of the arena.
+  size_t GetPeakHeadUsedBytes() const;
+
+  // Returns the most bytes a chain of temp allocations has taken up since the
+  // allocator was created or ResetPeakTempBytes() was last called.
+  size_t GetPeakTempBytes() const;
+  void ResetPeakTempBytes();
+
   TfLiteStatus EnsureHeadSize(size_t size, size_t alignment) override;
   uint8_t* AllocateFromTail(size_t size, size_t alignment) override;
+  uint8_t* AllocateTemp(size_t size, size_t alignment) override;
 
  private:
   size_t requested_head_bytes_;
   size_t requested_tail_bytes_;
   size_t used_bytes_;
   size_t alloc_count_;
+  size_t peak_head_used_bytes_;
+  size_t peak_temp_bytes_;
 
   TF_LITE_REMOVE_VIRTUAL_DELETE
 };
@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "AdaptiveCodec.h"
+#include "StreamFrame.h"
+
+// worst to best sounding, which is also fewest to most bytes
+static const AudioCodec_t codec_levels[] = {AUDIO_CODEC_IMA_ADPCM, AUDIO_CODEC_ULAW, AUDIO_CODEC_PCM16};
+#define CODEC_LEVELS (int)(sizeof(codec_levels) / sizeof(codec_levels[0]))
+
+// frames a second at 16KHz
+#define FRAMES_PER_SECOND (16000 / STREAM_FRAME_SAMPLES)
+// sends that have to go through without waiting before trying the next codec up - a second's worth of chunks at first,
+// doubling each time the codec it tried had to come back down within PROBE_SETTLE_SENDS
+#define PROBE_MIN_SENDS 10
+#define PROBE_MAX_SENDS 160
+#define PROBE_SETTLE_SENDS 50
+
+static int codec_level(AudioCodec_t codec)
+{
+    for (int level = 0; level < CODEC_LEVELS; level++)
+    {
+        if (codec_levels[level] == codec)
+        {
+            return level;
+        }
+    }
+    return 0;
+}
+
+// bytes a second a codec needs, frame headers and all, with a quarter to spare
+static uint32_t needed_goodput(int level)
+{
+    int frame_bytes = STREAM_FRAME_HEADER_BYTES + audio_codec_encoded_bytes(codec_levels[level], STREAM_FRAME_SAMPLES);
+    return frame_bytes * FRAMES_PER_SECOND * 5 / 4;
+}
+
+AdaptiveCodec::AdaptiveCodec(AudioCodec_t codec)
+{
+    m_codec = codec_levels[codec_level(codec)];
+    m_probe_sends = PROBE_MIN_SENDS;
+    m_probe_age = PROBE_SETTLE_SENDS;
+    reset();
+}
+
+void AdaptiveCodec::reset()
+{
+    m_goodput = 0;
+    m_clear_sends = 0;
+    m_last_send_end = 0;
+}
+
+void AdaptiveCodec::setCodec(int level)
+{
+    m_codec = codec_levels[level];
+    m_clear_sends = 0;
+}
+
+bool AdaptiveCodec::update(int bytes, int64_t send_start, int64_t send_end)
+{
+    int level = codec_level(m_codec);
+    int64_t since = m_last_send_end ? m_last_send_end : send_start;
+    m_last_send_end = send_end;
+    m_probe_age = std::min(m_probe_age + 1, PROBE_SETTLE_SENDS);
+    if (send_end - send_start < ADAPTIVE_CODEC_BLOCKED_SEND_US)
+    {
+        m_clear_sends++;
+        if (m_clear_sends < m_probe_sends || level == CODEC_LEVELS - 1)
+        {
+            return false;
+        }
+        // what was measured was the link struggling with less than this - measure it afresh
+        setCodec(level + 1);
+        m_goodput = 0;
+        m_probe_age = 0;
+        return true;
+    }
+    m_clear_sends = 0;
+    uint32_t goodput = (uint64_t)bytes * 1000000 / (send_end - since);
+    // down straight away, so it follows the link as soon as it gets worse, but only up gradually
+    m_goodput = m_goodput == 0 || goodput < m_goodput ? goodput : (3 * m_goodput + goodput) / 4;
+    int fits = level;
+    while (fits > 0 && needed_goodput(fits) > m_goodput)
+    {
+        fits--;
+    }
+    if (fits == level)
+    {
+        return false;
+    }
+    // the last move up was too far if it hasn't lasted - don't try it again as soon
+    m_probe_sends = m_probe_age < PROBE_SETTLE_SENDS ? std::min(m_probe_sends * 2, PROBE_MAX_SENDS) : PROBE_MIN_SENDS;
+    m_probe_age = PROBE_SETTLE_SENDS;
+    setCodec(fits);
+    return true;
+}
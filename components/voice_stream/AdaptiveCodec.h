@@ -0,0 +1,60 @@
+#ifndef __adaptive_codec_h__
+#define __adaptive_codec_h__
+
+#include <stdint.h>
+
+#include "AudioCodec.h"
+
+// a send that takes this long had to wait for room in the send buffer
+#define ADAPTIVE_CODEC_BLOCKED_SEND_US 10000
+
+/**
+ * Picks the codec an upload's next chunk goes out in from how well the
+ * connection is keeping up - the best sounding one the link has room for.
+ *
+ * A send that has to wait means the socket's send buffer is full and the
+ * link is taking bytes as fast as it can. If the send before it had to wait
+ * too the buffer was full then as well, so the link carried exactly the
+ * bytes sent in between - that over the time between is the link's goodput
+ * (and only a little over it otherwise). It's followed straight down and
+ * gradually up, and as soon as it's too little for the current codec with a
+ * quarter to spare, it drops to the best codec that fits. Sends that don't
+ * wait only say the link is keeping up, not by how much - so after enough of
+ * them in a row it tries the next codec up. If that has to come back down
+ * soon after, it waits twice as long before trying again.
+ *
+ * The codec only ever changes between chunks, which always start a frame.
+ **/
+class AdaptiveCodec
+{
+private:
+    AudioCodec_t m_codec;
+    // bytes a second, 0 until the link has been measured
+    uint32_t m_goodput;
+    // sends in a row that didn't have to wait, and how many it takes to try the next codec up
+    int m_clear_sends;
+    int m_probe_sends;
+    // sends since it last moved up, while it might still turn out to have been too far
+    int m_probe_age;
+    // when the last send finished, 0 before the first
+    int64_t m_last_send_end;
+
+    void setCodec(int level);
+
+public:
+    AdaptiveCodec(AudioCodec_t codec);
+    // starting another upload - the link may have changed since it was last measured, so that doesn't count
+    void reset();
+    // bytes went out in a send from send_start to send_end (esp_timer_get_time), returns true if the codec has changed
+    bool update(int bytes, int64_t send_start, int64_t send_end);
+    AudioCodec_t getCodec()
+    {
+        return m_codec;
+    }
+    uint32_t getGoodput()
+    {
+        return m_goodput;
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include <string.h>
+#include "AudioCodec.h"
+
+// G.711 - magnitudes are clipped so adding the bias can't overflow the top segment
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 32635
+
+#define ADPCM_MAX_INDEX 88
+
+static const int16_t adpcm_step_table[ADPCM_MAX_INDEX + 1] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107,
+    118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894,
+    6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767};
+
+static const int8_t adpcm_index_table[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+int audio_codec_encoded_bytes(AudioCodec_t codec, int samples)
+{
+    switch (codec)
+    {
+    case AUDIO_CODEC_PCM16:
+        return samples * 2;
+    case AUDIO_CODEC_ULAW:
+        return samples;
+    case AUDIO_CODEC_IMA_ADPCM:
+        return ADPCM_STATE_BYTES + (samples + 1) / 2;
+    }
+    return -1;
+}
+
+int ulaw_encode(const int16_t *samples, int count, uint8_t *out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int sample = samples[i];
+        int sign = 0;
+        if (sample < 0)
+        {
+            sign = 0x80;
+            sample = -sample;
+        }
+        if (sample > ULAW_CLIP)
+        {
+            sample = ULAW_CLIP;
+        }
+        sample += ULAW_BIAS;
+        // the segment is where the top bit is, counting from bit 7 - a single instruction (NSAU) on the ESP32
+        int exponent = 24 - __builtin_clz(sample);
+        int mantissa = (sample >> (exponent + 3)) & 0x0f;
+        out[i] = ~(sign | (exponent << 4) | mantissa);
+    }
+    return count;
+}
+
+void ulaw_decode(const uint8_t *bytes, int count, int16_t *out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int code = ~bytes[i];
+        int exponent = (code >> 4) & 0x07;
+        int magnitude = ((((code & 0x0f) << 3) + ULAW_BIAS) << exponent) - ULAW_BIAS;
+        out[i] = (code & 0x80) ? -magnitude : magnitude;
+    }
+}
+
+int adpcm_encode(AdpcmState_t *state, const int16_t *samples, int count, uint8_t *out)
+{
+    // the state the block starts from - predictor then step index, like the header of a WAV IMA ADPCM block
+    int predictor = state->predictor;
+    int index = state->index;
+    out[0] = predictor & 0xff;
+    out[1] = (predictor >> 8) & 0xff;
+    out[2] = index;
+    out[3] = 0;
+    uint8_t *packed = out + ADPCM_STATE_BYTES;
+    for (int i = 0; i < count; i++)
+    {
+        int step = adpcm_step_table[index];
+        int diff = samples[i] - predictor;
+        int nibble = 0;
+        if (diff < 0)
+        {
+            nibble = 8;
+            diff = -diff;
+        }
+        // quantise the difference to 3 bits of the step size, tracking what the decoder will reconstruct
+        int vpdiff = step >> 3;
+        if (diff >= step)
+        {
+            nibble |= 4;
+            diff -= step;
+            vpdiff += step;
+        }
+        step >>= 1;
+        if (diff >= step)
+        {
+            nibble |= 2;
+            diff -= step;
+            vpdiff += step;
+        }
+        step >>= 1;
+        if (diff >= step)
+        {
+            nibble |= 1;
+            vpdiff += step;
+        }
+        predictor += (nibble & 8) ? -vpdiff : vpdiff;
+        predictor = predictor > 32767 ? 32767 : (predictor < -32768 ? -32768 : predictor);
+        index += adpcm_index_table[nibble];
+        index = index < 0 ? 0 : (index > ADPCM_MAX_INDEX ? ADPCM_MAX_INDEX : index);
+        // first sample in the low nibble
+        if (i & 1)
+        {
+            packed[i >> 1] |= nibble << 4;
+        }
+        else
+        {
+            packed[i >> 1] = nibble;
+        }
+    }
+    state->predictor = predictor;
+    state->index = index;
+    return ADPCM_STATE_BYTES + (count + 1) / 2;
+}
+
+void adpcm_decode(const uint8_t *bytes, int count, int16_t *out)
+{
+    int predictor = (int16_t)(bytes[0] | (bytes[1] << 8));
+    int index = bytes[2] > ADPCM_MAX_INDEX ? ADPCM_MAX_INDEX : bytes[2];
+    const uint8_t *packed = bytes + ADPCM_STATE_BYTES;
+    for (int i = 0; i < count; i++)
+    {
+        int nibble = (i & 1) ? packed[i >> 1] >> 4 : packed[i >> 1] & 0x0f;
+        int step = adpcm_step_table[index];
+        int vpdiff = step >> 3;
+        if (nibble & 4)
+        {
+            vpdiff += step;
+        }
+        if (nibble & 2)
+        {
+            vpdiff += step >> 1;
+        }
+        if (nibble & 1)
+        {
+            vpdiff += step >> 2;
+        }
+        predictor += (nibble & 8) ? -vpdiff : vpdiff;
+        predictor = predictor > 32767 ? 32767 : (predictor < -32768 ? -32768 : predictor);
+        index += adpcm_index_table[nibble];
+        index = index < 0 ? 0 : (index > ADPCM_MAX_INDEX ? ADPCM_MAX_INDEX : index);
+        out[i] = predictor;
+    }
+}
+
+int audio_codec_encode(AudioCodec_t codec, AdpcmState_t *state, const int16_t *samples, int count, uint8_t *out)
+{
+    switch (codec)
+    {
+    case AUDIO_CODEC_PCM16:
+        // everything we run on is little endian
+        memcpy(out, samples, count * 2);
+        return count * 2;
+    case AUDIO_CODEC_ULAW:
+        return ulaw_encode(samples, count, out);
+    case AUDIO_CODEC_IMA_ADPCM:
+        return adpcm_encode(state, samples, count, out);
+    }
+    return -1;
+}
+
+int audio_codec_decode(AudioCodec_t codec, const uint8_t *bytes, int byte_count, int16_t *out, int count)
+{
+    if (audio_codec_encoded_bytes(codec, count) != byte_count)
+    {
+        return -1;
+    }
+    switch (codec)
+    {
+    case AUDIO_CODEC_PCM16:
+        memcpy(out, bytes, count * 2);
+        break;
+    case AUDIO_CODEC_ULAW:
+        ulaw_decode(bytes, count, out);
+        break;
+    case AUDIO_CODEC_IMA_ADPCM:
+        adpcm_decode(bytes, count, out);
+        break;
+    }
+    return count;
+}
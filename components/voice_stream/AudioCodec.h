@@ -0,0 +1,47 @@
+#ifndef __audio_codec_h__
+#define __audio_codec_h__
+
+#include <stdint.h>
+
+// how the samples in an audio frame are encoded - the values go over the wire in the frame header
+typedef enum
+{
+    AUDIO_CODEC_PCM16 = 0,
+    // G.711 mu-law, a byte per sample
+    AUDIO_CODEC_ULAW = 1,
+    // IMA ADPCM, a 4 byte state then 4 bits per sample
+    AUDIO_CODEC_IMA_ADPCM = 2
+} AudioCodec_t;
+
+#define AUDIO_CODEC_COUNT 3
+
+// predictor and step index, carried from one block to the next
+typedef struct
+{
+    int16_t predictor;
+    uint8_t index;
+} AdpcmState_t;
+
+#define ADPCM_STATE_BYTES 4
+
+// bytes needed to encode a block of samples, -1 for an unknown codec
+int audio_codec_encoded_bytes(AudioCodec_t codec, int samples);
+
+/**
+ * Block encoders and decoders. Each encodes a whole block in one go and
+ * returns the number of bytes written. ADPCM blocks start with the state they
+ * were encoded from so every block can be decoded on its own - encoding
+ * carries the state on in place so consecutive blocks follow on without a
+ * jump. Decoding takes the state from the block.
+ **/
+int ulaw_encode(const int16_t *samples, int count, uint8_t *out);
+void ulaw_decode(const uint8_t *bytes, int count, int16_t *out);
+int adpcm_encode(AdpcmState_t *state, const int16_t *samples, int count, uint8_t *out);
+void adpcm_decode(const uint8_t *bytes, int count, int16_t *out);
+
+// any of the codecs - encode returns the number of bytes, decode the number of samples, and both -1 for an unknown
+// codec or if the bytes aren't the size the samples encode to
+int audio_codec_encode(AudioCodec_t codec, AdpcmState_t *state, const int16_t *samples, int count, uint8_t *out);
+int audio_codec_decode(AudioCodec_t codec, const uint8_t *bytes, int byte_count, int16_t *out, int count);
+
+#endif
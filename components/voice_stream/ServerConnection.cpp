@@ -0,0 +1,290 @@
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <freertos/task.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ServerConnection.h"
+#include "StreamFrame.h"
+#include "StreamSocket.h"
+
+static const char *TAG = "ServerConnection";
+
+#define CONNECT_TIMEOUT_MS 2000
+// the wait before trying again after losing the connection or failing to make it, doubling each time it fails
+#define BACKOFF_MIN_MS 250
+#define BACKOFF_MAX_MS 30000
+// longest the connection task goes without looking at what it has been asked to do
+#define POLL_MS 100
+
+void serverConnectionTask(void *param);
+
+ServerConnection::ServerConnection(uint16_t port, int heartbeat_ms, int heartbeat_timeout_ms)
+{
+    m_port = port;
+    m_heartbeat_ms = heartbeat_ms;
+    m_heartbeat_timeout_ms = heartbeat_timeout_ms;
+    m_server_ip.store(0);
+    m_suspended.store(false);
+    m_reconnect_now.store(false);
+    m_connected.store(false);
+    m_mutex = xSemaphoreCreateMutex();
+    m_sock = -1;
+    m_sock_ip = 0;
+    m_broken = false;
+    m_backoff_ms = BACKOFF_MIN_MS;
+    m_next_attempt = 0;
+    m_next_heartbeat = 0;
+    m_awaiting_pong = false;
+    m_ping_sequence = 0;
+    m_ping_sent = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void ServerConnection::start(UBaseType_t priority)
+{
+    xTaskCreate(serverConnectionTask, "server_connection", 4096, this, priority, nullptr);
+}
+
+void ServerConnection::setServer(uint32_t server_ip)
+{
+    m_server_ip.store(server_ip);
+    m_reconnect_now.store(true);
+}
+
+void ServerConnection::suspend()
+{
+    m_suspended.store(true);
+}
+
+void ServerConnection::resume()
+{
+    m_suspended.store(false);
+    m_reconnect_now.store(true);
+}
+
+void ServerConnection::reconnectNow()
+{
+    m_reconnect_now.store(true);
+}
+
+int ServerConnection::acquire(TickType_t ticks_to_wait)
+{
+    // don't wait for a connection that isn't there
+    if (!m_connected.load() || xSemaphoreTake(m_mutex, ticks_to_wait) != pdTRUE)
+    {
+        return -1;
+    }
+    if (m_sock < 0 || m_broken)
+    {
+        xSemaphoreGive(m_mutex);
+        return -1;
+    }
+    m_stats.uploads++;
+    return m_sock;
+}
+
+void ServerConnection::release(bool ok)
+{
+    m_broken = !ok;
+    // the upload has kept the connection busy - forget any heartbeat that was on its way (the answer won't match
+    // the next one) and start counting again from now
+    m_awaiting_pong = false;
+    m_next_heartbeat = esp_timer_get_time() + m_heartbeat_ms * 1000LL;
+    xSemaphoreGive(m_mutex);
+}
+
+ServerConnectionStats_t ServerConnection::getStats()
+{
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+    ServerConnectionStats_t stats = m_stats;
+    xSemaphoreGive(m_mutex);
+    return stats;
+}
+
+void ServerConnection::connect(int sock, uint32_t server_ip)
+{
+    // a heartbeat's answer has to arrive in one piece once it has started
+    struct timeval timeout = {m_heartbeat_timeout_ms / 1000, (m_heartbeat_timeout_ms % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    m_sock = sock;
+    m_sock_ip = server_ip;
+    m_broken = false;
+    m_awaiting_pong = false;
+    // find out the round trip time straight away
+    m_next_heartbeat = esp_timer_get_time();
+    m_stats.connects++;
+    m_connected.store(true);
+    ESP_LOGI(TAG, "Connected to the server");
+}
+
+// waits out the backoff before the next attempt, and doubles it for the one after
+void ServerConnection::scheduleRetry()
+{
+    m_stats.backoff_ms = m_backoff_ms;
+    m_next_attempt = esp_timer_get_time() + m_backoff_ms * 1000LL;
+    m_backoff_ms = std::min(m_backoff_ms * 2, (uint32_t)BACKOFF_MAX_MS);
+}
+
+void ServerConnection::disconnect(const char *reason)
+{
+    ESP_LOGW(TAG, "Disconnected from the server: %s", reason);
+    close(m_sock);
+    m_sock = -1;
+    m_connected.store(false);
+    m_stats.disconnects++;
+    scheduleRetry();
+}
+
+// reads the frame the server has sent - only pongs mean anything while the connection is idle
+void ServerConnection::receive()
+{
+    uint8_t header_bytes[STREAM_FRAME_HEADER_BYTES];
+    uint8_t payload[STREAM_FRAME_MAX_PAYLOAD_BYTES];
+    StreamFrameHeader_t header;
+    if (!stream_socket_receive(m_sock, header_bytes, STREAM_FRAME_HEADER_BYTES) ||
+        !stream_frame_read_header(header_bytes, &header) ||
+        !stream_socket_receive(m_sock, payload, header.payload_bytes))
+    {
+        disconnect("closed by the server");
+        return;
+    }
+    if (header.type == STREAM_FRAME_PONG && m_awaiting_pong && header.sequence == m_ping_sequence)
+    {
+        m_awaiting_pong = false;
+        m_next_heartbeat = m_ping_sent + m_heartbeat_ms * 1000LL;
+        m_stats.heartbeats++;
+        // the server is answering - so the next time it goes away, start trying again quickly
+        m_backoff_ms = BACKOFF_MIN_MS;
+        addRttSample(esp_timer_get_time() - m_ping_sent);
+    }
+}
+
+void ServerConnection::sendHeartbeat()
+{
+    int64_t now = esp_timer_get_time();
+    uint8_t frame[STREAM_FRAME_HEADER_BYTES];
+    StreamFrameHeader_t header;
+    header.type = STREAM_FRAME_PING;
+    header.codec = 0;
+    header.stream = 0;
+    header.samples = 0;
+    header.sequence = ++m_ping_sequence;
+    header.timestamp = (uint32_t)now;
+    header.payload_bytes = 0;
+    stream_frame_write_header(frame, header);
+    if (!stream_socket_send(m_sock, frame, STREAM_FRAME_HEADER_BYTES))
+    {
+        disconnect("the heartbeat couldn't be sent");
+        return;
+    }
+    m_awaiting_pong = true;
+    m_ping_sent = now;
+}
+
+// RFC 6298 - the mean deviation is updated from the old average before the average moves
+void ServerConnection::addRttSample(uint32_t rtt_us)
+{
+    m_stats.last_rtt_us = rtt_us;
+    if (m_stats.srtt_us == 0)
+    {
+        m_stats.srtt_us = rtt_us;
+        m_stats.rtt_var_us = rtt_us / 2;
+        return;
+    }
+    uint32_t deviation = rtt_us > m_stats.srtt_us ? rtt_us - m_stats.srtt_us : m_stats.srtt_us - rtt_us;
+    m_stats.rtt_var_us = (3 * m_stats.rtt_var_us + deviation) / 4;
+    m_stats.srtt_us = (7 * m_stats.srtt_us + rtt_us) / 8;
+}
+
+// how long the connection task can wait before it next has something to do - 0 when it's time to connect
+int ServerConnection::waitMs()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t due;
+    if (m_reconnect_now.exchange(false))
+    {
+        m_next_attempt = now;
+        m_backoff_ms = BACKOFF_MIN_MS;
+    }
+    if (m_sock >= 0)
+    {
+        due = m_awaiting_pong ? m_ping_sent + m_heartbeat_timeout_ms * 1000LL : m_next_heartbeat;
+    }
+    else if (m_server_ip.load() == 0 || m_suspended.load())
+    {
+        return POLL_MS;
+    }
+    else
+    {
+        due = m_next_attempt;
+    }
+    return std::max((int64_t)0, std::min((due - now + 999) / 1000, (int64_t)POLL_MS));
+}
+
+void serverConnectionTask(void *param)
+{
+    ServerConnection *connection = static_cast<ServerConnection *>(param);
+    xSemaphoreTake(connection->m_mutex, portMAX_DELAY);
+    while (true)
+    {
+        int sock = connection->m_sock;
+        int wait_ms = connection->waitMs();
+        xSemaphoreGive(connection->m_mutex);
+        if (sock < 0)
+        {
+            if (wait_ms > 0)
+            {
+                vTaskDelay(pdMS_TO_TICKS(wait_ms));
+                xSemaphoreTake(connection->m_mutex, portMAX_DELAY);
+                continue;
+            }
+            uint32_t server_ip = connection->m_server_ip.load();
+            sock = stream_socket_connect(server_ip, connection->m_port, CONNECT_TIMEOUT_MS);
+            xSemaphoreTake(connection->m_mutex, portMAX_DELAY);
+            if (sock >= 0)
+            {
+                connection->connect(sock, server_ip);
+            }
+            else
+            {
+                connection->m_stats.failed_connects++;
+                connection->scheduleRetry();
+            }
+            continue;
+        }
+        // sleep until the server sends something or it's time for the next heartbeat
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        struct timeval timeout = {wait_ms / 1000, (wait_ms % 1000) * 1000};
+        bool received = select(sock + 1, &readable, NULL, NULL, &timeout) == 1;
+        // waits here while the socket is lent out
+        xSemaphoreTake(connection->m_mutex, portMAX_DELAY);
+        if (connection->m_broken)
+        {
+            connection->disconnect("an upload failed");
+        }
+        else if (connection->m_suspended.load() || connection->m_server_ip.load() != connection->m_sock_ip)
+        {
+            connection->disconnect("no longer wanted");
+        }
+        else if (received)
+        {
+            connection->receive();
+        }
+        else if (connection->m_awaiting_pong &&
+                 esp_timer_get_time() >= connection->m_ping_sent + connection->m_heartbeat_timeout_ms * 1000LL)
+        {
+            connection->m_stats.missed_heartbeats++;
+            connection->disconnect("the heartbeat wasn't answered");
+        }
+        else if (!connection->m_awaiting_pong && esp_timer_get_time() >= connection->m_next_heartbeat)
+        {
+            connection->sendHeartbeat();
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef __server_connection_h__
+#define __server_connection_h__
+
+#include <stdint.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+typedef struct
+{
+    // connections made, attempts that failed, and connections given up on - closed by the server, heartbeats going
+    // unanswered, an upload failing, or the server changing
+    uint32_t connects;
+    uint32_t failed_connects;
+    uint32_t disconnects;
+    // heartbeats answered, and connections given up on because one wasn't
+    uint32_t heartbeats;
+    uint32_t missed_heartbeats;
+    // times the connection has been lent out
+    uint32_t uploads;
+    // round trip time of the last heartbeat, and the smoothed round trip time and its mean deviation - the jitter
+    uint32_t last_rtt_us;
+    uint32_t srtt_us;
+    uint32_t rtt_var_us;
+    // how long the connection task waited before its last attempt to reconnect
+    uint32_t backoff_ms;
+} ServerConnectionStats_t;
+
+/**
+ * Keeps a TCP connection to the server open so an utterance can go out the
+ * moment the wake word is heard, without waiting for a handshake.
+ *
+ * A task of its own connects to the server, and while the connection is
+ * idle sends a heartbeat (StreamFrame.h ping) every heartbeat_ms. The
+ * answers give the round trip time, smoothed the way TCP does (RFC 6298)
+ * into an average and a mean deviation. The connection is given up on if
+ * the server closes it, a heartbeat isn't answered within
+ * heartbeat_timeout_ms, or an upload on it fails, and is made again after a
+ * backoff that doubles with each failed attempt - back to the shortest once
+ * a heartbeat has been answered.
+ *
+ * acquire lends the socket out (heartbeats stop until it's released), so
+ * anything that wants to send on it - UtteranceUploader - has it to itself.
+ **/
+class ServerConnection
+{
+private:
+    uint16_t m_port;
+    int m_heartbeat_ms;
+    int m_heartbeat_timeout_ms;
+    // set by any task for the connection task to act on - 0 for no server
+    std::atomic<uint32_t> m_server_ip;
+    std::atomic<bool> m_suspended;
+    std::atomic<bool> m_reconnect_now;
+    std::atomic<bool> m_connected;
+    // held by the connection task while it uses the socket, and by whoever it's lent to
+    SemaphoreHandle_t m_mutex;
+    // everything below is under the mutex - m_sock is only ever changed by the connection task
+    int m_sock;
+    uint32_t m_sock_ip;
+    // an upload failed on it
+    bool m_broken;
+    uint32_t m_backoff_ms;
+    int64_t m_next_attempt;
+    int64_t m_next_heartbeat;
+    bool m_awaiting_pong;
+    uint32_t m_ping_sequence;
+    int64_t m_ping_sent;
+    ServerConnectionStats_t m_stats;
+
+    void connect(int sock, uint32_t server_ip);
+    void scheduleRetry();
+    void disconnect(const char *reason);
+    void receive();
+    void sendHeartbeat();
+    void addRttSample(uint32_t rtt_us);
+    int waitMs();
+
+public:
+    ServerConnection(uint16_t port, int heartbeat_ms, int heartbeat_timeout_ms);
+    void start(UBaseType_t priority);
+    // where the server is (IPv4 address in network byte order, 0 for nowhere) - connects to it straight away
+    void setServer(uint32_t server_ip);
+    // closes the connection and stops trying to make it until resumed - for when the network is down
+    void suspend();
+    void resume();
+    // try again now rather than waiting out the backoff
+    void reconnectNow();
+    bool isConnected()
+    {
+        return m_connected.load();
+    }
+    // the connected socket, for this task alone until it's released - or -1 if there's no connection (or it couldn't
+    // be had in time)
+    int acquire(TickType_t ticks_to_wait);
+    // hands the socket back - ok is false if it failed and shouldn't be used again
+    void release(bool ok);
+    // waits for the socket to come back if it has been lent out
+    ServerConnectionStats_t getStats();
+    friend void serverConnectionTask(void *param);
+};
+
+#endif
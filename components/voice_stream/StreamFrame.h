@@ -0,0 +1,112 @@
+#ifndef __stream_frame_h__
+#define __stream_frame_h__
+
+#include <stdint.h>
+
+/**
+ * The framing audio goes over the wire in, in both directions. Every frame
+ * is a fixed size header followed by its payload, everything little endian:
+ *
+ *   0  magic          'V' 'S'
+ *   2  type           STREAM_FRAME_*
+ *   3  codec          AudioCodec_t of the payload
+ *   4  stream         which utterance (or response) the frame belongs to
+ *   6  samples        how many samples the payload decodes to
+ *   8  sequence       frame number within the stream, from 0
+ *   12 timestamp      position of the frame's first sample in the stream, in
+ *                     samples at 16KHz - a jump means samples were lost
+ *   16 payload bytes
+ *   18 reserved       0
+ *
+ * A stream is its audio frames then an end frame, with no payload, whose
+ * timestamp is the length of the stream. The codec can change from one frame
+ * to the next as the sender adapts to the link, so every frame is decoded
+ * with its own.
+ *
+ * A connection can carry any number of streams one after the other. While
+ * it's idle the device sends a heartbeat every so often - a ping frame with
+ * no payload whose sequence counts the pings and whose timestamp is the
+ * device's clock in microseconds - and the server answers each one straight
+ * away with a pong frame carrying the same sequence and timestamp.
+ **/
+
+#define STREAM_FRAME_MAGIC_0 'V'
+#define STREAM_FRAME_MAGIC_1 'S'
+#define STREAM_FRAME_HEADER_BYTES 20
+// 20ms at 16KHz - small enough to go out while the user is still speaking
+#define STREAM_FRAME_SAMPLES 320
+#define STREAM_FRAME_MAX_PAYLOAD_BYTES (STREAM_FRAME_SAMPLES * 2)
+
+typedef enum
+{
+    STREAM_FRAME_AUDIO = 1,
+    STREAM_FRAME_END = 2,
+    STREAM_FRAME_PING = 3,
+    STREAM_FRAME_PONG = 4
+} StreamFrameType_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint8_t codec;
+    uint16_t stream;
+    uint16_t samples;
+    uint32_t sequence;
+    uint32_t timestamp;
+    uint16_t payload_bytes;
+} StreamFrameHeader_t;
+
+static inline void stream_frame_write16(uint8_t *bytes, uint16_t value)
+{
+    bytes[0] = value & 0xff;
+    bytes[1] = value >> 8;
+}
+
+static inline void stream_frame_write32(uint8_t *bytes, uint32_t value)
+{
+    stream_frame_write16(bytes, value & 0xffff);
+    stream_frame_write16(bytes + 2, value >> 16);
+}
+
+static inline uint16_t stream_frame_read16(const uint8_t *bytes)
+{
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static inline uint32_t stream_frame_read32(const uint8_t *bytes)
+{
+    return stream_frame_read16(bytes) | ((uint32_t)stream_frame_read16(bytes + 2) << 16);
+}
+
+static inline void stream_frame_write_header(uint8_t *bytes, const StreamFrameHeader_t &header)
+{
+    bytes[0] = STREAM_FRAME_MAGIC_0;
+    bytes[1] = STREAM_FRAME_MAGIC_1;
+    bytes[2] = header.type;
+    bytes[3] = header.codec;
+    stream_frame_write16(bytes + 4, header.stream);
+    stream_frame_write16(bytes + 6, header.samples);
+    stream_frame_write32(bytes + 8, header.sequence);
+    stream_frame_write32(bytes + 12, header.timestamp);
+    stream_frame_write16(bytes + 16, header.payload_bytes);
+    stream_frame_write16(bytes + 18, 0);
+}
+
+// false if the bytes aren't a frame header or the payload is too big to be one of ours
+static inline bool stream_frame_read_header(const uint8_t *bytes, StreamFrameHeader_t *header)
+{
+    if (bytes[0] != STREAM_FRAME_MAGIC_0 || bytes[1] != STREAM_FRAME_MAGIC_1)
+    {
+        return false;
+    }
+    header->type = bytes[2];
+    header->codec = bytes[3];
+    header->stream = stream_frame_read16(bytes + 4);
+    header->samples = stream_frame_read16(bytes + 6);
+    header->sequence = stream_frame_read32(bytes + 8);
+    header->timestamp = stream_frame_read32(bytes + 12);
+    header->payload_bytes = stream_frame_read16(bytes + 16);
+    return header->payload_bytes <= STREAM_FRAME_MAX_PAYLOAD_BYTES;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "StreamSocket.h"
+
+int stream_socket_connect(uint32_t server_ip, uint16_t port, int timeout_ms)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0)
+    {
+        return -1;
+    }
+    // frames go out as soon as they're ready rather than waiting to fill a packet
+    int no_delay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    struct timeval send_timeout = {STREAM_SEND_TIMEOUT_MS / 1000, (STREAM_SEND_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    // connect without blocking so we can give up when we want to
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = server_ip;
+    int result = connect(sock, (struct sockaddr *)&address, sizeof(address));
+    if (result != 0 && errno == EINPROGRESS)
+    {
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(sock, &writable);
+        struct timeval connect_timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        int error = -1;
+        socklen_t error_size = sizeof(error);
+        if (select(sock + 1, NULL, &writable, NULL, &connect_timeout) == 1 &&
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &error_size) == 0)
+        {
+            result = error;
+        }
+    }
+    if (result != 0)
+    {
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, flags);
+    return sock;
+}
+
+bool stream_socket_send(int sock, const uint8_t *bytes, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(sock, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool stream_socket_receive(int sock, uint8_t *bytes, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t received = recv(sock, bytes, size, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
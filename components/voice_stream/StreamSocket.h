@@ -0,0 +1,19 @@
+#ifndef __stream_socket_h__
+#define __stream_socket_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// give up on a server that stops taking data rather than hold on to audio that's waiting to go
+#define STREAM_SEND_TIMEOUT_MS 2000
+
+// a TCP connection to the server (IPv4 address in network byte order) with Nagle turned off so frames go out as soon
+// as they're ready and sends that give up after STREAM_SEND_TIMEOUT_MS - or -1 if it couldn't be reached within
+// timeout_ms
+int stream_socket_connect(uint32_t server_ip, uint16_t port, int timeout_ms);
+// false if the connection is gone or the server stopped taking data
+bool stream_socket_send(int sock, const uint8_t *bytes, size_t size);
+// false if the connection is gone or nothing came within the socket's receive timeout
+bool stream_socket_receive(int sock, uint8_t *bytes, size_t size);
+
+#endif
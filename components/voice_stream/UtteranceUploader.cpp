@@ -0,0 +1,200 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "UtteranceUploader.h"
+#include "StreamFrame.h"
+#include "StreamSocket.h"
+
+static const char *TAG = "UtteranceUploader";
+
+#define UPLOAD_CONNECT_TIMEOUT_MS 2000
+// a chunk never spans ring buffers, so this many frames and the end frame
+#define UPLOAD_FRAMES_PER_CHUNK ((SAMPLE_BUFFER_SIZE + STREAM_FRAME_SAMPLES - 1) / STREAM_FRAME_SAMPLES + 1)
+#define UPLOAD_FRAME_BYTES (STREAM_FRAME_HEADER_BYTES + STREAM_FRAME_MAX_PAYLOAD_BYTES)
+
+UtteranceUploader::UtteranceUploader(UtteranceCapture *capture, AudioCodec_t codec, bool adaptive)
+{
+    m_capture = capture;
+    m_codec = codec;
+    m_adaptive_codec = adaptive ? new AdaptiveCodec(codec) : nullptr;
+    m_stream = 0;
+    m_sequence = 0;
+    m_adpcm_state = {0, 0};
+    m_last_codec = codec;
+    m_last_sample = 0;
+    m_frames = static_cast<uint8_t *>(malloc(UPLOAD_FRAMES_PER_CHUNK * UPLOAD_FRAME_BYTES));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+UtteranceUploader::~UtteranceUploader()
+{
+    free(m_frames);
+    delete m_adaptive_codec;
+}
+
+// the chunk's frames, one after the other in m_frames, followed by the end frame if it's the last - returns the bytes
+int UtteranceUploader::encodeChunk(const AudioChunk_t &chunk)
+{
+    uint8_t *out = m_frames;
+    if (m_codec == AUDIO_CODEC_IMA_ADPCM && m_last_codec != AUDIO_CODEC_IMA_ADPCM)
+    {
+        // pick up from where the other codec left off rather than from wherever ADPCM last was
+        m_adpcm_state.predictor = m_last_sample;
+    }
+    StreamFrameHeader_t header;
+    header.type = STREAM_FRAME_AUDIO;
+    header.codec = m_codec;
+    header.stream = m_stream;
+    for (int offset = 0; offset < chunk.count; offset += STREAM_FRAME_SAMPLES)
+    {
+        int samples = std::min(chunk.count - offset, STREAM_FRAME_SAMPLES);
+        int payload_bytes = audio_codec_encode(m_codec, &m_adpcm_state, chunk.samples + offset, samples,
+                                               out + STREAM_FRAME_HEADER_BYTES);
+        header.samples = samples;
+        header.sequence = m_sequence++;
+        header.timestamp = chunk.position + offset;
+        header.payload_bytes = payload_bytes;
+        stream_frame_write_header(out, header);
+        out += STREAM_FRAME_HEADER_BYTES + payload_bytes;
+        m_stats.frames++;
+        m_stats.samples += samples;
+        m_stats.payload_bytes += payload_bytes;
+        m_stats.codec_frames[m_codec]++;
+    }
+    if (chunk.count > 0)
+    {
+        m_last_codec = m_codec;
+        m_last_sample = chunk.samples[chunk.count - 1];
+    }
+    if (chunk.last)
+    {
+        header.type = STREAM_FRAME_END;
+        header.samples = 0;
+        header.sequence = m_sequence++;
+        header.timestamp = chunk.position + chunk.count;
+        header.payload_bytes = 0;
+        stream_frame_write_header(out, header);
+        out += STREAM_FRAME_HEADER_BYTES;
+    }
+    return out - m_frames;
+}
+
+bool UtteranceUploader::upload(const AudioChunk_t &first, uint32_t server_ip, uint16_t port)
+{
+    int64_t start = esp_timer_get_time();
+    int sock = stream_socket_connect(server_ip, port, UPLOAD_CONNECT_TIMEOUT_MS);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Failed to connect to the server");
+        m_stats.utterances++;
+        m_stats.failed++;
+        discard(first);
+        return false;
+    }
+    m_stats.connect_us = esp_timer_get_time() - start;
+    bool sent = send(first, sock, start);
+    close(sock);
+    return sent;
+}
+
+bool UtteranceUploader::upload(const AudioChunk_t &first, int sock)
+{
+    m_stats.connect_us = 0;
+    return send(first, sock, esp_timer_get_time());
+}
+
+bool UtteranceUploader::send(const AudioChunk_t &first, int sock, int64_t start)
+{
+    m_stats.utterances++;
+    m_stream++;
+    m_sequence = 0;
+    m_adpcm_state = {0, 0};
+    m_last_codec = m_codec;
+    m_last_sample = 0;
+    if (m_adaptive_codec)
+    {
+        m_adaptive_codec->reset();
+    }
+    AudioChunk_t chunk = first;
+    bool sent = true;
+    while (true)
+    {
+        int bytes = encodeChunk(chunk);
+        // the samples are in our frames now - let the ring buffer have them back before we wait on the network
+        m_capture->releaseChunk(chunk);
+        int64_t send_start = esp_timer_get_time();
+        sent = stream_socket_send(sock, m_frames, bytes);
+        if (!sent)
+        {
+            break;
+        }
+        m_stats.sent_bytes += bytes;
+        if (m_adaptive_codec)
+        {
+            adaptCodec(bytes, send_start, esp_timer_get_time());
+        }
+        if (chunk.sequence == 0)
+        {
+            m_stats.first_frame_us = esp_timer_get_time() - start;
+        }
+        if (chunk.last)
+        {
+            break;
+        }
+        m_capture->getChunk(&chunk, portMAX_DELAY);
+    }
+    m_stats.upload_us = esp_timer_get_time() - start;
+    if (!sent)
+    {
+        ESP_LOGE(TAG, "Lost the connection to the server after %lu frames", (unsigned long)m_sequence);
+        m_stats.failed++;
+        if (!chunk.last)
+        {
+            discardRest(chunk);
+        }
+        return false;
+    }
+    ESP_LOGI(TAG, "Uploaded %lu frames in %lu ms, first frame after %lu ms", (unsigned long)m_sequence,
+             (unsigned long)m_stats.upload_us / 1000, (unsigned long)m_stats.first_frame_us / 1000);
+    return true;
+}
+
+// lets the adaptive codec see how the send went, and takes its codec for the next chunk
+void UtteranceUploader::adaptCodec(int bytes, int64_t send_start, int64_t send_end)
+{
+    bool changed = m_adaptive_codec->update(bytes, send_start, send_end);
+    if (send_end - send_start >= ADAPTIVE_CODEC_BLOCKED_SEND_US)
+    {
+        m_stats.blocked_sends++;
+    }
+    m_stats.goodput = m_adaptive_codec->getGoodput() ? m_adaptive_codec->getGoodput() : m_stats.goodput;
+    if (changed)
+    {
+        m_codec = m_adaptive_codec->getCodec();
+        m_stats.codec_changes++;
+        ESP_LOGI(TAG, "Switched to codec %d, goodput %lu bytes/s", m_codec, (unsigned long)m_stats.goodput);
+    }
+}
+
+void UtteranceUploader::discard(const AudioChunk_t &first)
+{
+    m_capture->releaseChunk(first);
+    if (!first.last)
+    {
+        discardRest(first);
+    }
+}
+
+// everything after chunk, which has already been released
+void UtteranceUploader::discardRest(AudioChunk_t chunk)
+{
+    do
+    {
+        m_capture->getChunk(&chunk, portMAX_DELAY);
+        m_capture->releaseChunk(chunk);
+    } while (!chunk.last);
+}
@@ -0,0 +1,85 @@
+#ifndef __utterance_uploader_h__
+#define __utterance_uploader_h__
+
+#include <stdint.h>
+
+#include "UtteranceCapture.h"
+#include "AudioCodec.h"
+#include "AdaptiveCodec.h"
+
+typedef struct
+{
+    uint32_t utterances;
+    // couldn't connect, or the connection broke part way through
+    uint32_t failed;
+    uint32_t frames;
+    uint32_t samples;
+    // encoded audio, and everything that went over the wire including the frame headers
+    uint32_t payload_bytes;
+    uint32_t sent_bytes;
+    // for the last utterance - setting up the connection (0 if it was already open), from being handed the first chunk
+    // until its frames were sent, and the whole upload
+    uint32_t connect_us;
+    uint32_t first_frame_us;
+    uint32_t upload_us;
+    // frames sent in each codec, how often the codec changed part way through an utterance, sends that had to wait
+    // for room in the socket's send buffer, and the link's goodput in bytes a second when it was last measured by one
+    uint32_t codec_frames[AUDIO_CODEC_COUNT];
+    uint32_t codec_changes;
+    uint32_t blocked_sends;
+    uint32_t goodput;
+} UtteranceUploaderStats_t;
+
+/**
+ * Streams utterances from an UtteranceCapture to the server over TCP.
+ *
+ * Each utterance gets its own stream number, on a connection of its own or
+ * on one that's already open (ServerConnection). Chunks are encoded into
+ * STREAM_FRAME_SAMPLES frames (StreamFrame.h) as soon as they are taken from
+ * the capture - which hands the ring buffer straight back - and sent while
+ * the rest of the utterance is still being captured. The last chunk is
+ * followed by an end frame.
+ *
+ * With adaptive set, the codec follows the link (AdaptiveCodec) - starting
+ * from the one given and moving between PCM16, mu-law and ADPCM from one
+ * chunk to the next as the sends show how much the connection can take.
+ **/
+class UtteranceUploader
+{
+private:
+    UtteranceCapture *m_capture;
+    AudioCodec_t m_codec;
+    AdaptiveCodec *m_adaptive_codec;
+    uint16_t m_stream;
+    uint32_t m_sequence;
+    AdpcmState_t m_adpcm_state;
+    // what the last chunk ended with, for ADPCM to carry on from after another codec
+    AudioCodec_t m_last_codec;
+    int16_t m_last_sample;
+    // the frames for one chunk
+    uint8_t *m_frames;
+    UtteranceUploaderStats_t m_stats;
+
+    int encodeChunk(const AudioChunk_t &chunk);
+    bool send(const AudioChunk_t &first, int sock, int64_t start);
+    void adaptCodec(int bytes, int64_t send_start, int64_t send_end);
+    void discardRest(AudioChunk_t chunk);
+
+public:
+    UtteranceUploader(UtteranceCapture *capture, AudioCodec_t codec, bool adaptive = false);
+    ~UtteranceUploader();
+    // sends the utterance starting with first to the server (IPv4 address in network byte order), taking the rest
+    // from the capture as it comes, and returns once it has all gone. If that can't be done the rest of the utterance
+    // is discarded and it returns false
+    bool upload(const AudioChunk_t &first, uint32_t server_ip, uint16_t port);
+    // the same on a connection that's already open, which is left open - false means it can't be used any more
+    bool upload(const AudioChunk_t &first, int sock);
+    // releases the utterance starting with first without sending it anywhere
+    void discard(const AudioChunk_t &first);
+    UtteranceUploaderStats_t getStats()
+    {
+        return m_stats;
+    }
+};
+
+#endif
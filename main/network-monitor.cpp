@@ -0,0 +1,62 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#include "network-monitor.h"
+#include "ServerConnection.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+extern "C" {
+#include "server-config.h"
+#include "wifi-connect.h"
+}
+
+static const char *TAG = "network-monitor";
+
+// kept open to the server, with heartbeats telling us it's still there and how far away it is
+static ServerConnection *server_connection = NULL;
+
+static void update_server() {
+    esp_ip4_addr_t ip4;
+    if (is_server_ip_set() && get_server_ip_addr(&ip4) == ESP_OK) {
+        server_connection->setServer(ip4.addr);
+    } else {
+        ESP_LOGW(TAG, "No server set");
+        server_connection->setServer(0);
+    }
+}
+
+bool is_server_reachable() {
+    return server_connection != NULL && server_connection->isConnected();
+}
+
+ServerConnection *get_server_connection() {
+    return server_connection;
+}
+
+void reconnect_server_now() {
+    if (server_connection != NULL) {
+        update_server();
+        server_connection->reconnectNow();
+    }
+}
+
+void start_network_monitor() {
+    xEventGroupWaitBits(get_wifi_event_group(), WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    server_connection = new ServerConnection(VOICE_SERVER_PORT, SERVER_HEARTBEAT_MS, SERVER_HEARTBEAT_TIMEOUT_MS);
+    update_server();
+    server_connection->start(SERVER_CONNECTION_PRIORITY);
+}
+
+void resume_network_monitor() {
+    if (server_connection != NULL) {
+        server_connection->resume();
+    }
+}
+
+void suspend_network_monitor() {
+    if (server_connection != NULL) {
+        server_connection->suspend();
+    }
+}
@@ -1,8 +1,22 @@
 #pragma once
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void start_network_monitor();
-void trigger_ping_now();
+// the server address has changed - connect to it now
+void reconnect_server_now();
 bool is_server_reachable();
-void start_ping_timer();
-void stop_ping_timer();
\ No newline at end of file
+// the network has come up or gone down
+void resume_network_monitor();
+void suspend_network_monitor();
+
+#ifdef __cplusplus
+}
+
+class ServerConnection;
+// the connection kept open to the server - NULL until the monitor has been started
+ServerConnection *get_server_connection();
+#endif
@@ -72,7 +72,7 @@ esp_err_t update_server_ip(const char *new_ip_str) {
         return err;
     }
 
-    trigger_ping_now();
+    reconnect_server_now();
 
     return ESP_OK;
 }
@@ -31,7 +31,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
             return;
         }
 
-        stop_ping_timer();
+        suspend_network_monitor();
 
         xSemaphoreTake(wifi_connect_mutex, portMAX_DELAY);
 
@@ -52,7 +52,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
         xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
 
-        start_ping_timer();
+        resume_network_monitor();
     }
 }
 
@@ -1,6 +1,55 @@
 // are you using an I2S microphone - comment this out if you want to use an analog mic and ADC input
 #define USE_I2S_MIC_INPUT
 
+// run the spectrogram and the neural network as a pipeline on separate cores - comment this out to run them one after
+// the other in a single task
+#define USE_PIPELINED_WAKE_WORD
+
+// how many tasks the neural network splits its convolution and fully connected layers across - 1 runs them all on the
+// task calling predict. Core 0 has the i2s reader, the wifi/bluetooth stacks and the front end, so the extra tasks are
+// pinned to core 1. The pipeline already gives inference core 1 to itself and keeps the front end busy on core 0, so
+// there's no core for them to run on and it doesn't split the layers
+#ifdef USE_PIPELINED_WAKE_WORD
+#define NEURAL_NETWORK_WORKERS 1
+#else
+#define NEURAL_NETWORK_WORKERS 2
+#endif
+#define NEURAL_NETWORK_WORKER_CORE 1
+
+// run the kernel micro-benchmarks (components/tfmicro/tensorflow/lite/micro/benchmarks) and log the results before
+// the wake word detector starts - uncomment to measure kernel changes on the device
+// #define RUN_KERNEL_BENCHMARKS
+// the clock the benchmarks turn their timings into cycles with
+#define KERNEL_BENCHMARK_CPU_MHZ CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#define KERNEL_BENCHMARK_INVOCATIONS 20
+
+// what's said after the wake word is recorded straight out of the sampler's ring buffer - how much audio from before
+// the trigger to include (at most 900ms), the longest an utterance can be and how many chunks can be waiting for the
+// consumer (each one holds on to a tenth of a second of the ring buffer)
+#define CAPTURE_PREROLL_MS 500
+#define CAPTURE_MAX_MS 8000
+#define CAPTURE_CHUNK_SLOTS 6
+
+// the utterance ends once the user has stopped talking for the hangover, or if they haven't said anything by
+// ENDPOINT_NO_SPEECH_MS - the pauses between words are shorter than the hangover
+#define ENDPOINT_HANGOVER_MS 700
+#define ENDPOINT_NO_SPEECH_MS 4000
+
+// utterances are streamed to the server set up over bluetooth on this port, encoded with AUDIO_CODEC_PCM16,
+// AUDIO_CODEC_ULAW (2:1) or AUDIO_CODEC_IMA_ADPCM (4:1). With UPLOAD_ADAPTIVE_CODEC the codec starts as UPLOAD_CODEC
+// and then follows how much the wifi can take, otherwise it's always UPLOAD_CODEC
+#define VOICE_SERVER_PORT 5005
+#define UPLOAD_CODEC AUDIO_CODEC_ULAW
+#define UPLOAD_ADAPTIVE_CODEC true
+
+// the network monitor keeps a connection to the server open for utterances to go out on straight away, sending a
+// heartbeat this often while it's idle and giving up on it if one isn't answered in time. An utterance waits this long
+// for a heartbeat that's in progress before making a connection of its own
+#define SERVER_HEARTBEAT_MS 5000
+#define SERVER_HEARTBEAT_TIMEOUT_MS 3000
+#define SERVER_CONNECTION_PRIORITY 3
+#define SERVER_ACQUIRE_TIMEOUT_MS 100
+
 // I2S Microphone Settings
 
 // Which channel is the I2S microphone on? I2S_CHANNEL_FMT_ONLY_LEFT or I2S_CHANNEL_FMT_ONLY_RIGHT
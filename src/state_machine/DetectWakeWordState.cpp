@@ -1,10 +1,13 @@
 #include "I2SSampler.h"
 #include "AudioProcessor.h"
 #include "NeuralNetwork.h"
+#include "Endpointer.h"
 #include "RingBuffer.h"
 #include "DetectWakeWordState.h"
+#include "config.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include <string.h>
 
 #define WINDOW_SIZE 320
 #define STEP_SIZE 160
@@ -22,28 +25,83 @@ DetectWakeWordState::DetectWakeWordState(I2SSampler *sample_provider)
 
 void DetectWakeWordState::enterState()
 {
-    m_nn = new NeuralNetwork();
-    ESP_LOGI(TAG, "Created Neural Network");
+    int64_t start = esp_timer_get_time();
+    // only the first time builds the interpreter, after that the one already in the arena is reused
+    m_nn = new NeuralNetwork(NEURAL_NETWORK_WORKERS, NEURAL_NETWORK_WORKER_CORE);
+    ESP_LOGI(TAG, "Created Neural Network in %lld us", esp_timer_get_time() - start);
     m_audio_processor = new AudioProcessor(AUDIO_LENGTH, WINDOW_SIZE, STEP_SIZE, POOLING_SIZE);
     ESP_LOGI(TAG, "Created Audio Processor");
+    m_endpointer = new Endpointer(STEP_SIZE, ENDPOINT_HANGOVER_MS, ENDPOINT_NO_SPEECH_MS, CAPTURE_MAX_MS);
     m_number_of_detections = 0;
 }
 
-bool DetectWakeWordState::run()
+int DetectWakeWordState::getFeatureSize()
 {
-    int64_t start = esp_timer_get_time();
+    return m_nn->getInputSize();
+}
+
+// front end - the spectrogram of the last second of audio, and the endpointer gets its frame energies
+bool DetectWakeWordState::getFeatures(float *features)
+{
+    uint32_t samples_written = m_sample_provider->getSamplesWritten();
     RingBufferAccessor *reader = m_sample_provider->getRingBufferReader();
-    reader->rewind(16000);
+    reader->rewind(AUDIO_LENGTH);
 
-    float *input_buffer = m_nn->getInputBuffer();
-    
-    m_audio_processor->get_spectrogram(reader, input_buffer);
+    m_audio_processor->get_spectrogram(reader, features);
 
     delete reader;
 
+    if (!m_endpointer->update(m_audio_processor->get_frame_energies(), m_audio_processor->get_frame_count(), samples_written))
+    {
+        return false;
+    }
+    EndpointerStats_t stats = m_endpointer->getStats();
+    ESP_LOGI(TAG, "Utterance ended after %lu ms with %lu ms of speech, noise floor %.1f dB",
+             (unsigned long)stats.length_ms, (unsigned long)stats.speech_ms, stats.noise_floor);
+    return true;
+}
+
+// inference - run the network over a window of features from getFeatures
+bool DetectWakeWordState::detect(const float *features)
+{
+    float *input_buffer = m_nn->getInputBuffer();
+    if (features != input_buffer)
+    {
+        memcpy(input_buffer, features, sizeof(float) * m_nn->getInputSize());
+    }
+
     float output = m_nn->predict();
     ESP_LOGI(TAG, "Output: %.4f", output);
 
+    if (output >= 0.9f)
+    {
+        ESP_LOGI(TAG, "P(%.2f): Wake word detected", output);
+        // a model with variable tensors would otherwise still have the wake word in its state
+        m_nn->resetState();
+        return true;
+    }
+
+    return false;
+}
+
+void DetectWakeWordState::startUtterance()
+{
+    m_endpointer->start();
+}
+
+bool DetectWakeWordState::endOfUtterance()
+{
+    return getFeatures(m_nn->getInputBuffer());
+}
+
+bool DetectWakeWordState::run()
+{
+    int64_t start = esp_timer_get_time();
+
+    float *input_buffer = m_nn->getInputBuffer();
+    getFeatures(input_buffer);
+    bool detected = detect(input_buffer);
+
     int64_t end = esp_timer_get_time();
 
     float detect_time_ms = (end - start) / 1000.0f;
@@ -56,13 +114,7 @@ bool DetectWakeWordState::run()
         ESP_LOGI(TAG, "Average detection time %.2f ms", m_average_detect_time);
     }
 
-    if (output >= 0.9f)
-    {
-        ESP_LOGI(TAG, "P(%.2f): Wake word detected", output);
-        return true;
-    }
-
-    return false;
+    return detected;
 }
 
 
@@ -72,6 +124,8 @@ void DetectWakeWordState::exitState()
     m_nn = nullptr;
     delete m_audio_processor;
     m_audio_processor = nullptr;
+    delete m_endpointer;
+    m_endpointer = nullptr;
 
     uint32_t free_ram = esp_get_free_heap_size();
     ESP_LOGI(TAG, "Free RAM after cleanup: %lu bytes", free_ram);
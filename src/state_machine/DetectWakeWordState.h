@@ -6,6 +6,7 @@
 class I2SSampler;
 class NeuralNetwork;
 class AudioProcessor;
+class Endpointer;
 
 class DetectWakeWordState : public State
 {
@@ -13,6 +14,7 @@ private:
     I2SSampler *m_sample_provider;
     NeuralNetwork *m_nn;
     AudioProcessor *m_audio_processor;
+    Endpointer *m_endpointer;
     float m_average_detect_time;
     int m_number_of_detections;
     int m_number_of_runs;
@@ -21,6 +23,15 @@ public:
     DetectWakeWordState(I2SSampler *sample_provider);
     void enterState();
     bool run();
+    // the two halves of run so they can be pipelined on separate cores
+    int getFeatureSize();
+    // returns true, once, when the user has stopped talking after startUtterance
+    bool getFeatures(float *features);
+    bool detect(const float *features);
+    // the wake word was heard - listen for the end of what's said after it
+    void startUtterance();
+    // just the front end, while an utterance is being captured - returns true when it has ended
+    bool endOfUtterance();
     void exitState();
 };
 
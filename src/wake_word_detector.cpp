@@ -1,15 +1,32 @@
+#include <atomic>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <driver/i2s.h>
 #include "DetectWakeWordState.h"
 #include "I2SMicSampler.h"
+#include "FeatureQueue.h"
+#include "UtteranceCapture.h"
+#include "UtteranceUploader.h"
+#include "ServerConnection.h"
 #include "wake_word_detector.h"
 #include "config.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "network-monitor.h"
+extern "C"
+{
+#include "server-config.h"
+}
+#ifdef RUN_KERNEL_BENCHMARKS
+#include "tensorflow/lite/micro/benchmarks/micro_benchmark.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+#endif
 
 static DetectWakeWordState *wake_word_state = nullptr;
 static I2SMicSampler *i2s_sampler = nullptr;
 static TaskHandle_t s_wake_word_task_handle = nullptr;
+static UtteranceCapture *utterance_capture = nullptr;
+static UtteranceUploader *utterance_uploader = nullptr;
 
 static const char* TAG = "WAKE_WORD";
 
@@ -46,6 +63,193 @@ static i2s_pin_config_t i2s_pins = {
 //     }
 // }
 
+#ifdef RUN_KERNEL_BENCHMARKS
+static void run_kernel_benchmarks()
+{
+    tflite::MicroErrorReporter error_reporter;
+    ESP_LOGI(TAG, "Running kernel benchmarks at %d MHz", KERNEL_BENCHMARK_CPU_MHZ);
+    if (tflite::RunKeywordBenchmark(&error_reporter, KERNEL_BENCHMARK_CPU_MHZ, KERNEL_BENCHMARK_INVOCATIONS) != kTfLiteOk ||
+        tflite::RunKernelBenchmarks(&error_reporter, KERNEL_BENCHMARK_CPU_MHZ, KERNEL_BENCHMARK_INVOCATIONS) != kTfLiteOk)
+    {
+        ESP_LOGE(TAG, "Kernel benchmarks failed");
+    }
+}
+#endif
+
+// streams each utterance to the server as it's captured
+static void utterance_task(void *param)
+{
+    while (true)
+    {
+        AudioChunk_t chunk;
+        if (utterance_capture->getChunk(&chunk, portMAX_DELAY))
+        {
+            // send it on the connection the network monitor keeps open, or make one if that isn't there
+            ServerConnection *server_connection = get_server_connection();
+            int sock = server_connection ? server_connection->acquire(pdMS_TO_TICKS(SERVER_ACQUIRE_TIMEOUT_MS)) : -1;
+            esp_ip4_addr_t server_ip;
+            if (sock >= 0)
+            {
+                server_connection->release(utterance_uploader->upload(chunk, sock));
+            }
+            else if (get_server_ip_addr(&server_ip) == ESP_OK)
+            {
+                utterance_uploader->upload(chunk, server_ip.addr, VOICE_SERVER_PORT);
+            }
+            else
+            {
+                ESP_LOGW(TAG, "No server to send the utterance to");
+                utterance_uploader->discard(chunk);
+            }
+        }
+    }
+}
+
+static void start_utterance_capture()
+{
+    utterance_capture = new UtteranceCapture(i2s_sampler, CAPTURE_PREROLL_MS, CAPTURE_MAX_MS, CAPTURE_CHUNK_SLOTS);
+    utterance_uploader = new UtteranceUploader(utterance_capture, UPLOAD_CODEC, UPLOAD_ADAPTIVE_CODEC);
+    xTaskCreate(utterance_task, "utterance_task", 4096, nullptr, 4, nullptr);
+}
+
+#ifdef USE_PIPELINED_WAKE_WORD
+
+// the front end shares core 0 with the i2s reader (and the wifi/bluetooth stacks), the network gets core 1 to itself
+#define FRONT_END_CORE 0
+#define INFERENCE_CORE 1
+// the i2s reader must be able to preempt the front end or the DMA buffers overflow while a spectrogram is computed
+#define I2S_READER_PRIORITY 6
+#define FRONT_END_PRIORITY 5
+#define INFERENCE_PRIORITY 5
+// windows in flight between the two stages - one being filled while the other is classified
+#define FEATURE_QUEUE_SLOTS 2
+#define STATS_INTERVAL 100
+
+static FeatureQueue *feature_queue = nullptr;
+static TaskHandle_t s_inference_task_handle = nullptr;
+// when each queued window was published - written by the front end before commitWrite so it is visible to the
+// inference task along with the window itself
+static int64_t s_window_ready_time[FEATURE_QUEUE_SLOTS];
+// from the wake word until the front end hears the end of the utterance - the network isn't run in between
+static std::atomic<bool> s_listening(false);
+
+static void front_end_task(void *param)
+{
+    uint32_t windows = 0;
+    uint32_t dropped = 0;
+    int64_t busy_time = 0;
+    int64_t stats_start = esp_timer_get_time();
+    while (true)
+    {
+        // the i2s reader wakes us each time another buffer of samples has arrived
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // queue any of the utterance that has just arrived before anything else
+        utterance_capture->update();
+        float *features = feature_queue->beginWrite();
+        if (!features)
+        {
+            // inference is behind - drop this window rather than hold up the audio
+            dropped++;
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        if (wake_word_state->getFeatures(features))
+        {
+            // the user has stopped talking - the utterance goes off now rather than at its longest
+            utterance_capture->stop();
+            s_listening.store(false);
+        }
+        int64_t end = esp_timer_get_time();
+        s_window_ready_time[windows % FEATURE_QUEUE_SLOTS] = end;
+        feature_queue->commitWrite();
+        xTaskNotifyGive(s_inference_task_handle);
+
+        busy_time += end - start;
+        windows++;
+        if (windows % STATS_INTERVAL == 0)
+        {
+            ESP_LOGI(TAG, "Front end %.1f%% busy, %.2f ms per window, %lu windows dropped",
+                     100.0f * busy_time / (end - stats_start), busy_time / 1000.0f / STATS_INTERVAL, (unsigned long)dropped);
+            busy_time = 0;
+            dropped = 0;
+            stats_start = end;
+        }
+    }
+}
+
+static void inference_task(void *param)
+{
+    gpio_set_direction(GPIO_NUM_2, GPIO_MODE_OUTPUT);
+    gpio_set_level(GPIO_NUM_2, 0);
+
+    uint32_t windows = 0;
+    int stats_windows = 0;
+    int64_t busy_time = 0;
+    int64_t latency = 0;
+    int64_t stats_start = esp_timer_get_time();
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        const float *features;
+        while ((features = feature_queue->beginRead()) != nullptr)
+        {
+            int64_t start = esp_timer_get_time();
+            int64_t ready_time = s_window_ready_time[windows % FEATURE_QUEUE_SLOTS];
+            // the LED stays on while the utterance is being captured
+            bool listening = s_listening.load();
+            gpio_set_level(GPIO_NUM_2, listening);
+            bool detected = !listening && wake_word_state->detect(features);
+            feature_queue->endRead();
+            int64_t end = esp_timer_get_time();
+
+            busy_time += end - start;
+            latency += end - ready_time;
+            windows++;
+            stats_windows++;
+            if (stats_windows == STATS_INTERVAL)
+            {
+                ESP_LOGI(TAG, "Inference %.1f%% busy, %.2f ms per window, %.2f ms from features to result",
+                         100.0f * busy_time / (end - stats_start), busy_time / 1000.0f / STATS_INTERVAL,
+                         latency / 1000.0f / STATS_INTERVAL);
+                stats_windows = 0;
+                busy_time = 0;
+                latency = 0;
+                stats_start = end;
+            }
+
+            if (detected)
+            {
+                ESP_LOGI(TAG, "Wake word detected!");
+                // the front end picks these up on its next buffer
+                s_listening.store(true);
+                wake_word_state->startUtterance();
+                utterance_capture->start();
+                gpio_set_level(GPIO_NUM_2, 1);
+            }
+        }
+    }
+}
+
+void start_wake_word_task()
+{
+#ifdef RUN_KERNEL_BENCHMARKS
+    run_kernel_benchmarks();
+#endif
+    i2s_sampler = new I2SMicSampler(i2s_pins, false);
+
+    wake_word_state = new DetectWakeWordState(i2s_sampler);
+    wake_word_state->enterState();
+
+    feature_queue = new FeatureQueue(FEATURE_QUEUE_SLOTS, wake_word_state->getFeatureSize());
+    start_utterance_capture();
+
+    xTaskCreatePinnedToCore(inference_task, "inference_task", 8192, nullptr, INFERENCE_PRIORITY, &s_inference_task_handle, INFERENCE_CORE);
+    xTaskCreatePinnedToCore(front_end_task, "front_end_task", 4096, nullptr, FRONT_END_PRIORITY, &s_wake_word_task_handle, FRONT_END_CORE);
+    static_cast<I2SSampler*>(i2s_sampler)->start(I2S_NUM_0, i2s_config, s_wake_word_task_handle, I2S_READER_PRIORITY, FRONT_END_CORE);
+}
+
+#else
+
 static void wake_word_task(void *param)
 {
     gpio_set_direction(GPIO_NUM_2, GPIO_MODE_OUTPUT);
@@ -53,25 +257,46 @@ static void wake_word_task(void *param)
 
     while (true)
     {
-        if (wake_word_state->run())
+        // queue any of the utterance that has arrived - the ring buffer only holds 1.1 seconds so we can't block here
+        utterance_capture->update();
+        if (utterance_capture->isCapturing())
         {
-            ESP_LOGI(TAG, "Wake word detected!");
-            gpio_set_level(GPIO_NUM_2, 1);
-            vTaskDelay(pdMS_TO_TICKS(3000));
+            // only the front end while the user is talking, to hear when they stop
+            if (wake_word_state->endOfUtterance())
+            {
+                utterance_capture->stop();
+            }
+        }
+        else
+        {
+            // the LED stays on while the utterance is being captured
             gpio_set_level(GPIO_NUM_2, 0);
+            if (wake_word_state->run())
+            {
+                ESP_LOGI(TAG, "Wake word detected!");
+                wake_word_state->startUtterance();
+                utterance_capture->start();
+                gpio_set_level(GPIO_NUM_2, 1);
+            }
         }
         vTaskDelay(pdMS_TO_TICKS(200));
     }
 }
 
-
 void start_wake_word_task()
 {
+#ifdef RUN_KERNEL_BENCHMARKS
+    run_kernel_benchmarks();
+#endif
     i2s_sampler = new I2SMicSampler(i2s_pins, false);
 
     wake_word_state = new DetectWakeWordState(i2s_sampler);
     wake_word_state->enterState();
+    start_utterance_capture();
 
-    xTaskCreate(wake_word_task, "wake_word_task", 8192, nullptr, 5, &s_wake_word_task_handle);
+    // on the other core from the network's extra workers (NEURAL_NETWORK_WORKER_CORE) so they can run alongside it
+    xTaskCreatePinnedToCore(wake_word_task, "wake_word_task", 8192, nullptr, 5, &s_wake_word_task_handle, 0);
     static_cast<I2SSampler*>(i2s_sampler)->start(I2S_NUM_0, i2s_config, s_wake_word_task_handle);
 }
+
+#endif
@@ -0,0 +1,212 @@
+/**
+ * Logistic and tanh lookup table benchmark
+ *
+ * Checks the accuracy and speed of the LUT/polynomial logistic and tanh in
+ * components/tfmicro/tensorflow/lite/micro/kernels/activation_lut.h against
+ * the reference implementations they replace.
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro; B=$R/tensorflow/lite/micro
+ *   g++ -std=c++11 -O2 -DTF_LITE_STATIC_MEMORY -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       tools/activation_benchmark/activation_benchmark.cc \
+ *       $B/kernels/activation_lut.cc \
+ *       $R/tensorflow/lite/kernels/internal/quantization_util.cc \
+ *       $R/tensorflow/lite/c/common.c -o activation_benchmark
+ *
+ * Usage:
+ *   ./activation_benchmark
+ **/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "tensorflow/lite/c/common.h"
+#include "tensorflow/lite/kernels/internal/quantization_util.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/logistic.h"
+#include "tensorflow/lite/kernels/internal/reference/integer_ops/tanh.h"
+#include "tensorflow/lite/kernels/internal/reference/logistic.h"
+#include "tensorflow/lite/kernels/internal/reference/tanh.h"
+#include "tensorflow/lite/micro/kernels/activation_lut.h"
+
+namespace {
+
+constexpr int kElements = 4096;
+constexpr int kIterations = 200;
+
+float float_input[kElements];
+float float_output[kElements];
+int8_t int8_input[kElements];
+int8_t int8_output[kElements];
+int8_t lut_buffer[tflite::micro::kInt8LutSize];
+
+void* AllocateLut(TfLiteContext* context, size_t bytes) { return lut_buffer; }
+
+// Average nanoseconds per element of `run`.
+template <typename F>
+double TimePerElement(F run) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    run();
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         (static_cast<double>(kIterations) * kElements);
+}
+
+double MaxAbsoluteError(float (*fast)(float), double (*exact)(double)) {
+  double max_error = 0.0;
+  for (int i = -2000000; i <= 2000000; ++i) {
+    const float x = i * 1e-5f;
+    max_error =
+        std::max(max_error, std::fabs(static_cast<double>(fast(x)) - exact(x)));
+  }
+  return max_error;
+}
+
+double MaxRelativeExpError(float limit_low, float limit_high) {
+  double max_error = 0.0;
+  for (float x = limit_low; x <= limit_high; x += 1e-4f) {
+    const double exact = std::exp(static_cast<double>(x));
+    max_error = std::max(
+        max_error,
+        std::fabs(static_cast<double>(tflite::micro::FastExp(x)) - exact) /
+            exact);
+  }
+  return max_error;
+}
+
+double Logistic(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+double Tanh(double x) { return std::tanh(x); }
+
+void FixedPointParams(float input_scale, int32_t* multiplier, int* shift,
+                      int32_t* range_radius) {
+  // Same as the reference kernels' Prepare.
+  static constexpr int kInputIntegerBits = 4;
+  const double real_multiplier =
+      static_cast<double>(input_scale) *
+      static_cast<double>(1 << (31 - kInputIntegerBits));
+  const double q = std::frexp(real_multiplier, shift);
+  *multiplier = static_cast<int32_t>(std::round(q * (1ll << 31)));
+  *range_radius = tflite::CalculateInputRadius(kInputIntegerBits, *shift, 31);
+}
+
+void BenchmarkInt8(const char* name, float input_scale, int input_zero_point,
+                   float output_scale, int output_zero_point,
+                   double (*exact)(double), bool is_logistic) {
+  TfLiteTensor input = {};
+  TfLiteTensor output = {};
+  input.type = output.type = kTfLiteInt8;
+  input.params = {input_scale, input_zero_point};
+  output.params = {output_scale, output_zero_point};
+  TfLiteContext context = {};
+  context.AllocatePersistentBuffer = AllocateLut;
+  int8_t* lut;
+  if (tflite::micro::PopulateInt8Lut(&context, &input, &output, exact, &lut) !=
+      kTfLiteOk) {
+    printf("%s: failed to build the table\n", name);
+    return;
+  }
+
+  int32_t multiplier, range_radius;
+  int shift;
+  FixedPointParams(input_scale, &multiplier, &shift, &range_radius);
+  const tflite::RuntimeShape shape({kElements});
+  auto reference = [&]() {
+    if (is_logistic) {
+      tflite::reference_integer_ops::Logistic(input_zero_point, range_radius,
+                                              multiplier, shift, kElements,
+                                              int8_input, int8_output);
+    } else {
+      tflite::reference_integer_ops::Tanh(input_zero_point, range_radius,
+                                          multiplier, shift, shape, int8_input,
+                                          shape, int8_output);
+    }
+  };
+
+  // Error over all 256 inputs, in output LSBs.
+  for (int i = 0; i < kElements; ++i) {
+    int8_input[i] = static_cast<int8_t>(i);
+  }
+  reference();
+  int reference_vs_lut = 0;
+  double lut_vs_exact = 0.0;
+  double reference_vs_exact = 0.0;
+  for (int i = 0; i < 256; ++i) {
+    const double real = exact(static_cast<double>(input_scale) *
+                              (int8_input[i] - input_zero_point));
+    const double ideal = std::min(
+        std::max(real / static_cast<double>(output_scale) + output_zero_point,
+                 -128.0),
+        127.0);
+    const int8_t from_lut = lut[static_cast<uint8_t>(int8_input[i])];
+    reference_vs_lut =
+        std::max(reference_vs_lut, std::abs(from_lut - int8_output[i]));
+    lut_vs_exact = std::max(lut_vs_exact, std::fabs(from_lut - ideal));
+    reference_vs_exact =
+        std::max(reference_vs_exact, std::fabs(int8_output[i] - ideal));
+  }
+
+  const double reference_ns = TimePerElement(reference);
+  const double lut_ns = TimePerElement([&]() {
+    tflite::micro::LookupInt8(lut, kElements, int8_input, int8_output);
+  });
+  printf(
+      "%-9s int8   reference %6.2f ns  lut %6.2f ns  (%5.1fx)  max error: "
+      "reference %.2f LSB, lut %.2f LSB, lut vs reference %d LSB\n",
+      name, reference_ns, lut_ns, reference_ns / lut_ns, reference_vs_exact,
+      lut_vs_exact, reference_vs_lut);
+}
+
+}  // namespace
+
+int main() {
+  for (int i = 0; i < kElements; ++i) {
+    float_input[i] = -12.0f + 24.0f * static_cast<float>(rand()) / RAND_MAX;
+  }
+  const tflite::RuntimeShape shape({kElements});
+
+  const double logistic_reference_ns = TimePerElement([&]() {
+    tflite::reference_ops::Logistic(shape, float_input, shape, float_output);
+  });
+  const double logistic_fast_ns = TimePerElement([&]() {
+    for (int i = 0; i < kElements; ++i) {
+      float_output[i] = tflite::micro::FastLogistic(float_input[i]);
+    }
+  });
+  printf("logistic  float  reference %6.2f ns  fast %6.2f ns  (%5.1fx)  "
+         "max abs error %.2g (documented %.2g)\n",
+         logistic_reference_ns, logistic_fast_ns,
+         logistic_reference_ns / logistic_fast_ns,
+         MaxAbsoluteError(tflite::micro::FastLogistic, Logistic),
+         static_cast<double>(tflite::micro::kFastLogisticMaxError));
+
+  const double tanh_reference_ns = TimePerElement([&]() {
+    tflite::reference_ops::Tanh(shape, float_input, shape, float_output);
+  });
+  const double tanh_fast_ns = TimePerElement([&]() {
+    for (int i = 0; i < kElements; ++i) {
+      float_output[i] = tflite::micro::FastTanh(float_input[i]);
+    }
+  });
+  printf("tanh      float  reference %6.2f ns  fast %6.2f ns  (%5.1fx)  "
+         "max abs error %.2g (documented %.2g)\n",
+         tanh_reference_ns, tanh_fast_ns, tanh_reference_ns / tanh_fast_ns,
+         MaxAbsoluteError(tflite::micro::FastTanh, Tanh),
+         static_cast<double>(tflite::micro::kFastTanhMaxError));
+
+  printf("exp       float  max relative error %.2g on [-87, 88], %.2g on "
+         "[-16, 16]\n",
+         MaxRelativeExpError(-87.0f, 88.0f),
+         MaxRelativeExpError(-16.0f, 16.0f));
+
+  // The output layer of the wake word model, a typical quantization of the
+  // layer in front of the activation, with the output quantization the
+  // converter uses for each.
+  BenchmarkInt8("logistic", 0.183332f, 21, 1.0f / 256, -128, Logistic, true);
+  BenchmarkInt8("logistic", 0.03f, -20, 1.0f / 256, -128, Logistic, true);
+  BenchmarkInt8("tanh", 0.05f, 3, 1.0f / 128, 0, Tanh, false);
+  return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * Tensor arena report for the bundled model
+ *
+ * Allocates and invokes the bundled model (components/neural_network/src/model.cc)
+ * with the same op resolver as NeuralNetwork through a RecordingMicroInterpreter
+ * and logs what the arena was used for: the memory plan in the head and how
+ * much of it is lost to gaps, the persistent tail, the peak temp allocations
+ * while preparing and invoking, the scratch buffer every op asked for and the
+ * smallest arena the model fits in.
+ *
+ * That smallest size is then checked by running the model again with a plain
+ * MicroInterpreter in an arena of exactly that size - it has to allocate and
+ * give the same output - so NeuralNetwork::kArenaSize can be set from it.
+ *
+ * The host's pointers are twice the size of the ESP32's, so the tail (which
+ * is mostly tensor and node structs) comes out bigger than on the device and
+ * the required size is an upper bound there.
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro
+ *   g++ -std=c++11 -O2 -fno-exceptions -DTF_LITE_STATIC_MEMORY -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       -I$R/third_party/ruy -Icomponents/neural_network/src \
+ *       tools/arena_report/arena_report.cc \
+ *       components/neural_network/src/WorkerPool.cpp \
+ *       components/neural_network/src/model.cc \
+ *       $(sed -n 's/^  SRCS //p' $R/CMakeLists.txt | tr ' ' '\n' | sed "s|^|$R/|") \
+ *       -lpthread -o arena_report
+ *
+ * Usage:
+ *   ./arena_report [workers]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "WorkerPool.h"
+#include "model.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/micro/recording_micro_interpreter.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+// plenty for recording, the point is to find out how much is really needed
+#define RECORDING_ARENA_SIZE 200000
+#define INVOCATIONS 3
+
+alignas(16) static uint8_t tensor_arena[RECORDING_ARENA_SIZE];
+
+static void add_ops(tflite::MicroMutableOpResolver<11> &resolver)
+{
+    // same as NeuralNetwork
+    resolver.AddConv2D();
+    resolver.AddMaxPool2D();
+    resolver.AddConv2DMaxPool2D();
+    resolver.AddDepthwiseConv2D();
+    resolver.AddFullyConnected();
+    resolver.AddMul();
+    resolver.AddAdd();
+    resolver.AddLogistic();
+    resolver.AddReshape();
+    resolver.AddQuantize();
+    resolver.AddDequantize();
+}
+
+// the same pseudo random spectrogram every time, then the output after a few invocations
+static bool invoke(tflite::MicroInterpreter &interpreter, std::vector<float> &output)
+{
+    TfLiteTensor *input = interpreter.input(0);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < input->bytes / sizeof(float); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        input->data.f[i] = -6.0f + 7.0f * ((seed >> 8) & 0xffff) / 65535.0f;
+    }
+    for (int i = 0; i < INVOCATIONS; i++)
+    {
+        if (interpreter.Invoke() != kTfLiteOk)
+        {
+            return false;
+        }
+    }
+    TfLiteTensor *result = interpreter.output(0);
+    output.assign(result->data.f, result->data.f + result->bytes / sizeof(float));
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int workers = argc > 1 ? atoi(argv[1]) : 1;
+    if (workers < 1)
+    {
+        fprintf(stderr, "Usage: %s [workers]\n", argv[0]);
+        return 1;
+    }
+    tflite::MicroErrorReporter error_reporter;
+    const tflite::Model *model = tflite::GetModel(converted_model_tflite);
+    tflite::MicroMutableOpResolver<11> resolver;
+    add_ops(resolver);
+    WorkerPool pool(workers);
+
+    tflite::RecordedArenaUsage usage;
+    std::vector<float> recorded_output;
+    {
+        tflite::RecordingMicroInterpreter interpreter(model, resolver, tensor_arena, RECORDING_ARENA_SIZE,
+                                                      &error_reporter);
+        if (workers > 1)
+        {
+            interpreter.SetExternalContext(kTfLiteCpuBackendContext, pool.external_context());
+        }
+        if (interpreter.AllocateTensors() != kTfLiteOk || !invoke(interpreter, recorded_output))
+        {
+            fprintf(stderr, "ERROR: could not run the model in a %d byte arena\n", RECORDING_ARENA_SIZE);
+            return 1;
+        }
+        interpreter.GetMicroAllocator().PrintAllocations();
+        interpreter.GetMicroAllocator().PrintArenaUsage();
+        usage = interpreter.GetMicroAllocator().GetRecordedArenaUsage();
+    }
+
+    // the recording allocator is a little bigger than the normal one and lives in the tail too
+    memset(tensor_arena, 0, sizeof(tensor_arena));
+    std::vector<float> output;
+    tflite::MicroInterpreter interpreter(model, resolver, tensor_arena, usage.required_bytes, &error_reporter);
+    if (workers > 1)
+    {
+        interpreter.SetExternalContext(kTfLiteCpuBackendContext, pool.external_context());
+    }
+    if (interpreter.AllocateTensors() != kTfLiteOk || !invoke(interpreter, output))
+    {
+        fprintf(stderr, "ERROR: the model does not run in the required %zu bytes\n", usage.required_bytes);
+        return 1;
+    }
+    if (output != recorded_output)
+    {
+        fprintf(stderr, "ERROR: output in a %zu byte arena differs from the recorded run\n", usage.required_bytes);
+        return 1;
+    }
+    printf("%d worker%s: model runs in a %zu byte arena (%zu bytes used)\n", workers, workers == 1 ? "" : "s",
+           usage.required_bytes, interpreter.arena_used_bytes());
+    return 0;
+}
@@ -0,0 +1,408 @@
+/**
+ * Endpointer accuracy check and benchmark
+ *
+ * Plays labelled WAV files through the front end the way the device does -
+ * SAMPLE_BUFFER_SIZE samples at a time into the ring buffer, then
+ * AudioProcessor's spectrogram of the last second - and hands the frame
+ * energies to an Endpointer started when the wake word was detected. The
+ * endpoint is where the sampler had got to when the Endpointer said the
+ * utterance was over, and its error is how long after the labelled end of
+ * speech that was (the hangover is the least it should be, anything below 0
+ * cut the user off). Reported:
+ *  - for each file, the error and how the utterance ended
+ *  - the error distribution - min, median, 90th and 95th percentile and max -
+ *    and how many utterances were cut off, ended late (more than
+ *    LATE_MS after the hangover), found no speech or hit the cap
+ *  - the time the Endpointer took per frame, and the audio that didn't have
+ *    to be uploaded compared with always capturing CAPTURE_MAX_MS
+ *
+ * The labels file has a line per WAV: its path (relative to the labels
+ * file), when the wake word was detected and when the speech after it ended,
+ * both in ms from the start of the file. Without one a labelled set is made
+ * up - speech-like syllables with harmonics, pauses between words and
+ * fricatives at the ends of some, in noise at 30, 20 and 10 dB SNR and with
+ * mains hum - and written to endpointer_wavs/ in the current directory. Its
+ * labels are exact, so the program exits with an error if any of those
+ * utterances is cut off, ends late or isn't ended by the user stopping.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -O2 -Itools/wav_reader_benchmark/host \
+ *       -Icomponents/audio_output -Icomponents/audio_input \
+ *       -Icomponents/audio_processor/src \
+ *       -Icomponents/audio_processor/src/kissfft \
+ *       tools/endpointer_benchmark/endpointer_benchmark.cc \
+ *       components/audio_processor/src/Endpointer.cpp \
+ *       components/audio_processor/src/AudioProcessor.cpp \
+ *       components/audio_processor/src/HammingWindow.cpp \
+ *       components/audio_processor/src/kissfft/kiss_fft.c \
+ *       components/audio_processor/src/kissfft/tools/kiss_fftr.c \
+ *       components/audio_output/WAVFileReader.cpp \
+ *       components/audio_output/PCMConverter.cpp \
+ *       components/audio_output/Resampler.cpp \
+ *       -o endpointer_benchmark
+ *
+ * Usage:
+ *   ./endpointer_benchmark [labels file]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <SPIFFS.h>
+#include "WAVFileReader.h"
+#include "AudioProcessor.h"
+#include "Endpointer.h"
+#include "RingBuffer.h"
+
+// same as DetectWakeWordState and the i2s sampler
+#define WINDOW_SIZE 320
+#define STEP_SIZE 160
+#define POOLING_SIZE 6
+#define AUDIO_LENGTH 16000
+#define AUDIO_BUFFER_COUNT 11
+// same as config.h
+#define ENDPOINT_HANGOVER_MS 700
+#define ENDPOINT_NO_SPEECH_MS 4000
+#define CAPTURE_MAX_MS 8000
+#define SAMPLE_RATE 16000
+#define SAMPLES_PER_MS 16
+// an endpoint this long after the hangover is late
+#define LATE_MS 300
+#define GENERATED_DIRECTORY "endpointer_wavs"
+
+typedef std::chrono::steady_clock Clock;
+
+struct LabelledWav
+{
+    std::string path;
+    int trigger_ms;
+    int speech_end_ms;
+};
+
+struct Result
+{
+    // -1 if the file ran out first
+    int endpoint_ms;
+    const char *how;
+};
+
+/**
+ * Made up speech - deterministic so the labelled set is the same every run
+ **/
+class Synthesizer
+{
+private:
+    uint32_t m_seed;
+    float m_hum_phase;
+    float m_noise_state;
+
+public:
+    std::vector<float> samples;
+
+    Synthesizer(uint32_t seed) : m_seed(seed), m_hum_phase(0), m_noise_state(0) {}
+    float uniform()
+    {
+        m_seed = m_seed * 1103515245 + 12345;
+        return ((m_seed >> 8) & 0xffff) / 65536.0f;
+    }
+    float between(float low, float high)
+    {
+        return low + (high - low) * uniform();
+    }
+    float gaussian()
+    {
+        return (uniform() + uniform() + uniform() + uniform() - 2.0f) * 1.7f;
+    }
+    int ms()
+    {
+        return samples.size() / SAMPLES_PER_MS;
+    }
+    void silence(int duration_ms)
+    {
+        samples.resize(samples.size() + duration_ms * SAMPLES_PER_MS, 0.0f);
+    }
+    // a voiced syllable - harmonics of a gliding pitch under a raised cosine envelope
+    void syllable(int duration_ms, float level)
+    {
+        int count = duration_ms * SAMPLES_PER_MS;
+        float pitch = between(100, 220);
+        float glide = between(-0.3f, 0.3f);
+        float phase = 0;
+        for (int i = 0; i < count; i++)
+        {
+            float t = (float)i / count;
+            float envelope = t < 0.15f ? 0.5f - 0.5f * cosf((float)M_PI * t / 0.15f)
+                                       : (t > 0.7f ? 0.5f + 0.5f * cosf((float)M_PI * (t - 0.7f) / 0.3f) : 1.0f);
+            phase += 2 * (float)M_PI * pitch * (1 + glide * t) / SAMPLE_RATE;
+            float voice = 0;
+            for (int harmonic = 1; harmonic <= 10; harmonic++)
+            {
+                voice += sinf(harmonic * phase) / harmonic;
+            }
+            samples.push_back(level * envelope * voice * 0.5f);
+        }
+    }
+    // an 's' or 'f' - high passed noise, much quieter than the voice
+    void fricative(int duration_ms, float level)
+    {
+        int count = duration_ms * SAMPLES_PER_MS;
+        float last = 0;
+        for (int i = 0; i < count; i++)
+        {
+            float t = (float)i / count;
+            float envelope = sinf((float)M_PI * t);
+            float noise = gaussian();
+            samples.push_back(level * envelope * (noise - last));
+            last = noise;
+        }
+    }
+    // a word of a few syllables, sometimes ending in a fricative - returns when the sound ends
+    void word(float level)
+    {
+        int syllables = 1 + (int)(uniform() * 3);
+        for (int i = 0; i < syllables; i++)
+        {
+            if (i > 0)
+            {
+                silence((int)between(20, 60));
+            }
+            syllable((int)between(120, 280), level * between(0.5f, 1.0f));
+        }
+        if (uniform() < 0.3f)
+        {
+            fricative((int)between(80, 150), level * between(0.08f, 0.15f));
+        }
+    }
+    // pink-ish background noise and mains hum over everything
+    void addNoise(float noise_rms, float hum_level)
+    {
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            m_noise_state = 0.9f * m_noise_state + 0.1f * gaussian() * 3.2f;
+            m_hum_phase += 2 * (float)M_PI * 50 / SAMPLE_RATE;
+            samples[i] += noise_rms * m_noise_state + hum_level * (sinf(m_hum_phase) + 0.3f * sinf(3 * m_hum_phase));
+        }
+    }
+};
+
+static bool write_wav(const std::string &path, const std::vector<float> &samples)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    uint32_t data_bytes = samples.size() * 2;
+    uint8_t header[44];
+    memcpy(header, "RIFF", 4);
+    uint32_t values[] = {36 + data_bytes, 0, 16, 0x00010001, SAMPLE_RATE, SAMPLE_RATE * 2, 0x00100002, 0, data_bytes};
+    memcpy(header + 4, &values[0], 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    memcpy(header + 16, &values[2], 20);
+    memcpy(header + 36, "data", 4);
+    memcpy(header + 40, &values[8], 4);
+    fwrite(header, 1, sizeof(header), file);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        int16_t sample = (int16_t)std::max(-32768.0f, std::min(32767.0f, samples[i]));
+        fwrite(&sample, 2, 1, file);
+    }
+    fclose(file);
+    return true;
+}
+
+// the made up set - returns the labels file
+static std::string generate_wavs()
+{
+    mkdir(GENERATED_DIRECTORY, 0755);
+    std::string labels_path = std::string(GENERATED_DIRECTORY) + "/labels.txt";
+    FILE *labels = fopen(labels_path.c_str(), "w");
+    const char *conditions[] = {"snr30", "snr20", "snr10", "hum"};
+    const float speech_level = 8000;
+    for (int condition = 0; condition < 4; condition++)
+    {
+        for (int n = 0; n < 12; n++)
+        {
+            Synthesizer synth(condition * 1000 + n + 1);
+            synth.silence((int)synth.between(1500, 2500));
+            // the wake word, and the detector noticing it a little after it ended
+            synth.word(speech_level);
+            synth.word(speech_level);
+            int trigger_ms = synth.ms() + (int)synth.between(150, 350);
+            synth.silence((int)synth.between(200, 700));
+            int words = 2 + (int)(synth.uniform() * 5);
+            for (int i = 0; i < words; i++)
+            {
+                if (i > 0)
+                {
+                    // shorter than the hangover - the user hasn't finished
+                    synth.silence((int)synth.between(100, 400));
+                }
+                synth.word(speech_level);
+            }
+            int speech_end_ms = synth.ms();
+            synth.silence(ENDPOINT_HANGOVER_MS + 3000);
+            // speech RMS is about a third of its level
+            float snr_db = condition == 0 ? 30 : (condition == 1 ? 20 : (condition == 2 ? 10 : 25));
+            synth.addNoise(speech_level / 3 / powf(10, snr_db / 20), condition == 3 ? 1500 : 0);
+            char name[64];
+            snprintf(name, sizeof(name), "%s_%02d.wav", conditions[condition], n);
+            write_wav(std::string(GENERATED_DIRECTORY) + "/" + name, synth.samples);
+            fprintf(labels, "%s %d %d\n", name, trigger_ms, speech_end_ms);
+        }
+    }
+    fclose(labels);
+    return labels_path;
+}
+
+static std::vector<LabelledWav> read_labels(const std::string &labels_path)
+{
+    std::vector<LabelledWav> wavs;
+    FILE *labels = fopen(labels_path.c_str(), "r");
+    if (!labels)
+    {
+        return wavs;
+    }
+    size_t slash = labels_path.rfind('/');
+    std::string directory = slash == std::string::npos ? "" : labels_path.substr(0, slash + 1);
+    char name[512];
+    LabelledWav wav;
+    while (fscanf(labels, "%511s %d %d", name, &wav.trigger_ms, &wav.speech_end_ms) == 3)
+    {
+        wav.path = name[0] == '/' ? name : directory + name;
+        wavs.push_back(wav);
+    }
+    fclose(labels);
+    return wavs;
+}
+
+static double s_update_ms = 0;
+static long s_frames = 0;
+
+// the front end and the endpointer over the file, from the start
+static Result run_file(const LabelledWav &wav)
+{
+    Result result = {-1, "file ended"};
+    WAVFileReader reader(wav.path.c_str());
+    AudioBuffer *buffers[AUDIO_BUFFER_COUNT];
+    for (int i = 0; i < AUDIO_BUFFER_COUNT; i++)
+    {
+        buffers[i] = new AudioBuffer();
+    }
+    RingBufferAccessor writer(buffers, AUDIO_BUFFER_COUNT);
+    AudioProcessor audio_processor(AUDIO_LENGTH, WINDOW_SIZE, STEP_SIZE, POOLING_SIZE);
+    std::vector<float> features(audio_processor.get_frame_count() * 43);
+    Endpointer endpointer(STEP_SIZE, ENDPOINT_HANGOVER_MS, ENDPOINT_NO_SPEECH_MS, CAPTURE_MAX_MS);
+    Frame_t frames[SAMPLE_BUFFER_SIZE];
+    uint32_t written = 0;
+    bool started = false;
+    while (reader.available())
+    {
+        int count = reader.getFrames(frames, SAMPLE_BUFFER_SIZE);
+        for (int i = 0; i < count; i++)
+        {
+            writer.setCurrentSample(frames[i].left);
+            writer.moveToNextSample();
+        }
+        written += count;
+        if (count < SAMPLE_BUFFER_SIZE)
+        {
+            break;
+        }
+        if (!started && written >= (uint32_t)wav.trigger_ms * SAMPLES_PER_MS)
+        {
+            endpointer.start();
+            started = true;
+        }
+        RingBufferAccessor *window = new RingBufferAccessor(buffers, AUDIO_BUFFER_COUNT);
+        window->setIndex(writer.getIndex());
+        window->rewind(AUDIO_LENGTH);
+        audio_processor.get_spectrogram(window, features.data());
+        delete window;
+        Clock::time_point start = Clock::now();
+        bool ended = endpointer.update(audio_processor.get_frame_energies(), audio_processor.get_frame_count(), written);
+        s_update_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (ended)
+        {
+            EndpointerStats_t stats = endpointer.getStats();
+            result.endpoint_ms = written / SAMPLES_PER_MS;
+            result.how = stats.ended ? "ended" : (stats.no_speech ? "no speech" : "capped");
+            break;
+        }
+    }
+    s_frames += written / STEP_SIZE;
+    for (int i = 0; i < AUDIO_BUFFER_COUNT; i++)
+    {
+        delete buffers[i];
+    }
+    return result;
+}
+
+static int percentile(std::vector<int> values, int percent)
+{
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, values.size() * percent / 100)];
+}
+
+int main(int argc, char **argv)
+{
+    bool generated = argc < 2;
+    std::string labels_path = generated ? generate_wavs() : argv[1];
+    // paths in the labels are host paths
+    SPIFFS.root() = "";
+    std::vector<LabelledWav> wavs = read_labels(labels_path);
+    if (wavs.empty())
+    {
+        fprintf(stderr, "No labelled WAVs in %s\n", labels_path.c_str());
+        return 1;
+    }
+    std::vector<int> errors;
+    int cut_off = 0;
+    int late = 0;
+    int no_speech = 0;
+    int capped = 0;
+    int missed = 0;
+    double captured_ms = 0;
+    for (size_t i = 0; i < wavs.size(); i++)
+    {
+        Result result = run_file(wavs[i]);
+        if (result.endpoint_ms < 0)
+        {
+            missed++;
+            printf("%-40s no endpoint before the file ended\n", wavs[i].path.c_str());
+            continue;
+        }
+        int error = result.endpoint_ms - wavs[i].speech_end_ms;
+        errors.push_back(error);
+        captured_ms += result.endpoint_ms - wavs[i].trigger_ms;
+        cut_off += error < 0;
+        late += error > ENDPOINT_HANGOVER_MS + LATE_MS;
+        no_speech += strcmp(result.how, "no speech") == 0;
+        capped += strcmp(result.how, "capped") == 0;
+        printf("%-40s %-9s error %5d ms\n", wavs[i].path.c_str(), result.how, error);
+    }
+    if (!errors.empty())
+    {
+        printf("\n%zu utterances, hangover %d ms - endpoint error min %d ms, median %d ms, p90 %d ms, p95 %d ms, "
+               "max %d ms\n",
+               errors.size(), ENDPOINT_HANGOVER_MS, percentile(errors, 0), percentile(errors, 50),
+               percentile(errors, 90), percentile(errors, 95), percentile(errors, 100));
+        printf("%d cut off, %d late, %d no speech, %d capped, %d without an endpoint\n", cut_off, late, no_speech,
+               capped, missed);
+        printf("%.1f ns per frame in the endpointer, %.2f s captured per utterance instead of %.2f s\n",
+               s_update_ms * 1e6 / s_frames, captured_ms / errors.size() / 1000, CAPTURE_MAX_MS / 1000.0);
+    }
+    if (generated && (cut_off || late || no_speech || capped || missed))
+    {
+        fprintf(stderr, "ERROR: endpoints on the generated set aren't right\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+#ifndef __host_i2s_h__
+#define __host_i2s_h__
+
+/**
+ * The legacy i2s driver calls I2SOutput and I2SSampler make, with a thread standing in for
+ * the DMA so it can be built and run on the host by tools/i2s_output_benchmark.
+ *
+ * Every dma_buf_len frames' worth of real time the DMA thread plays one DMA
+ * buffer from the bytes i2s_write has queued, and posts I2S_EVENT_TX_DONE the
+ * way the driver's interrupt does. If a whole buffer hasn't been written by
+ * then it plays what there is padded with zeros, counts an underrun and posts
+ * I2S_EVENT_TX_Q_OVF as well - once anything has been written, before that
+ * it's just silence at start up. i2s_write queues up to dma_buf_count - 1
+ * buffers, the free buffers the driver keeps in its queue. Everything played
+ * is kept so it can be checked afterwards.
+ **/
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+#define I2S_PIN_NO_CHANGE -1
+
+typedef int i2s_port_t;
+#define I2S_NUM_0 0
+#define I2S_NUM_1 1
+#define HOST_I2S_PORTS 16
+
+typedef enum
+{
+    I2S_MODE_MASTER = 1,
+    I2S_MODE_SLAVE = 2,
+    I2S_MODE_TX = 4,
+    I2S_MODE_RX = 8
+} i2s_mode_t;
+
+typedef enum
+{
+    I2S_BITS_PER_SAMPLE_16BIT = 16,
+    I2S_BITS_PER_SAMPLE_32BIT = 32
+} i2s_bits_per_sample_t;
+
+typedef enum
+{
+    I2S_CHANNEL_FMT_RIGHT_LEFT,
+    I2S_CHANNEL_FMT_ONLY_RIGHT,
+    I2S_CHANNEL_FMT_ONLY_LEFT
+} i2s_channel_fmt_t;
+
+typedef enum
+{
+    I2S_COMM_FORMAT_I2S = 1
+} i2s_comm_format_t;
+
+typedef struct
+{
+    i2s_mode_t mode;
+    uint32_t sample_rate;
+    i2s_bits_per_sample_t bits_per_sample;
+    i2s_channel_fmt_t channel_format;
+    i2s_comm_format_t communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+    bool use_apll;
+    bool tx_desc_auto_clear;
+    int fixed_mclk;
+} i2s_config_t;
+
+typedef struct
+{
+    int bck_io_num;
+    int ws_io_num;
+    int data_out_num;
+    int data_in_num;
+} i2s_pin_config_t;
+
+typedef enum
+{
+    I2S_EVENT_DMA_ERROR,
+    I2S_EVENT_TX_DONE,
+    I2S_EVENT_RX_DONE,
+    I2S_EVENT_TX_Q_OVF,
+    I2S_EVENT_RX_Q_OVF
+} i2s_event_type_t;
+
+typedef struct
+{
+    i2s_event_type_t type;
+    size_t size;
+} i2s_event_t;
+
+struct HostI2S
+{
+    std::mutex mutex;
+    std::condition_variable space;
+    // bytes written but not played yet, and the most there can be
+    std::deque<uint8_t> queued;
+    size_t capacity;
+    size_t buffer_bytes;
+    std::chrono::microseconds buffer_time;
+    QueueHandle_t events;
+    std::vector<uint8_t> played;
+    uint32_t buffers_played;
+    uint32_t underruns;
+    bool started;
+    std::atomic<bool> running;
+    std::thread dma;
+};
+
+// inline rather than static so the benchmark and I2SOutput.cpp share the ports
+inline HostI2S *&host_i2s(i2s_port_t port)
+{
+    static HostI2S *ports[HOST_I2S_PORTS];
+    return ports[port];
+}
+
+static inline void host_i2s_post(HostI2S *i2s, i2s_event_type_t type)
+{
+    i2s_event_t event = {type, i2s->buffer_bytes};
+    xQueueSend(i2s->events, &event, 0);
+}
+
+static inline void host_i2s_dma(HostI2S *i2s)
+{
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    while (i2s->running.load())
+    {
+        next += i2s->buffer_time;
+        std::this_thread::sleep_until(next);
+        std::lock_guard<std::mutex> lock(i2s->mutex);
+        size_t bytes = std::min(i2s->buffer_bytes, i2s->queued.size());
+        i2s->played.insert(i2s->played.end(), i2s->queued.begin(), i2s->queued.begin() + bytes);
+        i2s->queued.erase(i2s->queued.begin(), i2s->queued.begin() + bytes);
+        i2s->buffers_played++;
+        i2s->played.insert(i2s->played.end(), i2s->buffer_bytes - bytes, 0);
+        if (bytes < i2s->buffer_bytes && i2s->started)
+        {
+            i2s->underruns++;
+            host_i2s_post(i2s, I2S_EVENT_TX_Q_OVF);
+        }
+        host_i2s_post(i2s, I2S_EVENT_TX_DONE);
+        i2s->space.notify_all();
+    }
+}
+
+static inline esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *config, int queue_size,
+                                           QueueHandle_t *queue)
+{
+    if (port < 0 || port >= HOST_I2S_PORTS || host_i2s(port))
+    {
+        return ESP_FAIL;
+    }
+    HostI2S *i2s = new HostI2S;
+    int frame_bytes = 2 * config->bits_per_sample / 8;
+    i2s->buffer_bytes = config->dma_buf_len * frame_bytes;
+    i2s->capacity = (config->dma_buf_count - 1) * i2s->buffer_bytes;
+    i2s->buffer_time = std::chrono::microseconds(1000000LL * config->dma_buf_len / config->sample_rate);
+    i2s->events = xQueueCreate(queue_size, sizeof(i2s_event_t));
+    i2s->buffers_played = 0;
+    i2s->underruns = 0;
+    i2s->started = false;
+    i2s->running.store(true);
+    *queue = i2s->events;
+    host_i2s(port) = i2s;
+    i2s->dma = std::thread(host_i2s_dma, i2s);
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t *pins)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_zero_dma_buffer(i2s_port_t port)
+{
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_write(i2s_port_t port, const void *src, size_t size, size_t *bytes_written,
+                                  TickType_t ticks_to_wait)
+{
+    HostI2S *i2s = host_i2s(port);
+    const uint8_t *bytes = static_cast<const uint8_t *>(src);
+    std::unique_lock<std::mutex> lock(i2s->mutex);
+    size_t written = 0;
+    while (true)
+    {
+        size_t count = std::min(size - written, i2s->capacity - i2s->queued.size());
+        i2s->queued.insert(i2s->queued.end(), bytes + written, bytes + written + count);
+        written += count;
+        i2s->started |= written > 0;
+        if (written == size || ticks_to_wait == 0)
+        {
+            break;
+        }
+        i2s->space.wait(lock);
+    }
+    *bytes_written = written;
+    return ESP_OK;
+}
+
+// nothing is ever recorded on the host - tools/utterance_capture_benchmark hands I2SSampler its samples directly
+static inline esp_err_t i2s_read(i2s_port_t port, void *dest, size_t size, size_t *bytes_read, TickType_t ticks_to_wait)
+{
+    *bytes_read = 0;
+    return ESP_OK;
+}
+
+// host only - stops the DMA thread and returns what it played
+static inline HostI2S *host_i2s_stop(i2s_port_t port)
+{
+    HostI2S *i2s = host_i2s(port);
+    i2s->running.store(false);
+    i2s->dma.join();
+    return i2s;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __host_esp_heap_caps_h__
+#define __host_esp_heap_caps_h__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// all host memory is alike
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __host_esp_timer_h__
+#define __host_esp_timer_h__
+
+#include <stdint.h>
+#include <chrono>
+
+// microseconds since the program first asked - inline rather than static so every file shares the start
+inline int64_t esp_timer_get_time()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+#endif
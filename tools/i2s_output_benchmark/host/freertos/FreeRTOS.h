@@ -0,0 +1,130 @@
+#ifndef __host_freertos_h__
+#define __host_freertos_h__
+
+/**
+ * The FreeRTOS queues and tasks I2SOutput and the audio_input and
+ * voice_stream components use, on top of the C++ standard library, so they
+ * can be built on the host by the checks under tools. A tick is a
+ * millisecond and tasks are detached threads.
+ **/
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMAX_DELAY 0xffffffffUL
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) (ms)
+
+struct HostQueue
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<uint8_t>> items;
+    size_t item_size;
+    size_t length;
+};
+
+typedef HostQueue *QueueHandle_t;
+typedef void *TaskHandle_t;
+
+#define tskNO_AFFINITY 0x7fffffff
+
+typedef enum
+{
+    eNoAction,
+    eSetBits,
+    eIncrement
+} eNotifyAction;
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    HostQueue *queue = new HostQueue;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+// never blocks - fails if the queue is full, like sending from an interrupt
+static inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->items.size() == queue->length)
+    {
+        return pdFAIL;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    queue->items.push_back(std::vector<uint8_t>(bytes, bytes + queue->item_size));
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (ticks_to_wait == portMAX_DELAY)
+    {
+        queue->changed.wait(lock, [queue]() { return !queue->items.empty(); });
+    }
+    else if (!queue->changed.wait_for(lock, std::chrono::milliseconds(ticks_to_wait),
+                                      [queue]() { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    return pdPASS;
+}
+
+static inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->length - queue->items.size();
+}
+
+static inline void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+// nothing on the host waits for notifications
+static inline BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    return pdPASS;
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+static inline BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack_depth, void *param,
+                                     UBaseType_t priority, TaskHandle_t *handle)
+{
+    std::thread(task, param).detach();
+    if (handle)
+    {
+        *handle = NULL;
+    }
+    return pdPASS;
+}
+
+static inline BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stack_depth,
+                                                 void *param, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    return xTaskCreate(task, name, stack_depth, param, priority, handle);
+}
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef __host_freertos_queue_h__
+#define __host_freertos_queue_h__
+
+// everything is in FreeRTOS.h on the host
+#include <freertos/FreeRTOS.h>
+
+#endif
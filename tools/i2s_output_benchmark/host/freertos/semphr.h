@@ -0,0 +1,29 @@
+#ifndef __host_freertos_semphr_h__
+#define __host_freertos_semphr_h__
+
+// a mutex is a queue of one item, as it is in FreeRTOS - whoever has taken the item holds the mutex
+#include <freertos/FreeRTOS.h>
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t mutex = xQueueCreate(1, 1);
+    uint8_t item = 0;
+    xQueueSend(mutex, &item, 0);
+    return mutex;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks_to_wait)
+{
+    uint8_t item;
+    return xQueueReceive(mutex, &item, ticks_to_wait);
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    uint8_t item = 0;
+    return xQueueSend(mutex, &item, 0);
+}
+
+#endif
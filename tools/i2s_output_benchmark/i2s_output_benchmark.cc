@@ -0,0 +1,177 @@
+/**
+ * I2SOutput real time check
+ *
+ * Runs I2SOutput's writer task against a stand-in for the i2s driver
+ * (tools/i2s_output_benchmark/host) whose DMA thread plays the written
+ * samples at 16KHz in real time and counts an underrun whenever a DMA buffer
+ * comes due before it has been filled. Each scenario plays a source that
+ * numbers its frames, optionally spending a set time rendering each block,
+ * and checks:
+ *  - every frame played is the one after the last, apart from silence
+ *  - the underruns I2SOutput counts from the driver's events are the ones the
+ *    DMA thread saw (or fewer - the event queue drops events if the writer
+ *    falls far enough behind)
+ *  - there are none at all while the render time fits in the block time
+ * and prints I2SOutput's stats - blocks rendered, silent blocks, underruns
+ * and the render time per block. The program exits with an error if any of
+ * the checks fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -pthread -Itools/i2s_output_benchmark/host \
+ *       -Itools/wav_reader_benchmark/host -Icomponents/audio_output \
+ *       tools/i2s_output_benchmark/i2s_output_benchmark.cc \
+ *       components/audio_output/I2SOutput.cpp \
+ *       -o i2s_output_benchmark
+ *
+ * Usage:
+ *   ./i2s_output_benchmark [seconds per scenario]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#include "I2SOutput.h"
+
+#define SAMPLE_RATE 16000
+// frames are numbered so no frame is ever all zeros, which is silence
+#define FRAME_NUMBER_BASE 30000
+
+/**
+ * Numbered frames, spending render_us on each block - a stand in for a WAV
+ * reader, resampler or mixer - and running out after a set number of frames
+ **/
+class NumberedSource : public SampleSource
+{
+private:
+    int m_render_us;
+    int m_frames;
+    int m_position;
+
+public:
+    NumberedSource(int render_us, int frames) : m_render_us(render_us), m_frames(frames), m_position(0) {}
+    int getFrames(Frame_t *frames, int number_frames)
+    {
+        std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::microseconds(m_render_us);
+        int count = std::min(number_frames, m_frames - m_position);
+        for (int i = 0; i < count; i++, m_position++)
+        {
+            frames[i].left = m_position % FRAME_NUMBER_BASE + 1;
+            frames[i].right = m_position / FRAME_NUMBER_BASE;
+        }
+        // busy, like a real source would be
+        while (std::chrono::steady_clock::now() < until)
+        {
+        }
+        return count;
+    }
+    bool available()
+    {
+        return m_position < m_frames;
+    }
+};
+
+struct Scenario
+{
+    const char *label;
+    // -1 for no sample generator
+    int render_us;
+    // how much of the scenario the source plays for
+    double play_fraction;
+    bool expect_underruns;
+};
+
+static const Scenario scenarios[] = {
+    {"no sample generator", -1, 0, false},
+    {"source, no render time", 0, 1, false},
+    {"source, 5ms per 8ms block", 5000, 1, false},
+    {"source ending half way", 0, 0.5, false},
+    {"source, 10ms per 8ms block", 10000, 1, true},
+};
+
+static bool run(i2s_port_t port, const Scenario &scenario, double seconds)
+{
+    int frames = scenario.play_fraction * seconds * SAMPLE_RATE;
+    NumberedSource *source = new NumberedSource(scenario.render_us, frames);
+    I2SOutput *output = new I2SOutput();
+    if (scenario.render_us >= 0)
+    {
+        output->setSampleGenerator(source);
+    }
+    i2s_pin_config_t pins = {0, 0, 0, I2S_PIN_NO_CHANGE};
+    output->start(port, pins);
+    std::this_thread::sleep_for(std::chrono::microseconds((long long)(seconds * 1e6)));
+    HostI2S *i2s = host_i2s_stop(port);
+    // the writer task is left waiting for an event that will never come
+    I2SOutputStats_t stats = output->getStats();
+
+    // check the frames played follow on from each other
+    const Frame_t *played = reinterpret_cast<const Frame_t *>(i2s->played.data());
+    int played_frames = i2s->played.size() / sizeof(Frame_t);
+    int next = 0;
+    int silent = 0;
+    for (int i = 0; i < played_frames; i++)
+    {
+        if (played[i].left == 0 && played[i].right == 0)
+        {
+            silent++;
+            continue;
+        }
+        int number = played[i].right * FRAME_NUMBER_BASE + played[i].left - 1;
+        if (number != next)
+        {
+            fprintf(stderr, "ERROR: %s: frame %d played frame %d, expected frame %d\n", scenario.label, i, number, next);
+            return false;
+        }
+        next++;
+    }
+    double render_ms = stats.blocks ? stats.total_render_us / 1000.0 / stats.blocks : 0;
+    printf("%-30s %6d frames played %6d silent  %5u blocks %5u silent  %3u underruns (%3u seen)  "
+           "render %6.3f ms avg %6.3f ms max\n",
+           scenario.label, next, silent, stats.blocks, stats.silent_blocks, stats.underruns, i2s->underruns, render_ms,
+           stats.max_render_us / 1000.0);
+    if (stats.underruns > i2s->underruns || (stats.underruns == 0) != (i2s->underruns == 0))
+    {
+        fprintf(stderr, "ERROR: %s: I2SOutput counted %u underruns but there were %u\n", scenario.label,
+                stats.underruns, i2s->underruns);
+        return false;
+    }
+    if ((i2s->underruns > 0) != scenario.expect_underruns)
+    {
+        fprintf(stderr, "ERROR: %s: %u underruns\n", scenario.label, i2s->underruns);
+        return false;
+    }
+    // a few blocks can still be in the driver or rendered ahead when the DMA stops
+    if (scenario.render_us >= 0 && !scenario.expect_underruns && scenario.play_fraction == 1 &&
+        next < frames - 4 * NUM_FRAMES_TO_SEND)
+    {
+        fprintf(stderr, "ERROR: %s: only %d of %d frames played\n", scenario.label, next, frames);
+        return false;
+    }
+    if (scenario.play_fraction < 1 && next != frames)
+    {
+        fprintf(stderr, "ERROR: %s: %d of %d frames played\n", scenario.label, next, frames);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2;
+    if (seconds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [seconds per scenario]\n", argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]) && ok; i++)
+    {
+        ok = run(i, scenarios[i], seconds);
+    }
+    fflush(stdout);
+    // the writer tasks never return - leave without waiting for them
+    _exit(ok ? 0 : 1);
+}
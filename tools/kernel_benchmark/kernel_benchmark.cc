@@ -0,0 +1,53 @@
+/**
+ * Kernel micro-benchmarks on the host
+ *
+ * Runs the benchmarks in components/tfmicro/tensorflow/lite/micro/benchmarks:
+ * the bundled keyword benchmark model end to end and then every kernel
+ * NeuralNetwork registers on the layer shapes of our model. The same functions
+ * run on the device with RUN_KERNEL_BENCHMARKS in src/config.h, so a kernel
+ * change can be measured here first and then confirmed on the ESP32.
+ *
+ * Cycles are the measured time at the clock rate given on the command line, so
+ * pass the host's clock for real cycle counts.
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro
+ *   g++ -std=c++11 -O2 -DTF_LITE_STATIC_MEMORY -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       -I$R/third_party/ruy tools/kernel_benchmark/kernel_benchmark.cc \
+ *       $(sed -n 's/^  SRCS //p' $R/CMakeLists.txt | tr ' ' '\n' | sed "s|^|$R/|") \
+ *       -lpthread -o kernel_benchmark
+ *
+ * Usage:
+ *   ./kernel_benchmark [cpu MHz] [invocations]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tensorflow/lite/micro/benchmarks/micro_benchmark.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+
+int main(int argc, char **argv)
+{
+    int cpu_mhz = argc > 1 ? atoi(argv[1]) : 1000;
+    int invocations = argc > 2 ? atoi(argv[2]) : 200;
+    if (cpu_mhz < 1 || invocations < 1)
+    {
+        fprintf(stderr, "Usage: %s [cpu MHz] [invocations]\n", argv[0]);
+        return 1;
+    }
+
+    tflite::MicroErrorReporter error_reporter;
+    if (tflite::RunKeywordBenchmark(&error_reporter, cpu_mhz, invocations) != kTfLiteOk)
+    {
+        fprintf(stderr, "ERROR: keyword benchmark failed\n");
+        return 1;
+    }
+    if (tflite::RunKernelBenchmarks(&error_reporter, cpu_mhz, invocations) != kTfLiteOk)
+    {
+        fprintf(stderr, "ERROR: kernel benchmarks failed\n");
+        return 1;
+    }
+    return 0;
+}
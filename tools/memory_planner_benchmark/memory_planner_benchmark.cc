@@ -0,0 +1,263 @@
+/**
+ * Memory planner benchmark
+ *
+ * Plans synthetic buffer lifetimes of 100, 1000 and 10000 buffers with the
+ * tfmicro GreedyMemoryPlanner and with the original greedy planner it
+ * replaced (a bubble sort followed by a walk over every placed buffer for
+ * each buffer placed - copied below as LegacyGreedyPlanner) and prints how
+ * long each takes to plan.
+ *
+ * It is also the regression check for the planner: the arena the new planner
+ * needs must never be bigger than the old one for any of the lifetimes, and
+ * no two buffers that are in use at the same time may overlap. The program
+ * exits with an error if either happens.
+ *
+ * Two kinds of lifetimes are generated:
+ *   model  - like the tensors of a model: most buffers live for a few ops,
+ *            a few for a good part of the model
+ *   random - first and last use picked uniformly from the whole run, so most
+ *            buffers are in use at the same time as a third of the others
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro
+ *   g++ -std=c++11 -O2 -fno-exceptions -DTF_LITE_STATIC_MEMORY -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       -I$R/third_party/ruy \
+ *       tools/memory_planner_benchmark/memory_planner_benchmark.cc \
+ *       $(sed -n 's/^  SRCS //p' $R/CMakeLists.txt | tr ' ' '\n' | sed "s|^|$R/|") \
+ *       -lpthread -o memory_planner_benchmark
+ *
+ * Usage:
+ *   ./memory_planner_benchmark [seeds]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#include "tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+
+namespace tflite
+{
+// the old planner's sort, exported by greedy_memory_planner.cc for testing
+void ReverseSortInPlace(int *values, int *ids, int size);
+} // namespace tflite
+
+typedef std::chrono::steady_clock Clock;
+
+struct Buffer
+{
+    int size;
+    int first_time_used;
+    int last_time_used;
+};
+
+/**
+ * The greedy planner as it was before the first use index - kept here to
+ * compare the timings and the arena sizes against
+ **/
+class LegacyGreedyPlanner
+{
+private:
+    struct ListEntry
+    {
+        int offset;
+        int buffer_id;
+        int next_entry_index;
+    };
+    const std::vector<Buffer> &m_buffers;
+    std::vector<int> m_offsets;
+
+    bool overlapsInTime(const ListEntry &entry, int first_time_used, int last_time_used)
+    {
+        const Buffer &buffer = m_buffers[entry.buffer_id];
+        return buffer.first_time_used <= last_time_used && first_time_used <= buffer.last_time_used;
+    }
+
+public:
+    LegacyGreedyPlanner(const std::vector<Buffer> &buffers) : m_buffers(buffers)
+    {
+        int count = buffers.size();
+        // same order as GreedyMemoryPlanner::CalculateOffsetsIfNeeded collects them in
+        std::vector<int> sizes(count);
+        std::vector<int> ids(count);
+        for (int i = 0; i < count; i++)
+        {
+            sizes[count - 1 - i] = buffers[i].size;
+            ids[count - 1 - i] = i;
+        }
+        tflite::ReverseSortInPlace(sizes.data(), ids.data(), count);
+
+        std::vector<ListEntry> entries(count);
+        m_offsets.assign(count, 0);
+        int first_entry_index = 0;
+        entries[0].offset = 0;
+        entries[0].buffer_id = ids[0];
+        entries[0].next_entry_index = -1;
+        for (int i = 1; i < count; i++)
+        {
+            const Buffer &wanted = buffers[ids[i]];
+            int candidate_offset = 0;
+            // walk every placed buffer in offset order looking for a gap
+            for (int index = first_entry_index; index != -1; index = entries[index].next_entry_index)
+            {
+                const ListEntry &entry = entries[index];
+                if (!overlapsInTime(entry, wanted.first_time_used, wanted.last_time_used))
+                {
+                    continue;
+                }
+                if (entry.offset - candidate_offset >= wanted.size)
+                {
+                    break;
+                }
+                int end_offset = entry.offset + m_buffers[entry.buffer_id].size;
+                if (end_offset > candidate_offset)
+                {
+                    candidate_offset = end_offset;
+                }
+            }
+            m_offsets[ids[i]] = candidate_offset;
+            ListEntry &new_entry = entries[i];
+            new_entry.offset = candidate_offset;
+            new_entry.buffer_id = ids[i];
+            if (entries[first_entry_index].offset > candidate_offset)
+            {
+                new_entry.next_entry_index = first_entry_index;
+                first_entry_index = i;
+                continue;
+            }
+            int index = first_entry_index;
+            while (entries[index].next_entry_index != -1 &&
+                   entries[entries[index].next_entry_index].offset <= candidate_offset)
+            {
+                index = entries[index].next_entry_index;
+            }
+            new_entry.next_entry_index = entries[index].next_entry_index;
+            entries[index].next_entry_index = i;
+        }
+    }
+    size_t getArenaSize()
+    {
+        size_t arena_size = 0;
+        for (size_t i = 0; i < m_buffers.size(); i++)
+        {
+            size_t end = m_offsets[i] + m_buffers[i].size;
+            arena_size = end > arena_size ? end : arena_size;
+        }
+        return arena_size;
+    }
+};
+
+static uint32_t next_random(uint32_t &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) & 0xffffff;
+}
+
+static std::vector<Buffer> make_buffers(int count, bool model_like, uint32_t seed)
+{
+    std::vector<Buffer> buffers(count);
+    // a model has a few tensors per op
+    int time_steps = model_like ? count / 3 + 1 : count;
+    for (int i = 0; i < count; i++)
+    {
+        Buffer &buffer = buffers[i];
+        // 16 byte aligned, from 16 bytes to 64KB with small buffers the most common
+        buffer.size = 16 * (1 + next_random(seed) % 16) << (next_random(seed) % 9);
+        if (model_like)
+        {
+            buffer.first_time_used = i / 3;
+            uint32_t kind = next_random(seed) % 100;
+            int length = kind < 90 ? 1 + next_random(seed) % 4 : kind < 98 ? next_random(seed) % 64 : next_random(seed) % time_steps;
+            buffer.last_time_used = buffer.first_time_used + length < time_steps ? buffer.first_time_used + length : time_steps - 1;
+        }
+        else
+        {
+            int a = next_random(seed) % time_steps;
+            int b = next_random(seed) % time_steps;
+            buffer.first_time_used = a < b ? a : b;
+            buffer.last_time_used = a < b ? b : a;
+        }
+    }
+    return buffers;
+}
+
+static bool run(int count, bool model_like, int seeds)
+{
+    tflite::MicroErrorReporter error_reporter;
+    std::vector<uint8_t> scratch(count * tflite::GreedyMemoryPlanner::per_buffer_size());
+    double planner_ms = 0;
+    double legacy_ms = 0;
+    size_t planner_bytes = 0;
+    size_t legacy_bytes = 0;
+    for (int s = 0; s < seeds; s++)
+    {
+        std::vector<Buffer> buffers = make_buffers(count, model_like, 1 + s);
+
+        Clock::time_point start = Clock::now();
+        tflite::GreedyMemoryPlanner planner(scratch.data(), scratch.size());
+        for (const Buffer &buffer : buffers)
+        {
+            if (planner.AddBuffer(&error_reporter, buffer.size, buffer.first_time_used, buffer.last_time_used) !=
+                kTfLiteOk)
+            {
+                return false;
+            }
+        }
+        size_t arena_size = planner.GetMaximumMemorySize();
+        Clock::time_point end = Clock::now();
+        planner_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = Clock::now();
+        LegacyGreedyPlanner legacy(buffers);
+        size_t legacy_arena_size = legacy.getArenaSize();
+        end = Clock::now();
+        legacy_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+        if (arena_size > legacy_arena_size)
+        {
+            fprintf(stderr, "ERROR: %d %s buffers, seed %d: arena grew from %zu to %zu bytes\n", count,
+                    model_like ? "model" : "random", 1 + s, legacy_arena_size, arena_size);
+            return false;
+        }
+        // this check is O(N^2) so it isn't part of the timing
+        if (planner.DoAnyBuffersOverlap(&error_reporter))
+        {
+            fprintf(stderr, "ERROR: %d %s buffers, seed %d: overlapping buffers\n", count,
+                    model_like ? "model" : "random", 1 + s);
+            return false;
+        }
+        planner_bytes += arena_size;
+        legacy_bytes += legacy_arena_size;
+    }
+    printf("%-6s %6d buffers  planner %9.3f ms  legacy %9.3f ms  %6.1fx  arena %9zu bytes (legacy %9zu)\n",
+           model_like ? "model" : "random", count, planner_ms / seeds, legacy_ms / seeds, legacy_ms / planner_ms,
+           planner_bytes / seeds, legacy_bytes / seeds);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int seeds = argc > 1 ? atoi(argv[1]) : 5;
+    if (seeds < 1)
+    {
+        fprintf(stderr, "Usage: %s [seeds]\n", argv[0]);
+        return 1;
+    }
+    const int counts[] = {100, 1000, 10000};
+    for (int model_like = 1; model_like >= 0; model_like--)
+    {
+        for (int count : counts)
+        {
+            if (!run(count, model_like, seeds))
+            {
+                return 1;
+            }
+        }
+    }
+    printf("arena never bigger than the legacy planner, no overlapping buffers\n");
+    return 0;
+}
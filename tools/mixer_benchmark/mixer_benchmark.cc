@@ -0,0 +1,437 @@
+/**
+ * MixerSource checks and benchmark
+ *
+ * Checks the mixer against a floating point model of it - gains, fades in
+ * and out, gain ramps, saturation, sources running out part way through a
+ * block - and that sources attached and detached from another thread while
+ * the mix runs all come back through retired() exactly once.
+ *
+ * Then times mixing one 128 frame block (the block I2SOutput sends) from 1 to
+ * MIXER_MAX_SOURCES sources, at unity gain, at a fixed gain and while every
+ * source is ramping. The sources are tones generated ahead of time, so the
+ * times are the mixer's own. The program exits with an error if any of the
+ * checks fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -O2 -pthread -Itools/wav_reader_benchmark/host \
+ *       -Icomponents/audio_output \
+ *       tools/mixer_benchmark/mixer_benchmark.cc \
+ *       components/audio_output/MixerSource.cpp \
+ *       -o mixer_benchmark
+ *
+ * Usage:
+ *   ./mixer_benchmark [blocks to time]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "MixerSource.h"
+
+#define BLOCK_FRAMES 128
+#define SAMPLE_RATE 16000
+// most the mixer can be off from the model per source playing - the gain is
+// rounded to Q14 for the multiply and the ramp steps are rounded to Q24
+#define TOLERANCE_PER_SOURCE 4
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * A tone, with different frequencies left and right, that runs for a set
+ * number of frames - or for ever
+ **/
+class ToneSource : public SampleSource
+{
+private:
+    std::vector<Frame_t> m_period;
+    int m_position;
+    int m_frames_left;
+
+public:
+    ToneSource(double frequency, double amplitude, int frames = -1)
+    {
+        // a whole number of cycles of both tones
+        m_period.resize(SAMPLE_RATE / 100);
+        for (size_t i = 0; i < m_period.size(); i++)
+        {
+            m_period[i].left = lround(amplitude * sin(2 * M_PI * frequency * i / SAMPLE_RATE));
+            m_period[i].right = lround(amplitude * cos(2 * M_PI * 2 * frequency * i / SAMPLE_RATE));
+        }
+        m_position = 0;
+        m_frames_left = frames;
+    }
+    int getFrames(Frame_t *frames, int number_frames)
+    {
+        if (m_frames_left >= 0)
+        {
+            number_frames = std::min(number_frames, m_frames_left);
+            m_frames_left -= number_frames;
+        }
+        for (int i = 0; i < number_frames;)
+        {
+            int count = std::min(number_frames - i, (int)m_period.size() - m_position);
+            memcpy(frames + i, m_period.data() + m_position, count * sizeof(Frame_t));
+            m_position = (m_position + count) % m_period.size();
+            i += count;
+        }
+        return number_frames;
+    }
+    bool available()
+    {
+        return m_frames_left != 0;
+    }
+};
+
+/**
+ * The mixer in floating point, one source - its gain follows exactly straight
+ * ramps and is applied without any rounding
+ **/
+struct ModelChannel
+{
+    ToneSource *source;
+    double gain;
+    double target_gain;
+    double gain_step;
+    int ramp_frames;
+    bool detaching;
+    bool finished;
+
+    void startRamp(double gain_to, int frames)
+    {
+        target_gain = gain_to;
+        ramp_frames = frames > 0 && gain_to != gain ? frames : 0;
+        gain_step = ramp_frames ? (gain_to - gain) / ramp_frames : 0;
+        gain = ramp_frames ? gain : gain_to;
+    }
+};
+
+typedef enum
+{
+    ATTACH,
+    DETACH,
+    SET_GAIN
+} EventType_t;
+
+// a call to the mixer before the block with the given index
+struct Event
+{
+    int block;
+    EventType_t type;
+    int source;
+    double gain;
+    int ramp_frames;
+};
+
+struct Scenario
+{
+    const char *label;
+    int blocks;
+    // the frequency, amplitude and length of each source's tone
+    std::vector<double> frequencies;
+    std::vector<double> amplitudes;
+    std::vector<int> lengths;
+    std::vector<Event> events;
+};
+
+static bool run_scenario(const Scenario &scenario)
+{
+    int source_count = scenario.frequencies.size();
+    std::vector<ToneSource *> sources;
+    std::vector<ModelChannel> model;
+    for (int i = 0; i < source_count; i++)
+    {
+        sources.push_back(new ToneSource(scenario.frequencies[i], scenario.amplitudes[i], scenario.lengths[i]));
+        ModelChannel channel = {new ToneSource(scenario.frequencies[i], scenario.amplitudes[i], scenario.lengths[i]), 0, 0, 0, 0, false, true};
+        model.push_back(channel);
+    }
+    MixerSource mixer;
+    std::vector<int> retired_count(source_count, 0);
+    int max_error = 0;
+    bool ok = true;
+    for (int block = 0; block < scenario.blocks && ok; block++)
+    {
+        for (const Event &event : scenario.events)
+        {
+            if (event.block != block)
+            {
+                continue;
+            }
+            ModelChannel &channel = model[event.source];
+            switch (event.type)
+            {
+            case ATTACH:
+                mixer.attach(sources[event.source], event.gain, event.ramp_frames);
+                channel.gain = 0;
+                channel.detaching = false;
+                channel.finished = false;
+                channel.startRamp(event.gain, event.ramp_frames);
+                break;
+            case DETACH:
+                mixer.detach(sources[event.source], event.ramp_frames);
+                if (!channel.finished)
+                {
+                    channel.detaching = true;
+                    channel.startRamp(0, event.ramp_frames);
+                }
+                break;
+            case SET_GAIN:
+                mixer.setGain(sources[event.source], event.gain, event.ramp_frames);
+                if (!channel.finished && !channel.detaching)
+                {
+                    channel.startRamp(event.gain, event.ramp_frames);
+                }
+                break;
+            }
+        }
+        bool playing = false;
+        for (ModelChannel &channel : model)
+        {
+            playing |= !channel.finished;
+        }
+        if (mixer.available() != playing)
+        {
+            fprintf(stderr, "ERROR: %s: block %d the mixer says it has%s sources playing\n", scenario.label, block,
+                    playing ? " no" : "");
+            ok = false;
+            break;
+        }
+        Frame_t frames[BLOCK_FRAMES];
+        mixer.getFrames(frames, BLOCK_FRAMES);
+        std::vector<double> left(BLOCK_FRAMES, 0), right(BLOCK_FRAMES, 0);
+        int sources_playing = 0;
+        for (ModelChannel &channel : model)
+        {
+            if (channel.finished)
+            {
+                continue;
+            }
+            sources_playing++;
+            Frame_t input[BLOCK_FRAMES];
+            int got = channel.source->available() ? channel.source->getFrames(input, BLOCK_FRAMES) : 0;
+            for (int i = 0; i < got; i++)
+            {
+                left[i] += input[i].left * channel.gain;
+                right[i] += input[i].right * channel.gain;
+                if (channel.ramp_frames > 0 && --channel.ramp_frames == 0)
+                {
+                    channel.gain = channel.target_gain;
+                }
+                else if (channel.ramp_frames > 0)
+                {
+                    channel.gain += channel.gain_step;
+                }
+            }
+            channel.finished = got < BLOCK_FRAMES || (channel.detaching && channel.ramp_frames == 0);
+        }
+        for (int i = 0; i < BLOCK_FRAMES; i++)
+        {
+            int expected[2] = {(int)std::max(-32768.0, std::min(32767.0, round(left[i]))),
+                               (int)std::max(-32768.0, std::min(32767.0, round(right[i])))};
+            int error = std::max(abs(frames[i].left - expected[0]), abs(frames[i].right - expected[1]));
+            max_error = std::max(max_error, error);
+            if (error > TOLERANCE_PER_SOURCE * sources_playing)
+            {
+                fprintf(stderr, "ERROR: %s: block %d frame %d is %d, %d - expected %d, %d\n", scenario.label, block, i,
+                        frames[i].left, frames[i].right, expected[0], expected[1]);
+                ok = false;
+                break;
+            }
+        }
+        for (SampleSource *source = mixer.retired(); source; source = mixer.retired())
+        {
+            int index = std::find(sources.begin(), sources.end(), source) - sources.begin();
+            retired_count[index]++;
+            if (!model[index].finished)
+            {
+                fprintf(stderr, "ERROR: %s: block %d source %d was retired while it should still be playing\n",
+                        scenario.label, block, index);
+                ok = false;
+            }
+        }
+    }
+    for (int i = 0; i < source_count && ok; i++)
+    {
+        if (retired_count[i] != 1)
+        {
+            fprintf(stderr, "ERROR: %s: source %d was retired %d times\n", scenario.label, i, retired_count[i]);
+            ok = false;
+        }
+    }
+    for (int i = 0; i < source_count; i++)
+    {
+        delete sources[i];
+        delete model[i].source;
+    }
+    if (ok)
+    {
+        printf("%-48s max error %d\n", scenario.label, max_error);
+    }
+    return ok;
+}
+
+static std::vector<Scenario> scenarios()
+{
+    std::vector<Scenario> list;
+    list.push_back({"unity gain, plays until it runs out", 10, {440}, {20000}, {1000}, {{0, ATTACH, 0, 1.0, 0}}});
+    list.push_back({"two sources at 0.5 and 1.5", 10, {440, 1000}, {12000, 9000}, {-1, 1000},
+                    {{0, ATTACH, 0, 0.5, 0}, {0, ATTACH, 1, 1.5, 0}, {9, DETACH, 0, 0, 0}}});
+    list.push_back({"fade in, gain ramp, fade out", 60, {440}, {30000}, {-1},
+                    {{0, ATTACH, 0, 1.0, 1000}, {16, SET_GAIN, 0, 0.25, 500}, {24, SET_GAIN, 0, 2.0, 2000},
+                     {40, DETACH, 0, 0, 700}}});
+    list.push_back({"fade out before the fade in is done", 20, {440}, {30000}, {-1},
+                    {{0, ATTACH, 0, 1.0, 1500}, {5, DETACH, 0, 0, 300}}});
+    list.push_back({"saturation", 10, {440, 440}, {30000, 30000}, {-1, -1},
+                    {{0, ATTACH, 0, 1.0, 0}, {0, ATTACH, 1, 1.0, 0}, {9, DETACH, 0, 0, 0}, {9, DETACH, 1, 0, 0}}});
+    list.push_back({"staggered sources, fading while others end", 40, {300, 500, 700, 900}, {8000, 8000, 8000, 8000},
+                    {3000, -1, 777, -1},
+                    {{0, ATTACH, 0, 1.0, 0}, {2, ATTACH, 1, 0.7, 200}, {3, ATTACH, 2, 1.2, 100},
+                     {5, ATTACH, 3, 3.0, 0}, {10, SET_GAIN, 1, 0.1, 1000}, {20, DETACH, 3, 0, 1000},
+                     {30, DETACH, 1, 0, 0}}});
+    return list;
+}
+
+/**
+ * A control thread attaches sources with random fades and detaches them again
+ * while the writer thread mixes - every one has to come back exactly once
+ **/
+static bool check_threads()
+{
+    const int source_count = 2000;
+    MixerSource mixer;
+    std::vector<ToneSource *> sources;
+    for (int i = 0; i < source_count; i++)
+    {
+        sources.push_back(new ToneSource(200 + i % 1000, 3000, i % 3 == 0 ? 5000 : -1));
+    }
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        Frame_t frames[BLOCK_FRAMES];
+        while (!done.load())
+        {
+            if (mixer.available())
+            {
+                mixer.getFrames(frames, BLOCK_FRAMES);
+            }
+        }
+    });
+    std::vector<int> retired_count(source_count, 0);
+    int collected = 0;
+    auto collect = [&]() {
+        for (SampleSource *source = mixer.retired(); source; source = mixer.retired())
+        {
+            retired_count[std::find(sources.begin(), sources.end(), source) - sources.begin()]++;
+            collected++;
+        }
+    };
+    uint32_t seed = 1;
+    for (int i = 0; i < source_count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        while (!mixer.attach(sources[i], 0.5f, (seed >> 16) % 500))
+        {
+            collect();
+        }
+        if (i >= 4)
+        {
+            // keep a few playing and detach an older one, some of which will have already run out
+            while (!mixer.detach(sources[i - 4], (seed >> 8) % 300))
+            {
+                collect();
+            }
+        }
+        collect();
+    }
+    for (int i = source_count - 4; i < source_count; i++)
+    {
+        mixer.detach(sources[i], 0);
+    }
+    Clock::time_point start = Clock::now();
+    while (collected < source_count && Clock::now() - start < std::chrono::seconds(10))
+    {
+        collect();
+    }
+    done.store(true);
+    writer.join();
+    collect();
+    for (ToneSource *source : sources)
+    {
+        delete source;
+    }
+    for (int i = 0; i < source_count; i++)
+    {
+        if (retired_count[i] != 1)
+        {
+            fprintf(stderr, "ERROR: threads: source %d was retired %d times\n", i, retired_count[i]);
+            return false;
+        }
+    }
+    printf("%-48s all %d sources retired once\n", "attach and detach from another thread", source_count);
+    return true;
+}
+
+// ns to mix one block with source_count sources
+static double time_mix(int source_count, float gain, bool ramping, int blocks)
+{
+    MixerSource mixer;
+    std::vector<ToneSource *> sources;
+    for (int i = 0; i < source_count; i++)
+    {
+        sources.push_back(new ToneSource(300 + 100 * i, 4000));
+        mixer.attach(sources[i], gain, ramping ? blocks * BLOCK_FRAMES * 2 : 0);
+    }
+    Frame_t frames[BLOCK_FRAMES];
+    long checksum = 0;
+    mixer.getFrames(frames, BLOCK_FRAMES);
+    Clock::time_point start = Clock::now();
+    for (int block = 0; block < blocks; block++)
+    {
+        mixer.getFrames(frames, BLOCK_FRAMES);
+        checksum += frames[block % BLOCK_FRAMES].left;
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / blocks;
+    for (ToneSource *source : sources)
+    {
+        delete source;
+    }
+    // keeps the mix from being optimised away
+    if (checksum == 0x7fffffff)
+    {
+        printf(" ");
+    }
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    int blocks = argc > 1 ? atoi(argv[1]) : 20000;
+    if (blocks < 1)
+    {
+        fprintf(stderr, "Usage: %s [blocks to time]\n", argv[0]);
+        return 1;
+    }
+    bool ok = true;
+    for (const Scenario &scenario : scenarios())
+    {
+        ok = ok && run_scenario(scenario);
+    }
+    ok = ok && check_threads();
+    if (!ok)
+    {
+        return 1;
+    }
+    printf("\nns per %d frame block (%.0f us of audio)\n", BLOCK_FRAMES, 1e6 * BLOCK_FRAMES / SAMPLE_RATE);
+    printf("sources  unity gain  fixed gain  ramping\n");
+    for (int source_count = 1; source_count <= MIXER_MAX_SOURCES; source_count *= 2)
+    {
+        printf("%7d  %10.0f  %10.0f  %7.0f\n", source_count, time_mix(source_count, 1.0f, false, blocks),
+               time_mix(source_count, 0.6f, false, blocks), time_mix(source_count, 0.6f, true, blocks));
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * Host side model compiler
+ *
+ * Turns a .tflite file into the C++ source that gets linked into the
+ * neural_network component (components/neural_network/src/model.cc). Unlike
+ * `xxd -i` the emitted array is `const` and 16 byte aligned so it is placed in
+ * flash-mapped .rodata and the model costs no RAM at all.
+ *
+ * The model is verified against the bundled schema before anything is written
+ * and the weight tensors of the layers we run are listed together with the
+ * layout the kernels consume them in. The TFLite canonical layouts (OHWI for
+ * Conv2D, 1HWO for DepthwiseConv2D and OI for FullyConnected and the SVDF
+ * feature weights) are exactly what our kernels read, so the weights are
+ * emitted untouched - nothing has to be repacked when the interpreter starts.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -O2 -Icomponents/tfmicro \
+ *       -Icomponents/tfmicro/third_party/flatbuffers/include \
+ *       tools/model_compiler/model_compiler.cc -o model_compiler
+ *
+ * Usage:
+ *   ./model_compiler converted_model.tflite components/neural_network/src/model.cc
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+#include "flatbuffers/flatbuffers.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/version.h"
+
+#define ARRAY_NAME "converted_model_tflite"
+#define BYTES_PER_LINE 12
+
+static bool read_file(const char *file_name, std::vector<uint8_t> &contents)
+{
+    FILE *fp = fopen(file_name, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "ERROR: could not open %s\n", file_name);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    contents.resize(size);
+    size_t read = fread(contents.data(), 1, size, fp);
+    fclose(fp);
+    if (read != (size_t)size)
+    {
+        fprintf(stderr, "ERROR: short read on %s\n", file_name);
+        return false;
+    }
+    return true;
+}
+
+static const char *weight_layout(tflite::BuiltinOperator op)
+{
+    switch (op)
+    {
+    case tflite::BuiltinOperator_CONV_2D:
+        return "OHWI";
+    case tflite::BuiltinOperator_DEPTHWISE_CONV_2D:
+        return "1HWO";
+    case tflite::BuiltinOperator_FULLY_CONNECTED:
+    case tflite::BuiltinOperator_SVDF:
+        return "OI";
+    default:
+        return nullptr;
+    }
+}
+
+// list the weights of every layer we have a kernel layout for
+static size_t report_weights(const tflite::Model *model)
+{
+    const tflite::SubGraph *subgraph = model->subgraphs()->Get(0);
+    size_t weight_bytes = 0;
+    for (unsigned int i = 0; i < subgraph->operators()->size(); i++)
+    {
+        const tflite::Operator *op = subgraph->operators()->Get(i);
+        const tflite::OperatorCode *code = model->operator_codes()->Get(op->opcode_index());
+        tflite::BuiltinOperator builtin = static_cast<tflite::BuiltinOperator>(code->builtin_code());
+        const char *layout = weight_layout(builtin);
+        if (!layout || op->inputs()->size() < 2)
+        {
+            continue;
+        }
+        const tflite::Tensor *weights = subgraph->tensors()->Get(op->inputs()->Get(1));
+        const tflite::Buffer *buffer = model->buffers()->Get(weights->buffer());
+        size_t size = buffer->data() ? buffer->data()->size() : 0;
+        weight_bytes += size;
+        fprintf(stderr, "op %2d %-18s %-5s %-8s %6zu bytes\n", i, tflite::EnumNameBuiltinOperator(builtin),
+                layout, tflite::EnumNameTensorType(weights->type()), size);
+    }
+    return weight_bytes;
+}
+
+static bool write_source(const char *file_name, const std::vector<uint8_t> &model)
+{
+    FILE *fp = fopen(file_name, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", file_name);
+        return false;
+    }
+    fprintf(fp, "#include \"model.h\"\n\n");
+    fprintf(fp, "// const so the model stays in flash-mapped .rodata instead of being copied\n");
+    fprintf(fp, "// into RAM-backed .data at boot. Aligned for the flatbuffer scalar accesses.\n");
+    fprintf(fp, "alignas(16) const unsigned char " ARRAY_NAME "[] = {\n");
+    for (size_t i = 0; i < model.size(); i++)
+    {
+        if (i % BYTES_PER_LINE == 0)
+        {
+            fprintf(fp, "    ");
+        }
+        fprintf(fp, "0x%02x, ", model[i]);
+        if (i % BYTES_PER_LINE == BYTES_PER_LINE - 1)
+        {
+            fprintf(fp, "\n");
+        }
+    }
+    if (model.size() % BYTES_PER_LINE != 0)
+    {
+        fprintf(fp, "\n");
+    }
+    fprintf(fp, "};\n");
+    fprintf(fp, "const unsigned int " ARRAY_NAME "_len = %zu;\n", model.size());
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <model.tflite> <model.cc>\n", argv[0]);
+        return 1;
+    }
+    std::vector<uint8_t> model_data;
+    if (!read_file(argv[1], model_data))
+    {
+        return 1;
+    }
+    // make sure the flatbuffer is sound before we bake it into the firmware
+    flatbuffers::Verifier verifier(model_data.data(), model_data.size());
+    if (!tflite::VerifyModelBuffer(verifier))
+    {
+        fprintf(stderr, "ERROR: %s is not a valid TFLite model\n", argv[1]);
+        return 1;
+    }
+    const tflite::Model *model = tflite::GetModel(model_data.data());
+    if (model->version() != TFLITE_SCHEMA_VERSION)
+    {
+        fprintf(stderr, "ERROR: model is schema version %d, we support version %d\n", model->version(), TFLITE_SCHEMA_VERSION);
+        return 1;
+    }
+    if (model->subgraphs()->size() != 1)
+    {
+        fprintf(stderr, "ERROR: only models with a single subgraph are supported\n");
+        return 1;
+    }
+    size_t weight_bytes = report_weights(model);
+    if (!write_source(argv[2], model_data))
+    {
+        return 1;
+    }
+    fprintf(stderr, "Wrote %zu bytes (%zu bytes of weights) to %s\n", model_data.size(), weight_bytes, argv[2]);
+    return 0;
+}
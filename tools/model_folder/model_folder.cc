@@ -0,0 +1,398 @@
+/**
+ * Offline constant folding
+ *
+ * Folds MUL and ADD operators with a constant operand (typically the scale and
+ * offset of a batch norm the converter left in the graph) into the CONV_2D or
+ * FULLY_CONNECTED that feeds them and writes the smaller .tflite back out.
+ *
+ * Float models get the scale multiplied into the weights and bias and the
+ * offset added to the bias - the same thing FoldConstantOperators() does in
+ * the interpreter when the model is loaded. Quantized models can't be folded
+ * at load time, so this is where that happens:
+ *  - MUL by a positive constant scales the per-channel filter and bias scales,
+ *    the int8 weights and int32 bias stay as they are.
+ *  - ADD of a constant is requantized to the bias scale and added to the bias.
+ *  - the conv/fc then requantizes straight to the output of the folded op.
+ * FULLY_CONNECTED only supports per-tensor filter scales so it only takes
+ * scalar multipliers.
+ *
+ * Only operators that are the sole reader of the conv/fc output are folded,
+ * and only while the conv/fc has no fused activation of its own. The folded
+ * op's activation moves onto the conv/fc. The tensors that are no longer
+ * used stay in the tensor list, the interpreter does not allocate them.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -O2 -Icomponents/tfmicro \
+ *       -Icomponents/tfmicro/third_party/flatbuffers/include \
+ *       tools/model_folder/model_folder.cc -o model_folder
+ *
+ * Usage:
+ *   ./model_folder converted_model.tflite folded_model.tflite
+ *   ./model_compiler folded_model.tflite components/neural_network/src/model.cc
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <memory>
+#include <vector>
+
+#include "flatbuffers/flatbuffers.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+#include "tensorflow/lite/version.h"
+
+static bool read_file(const char *file_name, std::vector<uint8_t> &contents)
+{
+    FILE *fp = fopen(file_name, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "ERROR: could not open %s\n", file_name);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    contents.resize(size);
+    size_t read = fread(contents.data(), 1, size, fp);
+    fclose(fp);
+    if (read != (size_t)size)
+    {
+        fprintf(stderr, "ERROR: short read on %s\n", file_name);
+        return false;
+    }
+    return true;
+}
+
+static bool write_file(const char *file_name, const uint8_t *data, size_t size)
+{
+    FILE *fp = fopen(file_name, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "ERROR: could not open %s for writing\n", file_name);
+        return false;
+    }
+    size_t written = fwrite(data, 1, size, fp);
+    fclose(fp);
+    return written == size;
+}
+
+class Folder
+{
+private:
+    tflite::ModelT *m_model;
+    tflite::SubGraphT *m_subgraph;
+
+    tflite::BuiltinOperator opcode(const tflite::OperatorT &op)
+    {
+        return m_model->operator_codes[op.opcode_index]->builtin_code;
+    }
+
+    tflite::TensorT &tensor(int index)
+    {
+        return *m_subgraph->tensors[index];
+    }
+
+    std::vector<uint8_t> &buffer(int tensor_index)
+    {
+        return m_model->buffers[tensor(tensor_index).buffer]->data;
+    }
+
+    bool is_constant(int tensor_index)
+    {
+        return tensor_index >= 0 && !buffer(tensor_index).empty();
+    }
+
+    template <typename T>
+    T *data(int tensor_index)
+    {
+        return reinterpret_cast<T *>(buffer(tensor_index).data());
+    }
+
+    int element_count(int tensor_index)
+    {
+        int count = 1;
+        for (int dim : tensor(tensor_index).shape)
+        {
+            count *= dim;
+        }
+        return count;
+    }
+
+    tflite::ActivationFunctionType *activation(tflite::OperatorT &op)
+    {
+        switch (opcode(op))
+        {
+        case tflite::BuiltinOperator_CONV_2D:
+            return &op.builtin_options.AsConv2DOptions()->fused_activation_function;
+        case tflite::BuiltinOperator_FULLY_CONNECTED:
+            return &op.builtin_options.AsFullyConnectedOptions()->fused_activation_function;
+        case tflite::BuiltinOperator_MUL:
+            return &op.builtin_options.AsMulOptions()->fused_activation_function;
+        case tflite::BuiltinOperator_ADD:
+            return &op.builtin_options.AsAddOptions()->fused_activation_function;
+        default:
+            return nullptr;
+        }
+    }
+
+    // number of operators reading the tensor, plus one if it is a graph output
+    int reader_count(int tensor_index)
+    {
+        int count = 0;
+        for (auto &op : m_subgraph->operators)
+        {
+            for (int input : op->inputs)
+            {
+                count += input == tensor_index;
+            }
+        }
+        for (int output : m_subgraph->outputs)
+        {
+            count += output == tensor_index;
+        }
+        return count;
+    }
+
+    // the weights are modified in place so nothing else may share their buffer
+    bool is_private(int tensor_index)
+    {
+        int users = 0;
+        for (auto &t : m_subgraph->tensors)
+        {
+            users += t->buffer == tensor(tensor_index).buffer;
+        }
+        return users == 1 && reader_count(tensor_index) == 1;
+    }
+
+    int find_reader(int tensor_index)
+    {
+        for (size_t i = 0; i < m_subgraph->operators.size(); i++)
+        {
+            for (int input : m_subgraph->operators[i]->inputs)
+            {
+                if (input == tensor_index)
+                {
+                    return i;
+                }
+            }
+        }
+        return -1;
+    }
+
+    // real value of element i of a constant operand, broadcast if it is a scalar
+    float operand_value(int tensor_index, int i)
+    {
+        tflite::TensorT &t = tensor(tensor_index);
+        if (element_count(tensor_index) == 1)
+        {
+            i = 0;
+        }
+        if (t.type == tflite::TensorType_FLOAT32)
+        {
+            return data<float>(tensor_index)[i];
+        }
+        const tflite::QuantizationParametersT &q = *t.quantization;
+        return q.scale[0] * (data<int8_t>(tensor_index)[i] - q.zero_point[0]);
+    }
+
+    bool fold_float(tflite::OperatorT &producer, tflite::OperatorT &consumer, int operand, int channels)
+    {
+        int filter = producer.inputs[1];
+        int bias = producer.inputs[2];
+        int channel_size = element_count(filter) / channels;
+        float *weights = data<float>(filter);
+        float *biases = data<float>(bias);
+        for (int channel = 0; channel < channels; channel++)
+        {
+            float value = operand_value(operand, channel);
+            if (opcode(consumer) == tflite::BuiltinOperator_MUL)
+            {
+                for (int j = 0; j < channel_size; j++)
+                {
+                    weights[channel * channel_size + j] *= value;
+                }
+                biases[channel] *= value;
+            }
+            else
+            {
+                biases[channel] += value;
+            }
+        }
+        return true;
+    }
+
+    bool fold_quantized(tflite::OperatorT &producer, tflite::OperatorT &consumer, int operand, int channels)
+    {
+        tflite::QuantizationParametersT &filter_q = *tensor(producer.inputs[1]).quantization;
+        tflite::QuantizationParametersT &bias_q = *tensor(producer.inputs[2]).quantization;
+        int32_t *biases = data<int32_t>(producer.inputs[2]);
+        bool per_channel = element_count(operand) != 1;
+        if (opcode(consumer) == tflite::BuiltinOperator_MUL)
+        {
+            if (per_channel && opcode(producer) == tflite::BuiltinOperator_FULLY_CONNECTED)
+            {
+                return false;
+            }
+            for (int channel = 0; channel < channels; channel++)
+            {
+                if (operand_value(operand, channel) <= 0.0f)
+                {
+                    return false;
+                }
+            }
+            // the filter scale becomes per-channel when the multiplier is
+            if (per_channel && filter_q.scale.size() == 1)
+            {
+                filter_q.scale.resize(channels, filter_q.scale[0]);
+                filter_q.zero_point.resize(channels, filter_q.zero_point[0]);
+                bias_q.scale.resize(channels, bias_q.scale[0]);
+                bias_q.zero_point.resize(channels, bias_q.zero_point[0]);
+                filter_q.quantized_dimension = 0;
+                bias_q.quantized_dimension = 0;
+            }
+            for (size_t channel = 0; channel < filter_q.scale.size(); channel++)
+            {
+                float value = operand_value(operand, channel);
+                filter_q.scale[channel] *= value;
+                bias_q.scale[channel] *= value;
+            }
+        }
+        else
+        {
+            for (int channel = 0; channel < channels; channel++)
+            {
+                float scale = bias_q.scale[bias_q.scale.size() == 1 ? 0 : channel];
+                biases[channel] += (int32_t)lroundf(operand_value(operand, channel) / scale);
+            }
+        }
+        return true;
+    }
+
+    // folds the op reading the output of producer into it, returns false if there is none
+    bool fold_next(tflite::OperatorT &producer)
+    {
+        if (*activation(producer) != tflite::ActivationFunctionType_NONE)
+        {
+            return false;
+        }
+        int output = producer.outputs[0];
+        int consumer_index = find_reader(output);
+        if (consumer_index < 0 || reader_count(output) != 1)
+        {
+            return false;
+        }
+        tflite::OperatorT &consumer = *m_subgraph->operators[consumer_index];
+        tflite::BuiltinOperator code = opcode(consumer);
+        if ((code != tflite::BuiltinOperator_MUL && code != tflite::BuiltinOperator_ADD) ||
+            consumer.inputs.size() != 2 || consumer.outputs.size() != 1)
+        {
+            return false;
+        }
+        int operand = consumer.inputs[0] == output ? consumer.inputs[1] : consumer.inputs[0];
+        if (operand == output || !is_constant(operand))
+        {
+            return false;
+        }
+        // a scalar or one value per output channel along the last dimension
+        int channels = tensor(producer.inputs[1]).shape[0];
+        int count = element_count(operand);
+        if (count != 1 && (count != channels || tensor(operand).shape.back() != channels ||
+                           tensor(operand).shape.size() > tensor(output).shape.size()))
+        {
+            return false;
+        }
+        tflite::TensorType type = tensor(output).type;
+        bool folded = false;
+        if (type == tflite::TensorType_FLOAT32 && tensor(operand).type == type)
+        {
+            folded = fold_float(producer, consumer, operand, channels);
+        }
+        else if (type == tflite::TensorType_INT8 && tensor(operand).type == type &&
+                 tensor(operand).quantization && tensor(producer.inputs[2]).quantization)
+        {
+            folded = fold_quantized(producer, consumer, operand, channels);
+        }
+        if (!folded)
+        {
+            return false;
+        }
+        fprintf(stderr, "folded op %d %s into %s\n", consumer_index, tflite::EnumNameBuiltinOperator(code),
+                tflite::EnumNameBuiltinOperator(opcode(producer)));
+        *activation(producer) = *activation(consumer);
+        producer.outputs[0] = consumer.outputs[0];
+        m_subgraph->operators.erase(m_subgraph->operators.begin() + consumer_index);
+        return true;
+    }
+
+public:
+    Folder(tflite::ModelT *model) : m_model(model), m_subgraph(model->subgraphs[0].get())
+    {
+    }
+
+    int fold()
+    {
+        int folded = 0;
+        for (size_t i = 0; i < m_subgraph->operators.size(); i++)
+        {
+            tflite::OperatorT &producer = *m_subgraph->operators[i];
+            tflite::BuiltinOperator code = opcode(producer);
+            if ((code != tflite::BuiltinOperator_CONV_2D && code != tflite::BuiltinOperator_FULLY_CONNECTED) ||
+                producer.inputs.size() != 3 || producer.outputs.size() != 1 ||
+                !is_constant(producer.inputs[1]) || !is_constant(producer.inputs[2]) ||
+                !is_private(producer.inputs[1]) || !is_private(producer.inputs[2]))
+            {
+                continue;
+            }
+            while (fold_next(producer))
+            {
+                folded++;
+            }
+        }
+        return folded;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <model.tflite> <folded_model.tflite>\n", argv[0]);
+        return 1;
+    }
+    std::vector<uint8_t> model_data;
+    if (!read_file(argv[1], model_data))
+    {
+        return 1;
+    }
+    flatbuffers::Verifier verifier(model_data.data(), model_data.size());
+    if (!tflite::VerifyModelBuffer(verifier))
+    {
+        fprintf(stderr, "ERROR: %s is not a valid TFLite model\n", argv[1]);
+        return 1;
+    }
+    std::unique_ptr<tflite::ModelT> model = tflite::UnPackModel(model_data.data());
+    if (model->version != TFLITE_SCHEMA_VERSION || model->subgraphs.size() != 1)
+    {
+        fprintf(stderr, "ERROR: only single subgraph models of schema version %d are supported\n", TFLITE_SCHEMA_VERSION);
+        return 1;
+    }
+    Folder folder(model.get());
+    int folded = folder.fold();
+    if (folded == 0)
+    {
+        // keep the file byte for byte rather than repacking it
+        fprintf(stderr, "Nothing to fold, copying %s unchanged\n", argv[1]);
+        return write_file(argv[2], model_data.data(), model_data.size()) ? 0 : 1;
+    }
+    flatbuffers::FlatBufferBuilder builder;
+    tflite::FinishModelBuffer(builder, tflite::Model::Pack(builder, model.get()));
+    if (!write_file(argv[2], builder.GetBufferPointer(), builder.GetSize()))
+    {
+        fprintf(stderr, "ERROR: could not write %s\n", argv[2]);
+        return 1;
+    }
+    fprintf(stderr, "Folded %d operators, wrote %u bytes to %s\n", folded, builder.GetSize(), argv[2]);
+    return 0;
+}
@@ -0,0 +1,348 @@
+/**
+ * NetworkSampleSource playback check
+ *
+ * Plays responses streamed over a loopback TCP connection through
+ * NetworkSampleSource and I2SOutput, with I2SOutput running against the
+ * stand-in i2s driver (tools/i2s_output_benchmark/host) so the DMA plays
+ * samples at 16KHz in real time. A stand-in server accepts the connection,
+ * takes a while to think and then sends a response in StreamFrame.h frames,
+ * paced one of three ways:
+ *  - burst: everything as fast as the socket takes it
+ *  - jitter: each frame when it would be played, plus up to 60ms of
+ *    random delay
+ *  - stall: in real time, with the network stopping for 300ms part way
+ * for a few jitter buffer start thresholds. Each scenario checks that what
+ * was played is the decoded response in order with nothing but silence
+ * added, that every sample of it was played, and that there were no
+ * underruns wherever the threshold covers the network's jitter. It prints
+ * the time from the request to the first frame arriving and to the first
+ * sample being played, the underruns and the silence played while the
+ * buffer refilled. The program exits with an error if any of the checks
+ * fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -pthread -Itools/i2s_output_benchmark/host \
+ *       -Itools/wav_reader_benchmark/host -Icomponents/audio_output \
+ *       -Icomponents/voice_stream \
+ *       tools/network_source_benchmark/network_source_benchmark.cc \
+ *       components/audio_output/NetworkSampleSource.cpp \
+ *       components/audio_output/I2SOutput.cpp \
+ *       components/voice_stream/AudioCodec.cpp \
+ *       -o network_source_benchmark
+ *
+ * Usage:
+ *   ./network_source_benchmark [seconds of response]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "I2SOutput.h"
+#include "NetworkSampleSource.h"
+#include "AudioCodec.h"
+
+#define SAMPLE_RATE 16000
+// how long the server takes before it starts answering
+#define THINK_MS 100
+#define JITTER_MS 60
+#define STALL_MS 300
+#define CAPACITY_MS 1000
+
+typedef std::chrono::steady_clock Clock;
+
+typedef enum
+{
+    PACING_BURST,
+    PACING_JITTER,
+    PACING_STALL
+} Pacing_t;
+
+struct Scenario
+{
+    const char *label;
+    AudioCodec_t codec;
+    Pacing_t pacing;
+    int threshold_ms;
+    // -1 when it depends on luck
+    int expect_underruns;
+};
+
+static const Scenario scenarios[] = {
+    {"burst, adpcm, 60ms", AUDIO_CODEC_IMA_ADPCM, PACING_BURST, 60, 0},
+    {"burst, pcm16, 60ms", AUDIO_CODEC_PCM16, PACING_BURST, 60, 0},
+    {"jitter, adpcm, 0ms", AUDIO_CODEC_IMA_ADPCM, PACING_JITTER, 0, -1},
+    {"jitter, adpcm, 60ms", AUDIO_CODEC_IMA_ADPCM, PACING_JITTER, 60, -1},
+    {"jitter, adpcm, 120ms", AUDIO_CODEC_IMA_ADPCM, PACING_JITTER, 120, 0},
+    {"stall, adpcm, 120ms", AUDIO_CODEC_IMA_ADPCM, PACING_STALL, 120, 1},
+    {"stall, adpcm, 400ms", AUDIO_CODEC_IMA_ADPCM, PACING_STALL, 400, 0},
+};
+
+// a couple of tones that wander about - never long runs of zeros, which would look like silence
+static std::vector<int16_t> make_response(int samples)
+{
+    std::vector<int16_t> response(samples);
+    for (int i = 0; i < samples; i++)
+    {
+        double t = (double)i / SAMPLE_RATE;
+        response[i] = 6000 * sin(2 * M_PI * (220 + 40 * sin(2 * M_PI * t)) * t) + 3000 * sin(2 * M_PI * 1250 * t);
+    }
+    return response;
+}
+
+static bool send_all(int sock, const uint8_t *bytes, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(sock, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+/**
+ * Answers one request with the response, paced as the scenario says, and
+ * keeps what the device should decode each frame to
+ **/
+class StandInServer
+{
+private:
+    int m_listener;
+    uint16_t m_port;
+    std::thread m_thread;
+    std::vector<int16_t> m_expected;
+
+    void serve(int sock, const Scenario &scenario, const std::vector<int16_t> &response)
+    {
+        std::mt19937 random(1234);
+        std::uniform_int_distribution<int> jitter(0, JITTER_MS * 1000);
+        AdpcmState_t state = {0, 0};
+        uint8_t frame[STREAM_FRAME_HEADER_BYTES + STREAM_FRAME_MAX_PAYLOAD_BYTES];
+        int16_t decoded[STREAM_FRAME_SAMPLES];
+        StreamFrameHeader_t header;
+        header.type = STREAM_FRAME_AUDIO;
+        header.codec = scenario.codec;
+        header.stream = 1;
+        int frames = (response.size() + STREAM_FRAME_SAMPLES - 1) / STREAM_FRAME_SAMPLES;
+        std::this_thread::sleep_for(std::chrono::milliseconds(THINK_MS));
+        Clock::time_point start = Clock::now();
+        Clock::time_point last = start;
+        for (int i = 0; i < frames; i++)
+        {
+            int offset = i * STREAM_FRAME_SAMPLES;
+            int samples = std::min((int)response.size() - offset, STREAM_FRAME_SAMPLES);
+            int payload_bytes = audio_codec_encode(scenario.codec, &state, response.data() + offset, samples,
+                                                   frame + STREAM_FRAME_HEADER_BYTES);
+            audio_codec_decode(scenario.codec, frame + STREAM_FRAME_HEADER_BYTES, payload_bytes, decoded, samples);
+            m_expected.insert(m_expected.end(), decoded, decoded + samples);
+            header.samples = samples;
+            header.sequence = i;
+            header.timestamp = offset;
+            header.payload_bytes = payload_bytes;
+            stream_frame_write_header(frame, header);
+            if (scenario.pacing != PACING_BURST)
+            {
+                // when the frame is due to be played, taking the server's buffer as starting at nothing
+                Clock::time_point due = start + std::chrono::microseconds(1000000LL * offset / SAMPLE_RATE);
+                if (scenario.pacing == PACING_JITTER)
+                {
+                    due += std::chrono::microseconds(jitter(random));
+                }
+                if (scenario.pacing == PACING_STALL && i >= frames / 2)
+                {
+                    due += std::chrono::milliseconds(STALL_MS);
+                }
+                // TCP keeps them in order however late each one is
+                last = std::max(last, due);
+                std::this_thread::sleep_until(last);
+            }
+            if (!send_all(sock, frame, STREAM_FRAME_HEADER_BYTES + payload_bytes))
+            {
+                return;
+            }
+        }
+        header.type = STREAM_FRAME_END;
+        header.samples = 0;
+        header.sequence = frames;
+        header.timestamp = response.size();
+        header.payload_bytes = 0;
+        stream_frame_write_header(frame, header);
+        send_all(sock, frame, STREAM_FRAME_HEADER_BYTES);
+    }
+
+public:
+    StandInServer(const Scenario &scenario, const std::vector<int16_t> &response)
+    {
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = inet_addr("127.0.0.1");
+        address.sin_port = 0;
+        bind(m_listener, (struct sockaddr *)&address, sizeof(address));
+        listen(m_listener, 1);
+        socklen_t size = sizeof(address);
+        getsockname(m_listener, (struct sockaddr *)&address, &size);
+        m_port = ntohs(address.sin_port);
+        m_thread = std::thread([this, &scenario, &response]() {
+            int sock = accept(m_listener, NULL, NULL);
+            if (sock >= 0)
+            {
+                serve(sock, scenario, response);
+                close(sock);
+            }
+        });
+    }
+    ~StandInServer()
+    {
+        m_thread.join();
+        close(m_listener);
+    }
+    uint16_t port()
+    {
+        return m_port;
+    }
+    // only once the response has been sent
+    const std::vector<int16_t> &expected()
+    {
+        return m_expected;
+    }
+};
+
+static int connect_to(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr("127.0.0.1");
+    address.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static bool run(i2s_port_t port, const Scenario &scenario, const std::vector<int16_t> &response)
+{
+    NetworkSampleSource *source = new NetworkSampleSource(scenario.threshold_ms, CAPACITY_MS);
+    I2SOutput *output = new I2SOutput();
+    output->setSampleGenerator(source);
+    i2s_pin_config_t pins = {0, 0, 0, I2S_PIN_NO_CHANGE};
+    output->start(port, pins);
+    bool received;
+    {
+        StandInServer server(scenario, response);
+        // the request would go up on this connection - the response comes back down it
+        source->expectResponse();
+        int sock = connect_to(server.port());
+        received = sock >= 0 && source->receive(sock);
+        if (sock >= 0)
+        {
+            close(sock);
+        }
+        // let it play out, and a bit more for what's in the DMA buffers
+        while (!source->isFinished())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        HostI2S *i2s = host_i2s_stop(port);
+        // the writer task is left waiting for an event that will never come
+        NetworkSourceStats_t stats = source->getStats();
+
+        // what was played should be the decoded response with only silence added
+        const std::vector<int16_t> &expected = server.expected();
+        const Frame_t *played = reinterpret_cast<const Frame_t *>(i2s->played.data());
+        int played_frames = i2s->played.size() / sizeof(Frame_t);
+        size_t next = 0;
+        int silent = 0;
+        for (int i = 0; i < played_frames; i++)
+        {
+            if (played[i].left != played[i].right)
+            {
+                fprintf(stderr, "ERROR: %s: frame %d isn't mono\n", scenario.label, i);
+                return false;
+            }
+            // skip over silence in the response too, it can't be told apart from silence put in
+            while (next < expected.size() && expected[next] == 0)
+            {
+                next++;
+            }
+            if (played[i].left == 0)
+            {
+                silent++;
+                continue;
+            }
+            if (next == expected.size() || played[i].left != expected[next])
+            {
+                fprintf(stderr, "ERROR: %s: frame %d played %d, expected sample %d\n", scenario.label, i,
+                        played[i].left, (int)next);
+                return false;
+            }
+            next++;
+        }
+        while (next < expected.size() && expected[next] == 0)
+        {
+            next++;
+        }
+        // the DMA only runs out if the writer task can't keep up, which tools/i2s_output_benchmark looks at
+        printf("%-22s first frame %6.1f ms  first audio %6.1f ms  %3u underruns %6.1f ms refilling  "
+               "%4.0f ms most buffered  %5d silent frames  %u DMA underruns\n",
+               scenario.label, stats.first_frame_us / 1000.0, stats.first_audio_us / 1000.0, stats.underruns,
+               stats.underrun_samples * 1000.0 / SAMPLE_RATE, stats.max_buffered * 1000.0 / SAMPLE_RATE, silent,
+               i2s->underruns);
+        if (!received || stats.samples != response.size() || stats.bad_frames > 0 || stats.gap_samples > 0)
+        {
+            fprintf(stderr, "ERROR: %s: received %u of %u samples, %u bad frames, %u gap samples\n", scenario.label,
+                    stats.samples, (unsigned)response.size(), stats.bad_frames, stats.gap_samples);
+            return false;
+        }
+        if (next != expected.size())
+        {
+            fprintf(stderr, "ERROR: %s: only played %d of %d samples\n", scenario.label, (int)next,
+                    (int)expected.size());
+            return false;
+        }
+        if (scenario.expect_underruns >= 0 && (stats.underruns > 0) != (scenario.expect_underruns > 0))
+        {
+            fprintf(stderr, "ERROR: %s: %u underruns\n", scenario.label, stats.underruns);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2;
+    if (seconds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [seconds of response]\n", argv[0]);
+        return 1;
+    }
+    std::vector<int16_t> response = make_response(seconds * SAMPLE_RATE);
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]) && ok; i++)
+    {
+        ok = run(i, scenarios[i], response);
+    }
+    fflush(stdout);
+    // the writer tasks never return - leave without waiting for them
+    _exit(ok ? 0 : 1);
+}
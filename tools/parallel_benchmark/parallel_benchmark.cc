@@ -0,0 +1,230 @@
+/**
+ * Per layer latency of the model with the kernels split across workers
+ *
+ * Runs the bundled model (components/neural_network/src/model.cc) with the
+ * same op resolver as NeuralNetwork, first on a single thread and then with a
+ * WorkerPool of 2..N workers, and prints the average time spent in every
+ * layer for each. The output of every run is checked against the single
+ * threaded one - splitting the layers must not change a single bit.
+ *
+ * The host WorkerPool uses std::threads, so the speedups only mean something
+ * with that many free cores.
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro
+ *   g++ -std=c++11 -O2 -fno-exceptions -DTF_LITE_STATIC_MEMORY -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       -I$R/third_party/ruy -Icomponents/neural_network/src \
+ *       tools/parallel_benchmark/parallel_benchmark.cc \
+ *       components/neural_network/src/WorkerPool.cpp \
+ *       components/neural_network/src/model.cc \
+ *       $(sed -n 's/^  SRCS //p' $R/CMakeLists.txt | tr ' ' '\n' | sed "s|^|$R/|") \
+ *       -lpthread -o parallel_benchmark
+ *
+ * Usage:
+ *   ./parallel_benchmark [max workers] [invocations]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "WorkerPool.h"
+#include "model.h"
+#include "tensorflow/lite/core/api/profiler.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#define ARENA_SIZE 40000
+#define MAX_LAYERS 32
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Adds up the time spent in each operator the interpreter invokes
+ **/
+class LayerProfiler : public tflite::Profiler
+{
+private:
+    Clock::time_point m_start;
+    int m_layer;
+
+public:
+    const char *names[MAX_LAYERS];
+    double total_us[MAX_LAYERS];
+
+    LayerProfiler()
+    {
+        memset(names, 0, sizeof(names));
+        memset(total_us, 0, sizeof(total_us));
+        m_layer = 0;
+    }
+    uint32_t BeginEvent(const char *tag, EventType event_type, int64_t event_metadata1,
+                        int64_t event_metadata2) override
+    {
+        m_layer = (int)event_metadata1;
+        if (m_layer < MAX_LAYERS)
+        {
+            names[m_layer] = tag;
+        }
+        m_start = Clock::now();
+        return 0;
+    }
+    void EndEvent(uint32_t event_handle) override
+    {
+        if (m_layer < MAX_LAYERS)
+        {
+            total_us[m_layer] += std::chrono::duration<double, std::micro>(Clock::now() - m_start).count();
+        }
+    }
+};
+
+struct Result
+{
+    double layer_us[MAX_LAYERS];
+    const char *names[MAX_LAYERS];
+    double total_us;
+    size_t arena_bytes;
+    std::vector<float> output;
+};
+
+static bool run_model(int workers, int invocations, Result &result)
+{
+    alignas(16) static uint8_t tensor_arena[ARENA_SIZE];
+    tflite::MicroErrorReporter error_reporter;
+    const tflite::Model *model = tflite::GetModel(converted_model_tflite);
+
+    // same as NeuralNetwork
+    tflite::MicroMutableOpResolver<11> resolver;
+    resolver.AddConv2D();
+    resolver.AddMaxPool2D();
+    resolver.AddConv2DMaxPool2D();
+    resolver.AddDepthwiseConv2D();
+    resolver.AddFullyConnected();
+    resolver.AddMul();
+    resolver.AddAdd();
+    resolver.AddLogistic();
+    resolver.AddReshape();
+    resolver.AddQuantize();
+    resolver.AddDequantize();
+
+    LayerProfiler profiler;
+    WorkerPool pool(workers);
+    tflite::MicroInterpreter interpreter(model, resolver, tensor_arena, ARENA_SIZE, &error_reporter, &profiler);
+    if (workers > 1)
+    {
+        interpreter.SetExternalContext(kTfLiteCpuBackendContext, pool.external_context());
+    }
+    if (interpreter.AllocateTensors() != kTfLiteOk)
+    {
+        fprintf(stderr, "ERROR: AllocateTensors() failed with %d workers\n", workers);
+        return false;
+    }
+    result.arena_bytes = interpreter.arena_used_bytes();
+
+    // the same pseudo random spectrogram every time
+    TfLiteTensor *input = interpreter.input(0);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < input->bytes / sizeof(float); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        input->data.f[i] = -6.0f + 7.0f * ((seed >> 8) & 0xffff) / 65535.0f;
+    }
+
+    // warm up, then only count the timed invocations
+    interpreter.Invoke();
+    memset(profiler.total_us, 0, sizeof(profiler.total_us));
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < invocations; i++)
+    {
+        interpreter.Invoke();
+    }
+    result.total_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / invocations;
+    for (int i = 0; i < MAX_LAYERS; i++)
+    {
+        result.layer_us[i] = profiler.total_us[i] / invocations;
+        result.names[i] = profiler.names[i];
+    }
+    TfLiteTensor *output = interpreter.output(0);
+    result.output.assign(output->data.f, output->data.f + output->bytes / sizeof(float));
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int max_workers = argc > 1 ? atoi(argv[1]) : 2;
+    int invocations = argc > 2 ? atoi(argv[2]) : 200;
+    if (max_workers < 1 || invocations < 1)
+    {
+        fprintf(stderr, "Usage: %s [max workers] [invocations]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Result> results(max_workers);
+    // one untimed round so the first configuration doesn't pay for a cold cache
+    if (!run_model(1, invocations, results[0]))
+    {
+        return 1;
+    }
+    for (int workers = 1; workers <= max_workers; workers++)
+    {
+        if (!run_model(workers, invocations, results[workers - 1]))
+        {
+            return 1;
+        }
+    }
+
+    printf("%-4s %-22s", "op", "");
+    for (int workers = 1; workers <= max_workers; workers++)
+    {
+        printf(" %6d worker%s", workers, workers == 1 ? " " : "s");
+    }
+    printf("\n");
+    for (int layer = 0; layer < MAX_LAYERS; layer++)
+    {
+        if (!results[0].names[layer])
+        {
+            continue;
+        }
+        printf("%-4d %-22s", layer, results[0].names[layer]);
+        for (int workers = 1; workers <= max_workers; workers++)
+        {
+            const Result &result = results[workers - 1];
+            if (workers == 1)
+            {
+                printf(" %9.1f us    ", result.layer_us[layer]);
+            }
+            else
+            {
+                printf(" %9.1f us %4.2fx", result.layer_us[layer], results[0].layer_us[layer] / result.layer_us[layer]);
+            }
+        }
+        printf("\n");
+    }
+    printf("%-27s", "total");
+    for (int workers = 1; workers <= max_workers; workers++)
+    {
+        printf(" %9.1f us    ", results[workers - 1].total_us);
+    }
+    printf("\n%-27s", "arena");
+    for (int workers = 1; workers <= max_workers; workers++)
+    {
+        printf(" %9zu bytes ", results[workers - 1].arena_bytes);
+    }
+    printf("\n");
+
+    for (int workers = 2; workers <= max_workers; workers++)
+    {
+        if (results[workers - 1].output != results[0].output)
+        {
+            fprintf(stderr, "ERROR: output with %d workers differs from the single threaded output\n", workers);
+            return 1;
+        }
+    }
+    printf("outputs identical for 1..%d workers\n", max_workers);
+    return 0;
+}
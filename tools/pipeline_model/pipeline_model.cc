@@ -0,0 +1,264 @@
+/**
+ * Host model of the pipelined wake word detector
+ *
+ * Runs the real front end (AudioProcessor) and the real network
+ * (NeuralNetwork) the way start_wake_word_task() does with
+ * USE_PIPELINED_WAKE_WORD - one thread producing spectrogram windows into a
+ * FeatureQueue and one thread classifying them - and compares it with running
+ * the two stages one after the other. The std::threads stand in for the two
+ * pinned FreeRTOS tasks, so on a host with at least two free cores the
+ * numbers show how much of the serial time the pipeline hides.
+ *
+ * Without a period the front end runs flat out (waiting when the queue is
+ * full), which shows the throughput bound: the busier stage should sit close
+ * to 100% and windows per second should follow the slower stage rather than
+ * the sum of both. With a period the front end is woken every period ms like
+ * the i2s reader wakes it on the device and drops windows when inference falls
+ * behind.
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro
+ *   g++ -std=c++11 -O2 -fno-exceptions -DTF_LITE_STATIC_MEMORY -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       -I$R/third_party/ruy \
+ *       -Icomponents/neural_network/src -Icomponents/audio_processor/src \
+ *       -Icomponents/audio_processor/src/kissfft -Icomponents/audio_input \
+ *       tools/pipeline_model/pipeline_model.cc \
+ *       components/neural_network/src/NeuralNetwork.cpp \
+ *       components/neural_network/src/WorkerPool.cpp \
+ *       components/neural_network/src/model.cc \
+ *       components/audio_processor/src/AudioProcessor.cpp \
+ *       components/audio_processor/src/HammingWindow.cpp \
+ *       components/audio_processor/src/kissfft/kiss_fft.c \
+ *       components/audio_processor/src/kissfft/tools/kiss_fftr.c \
+ *       $(sed -n 's/^  SRCS //p' $R/CMakeLists.txt | tr ' ' '\n' | sed "s|^|$R/|") \
+ *       -lpthread -o pipeline_model
+ *
+ * Usage:
+ *   ./pipeline_model [windows] [period ms]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "AudioProcessor.h"
+#include "FeatureQueue.h"
+#include "NeuralNetwork.h"
+#include "RingBuffer.h"
+
+// same as DetectWakeWordState and the i2s sampler
+#define WINDOW_SIZE 320
+#define STEP_SIZE 160
+#define POOLING_SIZE 6
+#define AUDIO_LENGTH 16000
+#define AUDIO_BUFFER_COUNT 11
+// same as start_wake_word_task
+#define FEATURE_QUEUE_SLOTS 2
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/**
+ * Stands in for the i2s sampler - every call to fill adds another
+ * SAMPLE_BUFFER_SIZE samples of a tone in noise to the ring buffer
+ **/
+class AudioSource
+{
+private:
+    AudioBuffer *m_audio_buffers[AUDIO_BUFFER_COUNT];
+    RingBufferAccessor *m_writer;
+    uint32_t m_seed;
+    int m_sample_count;
+
+public:
+    AudioSource()
+    {
+        for (int i = 0; i < AUDIO_BUFFER_COUNT; i++)
+        {
+            m_audio_buffers[i] = new AudioBuffer();
+        }
+        m_writer = new RingBufferAccessor(m_audio_buffers, AUDIO_BUFFER_COUNT);
+        m_seed = 1;
+        m_sample_count = 0;
+        for (int i = 0; i < AUDIO_BUFFER_COUNT; i++)
+        {
+            fill();
+        }
+    }
+    ~AudioSource()
+    {
+        delete m_writer;
+        for (int i = 0; i < AUDIO_BUFFER_COUNT; i++)
+        {
+            delete m_audio_buffers[i];
+        }
+    }
+    void fill()
+    {
+        for (int i = 0; i < SAMPLE_BUFFER_SIZE; i++)
+        {
+            m_seed = m_seed * 1103515245 + 12345;
+            float noise = (float)((m_seed >> 16) & 0x7fff) - 16384.0f;
+            float tone = 8000.0f * sinf(2.0f * (float)M_PI * 440.0f * m_sample_count / 16000.0f);
+            m_writer->setCurrentSample((int16_t)(0.1f * noise + tone));
+            m_writer->moveToNextSample();
+            m_sample_count = (m_sample_count + 1) % 16000;
+        }
+    }
+    // a reader over the last second of audio, like I2SSampler::getRingBufferReader + rewind
+    RingBufferAccessor *getReader()
+    {
+        RingBufferAccessor *reader = new RingBufferAccessor(m_audio_buffers, AUDIO_BUFFER_COUNT);
+        reader->setIndex(m_writer->getIndex());
+        reader->rewind(AUDIO_LENGTH);
+        return reader;
+    }
+};
+
+struct StageStats
+{
+    double busy_ms;
+    int windows;
+};
+
+static void run_serial(AudioSource *audio, AudioProcessor *audio_processor, NeuralNetwork *nn, int windows)
+{
+    StageStats front_end = {0, 0};
+    StageStats inference = {0, 0};
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < windows; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        audio->fill();
+        RingBufferAccessor *reader = audio->getReader();
+        audio_processor->get_spectrogram(reader, nn->getInputBuffer());
+        delete reader;
+        Clock::time_point t1 = Clock::now();
+        nn->predict();
+        Clock::time_point t2 = Clock::now();
+        front_end.busy_ms += elapsed_ms(t0, t1);
+        inference.busy_ms += elapsed_ms(t1, t2);
+    }
+    double wall_ms = elapsed_ms(start, Clock::now());
+    printf("serial     %7.1f windows/s  front end %6.3f ms  inference %6.3f ms  latency %6.3f ms\n",
+           1000.0 * windows / wall_ms, front_end.busy_ms / windows, inference.busy_ms / windows,
+           wall_ms / windows);
+}
+
+static void run_pipelined(AudioSource *audio, AudioProcessor *audio_processor, NeuralNetwork *nn, int windows,
+                          double period_ms)
+{
+    FeatureQueue queue(FEATURE_QUEUE_SLOTS, nn->getInputSize());
+    // when each queued window was published, as s_window_ready_time on the device
+    Clock::time_point ready_time[FEATURE_QUEUE_SLOTS];
+    std::atomic<bool> front_end_done(false);
+    StageStats front_end = {0, 0};
+    StageStats inference = {0, 0};
+    int dropped = 0;
+    double latency_ms = 0;
+
+    Clock::time_point start = Clock::now();
+    std::thread front_end_thread([&]() {
+        Clock::time_point next_wake = start;
+        for (int i = 0; i < windows; i++)
+        {
+            if (period_ms > 0)
+            {
+                // wait for the next buffer of audio
+                next_wake += std::chrono::microseconds((int64_t)(period_ms * 1000));
+                std::this_thread::sleep_until(next_wake);
+            }
+            audio->fill();
+            float *features = queue.beginWrite();
+            while (!features && period_ms <= 0)
+            {
+                std::this_thread::yield();
+                features = queue.beginWrite();
+            }
+            if (!features)
+            {
+                dropped++;
+                continue;
+            }
+            Clock::time_point t0 = Clock::now();
+            RingBufferAccessor *reader = audio->getReader();
+            audio_processor->get_spectrogram(reader, features);
+            delete reader;
+            Clock::time_point t1 = Clock::now();
+            ready_time[front_end.windows % FEATURE_QUEUE_SLOTS] = t1;
+            queue.commitWrite();
+            front_end.busy_ms += elapsed_ms(t0, t1);
+            front_end.windows++;
+        }
+        front_end_done = true;
+    });
+    std::thread inference_thread([&]() {
+        while (true)
+        {
+            const float *features = queue.beginRead();
+            if (!features)
+            {
+                if (front_end_done && !queue.beginRead())
+                {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            Clock::time_point t0 = Clock::now();
+            Clock::time_point ready = ready_time[inference.windows % FEATURE_QUEUE_SLOTS];
+            memcpy(nn->getInputBuffer(), features, sizeof(float) * nn->getInputSize());
+            nn->predict();
+            queue.endRead();
+            Clock::time_point t1 = Clock::now();
+            inference.busy_ms += elapsed_ms(t0, t1);
+            latency_ms += elapsed_ms(ready, t1);
+            inference.windows++;
+        }
+    });
+    front_end_thread.join();
+    inference_thread.join();
+    double wall_ms = elapsed_ms(start, Clock::now());
+
+    printf("pipelined  %7.1f windows/s  front end %6.3f ms (%5.1f%% busy)  inference %6.3f ms (%5.1f%% busy)  "
+           "latency %6.3f ms  dropped %d\n",
+           1000.0 * inference.windows / wall_ms, front_end.busy_ms / front_end.windows,
+           100.0 * front_end.busy_ms / wall_ms, inference.busy_ms / inference.windows,
+           100.0 * inference.busy_ms / wall_ms,
+           front_end.busy_ms / front_end.windows + latency_ms / inference.windows, dropped);
+}
+
+int main(int argc, char **argv)
+{
+    int windows = argc > 1 ? atoi(argv[1]) : 200;
+    double period_ms = argc > 2 ? atof(argv[2]) : 0;
+    if (windows <= 0)
+    {
+        fprintf(stderr, "Usage: %s [windows] [period ms]\n", argv[0]);
+        return 1;
+    }
+
+    AudioSource audio;
+    AudioProcessor audio_processor(AUDIO_LENGTH, WINDOW_SIZE, STEP_SIZE, POOLING_SIZE);
+    NeuralNetwork nn;
+
+    // warm up the caches
+    for (int i = 0; i < 10; i++)
+    {
+        nn.predict();
+    }
+    printf("%d windows, %s\n", windows, period_ms > 0 ? "front end woken every period" : "front end running flat out");
+    run_serial(&audio, &audio_processor, &nn, windows);
+    run_pipelined(&audio, &audio_processor, &nn, windows, period_ms);
+    return 0;
+}
@@ -0,0 +1,419 @@
+/**
+ * ServerConnection check
+ *
+ * Runs ServerConnection against a stand-in server on the loopback interface
+ * that answers heartbeats after an injected delay and can be told to drop
+ * its connections, stop answering or stop listening altogether. With
+ * heartbeats every 100ms and a 300ms timeout it goes through:
+ *  - a steady 20ms round trip, which the smoothed RTT has to settle on
+ *  - 50-110ms of jitter, which has to show in the mean deviation
+ *  - an upload on the open socket lasting several heartbeat intervals, which
+ *    the server has to receive intact with no heartbeats in the middle of it
+ *  - the server closing the connection, the server going quiet, and the
+ *    server going away for a few seconds - each has to be noticed and the
+ *    connection made again, with the backoff growing while it can't be
+ *  - an upload failing, after which the connection has to be made again
+ * and prints the time taken to reconnect and the connection's stats along
+ * the way. The program exits with an error if any of the checks fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -pthread -Itools/i2s_output_benchmark/host \
+ *       -Icomponents/voice_stream \
+ *       tools/server_connection_benchmark/server_connection_benchmark.cc \
+ *       components/voice_stream/ServerConnection.cpp \
+ *       components/voice_stream/StreamSocket.cpp \
+ *       -o server_connection_benchmark
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ServerConnection.h"
+#include "StreamFrame.h"
+#include "StreamSocket.h"
+
+#define HEARTBEAT_MS 100
+#define HEARTBEAT_TIMEOUT_MS 300
+#define UPLOAD_FRAMES 50
+#define UPLOAD_FRAME_INTERVAL_MS 10
+
+typedef std::chrono::steady_clock Clock;
+
+static double ms_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/**
+ * Answers pings with pongs after latency_ms plus up to jitter_ms, and keeps
+ * track of the streams sent to it - a frame that doesn't parse or a ping in
+ * the middle of a stream is an error
+ **/
+class StandInServer
+{
+private:
+    uint16_t m_port;
+    int m_listener;
+    std::thread m_acceptor;
+    std::mutex m_mutex;
+    std::vector<int> m_socks;
+    std::vector<std::thread> m_connections;
+    std::vector<std::string> m_errors;
+    uint32_t m_accepted;
+    uint32_t m_streams;
+    uint32_t m_stream_frames;
+
+    void error(const std::string &message)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_errors.push_back(message);
+    }
+
+    void serve(int sock, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        uint8_t header_bytes[STREAM_FRAME_HEADER_BYTES];
+        uint8_t payload[STREAM_FRAME_MAX_PAYLOAD_BYTES];
+        bool in_stream = false;
+        uint32_t frames = 0;
+        StreamFrameHeader_t header;
+        while (stream_socket_receive(sock, header_bytes, STREAM_FRAME_HEADER_BYTES))
+        {
+            if (!stream_frame_read_header(header_bytes, &header) ||
+                !stream_socket_receive(sock, payload, header.payload_bytes))
+            {
+                error("bad frame");
+                break;
+            }
+            if (header.type == STREAM_FRAME_PING)
+            {
+                if (in_stream)
+                {
+                    error("heartbeat in the middle of a stream");
+                }
+                if (!answering.load())
+                {
+                    continue;
+                }
+                std::uniform_int_distribution<int> jitter(0, jitter_ms.load() * 1000);
+                int delay_us = latency_ms.load() * 1000 + jitter(random);
+                std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+                header.type = STREAM_FRAME_PONG;
+                stream_frame_write_header(header_bytes, header);
+                stream_socket_send(sock, header_bytes, STREAM_FRAME_HEADER_BYTES);
+            }
+            else if (header.type == STREAM_FRAME_AUDIO)
+            {
+                if (header.sequence != frames)
+                {
+                    error("frame out of order");
+                }
+                in_stream = true;
+                frames++;
+            }
+            else if (header.type == STREAM_FRAME_END)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_streams++;
+                m_stream_frames = frames;
+                in_stream = false;
+                frames = 0;
+            }
+        }
+    }
+
+    void listen()
+    {
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = inet_addr("127.0.0.1");
+        address.sin_port = htons(m_port);
+        if (bind(m_listener, (struct sockaddr *)&address, sizeof(address)) != 0)
+        {
+            error("can't listen");
+        }
+        ::listen(m_listener, 4);
+        socklen_t size = sizeof(address);
+        getsockname(m_listener, (struct sockaddr *)&address, &size);
+        m_port = ntohs(address.sin_port);
+        m_acceptor = std::thread([this]() {
+            int sock;
+            while ((sock = accept(m_listener, NULL, NULL)) >= 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_accepted++;
+                m_socks.push_back(sock);
+                m_connections.push_back(std::thread(&StandInServer::serve, this, sock, m_accepted));
+            }
+        });
+    }
+
+public:
+    std::atomic<int> latency_ms;
+    std::atomic<int> jitter_ms;
+    std::atomic<bool> answering;
+
+    StandInServer() : m_port(0), m_accepted(0), m_streams(0), m_stream_frames(0)
+    {
+        latency_ms.store(0);
+        jitter_ms.store(0);
+        answering.store(true);
+        listen();
+    }
+    ~StandInServer()
+    {
+        stopListening();
+        dropConnections();
+    }
+    uint16_t port()
+    {
+        return m_port;
+    }
+    // closes every connection as though the server had gone away
+    void dropConnections()
+    {
+        std::vector<std::thread> connections;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (int sock : m_socks)
+            {
+                shutdown(sock, SHUT_RDWR);
+            }
+            connections.swap(m_connections);
+        }
+        for (std::thread &connection : connections)
+        {
+            connection.join();
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int sock : m_socks)
+        {
+            close(sock);
+        }
+        m_socks.clear();
+    }
+    // connections are refused until it starts listening again, on the same port
+    void stopListening()
+    {
+        if (m_listener >= 0)
+        {
+            shutdown(m_listener, SHUT_RDWR);
+            close(m_listener);
+            m_acceptor.join();
+            m_listener = -1;
+        }
+    }
+    void startListening()
+    {
+        listen();
+    }
+    uint32_t accepted()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_accepted;
+    }
+    uint32_t streams(uint32_t *frames)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        *frames = m_stream_frames;
+        return m_streams;
+    }
+    std::vector<std::string> errors()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_errors;
+    }
+};
+
+static bool wait_for_connection(ServerConnection &connection, bool connected, int timeout_ms)
+{
+    Clock::time_point start = Clock::now();
+    while (connection.isConnected() != connected)
+    {
+        if (ms_since(start) > timeout_ms)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+static void print_stats(const char *label, ServerConnection &connection)
+{
+    ServerConnectionStats_t stats = connection.getStats();
+    printf("%-28s rtt %6.1f ms  srtt %6.1f ms  jitter %5.1f ms  %3u heartbeats %u missed  %u connects %2u failed "
+           "%u disconnects  backoff %5u ms\n",
+           label, stats.last_rtt_us / 1000.0, stats.srtt_us / 1000.0, stats.rtt_var_us / 1000.0, stats.heartbeats,
+           stats.missed_heartbeats, stats.connects, stats.failed_connects, stats.disconnects, stats.backoff_ms);
+}
+
+#define CHECK(condition, ...)                    \
+    if (!(condition))                            \
+    {                                            \
+        fprintf(stderr, "ERROR: " __VA_ARGS__); \
+        fprintf(stderr, "\n");                   \
+        return false;                            \
+    }
+
+static bool send_stream(int sock, uint16_t stream)
+{
+    uint8_t frame[STREAM_FRAME_HEADER_BYTES + STREAM_FRAME_MAX_PAYLOAD_BYTES];
+    memset(frame, 0, sizeof(frame));
+    StreamFrameHeader_t header;
+    header.type = STREAM_FRAME_AUDIO;
+    header.codec = 0;
+    header.stream = stream;
+    header.samples = STREAM_FRAME_SAMPLES;
+    header.payload_bytes = STREAM_FRAME_MAX_PAYLOAD_BYTES;
+    for (int i = 0; i < UPLOAD_FRAMES; i++)
+    {
+        header.sequence = i;
+        header.timestamp = i * STREAM_FRAME_SAMPLES;
+        stream_frame_write_header(frame, header);
+        if (!stream_socket_send(sock, frame, sizeof(frame)))
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(UPLOAD_FRAME_INTERVAL_MS));
+    }
+    header.type = STREAM_FRAME_END;
+    header.samples = 0;
+    header.sequence = UPLOAD_FRAMES;
+    header.timestamp = UPLOAD_FRAMES * STREAM_FRAME_SAMPLES;
+    header.payload_bytes = 0;
+    stream_frame_write_header(frame, header);
+    return stream_socket_send(sock, frame, STREAM_FRAME_HEADER_BYTES);
+}
+
+static bool run(StandInServer &server, ServerConnection &connection)
+{
+    Clock::time_point start = Clock::now();
+    server.latency_ms.store(20);
+    connection.setServer(inet_addr("127.0.0.1"));
+    CHECK(wait_for_connection(connection, true, 1000), "didn't connect");
+    printf("connected after %.1f ms\n", ms_since(start));
+
+    // steady round trip
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    print_stats("steady 20ms", connection);
+    ServerConnectionStats_t stats = connection.getStats();
+    CHECK(stats.heartbeats >= 8, "only %u heartbeats answered", stats.heartbeats);
+    CHECK(stats.srtt_us > 18000 && stats.srtt_us < 30000, "smoothed rtt %u us for a 20ms round trip", stats.srtt_us);
+    CHECK(stats.rtt_var_us < 5000, "rtt deviation %u us with no jitter", stats.rtt_var_us);
+
+    // jitter
+    server.latency_ms.store(50);
+    server.jitter_ms.store(60);
+    std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+    print_stats("50-110ms", connection);
+    stats = connection.getStats();
+    CHECK(stats.srtt_us > 55000 && stats.srtt_us < 105000, "smoothed rtt %u us for a 50-110ms round trip",
+          stats.srtt_us);
+    CHECK(stats.rtt_var_us > 5000, "rtt deviation %u us with 60ms of jitter", stats.rtt_var_us);
+    CHECK(stats.disconnects == 0, "%u disconnects", stats.disconnects);
+    server.latency_ms.store(5);
+    server.jitter_ms.store(0);
+
+    // an upload going out on the open connection, for longer than a few heartbeats
+    Clock::time_point acquire_start = Clock::now();
+    int sock = connection.acquire(pdMS_TO_TICKS(1000));
+    double acquire_ms = ms_since(acquire_start);
+    CHECK(sock >= 0, "couldn't have the connection");
+    bool sent = send_stream(sock, 1);
+    connection.release(sent);
+    CHECK(sent, "upload failed");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint32_t frames;
+    uint32_t streams = server.streams(&frames);
+    printf("upload                       connection had after %.2f ms, %u frames received\n", acquire_ms, frames);
+    CHECK(streams == 1 && frames == UPLOAD_FRAMES, "%u streams received, %u frames in the last", streams, frames);
+    CHECK(server.accepted() == 1, "%u connections for one upload", server.accepted());
+
+    // the server closing the connection
+    server.dropConnections();
+    start = Clock::now();
+    CHECK(wait_for_connection(connection, false, 500), "didn't notice the server closing the connection");
+    double noticed_ms = ms_since(start);
+    CHECK(wait_for_connection(connection, true, 1000), "didn't reconnect");
+    printf("server closing               noticed after %6.1f ms, reconnected after %6.1f ms\n", noticed_ms,
+           ms_since(start));
+
+    // the server going quiet
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    server.answering.store(false);
+    start = Clock::now();
+    CHECK(wait_for_connection(connection, false, HEARTBEAT_MS + HEARTBEAT_TIMEOUT_MS + 200),
+          "didn't notice the heartbeats going unanswered");
+    noticed_ms = ms_since(start);
+    server.answering.store(true);
+    CHECK(wait_for_connection(connection, true, 1000), "didn't reconnect");
+    printf("server quiet                 noticed after %6.1f ms, reconnected after %6.1f ms\n", noticed_ms,
+           ms_since(start));
+    stats = connection.getStats();
+    CHECK(stats.missed_heartbeats == 1, "%u missed heartbeats", stats.missed_heartbeats);
+
+    // the server going away altogether - the backoff should grow while it can't be reached
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint32_t failed = stats.failed_connects;
+    server.stopListening();
+    server.dropConnections();
+    CHECK(wait_for_connection(connection, false, 500), "didn't notice the server going away");
+    std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+    print_stats("server away 3s", connection);
+    stats = connection.getStats();
+    CHECK(stats.failed_connects - failed >= 3 && stats.failed_connects - failed <= 5,
+          "%u attempts in 3s", stats.failed_connects - failed);
+    CHECK(stats.backoff_ms >= 1000, "backoff only got to %u ms", stats.backoff_ms);
+    server.startListening();
+    start = Clock::now();
+    CHECK(wait_for_connection(connection, true, 2 * stats.backoff_ms + 500), "didn't reconnect");
+    printf("server back                  reconnected after %6.1f ms\n", ms_since(start));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    // the backoff is back to the shortest once the server answers, so an upload failing is got over quickly
+    uint32_t disconnects = connection.getStats().disconnects;
+    sock = connection.acquire(pdMS_TO_TICKS(1000));
+    CHECK(sock >= 0, "couldn't have the connection");
+    connection.release(false);
+    start = Clock::now();
+    CHECK(wait_for_connection(connection, false, 500), "kept the connection an upload failed on");
+    CHECK(wait_for_connection(connection, true, 1000), "didn't reconnect");
+    printf("upload failing               reconnected after %6.1f ms\n", ms_since(start));
+    stats = connection.getStats();
+    CHECK(stats.disconnects == disconnects + 1, "%u disconnects", stats.disconnects - disconnects);
+    print_stats("end", connection);
+
+    std::vector<std::string> errors = server.errors();
+    for (const std::string &error : errors)
+    {
+        fprintf(stderr, "ERROR: server: %s\n", error.c_str());
+    }
+    return errors.empty();
+}
+
+int main(int argc, char **argv)
+{
+    StandInServer *server = new StandInServer();
+    ServerConnection *connection = new ServerConnection(server->port(), HEARTBEAT_MS, HEARTBEAT_TIMEOUT_MS);
+    connection->start(1);
+    bool ok = run(*server, *connection);
+    fflush(stdout);
+    // the connection task never returns - leave without waiting for it
+    _exit(ok ? 0 : 1);
+}
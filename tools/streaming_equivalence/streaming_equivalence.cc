@@ -0,0 +1,240 @@
+/**
+ * Streaming Conv2D/MaxPool2D equivalence check
+ *
+ * Runs the bundled model (components/neural_network/src/model.cc) twice side
+ * by side - once with the default CONV_2D and MAX_POOL_2D kernels, which
+ * compute every window from scratch, and once with
+ * Register_CONV_2D_STREAMING() and Register_MAX_POOL_2D_STREAMING(), which
+ * copy the output rows they can from the previous invocation. Both are fed
+ * the same windows of a pseudo random spectrogram sliding down by a schedule
+ * of hops - the usual one, single rows, shifts that aren't a multiple of the
+ * pooling stride, a repeat of the same window and a jump with no overlap at
+ * all - until the window has moved on by STREAMED_WINDOWS whole windows.
+ *
+ * The output of every layer is recorded as it finishes (before the arena
+ * reuses its memory) and compared byte for byte with the full recompute.
+ * Any difference is reported with the hop and layer it was in and the
+ * program exits with an error.
+ *
+ * The streaming kernels are only compiled in with TF_LITE_MICRO_STREAMING_ROWS
+ * defined - the firmware doesn't register them.
+ *
+ * Build (from the repository root):
+ *   R=components/tfmicro
+ *   g++ -std=c++11 -O2 -fno-exceptions -DTF_LITE_STATIC_MEMORY \
+ *       -DTF_LITE_MICRO_STREAMING_ROWS -I$R \
+ *       -I$R/third_party/gemmlowp -I$R/third_party/flatbuffers/include \
+ *       -I$R/third_party/ruy -Icomponents/neural_network/src \
+ *       tools/streaming_equivalence/streaming_equivalence.cc \
+ *       components/neural_network/src/model.cc \
+ *       $(sed -n 's/^  SRCS //p' $R/CMakeLists.txt | tr ' ' '\n' | sed "s|^|$R/|") \
+ *       -lpthread -o streaming_equivalence
+ *
+ * Usage:
+ *   ./streaming_equivalence
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "model.h"
+#include "tensorflow/lite/core/api/profiler.h"
+#include "tensorflow/lite/micro/kernels/micro_ops.h"
+#include "tensorflow/lite/micro/micro_error_reporter.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+// the streaming kernels keep a copy of their layer's input and output in the arena as well
+#define ARENA_SIZE 120000
+#define MAX_LAYERS 32
+// how far the window has to have slid before the check stops
+#define STREAMED_WINDOWS 3
+// rows the window moves on by each invocation, repeated until it has gone far enough - 4 is what the device hops by,
+// odd shifts can't be reused by the stride 2 pooling layers, 0 is the same window again and 120 leaves no overlap
+static const int hops[] = {4, 4, 4, 1, 2, 3, 8, 4, 0, 4, 5, 12, 4, 4, 120, 4, 4, 1, 4, 4};
+#define HOP_COUNT (int)(sizeof(hops) / sizeof(hops[0]))
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Copies the output of each operator as soon as it has been invoked - later
+ * layers are planned into the same arena memory, so it's gone by the end
+ **/
+class LayerRecorder : public tflite::Profiler
+{
+private:
+    const tflite::SubGraph *m_subgraph;
+    int m_layer;
+
+public:
+    tflite::MicroInterpreter *interpreter;
+    const char *names[MAX_LAYERS];
+    std::vector<uint8_t> outputs[MAX_LAYERS];
+
+    LayerRecorder(const tflite::Model *model)
+    {
+        m_subgraph = model->subgraphs()->Get(0);
+        m_layer = 0;
+        interpreter = nullptr;
+        memset(names, 0, sizeof(names));
+    }
+    uint32_t BeginEvent(const char *tag, EventType event_type, int64_t event_metadata1,
+                        int64_t event_metadata2) override
+    {
+        m_layer = (int)event_metadata1;
+        if (m_layer < MAX_LAYERS)
+        {
+            names[m_layer] = tag;
+        }
+        return 0;
+    }
+    void EndEvent(uint32_t event_handle) override
+    {
+        if (m_layer >= MAX_LAYERS || !interpreter)
+        {
+            return;
+        }
+        const tflite::Operator *op = m_subgraph->operators()->Get(m_layer);
+        const TfLiteTensor *output = interpreter->tensor(op->outputs()->Get(0));
+        outputs[m_layer].assign(output->data.uint8, output->data.uint8 + output->bytes);
+    }
+};
+
+/**
+ * The model with one or other set of kernels and what its layers output last
+ **/
+struct ModelRun
+{
+    LayerRecorder recorder;
+    tflite::MicroMutableOpResolver<7> resolver;
+    tflite::MicroInterpreter *interpreter;
+    double total_us;
+
+    ModelRun(const tflite::Model *model, uint8_t *arena, tflite::ErrorReporter *error_reporter, bool streaming)
+        : recorder(model), total_us(0)
+    {
+        if (streaming)
+        {
+            resolver.AddConv2D(tflite::ops::micro::Register_CONV_2D_STREAMING());
+            resolver.AddMaxPool2D(tflite::ops::micro::Register_MAX_POOL_2D_STREAMING());
+        }
+        else
+        {
+            resolver.AddConv2D();
+            resolver.AddMaxPool2D();
+        }
+        resolver.AddFullyConnected();
+        resolver.AddLogistic();
+        resolver.AddReshape();
+        resolver.AddQuantize();
+        resolver.AddDequantize();
+        interpreter = new tflite::MicroInterpreter(model, resolver, arena, ARENA_SIZE, error_reporter, &recorder);
+        recorder.interpreter = interpreter;
+    }
+    ~ModelRun()
+    {
+        delete interpreter;
+    }
+    bool invoke(const float *window)
+    {
+        TfLiteTensor *input = interpreter->input(0);
+        memcpy(input->data.f, window, input->bytes);
+        Clock::time_point start = Clock::now();
+        bool ok = interpreter->Invoke() == kTfLiteOk;
+        total_us += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        return ok;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    alignas(16) static uint8_t full_arena[ARENA_SIZE];
+    alignas(16) static uint8_t streaming_arena[ARENA_SIZE];
+    tflite::MicroErrorReporter error_reporter;
+    const tflite::Model *model = tflite::GetModel(converted_model_tflite);
+
+    ModelRun full(model, full_arena, &error_reporter, false);
+    ModelRun streaming(model, streaming_arena, &error_reporter, true);
+    if (full.interpreter->AllocateTensors() != kTfLiteOk || streaming.interpreter->AllocateTensors() != kTfLiteOk)
+    {
+        fprintf(stderr, "ERROR: AllocateTensors() failed\n");
+        return 1;
+    }
+    TfLiteTensor *input = full.interpreter->input(0);
+    int window_rows = input->dims->data[1];
+    int row_size = input->bytes / sizeof(float) / window_rows;
+
+    // a spectrogram long enough for every hop in the schedule, in the range AudioProcessor's log energies fall in
+    int total_rows = window_rows;
+    for (int advanced = 0, hop = 0; advanced < STREAMED_WINDOWS * window_rows; hop++)
+    {
+        advanced += hops[hop % HOP_COUNT];
+        total_rows += hops[hop % HOP_COUNT];
+    }
+    std::vector<float> spectrogram(total_rows * row_size);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < spectrogram.size(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        spectrogram[i] = -6.0f + 7.0f * ((seed >> 8) & 0xffff) / 65535.0f;
+    }
+
+    int layer_count = model->subgraphs()->Get(0)->operators()->size();
+    int layer_mismatches[MAX_LAYERS] = {0};
+    int invocations = 0;
+    int mismatched_invocations = 0;
+    int row = 0;
+    for (int hop = -1; row < STREAMED_WINDOWS * window_rows; hop++)
+    {
+        // the first window has nothing before it to reuse
+        if (hop >= 0)
+        {
+            row += hops[hop % HOP_COUNT];
+        }
+        const float *window = &spectrogram[row * row_size];
+        if (!full.invoke(window) || !streaming.invoke(window))
+        {
+            fprintf(stderr, "ERROR: Invoke() failed at row %d\n", row);
+            return 1;
+        }
+        invocations++;
+        bool mismatched = false;
+        for (int layer = 0; layer < layer_count && layer < MAX_LAYERS; layer++)
+        {
+            if (full.recorder.outputs[layer] != streaming.recorder.outputs[layer])
+            {
+                fprintf(stderr, "ERROR: layer %d (%s) differs in the window at row %d after a hop of %d rows\n", layer,
+                        full.recorder.names[layer], row, hop >= 0 ? hops[hop % HOP_COUNT] : 0);
+                layer_mismatches[layer]++;
+                mismatched = true;
+            }
+        }
+        if (mismatched)
+        {
+            mismatched_invocations++;
+        }
+    }
+
+    printf("%d windows of %d rows, slid %d rows (%d windows)\n", invocations, window_rows, row, row / window_rows);
+    printf("%-4s %-16s %10s  %s\n", "op", "", "bytes", "mismatched windows");
+    for (int layer = 0; layer < layer_count && layer < MAX_LAYERS; layer++)
+    {
+        printf("%-4d %-16s %10zu  %d\n", layer, full.recorder.names[layer], full.recorder.outputs[layer].size(),
+               layer_mismatches[layer]);
+    }
+    printf("full recompute %.1f us, streaming %.1f us per window\n", full.total_us / invocations,
+           streaming.total_us / invocations);
+    printf("arena %zu bytes full, %zu bytes streaming\n", full.interpreter->arena_used_bytes(),
+           streaming.interpreter->arena_used_bytes());
+    if (mismatched_invocations)
+    {
+        fprintf(stderr, "ERROR: %d of %d windows differ from the full recompute\n", mismatched_invocations, invocations);
+        return 1;
+    }
+    printf("every layer identical to the full recompute in all %d windows\n", invocations);
+    return 0;
+}
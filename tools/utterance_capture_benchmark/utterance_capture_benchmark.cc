@@ -0,0 +1,345 @@
+/**
+ * UtteranceCapture check
+ *
+ * Feeds I2SSampler numbered samples - each is one more than the last, mod
+ * 2^15 - through a stand-in sampler so UtteranceCapture and the ring buffer
+ * pinning can be built and run on the host (the FreeRTOS and i2s stand-ins are
+ * in tools/i2s_output_benchmark/host). The scenarios check:
+ *  - the pre-roll is exactly the samples from before the trigger
+ *  - chunks come in order, numbered from 0, and the samples in them follow on
+ *    from each other unless the positions say some were lost
+ *  - the utterance is the pre-roll plus the maximum length, or ends at stop(),
+ *    and only its last chunk is marked last
+ *  - a consumer holding on to chunks makes the writer drop samples rather than
+ *    overwrite them, and the capture drops what the writer got to before it
+ *    could be queued if it isn't updated in time
+ *  - with the writer, the capture and the consumer on their own threads the
+ *    samples in every chunk are unchanged from when it was taken until it is
+ *    released
+ * and prints the capture's and the sampler's stats. The program exits with an
+ * error if any of the checks fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -pthread -Itools/i2s_output_benchmark/host \
+ *       -Icomponents/audio_input \
+ *       tools/utterance_capture_benchmark/utterance_capture_benchmark.cc \
+ *       components/audio_input/I2SSampler.cpp \
+ *       components/audio_input/UtteranceCapture.cpp \
+ *       -o utterance_capture_benchmark
+ *
+ * Usage:
+ *   ./utterance_capture_benchmark [seconds for the threaded scenario]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "I2SSampler.h"
+#include "UtteranceCapture.h"
+
+#define PREROLL_MS 500
+#define MAX_MS 3000
+#define CHUNK_SLOTS 6
+#define SAMPLES_PER_MS 16
+#define NUMBER_MASK 0x7fff
+
+/**
+ * Takes its samples from push instead of the i2s peripheral
+ **/
+class HostSampler : public I2SSampler
+{
+protected:
+    void configureI2S() {}
+    void processI2SData(uint8_t *i2sData, size_t bytesRead) {}
+
+public:
+    uint32_t m_pushed;
+    HostSampler() : m_pushed(0) {}
+    void push(int count)
+    {
+        for (int i = 0; i < count; i++, m_pushed++)
+        {
+            addSample(m_pushed & NUMBER_MASK);
+        }
+    }
+};
+
+static bool failed = false;
+
+#define CHECK(condition, ...)                    \
+    if (!(condition))                            \
+    {                                            \
+        fprintf(stderr, "ERROR: " __VA_ARGS__); \
+        fprintf(stderr, "\n");                   \
+        failed = true;                           \
+        return;                                  \
+    }
+
+/**
+ * What the consumer saw of an utterance
+ **/
+struct Utterance
+{
+    std::vector<AudioChunk_t> chunks;
+    // the samples, with the positions of any that were lost left out
+    std::vector<int16_t> samples;
+    uint32_t length;
+    bool ended;
+    Utterance() : length(0), ended(false) {}
+};
+
+// takes and releases everything that's queued, checking the chunks follow on from each other
+static void drain(UtteranceCapture *capture, Utterance &utterance)
+{
+    AudioChunk_t chunk;
+    while (capture->getChunk(&chunk, 0))
+    {
+        CHECK(!utterance.ended, "chunk %u after the last one", chunk.sequence);
+        CHECK(chunk.sequence == utterance.chunks.size(), "chunk %u, expected %u", chunk.sequence,
+              (unsigned)utterance.chunks.size());
+        CHECK(chunk.position >= utterance.length, "chunk %u at %u, before the end of the last at %u", chunk.sequence,
+              chunk.position, utterance.length);
+        CHECK(chunk.count <= SAMPLE_BUFFER_SIZE && (chunk.buffer || chunk.count == 0), "chunk %u has %d samples",
+              chunk.sequence, chunk.count);
+        for (int i = 0; i < chunk.count; i++)
+        {
+            CHECK(i == 0 || chunk.samples[i] == ((chunk.samples[i - 1] + 1) & NUMBER_MASK),
+                  "chunk %u sample %d is %d after %d", chunk.sequence, i, chunk.samples[i], chunk.samples[i - 1]);
+        }
+        utterance.samples.insert(utterance.samples.end(), chunk.samples, chunk.samples + chunk.count);
+        utterance.chunks.push_back(chunk);
+        utterance.length = chunk.position + chunk.count;
+        utterance.ended = chunk.last;
+        capture->releaseChunk(chunk);
+    }
+}
+
+static void print_stats(const char *label, UtteranceCapture *capture, HostSampler *sampler, const Utterance &utterance)
+{
+    UtteranceCaptureStats_t stats = capture->getStats();
+    printf("%-32s %6u samples in %3u chunks %6u dropped by the capture %6u by the writer  %4u queue full\n", label,
+           stats.samples, stats.chunks, stats.dropped_samples, sampler->getDroppedSamples(), stats.queue_full);
+}
+
+// whole utterance, collected as it's captured - the first chunk must be the pre-roll
+static void check_preroll_and_length()
+{
+    HostSampler sampler;
+    UtteranceCapture capture(&sampler, PREROLL_MS, MAX_MS, CHUNK_SLOTS);
+    // part way through a buffer
+    sampler.push(20000 + 777);
+    uint32_t trigger = sampler.m_pushed;
+    capture.start();
+    capture.update();
+    Utterance utterance;
+    while (!utterance.ended && !failed)
+    {
+        drain(&capture, utterance);
+        sampler.push(SAMPLE_BUFFER_SIZE);
+        capture.update();
+    }
+    if (failed)
+    {
+        return;
+    }
+    uint32_t preroll = PREROLL_MS * SAMPLES_PER_MS;
+    uint32_t expected = preroll + MAX_MS * SAMPLES_PER_MS;
+    CHECK(utterance.length == expected && utterance.samples.size() == expected, "utterance of %u samples (%u kept), expected %u",
+          utterance.length, (unsigned)utterance.samples.size(), expected);
+    CHECK(utterance.samples[0] == (int16_t)((trigger - preroll) & NUMBER_MASK), "pre-roll starts at %d, expected %d",
+          utterance.samples[0], (trigger - preroll) & NUMBER_MASK);
+    for (size_t i = 1; i < utterance.samples.size(); i++)
+    {
+        CHECK(utterance.samples[i] == ((utterance.samples[i - 1] + 1) & NUMBER_MASK), "sample %u is %d after %d",
+              (unsigned)i, utterance.samples[i], utterance.samples[i - 1]);
+    }
+    CHECK(sampler.getDroppedSamples() == 0 && capture.getStats().dropped_samples == 0, "samples dropped");
+    CHECK(!capture.isCapturing(), "still capturing");
+    print_stats("pre-roll and maximum length", &capture, &sampler, utterance);
+}
+
+// a short pre-roll just after start up, then stop() part way through and again after everything has been queued
+static void check_stop()
+{
+    for (int late = 0; late < 2; late++)
+    {
+        HostSampler sampler;
+        UtteranceCapture capture(&sampler, PREROLL_MS, MAX_MS, CHUNK_SLOTS);
+        sampler.push(3000);
+        capture.start();
+        capture.update();
+        Utterance utterance;
+        drain(&capture, utterance);
+        CHECK(utterance.length == 3000 && utterance.samples[0] == 0, "%u samples of pre-roll from %d at start up",
+              utterance.length, utterance.samples[0]);
+        sampler.push(10000);
+        for (int i = 0; i < 3 * late; i++)
+        {
+            capture.update();
+            drain(&capture, utterance);
+        }
+        capture.stop();
+        // anything that arrives after stop isn't part of it
+        sampler.push(5000);
+        for (int i = 0; i < 3; i++)
+        {
+            capture.update();
+            drain(&capture, utterance);
+        }
+        CHECK(utterance.ended && utterance.length == 13000 && utterance.samples.size() == 13000,
+              "stopped utterance of %u samples, expected 13000", utterance.length);
+        CHECK(!late || utterance.chunks.back().count == 0, "no empty chunk to end an utterance stopped late");
+        CHECK(!capture.isCapturing(), "still capturing after stop");
+        // and it can go again
+        capture.start();
+        capture.update();
+        CHECK(capture.isCapturing() && capture.getStats().utterances == 2, "didn't start again");
+        print_stats(late ? "stopped after everything queued" : "stopped part way", &capture, &sampler, utterance);
+    }
+}
+
+// three seconds without the consumer taking anything, or without the capture being updated. The consumer not keeping
+// up pins the oldest samples so the writer has to drop samples as it comes round to them and the pinned chunks must
+// come through untouched. No updates means the writer runs over samples before the capture can queue them
+static void check_stall(const char *label, bool stall_consumer)
+{
+    HostSampler sampler;
+    UtteranceCapture capture(&sampler, PREROLL_MS, MAX_MS, CHUNK_SLOTS);
+    sampler.push(20000);
+    capture.start();
+    capture.update();
+    Utterance utterance;
+    if (!stall_consumer)
+    {
+        drain(&capture, utterance);
+    }
+    for (int i = 0; i < 30; i++)
+    {
+        sampler.push(SAMPLE_BUFFER_SIZE);
+        if (stall_consumer)
+        {
+            capture.update();
+        }
+    }
+    while (!utterance.ended && !failed)
+    {
+        capture.update();
+        drain(&capture, utterance);
+        sampler.push(SAMPLE_BUFFER_SIZE);
+    }
+    if (failed)
+    {
+        return;
+    }
+    CHECK(utterance.samples[0] == (int16_t)((20000 - PREROLL_MS * SAMPLES_PER_MS) & NUMBER_MASK),
+          "pre-roll starts at %d", utterance.samples[0]);
+    uint32_t unbroken = 0;
+    for (size_t i = 0; i < utterance.chunks.size() && utterance.chunks[i].position == unbroken; i++)
+    {
+        unbroken += utterance.chunks[i].count;
+    }
+    UtteranceCaptureStats_t stats = capture.getStats();
+    if (stall_consumer)
+    {
+        CHECK(sampler.getDroppedSamples() > 0, "the writer didn't drop anything with the ring buffer pinned");
+        CHECK(stats.queue_full > 0, "the queue never filled");
+        CHECK(unbroken == utterance.length, "gap at %u", unbroken);
+    }
+    else
+    {
+        CHECK(sampler.getDroppedSamples() == 0, "the writer dropped samples with nothing pinned");
+        CHECK(unbroken < utterance.length, "no gap");
+    }
+    CHECK((stats.dropped_samples > 0) == !stall_consumer && stats.samples + stats.dropped_samples == utterance.length,
+          "%u samples and %u dropped for an utterance of %u", stats.samples, stats.dropped_samples, utterance.length);
+    CHECK(utterance.length == (PREROLL_MS + MAX_MS) * SAMPLES_PER_MS, "utterance of %u samples", utterance.length);
+    print_stats(label, &capture, &sampler, utterance);
+}
+
+// writer, capture and consumer on their own threads at ten times real time, with the consumer taking its time
+static void check_threaded(double seconds)
+{
+    HostSampler sampler;
+    UtteranceCapture capture(&sampler, PREROLL_MS, MAX_MS, CHUNK_SLOTS);
+    std::atomic<bool> running(true);
+    std::atomic<int> overwritten(0);
+    std::atomic<int> utterances(0);
+    std::thread writer([&]() {
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while (running.load())
+        {
+            next += std::chrono::microseconds(100);
+            std::this_thread::sleep_until(next);
+            sampler.push(SAMPLES_PER_MS);
+        }
+    });
+    std::thread capturer([&]() {
+        uint32_t last_trigger = 0;
+        while (running.load())
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            uint32_t written = sampler.getSamplesWritten();
+            // a wake word every 2 seconds and the speech ending 1 second later
+            if (written - last_trigger > 32000 && !capture.isCapturing())
+            {
+                capture.start();
+                last_trigger = written;
+            }
+            if (written - last_trigger > 16000)
+            {
+                capture.stop();
+            }
+            capture.update();
+        }
+    });
+    std::thread consumer([&]() {
+        uint32_t seed = 1;
+        int16_t copy[SAMPLE_BUFFER_SIZE];
+        AudioChunk_t chunk;
+        while (running.load())
+        {
+            if (!capture.getChunk(&chunk, 10))
+            {
+                continue;
+            }
+            memcpy(copy, chunk.samples, chunk.count * sizeof(int16_t));
+            seed = seed * 1103515245 + 12345;
+            std::this_thread::sleep_for(std::chrono::microseconds((seed >> 16) % 3000));
+            if (memcmp(copy, chunk.samples, chunk.count * sizeof(int16_t)) != 0)
+            {
+                overwritten++;
+            }
+            utterances += chunk.last;
+            capture.releaseChunk(chunk);
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::microseconds((long long)(seconds * 1e6)));
+    running.store(false);
+    writer.join();
+    capturer.join();
+    consumer.join();
+    Utterance none;
+    print_stats("threaded, consumer up to 3ms", &capture, &sampler, none);
+    CHECK(overwritten.load() == 0, "%d chunks were overwritten while the consumer had them", overwritten.load());
+    CHECK(utterances.load() > 0, "no utterances were completed");
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3;
+    if (seconds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [seconds for the threaded scenario]\n", argv[0]);
+        return 1;
+    }
+    check_preroll_and_length();
+    check_stop();
+    check_stall("consumer stalled for 3s", true);
+    check_stall("capture stalled for 3s", false);
+    check_threaded(seconds);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,798 @@
+/**
+ * Utterance upload check and benchmark
+ *
+ * Checks the audio codecs and then runs UtteranceCapture and
+ * UtteranceUploader on the host (the FreeRTOS and ESP-IDF stand-ins are in
+ * tools/i2s_output_benchmark/host) against a stand-in for the server
+ * listening on the loopback interface.
+ *
+ * Codecs:
+ *  - mu-law must match the G.711 reference encoder for every 16 bit sample
+ *    and decode to the middle of each code's range
+ *  - IMA ADPCM blocks must decode on their own to what decoding the whole
+ *    signal in one go gives, and the SNR is reported
+ *  - encode and decode speed in millions of samples a second
+ *
+ * Upload, for each codec, with a sampler writing a speech-like signal in real
+ * time: the wake word is triggered, the user talks for a second and stops.
+ * The server checks every frame follows on from the last, decodes the audio
+ * and compares it with what the sampler wrote. Reported:
+ *  - first byte latency - from the trigger to the server getting the first
+ *    byte, which includes connecting
+ *  - end latency - from the end of speech to the server getting the end frame
+ *  - bytes on the wire per second of audio, and the SNR of what arrived
+ * Then throughput: the sampler writes as fast as it can and the upload speed
+ * is reported in seconds of audio per second.
+ *
+ * Adaptive codec, with the server reading through a token bucket whose rate
+ * changes part way through - a good link, a congested one and a middling
+ * one - and small socket buffers either end like lwip's. The user talks for
+ * most of the longest utterance. The stream must arrive whole with nothing
+ * dropped, mostly PCM16 while the link is good, down to ADPCM and never
+ * PCM16 while it's congested, mostly off ADPCM again once it has recovered,
+ * and never more than a second behind. Reported are the frames in each codec, the codec
+ * changes, the goodput the uploader measured and the furthest behind the
+ * audio got. The same link with PCM16 alone is reported for comparison.
+ *
+ * The program exits with an error if any of the checks fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=gnu++11 -O2 -pthread -Itools/i2s_output_benchmark/host \
+ *       -Icomponents/audio_input -Icomponents/voice_stream \
+ *       tools/voice_stream_benchmark/voice_stream_benchmark.cc \
+ *       components/audio_input/I2SSampler.cpp \
+ *       components/audio_input/UtteranceCapture.cpp \
+ *       components/voice_stream/AudioCodec.cpp \
+ *       components/voice_stream/AdaptiveCodec.cpp \
+ *       components/voice_stream/StreamSocket.cpp \
+ *       components/voice_stream/UtteranceUploader.cpp \
+ *       -o voice_stream_benchmark
+ *
+ * Usage:
+ *   ./voice_stream_benchmark
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "I2SSampler.h"
+#include "UtteranceCapture.h"
+#include "UtteranceUploader.h"
+#include "AudioCodec.h"
+#include "StreamFrame.h"
+#include "StreamSocket.h"
+
+#define PREROLL_MS 500
+#define MAX_MS 8000
+#define CHUNK_SLOTS 6
+#define SAMPLE_RATE 16000
+// socket buffers for the shaped link - Linux doubles them, so about lwip's TCP_SND_BUF at each end
+#define SHAPED_SEND_BUFFER 2048
+#define SHAPED_RECEIVE_BUFFER 2048
+// the most the token bucket lets through in one go - a packet
+#define SHAPED_BURST_BYTES 1460
+
+typedef std::chrono::steady_clock Clock;
+
+static double elapsed_ms(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// a couple of voices, one of them wobbling, and some noise - the same for any sample number
+static int16_t test_signal(uint32_t n)
+{
+    double t = (double)n / SAMPLE_RATE;
+    double voice = 6000 * sin(2 * M_PI * 220 * t) * (0.6 + 0.4 * sin(2 * M_PI * 3 * t)) +
+                   2500 * sin(2 * M_PI * 1250 * t + 2 * sin(2 * M_PI * 5 * t));
+    uint32_t hash = n * 2654435761u;
+    double noise = (double)((hash >> 16) & 0x3ff) - 512;
+    return (int16_t)(voice + noise);
+}
+
+static double snr_db(const int16_t *expected, const int16_t *actual, int count)
+{
+    double signal = 0;
+    double error = 0;
+    for (int i = 0; i < count; i++)
+    {
+        signal += (double)expected[i] * expected[i];
+        error += (double)(expected[i] - actual[i]) * (expected[i] - actual[i]);
+    }
+    return error == 0 ? INFINITY : 10 * log10(signal / error);
+}
+
+static bool failed = false;
+
+#define CHECK(condition, ...)                    \
+    if (!(condition))                            \
+    {                                            \
+        fprintf(stderr, "ERROR: " __VA_ARGS__); \
+        fprintf(stderr, "\n");                   \
+        failed = true;                           \
+        return;                                  \
+    }
+
+// the classic G.711 reference (Sun's g711.c) - a table search for the segment
+static uint8_t reference_ulaw(int16_t pcm)
+{
+    static const int segment_end[8] = {0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF};
+    int value = pcm;
+    int mask;
+    if (value < 0)
+    {
+        value = 0x84 - value;
+        mask = 0x7F;
+    }
+    else
+    {
+        value += 0x84;
+        mask = 0xFF;
+    }
+    if (value > 32635 + 0x84)
+    {
+        value = 32635 + 0x84;
+    }
+    int segment = 0;
+    while (segment < 8 && value > segment_end[segment])
+    {
+        segment++;
+    }
+    if (segment >= 8)
+    {
+        return 0x7F ^ mask;
+    }
+    return ((segment << 4) | ((value >> (segment + 3)) & 0xF)) ^ mask;
+}
+
+static void check_ulaw()
+{
+    for (int value = -32768; value <= 32767; value++)
+    {
+        int16_t sample = value;
+        uint8_t code;
+        ulaw_encode(&sample, 1, &code);
+        CHECK(code == reference_ulaw(sample), "mu-law of %d is %02x, expected %02x", value, code,
+              reference_ulaw(sample));
+        // decoding gives the middle of the code's range, within half a step of what went in
+        int16_t decoded;
+        ulaw_decode(&code, 1, &decoded);
+        int exponent = ((~code) >> 4) & 0x07;
+        int clipped = std::max(-32635, std::min(32635, value));
+        CHECK(abs(decoded - clipped) <= (4 << exponent), "mu-law %02x of %d decodes to %d", code, value, decoded);
+    }
+    printf("mu-law matches the reference for all 65536 samples\n");
+}
+
+static void check_adpcm()
+{
+    const int count = SAMPLE_RATE * 2;
+    std::vector<int16_t> signal(count);
+    for (int i = 0; i < count; i++)
+    {
+        signal[i] = test_signal(i);
+    }
+    // in frames, each decoded on its own
+    AdpcmState_t state = {0, 0};
+    std::vector<uint8_t> block(audio_codec_encoded_bytes(AUDIO_CODEC_IMA_ADPCM, STREAM_FRAME_SAMPLES));
+    std::vector<int16_t> framed(count);
+    for (int i = 0; i < count; i += STREAM_FRAME_SAMPLES - 7)
+    {
+        // odd sized frames so the last nibble of a byte gets used too
+        int samples = std::min(count - i, STREAM_FRAME_SAMPLES - 7);
+        int bytes = adpcm_encode(&state, &signal[i], samples, block.data());
+        CHECK(bytes == audio_codec_encoded_bytes(AUDIO_CODEC_IMA_ADPCM, samples), "%d bytes for %d samples", bytes,
+              samples);
+        CHECK(audio_codec_decode(AUDIO_CODEC_IMA_ADPCM, block.data(), bytes, &framed[i], samples) == samples,
+              "frame didn't decode");
+    }
+    // and in one go
+    AdpcmState_t whole_state = {0, 0};
+    std::vector<uint8_t> whole(audio_codec_encoded_bytes(AUDIO_CODEC_IMA_ADPCM, count));
+    adpcm_encode(&whole_state, signal.data(), count, whole.data());
+    std::vector<int16_t> decoded(count);
+    adpcm_decode(whole.data(), count, decoded.data());
+    CHECK(decoded == framed, "frames decoded on their own differ from the whole signal");
+    CHECK(whole_state.predictor == decoded[count - 1], "encoder finished at %d, decoder at %d", whole_state.predictor,
+          decoded[count - 1]);
+    double snr = snr_db(signal.data(), decoded.data(), count);
+    CHECK(snr > 20, "ADPCM SNR %.1f dB", snr);
+    printf("IMA ADPCM frames decode on their own, SNR %.1f dB\n", snr);
+}
+
+static void time_codecs()
+{
+    const int count = SAMPLE_RATE * 4;
+    std::vector<int16_t> signal(count);
+    for (int i = 0; i < count; i++)
+    {
+        signal[i] = test_signal(i);
+    }
+    std::vector<uint8_t> encoded(count * 2 + ADPCM_STATE_BYTES);
+    std::vector<int16_t> decoded(count);
+    const AudioCodec_t codecs[] = {AUDIO_CODEC_PCM16, AUDIO_CODEC_ULAW, AUDIO_CODEC_IMA_ADPCM};
+    const char *names[] = {"PCM16", "mu-law", "IMA ADPCM"};
+    for (int c = 0; c < 3; c++)
+    {
+        const int repeats = 20;
+        AdpcmState_t state = {0, 0};
+        double encode_ms = 0;
+        double decode_ms = 0;
+        for (int r = 0; r < repeats; r++)
+        {
+            Clock::time_point t0 = Clock::now();
+            int bytes = 0;
+            for (int i = 0; i < count; i += STREAM_FRAME_SAMPLES)
+            {
+                bytes += audio_codec_encode(codecs[c], &state, &signal[i], STREAM_FRAME_SAMPLES, &encoded[bytes]);
+            }
+            Clock::time_point t1 = Clock::now();
+            int frame_bytes = audio_codec_encoded_bytes(codecs[c], STREAM_FRAME_SAMPLES);
+            for (int i = 0, offset = 0; i < count; i += STREAM_FRAME_SAMPLES, offset += frame_bytes)
+            {
+                audio_codec_decode(codecs[c], &encoded[offset], frame_bytes, &decoded[i], STREAM_FRAME_SAMPLES);
+            }
+            Clock::time_point t2 = Clock::now();
+            encode_ms += elapsed_ms(t0, t1);
+            decode_ms += elapsed_ms(t1, t2);
+        }
+        printf("%-10s encode %7.1f Msamples/s  decode %7.1f Msamples/s  SNR %5.1f dB\n", names[c],
+               count * repeats / encode_ms / 1000, count * repeats / decode_ms / 1000,
+               snr_db(signal.data(), decoded.data(), count));
+    }
+}
+
+/**
+ * Stand-in for the server - takes one connection at a time on the loopback
+ * interface and checks and decodes the stream on it
+ **/
+struct ReceivedStream
+{
+    Clock::time_point first_byte;
+    Clock::time_point end;
+    uint16_t stream;
+    uint32_t frames;
+    uint32_t bytes;
+    std::vector<int16_t> samples;
+    // for each audio frame
+    std::vector<uint8_t> codecs;
+    std::vector<Clock::time_point> arrivals;
+    bool ended;
+};
+
+// the link runs at bytes_per_second until until_ms after the connection was made
+struct LinkPhase
+{
+    int until_ms;
+    int bytes_per_second;
+};
+
+class LoopbackServer
+{
+private:
+    int m_listener;
+    uint16_t m_port;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::vector<ReceivedStream> m_streams;
+    std::vector<std::string> m_errors;
+    // traffic shaping - empty for as fast as loopback goes
+    std::vector<LinkPhase> m_link;
+    Clock::time_point m_connected;
+    Clock::time_point m_refilled;
+    double m_tokens;
+
+    // bytes a second the link can take at the moment, 0 for no limit
+    int linkRate(Clock::time_point now)
+    {
+        for (size_t i = 0; i < m_link.size(); i++)
+        {
+            if (elapsed_ms(m_connected, now) < m_link[i].until_ms)
+            {
+                return m_link[i].bytes_per_second;
+            }
+        }
+        return 0;
+    }
+
+    bool receive(int sock, uint8_t *bytes, size_t size)
+    {
+        while (size > 0)
+        {
+            size_t wanted = size;
+            Clock::time_point now = Clock::now();
+            int rate = linkRate(now);
+            if (rate > 0)
+            {
+                // only take what the link would have delivered by now
+                m_tokens = std::min(m_tokens + rate * elapsed_ms(m_refilled, now) / 1000, (double)SHAPED_BURST_BYTES);
+                m_refilled = now;
+                if (m_tokens < 1)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                wanted = std::min(size, (size_t)m_tokens);
+            }
+            ssize_t received = recv(sock, bytes, wanted, 0);
+            if (received <= 0)
+            {
+                return false;
+            }
+            m_tokens -= received;
+            if (rate > 0)
+            {
+                // acknowledge straight away - with so small a window delayed acks would slow the link down on their own
+                int quick_ack = 1;
+                setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &quick_ack, sizeof(quick_ack));
+            }
+            bytes += received;
+            size -= received;
+        }
+        return true;
+    }
+
+    void error(const char *message, const ReceivedStream &stream)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        char text[200];
+        snprintf(text, sizeof(text), "stream %u frame %u: %s", stream.stream, stream.frames, message);
+        m_errors.push_back(text);
+    }
+
+    void serve(int sock)
+    {
+        ReceivedStream stream;
+        stream.frames = 0;
+        stream.bytes = 0;
+        stream.ended = false;
+        uint8_t header_bytes[STREAM_FRAME_HEADER_BYTES];
+        uint8_t payload[STREAM_FRAME_MAX_PAYLOAD_BYTES];
+        int16_t decoded[STREAM_FRAME_SAMPLES];
+        m_connected = Clock::now();
+        m_refilled = m_connected;
+        m_tokens = 0;
+        while (receive(sock, header_bytes, 1))
+        {
+            if (stream.bytes == 0)
+            {
+                stream.first_byte = Clock::now();
+            }
+            StreamFrameHeader_t header;
+            if (!receive(sock, header_bytes + 1, STREAM_FRAME_HEADER_BYTES - 1) ||
+                !stream_frame_read_header(header_bytes, &header) ||
+                !receive(sock, payload, header.payload_bytes))
+            {
+                error("bad frame", stream);
+                break;
+            }
+            stream.bytes += STREAM_FRAME_HEADER_BYTES + header.payload_bytes;
+            if (stream.frames == 0)
+            {
+                stream.stream = header.stream;
+            }
+            if (header.stream != stream.stream || header.sequence != stream.frames || stream.ended)
+            {
+                error("out of sequence", stream);
+                break;
+            }
+            stream.frames++;
+            if (header.timestamp < stream.samples.size())
+            {
+                error("timestamp went backwards", stream);
+                break;
+            }
+            // anything lost is left as silence
+            stream.samples.resize(header.timestamp, 0);
+            if (header.type == STREAM_FRAME_END)
+            {
+                stream.ended = true;
+                stream.end = Clock::now();
+                continue;
+            }
+            if (header.samples > STREAM_FRAME_SAMPLES ||
+                audio_codec_decode((AudioCodec_t)header.codec, payload, header.payload_bytes, decoded,
+                                   header.samples) != header.samples)
+            {
+                error("couldn't decode", stream);
+                break;
+            }
+            stream.samples.insert(stream.samples.end(), decoded, decoded + header.samples);
+            stream.codecs.push_back(header.codec);
+            stream.arrivals.push_back(Clock::now());
+        }
+        close(sock);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_streams.push_back(stream);
+    }
+
+public:
+    // link is the shaping each connection gets, with the receive buffer kept to receive_buffer if it's set
+    LoopbackServer(const std::vector<LinkPhase> &link = std::vector<LinkPhase>(), int receive_buffer = 0)
+        : m_link(link)
+    {
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (receive_buffer > 0)
+        {
+            // accepted connections take it from the listener
+            setsockopt(m_listener, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        }
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = inet_addr("127.0.0.1");
+        address.sin_port = 0;
+        bind(m_listener, (struct sockaddr *)&address, sizeof(address));
+        listen(m_listener, 4);
+        socklen_t size = sizeof(address);
+        getsockname(m_listener, (struct sockaddr *)&address, &size);
+        m_port = ntohs(address.sin_port);
+        m_thread = std::thread([this]() {
+            int sock;
+            while ((sock = accept(m_listener, NULL, NULL)) >= 0)
+            {
+                serve(sock);
+            }
+        });
+    }
+    ~LoopbackServer()
+    {
+        shutdown(m_listener, SHUT_RDWR);
+        close(m_listener);
+        m_thread.join();
+    }
+    uint16_t port()
+    {
+        return m_port;
+    }
+    // waits for the next stream to finish
+    bool takeStream(ReceivedStream *stream, std::vector<std::string> *errors, int timeout_ms)
+    {
+        Clock::time_point until = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (Clock::now() < until)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_streams.empty())
+                {
+                    *stream = m_streams.front();
+                    m_streams.erase(m_streams.begin());
+                    *errors = m_errors;
+                    m_errors.clear();
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return false;
+    }
+};
+
+/**
+ * Takes its samples from push instead of the i2s peripheral
+ **/
+class HostSampler : public I2SSampler
+{
+protected:
+    void configureI2S() {}
+    void processI2SData(uint8_t *i2sData, size_t bytesRead) {}
+
+public:
+    std::atomic<uint32_t> m_pushed;
+    HostSampler() : m_pushed(0) {}
+    void push(int count)
+    {
+        uint32_t pushed = m_pushed.load();
+        for (int i = 0; i < count; i++)
+        {
+            addSample(test_signal(pushed + i));
+        }
+        m_pushed.store(pushed + count);
+    }
+};
+
+/**
+ * The device end - the sampler's writer, the task the sampler wakes as each
+ * buffer fills and the task uploading the utterances. With a send buffer
+ * size it makes each connection itself to set it, then hands it to the
+ * uploader like an already open one.
+ **/
+class Device
+{
+public:
+    HostSampler sampler;
+    UtteranceCapture capture;
+    UtteranceUploader uploader;
+    std::atomic<bool> running;
+    std::thread writer;
+    std::thread capturer;
+    std::thread uploading;
+
+    Device(AudioCodec_t codec, uint16_t port, bool real_time, bool adaptive = false, int send_buffer = 0)
+        : capture(&sampler, PREROLL_MS, MAX_MS, CHUNK_SLOTS), uploader(&capture, codec, adaptive), running(true)
+    {
+        writer = std::thread([this, real_time]() {
+            Clock::time_point next = Clock::now();
+            while (running.load())
+            {
+                if (real_time)
+                {
+                    // a millisecond at a time
+                    next += std::chrono::milliseconds(1);
+                    std::this_thread::sleep_until(next);
+                    sampler.push(SAMPLE_RATE / 1000);
+                }
+                else
+                {
+                    sampler.push(SAMPLE_BUFFER_SIZE);
+                    std::this_thread::yield();
+                }
+            }
+        });
+        capturer = std::thread([this]() {
+            uint32_t buffers = 0;
+            while (running.load())
+            {
+                // update as each buffer fills, like the front end task
+                uint32_t filled = sampler.getSamplesWritten() / SAMPLE_BUFFER_SIZE;
+                if (filled != buffers)
+                {
+                    buffers = filled;
+                    capture.update();
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+        uint32_t server_ip = inet_addr("127.0.0.1");
+        uploading = std::thread([this, server_ip, port, send_buffer]() {
+            while (running.load())
+            {
+                AudioChunk_t chunk;
+                if (!capture.getChunk(&chunk, 10))
+                {
+                    continue;
+                }
+                if (send_buffer == 0)
+                {
+                    uploader.upload(chunk, server_ip, port);
+                    continue;
+                }
+                int sock = stream_socket_connect(server_ip, port, 2000);
+                setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+                uploader.upload(chunk, sock);
+                close(sock);
+            }
+        });
+    }
+    // the stats can be read once it has stopped
+    void stop()
+    {
+        if (running.exchange(false))
+        {
+            writer.join();
+            capturer.join();
+            uploading.join();
+        }
+    }
+    ~Device()
+    {
+        stop();
+    }
+};
+
+static void check_upload(LoopbackServer &server, AudioCodec_t codec, const char *name, double min_snr)
+{
+    Device device(codec, server.port(), true);
+    // part way through a buffer, as a wake word would be
+    std::this_thread::sleep_for(std::chrono::milliseconds(1250));
+    Clock::time_point trigger = Clock::now();
+    uint32_t trigger_sample = device.sampler.m_pushed.load();
+    device.capture.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    Clock::time_point stop = Clock::now();
+    uint32_t stop_sample = device.sampler.m_pushed.load();
+    device.capture.stop();
+    ReceivedStream stream;
+    std::vector<std::string> errors;
+    CHECK(server.takeStream(&stream, &errors, 5000), "%s: nothing received", name);
+    for (size_t i = 0; i < errors.size(); i++)
+    {
+        fprintf(stderr, "ERROR: %s: %s\n", name, errors[i].c_str());
+    }
+    CHECK(errors.empty() && stream.ended, "%s: stream didn't end properly", name);
+    device.stop();
+    CHECK(device.sampler.getDroppedSamples() == 0 && device.capture.getStats().dropped_samples == 0,
+          "%s: samples dropped", name);
+    // the capture starts and stops at the next buffer - find where the pre-roll started from the samples themselves
+    int count = stream.samples.size();
+    int expected = (stop_sample - trigger_sample) + PREROLL_MS * SAMPLE_RATE / 1000;
+    CHECK(abs(count - expected) <= 2 * SAMPLE_BUFFER_SIZE, "%s: %d samples, expected about %d", name, count, expected);
+    std::vector<int16_t> reference(count);
+    double best_snr = -INFINITY;
+    int64_t start_guess = (int64_t)trigger_sample - PREROLL_MS * SAMPLE_RATE / 1000;
+    for (int64_t start = start_guess - SAMPLE_BUFFER_SIZE; start <= start_guess + 2 * SAMPLE_BUFFER_SIZE; start++)
+    {
+        if (start < 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < 200; i++)
+        {
+            reference[i] = test_signal(start + i);
+        }
+        if (snr_db(reference.data(), stream.samples.data(), 200) < min_snr - 10)
+        {
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            reference[i] = test_signal(start + i);
+        }
+        best_snr = std::max(best_snr, snr_db(reference.data(), stream.samples.data(), count));
+    }
+    CHECK(best_snr >= min_snr, "%s: SNR %.1f dB", name, best_snr);
+    UtteranceUploaderStats_t stats = device.uploader.getStats();
+    printf("%-10s first byte %6.2f ms (connect %5.2f ms)  end %6.2f ms after stop  %5.2f s of audio  "
+           "%6.0f bytes/s  SNR %5.1f dB\n",
+           name, elapsed_ms(trigger, stream.first_byte), stats.connect_us / 1000.0, elapsed_ms(stop, stream.end),
+           count / (double)SAMPLE_RATE, stream.bytes * (double)SAMPLE_RATE / count, best_snr);
+}
+
+static void time_upload(LoopbackServer &server, AudioCodec_t codec, const char *name)
+{
+    Device device(codec, server.port(), false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    device.capture.start();
+    ReceivedStream stream;
+    std::vector<std::string> errors;
+    CHECK(server.takeStream(&stream, &errors, 10000) && errors.empty() && stream.ended, "%s: stream failed", name);
+    double ms = elapsed_ms(stream.first_byte, stream.end);
+    device.stop();
+    UtteranceCaptureStats_t capture_stats = device.capture.getStats();
+    printf("%-10s %5.2f s of audio in %7.2f ms - %6.0fx real time, %6.2f MB/s, %u samples dropped by the writer\n",
+           name, stream.samples.size() / (double)SAMPLE_RATE, ms, stream.samples.size() / (double)SAMPLE_RATE * 1000 / ms,
+           stream.bytes / ms / 1000, device.sampler.getDroppedSamples());
+    CHECK(capture_stats.samples + capture_stats.dropped_samples == (PREROLL_MS + MAX_MS) * SAMPLE_RATE / 1000,
+          "%s: utterance of %u samples", name, capture_stats.samples + capture_stats.dropped_samples);
+}
+
+// how many of the frames that arrived from from_ms to to_ms after the first byte were in each codec
+static void count_codecs(const ReceivedStream &stream, int from_ms, int to_ms, int *counts)
+{
+    for (int codec = 0; codec < AUDIO_CODEC_COUNT; codec++)
+    {
+        counts[codec] = 0;
+    }
+    for (size_t i = 0; i < stream.codecs.size(); i++)
+    {
+        double ms = elapsed_ms(stream.first_byte, stream.arrivals[i]);
+        if (ms >= from_ms && ms < to_ms && stream.codecs[i] < AUDIO_CODEC_COUNT)
+        {
+            counts[stream.codecs[i]]++;
+        }
+    }
+}
+
+static void check_adaptive_upload(bool adaptive, const char *name)
+{
+    // good, congested (only ADPCM fits), then middling (mu-law fits) - in bytes a second, frame headers included,
+    // PCM16 needs 33000, mu-law 17000 and ADPCM 9200
+    const std::vector<LinkPhase> link = {{2000, 60000}, {4000, 14000}, {7500, 28000}};
+    LoopbackServer server(link, SHAPED_RECEIVE_BUFFER);
+    Device device(AUDIO_CODEC_PCM16, server.port(), true, adaptive, SHAPED_SEND_BUFFER);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1250));
+    Clock::time_point trigger = Clock::now();
+    uint32_t trigger_sample = device.sampler.m_pushed.load();
+    device.capture.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(MAX_MS - 1000));
+    Clock::time_point stop = Clock::now();
+    device.capture.stop();
+    ReceivedStream stream;
+    std::vector<std::string> errors;
+    CHECK(server.takeStream(&stream, &errors, 20000), "%s: nothing received", name);
+    device.stop();
+    // how far behind the audio got - the first sample went out at the trigger, having been spoken PREROLL_MS before
+    int64_t start_sample = (int64_t)trigger_sample - PREROLL_MS * SAMPLE_RATE / 1000;
+    double max_lag_ms = 0;
+    for (size_t i = 0; i < stream.codecs.size(); i++)
+    {
+        double spoken_ms = std::max(i * STREAM_FRAME_SAMPLES * 1000.0 / SAMPLE_RATE - PREROLL_MS, 0.0);
+        max_lag_ms = std::max(max_lag_ms, elapsed_ms(trigger, stream.arrivals[i]) - spoken_ms);
+    }
+    UtteranceUploaderStats_t stats = device.uploader.getStats();
+    uint32_t dropped = device.sampler.getDroppedSamples() + device.capture.getStats().dropped_samples;
+    printf("%-10s PCM16 %3u  mu-law %3u  ADPCM %3u frames  %2u changes  goodput %6u bytes/s  %3u blocked sends  "
+           "end %7.2f ms after stop  at most %7.2f ms behind  %u samples dropped\n",
+           name, stats.codec_frames[AUDIO_CODEC_PCM16], stats.codec_frames[AUDIO_CODEC_ULAW],
+           stats.codec_frames[AUDIO_CODEC_IMA_ADPCM], stats.codec_changes, stats.goodput, stats.blocked_sends,
+           stream.ended ? elapsed_ms(stop, stream.end) : -1.0, max_lag_ms, dropped);
+    if (!adaptive)
+    {
+        return;
+    }
+    for (size_t i = 0; i < errors.size(); i++)
+    {
+        fprintf(stderr, "ERROR: %s: %s\n", name, errors[i].c_str());
+    }
+    CHECK(errors.empty() && stream.ended, "%s: stream didn't end properly", name);
+    CHECK(dropped == 0, "%s: %u samples dropped", name, dropped);
+    CHECK(max_lag_ms < 1000, "%s: fell %.0f ms behind", name, max_lag_ms);
+    // every sample arrived, whatever it was encoded with - ADPCM is the worst of them
+    int count = stream.samples.size();
+    std::vector<int16_t> reference(count);
+    for (int i = 0; i < count; i++)
+    {
+        reference[i] = test_signal(start_sample + i);
+    }
+    double best_snr = -INFINITY;
+    for (int64_t start = start_sample - SAMPLE_BUFFER_SIZE; start <= start_sample + 2 * SAMPLE_BUFFER_SIZE; start++)
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            reference[i] = test_signal(start + i);
+        }
+        if (start < 0 || snr_db(reference.data(), stream.samples.data(), 200) < 10)
+        {
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            reference[i] = test_signal(start + i);
+        }
+        best_snr = std::max(best_snr, snr_db(reference.data(), stream.samples.data(), count));
+    }
+    CHECK(best_snr >= 20, "%s: SNR %.1f dB", name, best_snr);
+    // the second half of each phase, once it has had time to notice. Sends only wait once the socket buffers are full,
+    // so a codec that's just too much for the link can be tried for a while before that's found out
+    int pcm, ulaw, adpcm;
+    int counts[AUDIO_CODEC_COUNT];
+    count_codecs(stream, 1000, 2000, counts);
+    pcm = counts[AUDIO_CODEC_PCM16];
+    ulaw = counts[AUDIO_CODEC_ULAW];
+    adpcm = counts[AUDIO_CODEC_IMA_ADPCM];
+    CHECK(pcm > ulaw + adpcm, "%s: %d PCM16, %d mu-law and %d ADPCM frames on the good link", name, pcm, ulaw, adpcm);
+    count_codecs(stream, 3000, 4000, counts);
+    pcm = counts[AUDIO_CODEC_PCM16];
+    ulaw = counts[AUDIO_CODEC_ULAW];
+    adpcm = counts[AUDIO_CODEC_IMA_ADPCM];
+    CHECK(pcm == 0 && adpcm > 0, "%s: %d PCM16, %d mu-law and %d ADPCM frames on the congested link", name, pcm, ulaw,
+          adpcm);
+    count_codecs(stream, 5500, 7500, counts);
+    pcm = counts[AUDIO_CODEC_PCM16];
+    ulaw = counts[AUDIO_CODEC_ULAW];
+    adpcm = counts[AUDIO_CODEC_IMA_ADPCM];
+    CHECK(adpcm < pcm + ulaw, "%s: %d PCM16, %d mu-law and %d ADPCM frames once the link recovered", name, pcm, ulaw,
+          adpcm);
+}
+
+int main(int argc, char **argv)
+{
+    check_ulaw();
+    check_adpcm();
+    time_codecs();
+    if (failed)
+    {
+        return 1;
+    }
+    LoopbackServer server;
+    check_upload(server, AUDIO_CODEC_PCM16, "PCM16", 90);
+    check_upload(server, AUDIO_CODEC_ULAW, "mu-law", 30);
+    check_upload(server, AUDIO_CODEC_IMA_ADPCM, "IMA ADPCM", 20);
+    time_upload(server, AUDIO_CODEC_PCM16, "PCM16");
+    time_upload(server, AUDIO_CODEC_ULAW, "mu-law");
+    time_upload(server, AUDIO_CODEC_IMA_ADPCM, "IMA ADPCM");
+    check_adaptive_upload(false, "PCM16");
+    check_adaptive_upload(true, "adaptive");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef __host_arduino_h__
+#define __host_arduino_h__
+
+/**
+ * The little of the Arduino core that the audio_output component uses, so it
+ * can be built on the host by tools/wav_reader_benchmark
+ **/
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class HardwareSerial
+{
+public:
+    int printf(const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        int result = vfprintf(stderr, format, args);
+        va_end(args);
+        return result;
+    }
+};
+
+static HardwareSerial Serial __attribute__((unused));
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __host_fs_h__
+#define __host_fs_h__
+
+#include <Arduino.h>
+
+/**
+ * File backed by a host file. Counts the calls that go to the filesystem,
+ * which on the device are SPIFFS calls, each with its own locking and page lookups
+ **/
+class File
+{
+private:
+    FILE *m_file;
+    long m_size;
+
+public:
+    File(FILE *file = NULL) : m_file(file), m_size(0)
+    {
+        if (m_file)
+        {
+            fseek(m_file, 0, SEEK_END);
+            m_size = ftell(m_file);
+            fseek(m_file, 0, SEEK_SET);
+        }
+    }
+
+    // filesystem calls made through any File since the counter was last reset
+    static unsigned long &calls()
+    {
+        static unsigned long count = 0;
+        return count;
+    }
+    size_t read(uint8_t *buffer, size_t size)
+    {
+        calls()++;
+        return m_file ? fread(buffer, 1, size, m_file) : 0;
+    }
+    bool seek(uint32_t position)
+    {
+        calls()++;
+        return m_file && fseek(m_file, position, SEEK_SET) == 0;
+    }
+    int available()
+    {
+        calls()++;
+        return m_file ? m_size - ftell(m_file) : 0;
+    }
+    size_t size() const { return m_size; }
+    void close()
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            m_file = NULL;
+        }
+    }
+    operator bool() const { return m_file != NULL; }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __host_spiffs_h__
+#define __host_spiffs_h__
+
+#include <string>
+#include <FS.h>
+
+/**
+ * SPIFFS stand-in that opens files under a host directory
+ **/
+class SPIFFSFS
+{
+public:
+    // the host directory that stands in for the root of the SPIFFS partition
+    static std::string &root()
+    {
+        static std::string path = ".";
+        return path;
+    }
+    File open(const char *path, const char *mode)
+    {
+        return File(fopen((root() + path).c_str(), strcmp(mode, "r") == 0 ? "rb" : "wb"));
+    }
+};
+
+static SPIFFSFS SPIFFS;
+
+#endif
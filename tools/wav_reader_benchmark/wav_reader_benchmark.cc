@@ -0,0 +1,560 @@
+/**
+ * WAVFileReader throughput benchmark and format checks
+ *
+ * Plays mono and stereo 16 bit WAV files through WAVFileReader the way
+ * i2sWriterTask does, NUM_FRAMES_TO_SEND (128) frames at a time, and through
+ * the reader it replaced (one or two 2 byte reads per frame, each after a
+ * check for available data - copied below as LegacyWAVFileReader). It prints
+ * the time per block and the filesystem calls per block for both.
+ *
+ * SPIFFS is stood in for by files on the host (tools/wav_reader_benchmark/host),
+ * so the times are the host's - the calls per block are what carries over to
+ * the device, where every call goes through the SPIFFS locks and page lookups.
+ *
+ * It is also the regression check for the reader: both readers have to give
+ * exactly the same frames, to the end of the file without repeat and across
+ * the wrap around with it. The files are a whole number of seconds plus a few
+ * frames, so the end of the file falls in the middle of a block.
+ *
+ * Then it checks the formats the reader converts - 8, 24 and 32 bit PCM and
+ * 32 bit float, with LIST and fact chunks and WAVE_FORMAT_EXTENSIBLE headers -
+ * give exactly the 16 bit samples written, that files it can't play are
+ * refused, and that tones at other sample rates are resampled to 16KHz
+ * cleanly, printing the SNR and the time taken per second of audio. The
+ * program exits with an error if any of the checks fail.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -O2 -Itools/wav_reader_benchmark/host \
+ *       -Icomponents/audio_output \
+ *       tools/wav_reader_benchmark/wav_reader_benchmark.cc \
+ *       components/audio_output/WAVFileReader.cpp \
+ *       components/audio_output/PCMConverter.cpp \
+ *       components/audio_output/Resampler.cpp \
+ *       -o wav_reader_benchmark
+ *
+ * Usage:
+ *   ./wav_reader_benchmark [seconds] [directory for the test files]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <SPIFFS.h>
+#include "WAVFileReader.h"
+
+// same as I2SOutput
+#define NUM_FRAMES_TO_SEND 128
+#define SAMPLE_RATE 16000
+// how many times over the file is played with repeat on
+#define REPEAT_PLAYS 3
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * WAVFileReader as it was before the read buffer - kept here to compare the
+ * timings and the frames against
+ **/
+class LegacyWAVFileReader : public SampleSource
+{
+private:
+    int m_num_channels;
+    bool m_repeat;
+    File m_file;
+
+public:
+    LegacyWAVFileReader(const char *file_name, int num_channels, bool repeat)
+    {
+        m_file = SPIFFS.open(file_name, "r");
+        m_num_channels = num_channels;
+        m_repeat = repeat;
+        reset();
+    }
+    ~LegacyWAVFileReader()
+    {
+        m_file.close();
+    }
+    void reset()
+    {
+        m_file.seek(44);
+    }
+    int getFrames(Frame_t *frames, int number_frames)
+    {
+        for (int i = 0; i < number_frames; i++)
+        {
+            if (m_file.available() == 0)
+            {
+                if (m_repeat)
+                {
+                    reset();
+                }
+                else
+                {
+                    return i;
+                }
+            }
+            m_file.read((uint8_t *)(&frames[i].left), sizeof(int16_t));
+            if (m_num_channels == 1)
+            {
+                frames[i].right = frames[i].left;
+            }
+            else
+            {
+                m_file.read((uint8_t *)(&frames[i].right), sizeof(int16_t));
+            }
+        }
+        return number_frames;
+    }
+    bool available()
+    {
+        return m_file.available() || m_repeat;
+    }
+};
+
+static void put32(std::vector<uint8_t> &bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        bytes.push_back(value >> (8 * i));
+    }
+}
+
+static void put16(std::vector<uint8_t> &bytes, uint16_t value)
+{
+    bytes.push_back(value);
+    bytes.push_back(value >> 8);
+}
+
+static void put_chunk(std::vector<uint8_t> &bytes, const char *id, const std::vector<uint8_t> &contents)
+{
+    bytes.insert(bytes.end(), id, id + 4);
+    put32(bytes, contents.size());
+    bytes.insert(bytes.end(), contents.begin(), contents.end());
+    if (contents.size() & 1)
+    {
+        bytes.push_back(0);
+    }
+}
+
+/**
+ * A WAV file around the samples in data. Without extras it's the canonical 44
+ * byte header, with them there's an odd sized LIST chunk before the fmt chunk,
+ * a fact chunk between it and the data and another LIST chunk after the data,
+ * and a plain fmt chunk has an odd sized extension so it's padded as well.
+ **/
+static std::vector<uint8_t> wav_file(int format, int bits_per_sample, int num_channels, int sample_rate,
+                                     const std::vector<uint8_t> &data, bool extensible, bool extras)
+{
+    std::vector<uint8_t> list = {'I', 'N', 'F', 'O', 'I', 'N', 'A', 'M', 3, 0, 0, 0, 'a', 'b', 0};
+    int block_align = num_channels * bits_per_sample / 8;
+    std::vector<uint8_t> fmt;
+    put16(fmt, extensible ? WAVE_FORMAT_EXTENSIBLE : format);
+    put16(fmt, num_channels);
+    put32(fmt, sample_rate);
+    put32(fmt, sample_rate * block_align);
+    put16(fmt, block_align);
+    put16(fmt, bits_per_sample);
+    if (extensible)
+    {
+        // cbSize, valid bits, channel mask and the sub format GUID
+        put16(fmt, 22);
+        put16(fmt, bits_per_sample);
+        put32(fmt, num_channels == 1 ? 4 : 3);
+        put16(fmt, format);
+        fmt.insert(fmt.end(), {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71});
+    }
+    else if (extras)
+    {
+        // cbSize and a byte of extra format information - 19 bytes in all
+        put16(fmt, 1);
+        fmt.push_back(0);
+    }
+    std::vector<uint8_t> chunks;
+    if (extras)
+    {
+        put_chunk(chunks, "LIST", list);
+    }
+    put_chunk(chunks, "fmt ", fmt);
+    if (extras)
+    {
+        std::vector<uint8_t> fact;
+        put32(fact, data.size() / block_align);
+        put_chunk(chunks, "fact", fact);
+    }
+    put_chunk(chunks, "data", data);
+    if (extras)
+    {
+        put_chunk(chunks, "LIST", list);
+    }
+    std::vector<uint8_t> bytes = {'R', 'I', 'F', 'F'};
+    put32(bytes, 4 + chunks.size());
+    bytes.insert(bytes.end(), {'W', 'A', 'V', 'E'});
+    bytes.insert(bytes.end(), chunks.begin(), chunks.end());
+    return bytes;
+}
+
+static bool save(const char *name, const std::vector<uint8_t> &bytes)
+{
+    FILE *file = fopen((SPIFFSFS::root() + name).c_str(), "wb");
+    if (!file)
+    {
+        fprintf(stderr, "ERROR: could not write %s%s\n", SPIFFSFS::root().c_str(), name);
+        return false;
+    }
+    bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    fclose(file);
+    return ok;
+}
+
+static uint32_t next_random(uint32_t &seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+// a canonical 16KHz 16 bit file of pseudo random samples
+static bool write_wav(const char *name, int num_channels, int frames)
+{
+    std::vector<uint8_t> data;
+    uint32_t seed = num_channels;
+    for (int i = 0; i < frames * num_channels; i++)
+    {
+        put16(data, next_random(seed));
+    }
+    return save(name, wav_file(WAVE_FORMAT_PCM, 16, num_channels, SAMPLE_RATE, data, false, false));
+}
+
+struct Run
+{
+    std::vector<Frame_t> frames;
+    double ms;
+    unsigned long calls;
+    int blocks;
+};
+
+// plays the source until it runs out or max_frames have been played
+static Run play(SampleSource &source, int max_frames)
+{
+    Run run;
+    run.frames.resize(max_frames + NUM_FRAMES_TO_SEND);
+    run.blocks = 0;
+    int played = 0;
+    File::calls() = 0;
+    Clock::time_point start = Clock::now();
+    while (played < max_frames && source.available())
+    {
+        int frames = source.getFrames(run.frames.data() + played, NUM_FRAMES_TO_SEND);
+        played += frames;
+        run.blocks++;
+        if (frames < NUM_FRAMES_TO_SEND)
+        {
+            break;
+        }
+    }
+    run.ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    run.calls = File::calls();
+    run.frames.resize(played);
+    return run;
+}
+
+static bool same_frames(const Run &a, const Run &b)
+{
+    return a.frames.size() == b.frames.size() &&
+           memcmp(a.frames.data(), b.frames.data(), a.frames.size() * sizeof(Frame_t)) == 0;
+}
+
+static bool run(const char *name, int num_channels, int file_frames, bool repeat)
+{
+    int max_frames = repeat ? REPEAT_PLAYS * file_frames : file_frames + NUM_FRAMES_TO_SEND;
+    Run legacy_run;
+    {
+        LegacyWAVFileReader legacy(name, num_channels, repeat);
+        legacy_run = play(legacy, max_frames);
+    }
+    Run reader_run;
+    {
+        WAVFileReader reader(name, repeat);
+        reader_run = play(reader, max_frames);
+    }
+    if (!same_frames(legacy_run, reader_run))
+    {
+        fprintf(stderr, "ERROR: %s%s: frames differ from the legacy reader (%zu and %zu frames)\n", name,
+                repeat ? " on repeat" : "", reader_run.frames.size(), legacy_run.frames.size());
+        return false;
+    }
+    printf("%-6s %-6s %7zu frames  reader %8.3f ms %6.1f calls/block  legacy %8.3f ms %6.1f calls/block  %5.1fx\n",
+           num_channels == 1 ? "mono" : "stereo", repeat ? "repeat" : "once", reader_run.frames.size(), reader_run.ms,
+           (double)reader_run.calls / reader_run.blocks, legacy_run.ms, (double)legacy_run.calls / legacy_run.blocks,
+           legacy_run.ms / reader_run.ms);
+    return true;
+}
+
+struct FormatCheck
+{
+    const char *label;
+    int format;
+    int bits_per_sample;
+    int num_channels;
+    bool extensible;
+    bool extras;
+};
+
+static const FormatCheck format_checks[] = {
+    {"8 bit mono", WAVE_FORMAT_PCM, 8, 1, false, false},
+    {"16 bit stereo, extra chunks", WAVE_FORMAT_PCM, 16, 2, false, true},
+    {"16 bit mono, extensible", WAVE_FORMAT_PCM, 16, 1, true, false},
+    {"24 bit stereo, extensible, extra chunks", WAVE_FORMAT_PCM, 24, 2, true, true},
+    {"32 bit mono, extra chunks", WAVE_FORMAT_PCM, 32, 1, false, true},
+    {"float stereo", WAVE_FORMAT_IEEE_FLOAT, 32, 2, false, false},
+    {"float mono, extensible, extra chunks", WAVE_FORMAT_IEEE_FLOAT, 32, 1, true, true},
+};
+
+/**
+ * Writes pseudo random 16KHz samples in the check's format - with random bits
+ * below the top 16 where there are any - and checks the reader gives back the
+ * 16 bit samples exactly, once through and on repeat
+ **/
+static bool check_format(const char *name, const FormatCheck &check, int file_frames)
+{
+    std::vector<uint8_t> data;
+    std::vector<Frame_t> expected(file_frames);
+    uint32_t seed = 42;
+    for (int i = 0; i < file_frames; i++)
+    {
+        int16_t samples[2] = {0, 0};
+        for (int channel = 0; channel < check.num_channels; channel++)
+        {
+            int16_t sample = next_random(seed);
+            uint16_t low_bits = next_random(seed);
+            switch (check.bits_per_sample)
+            {
+            case 8:
+                sample = (sample >> 8) * 256;
+                data.push_back((sample >> 8) + 128);
+                break;
+            case 16:
+                put16(data, sample);
+                break;
+            case 24:
+                data.push_back(low_bits);
+                put16(data, sample);
+                break;
+            case 32:
+                if (check.format == WAVE_FORMAT_IEEE_FLOAT)
+                {
+                    float value = sample / 32768.0f;
+                    uint32_t value_bits;
+                    memcpy(&value_bits, &value, sizeof(value));
+                    put32(data, value_bits);
+                }
+                else
+                {
+                    put16(data, low_bits);
+                    put16(data, sample);
+                }
+                break;
+            }
+            samples[channel] = sample;
+        }
+        expected[i].left = samples[0];
+        expected[i].right = check.num_channels == 1 ? samples[0] : samples[1];
+    }
+    if (!save(name, wav_file(check.format, check.bits_per_sample, check.num_channels, SAMPLE_RATE, data,
+                             check.extensible, check.extras)))
+    {
+        return false;
+    }
+    for (int repeat = 0; repeat < 2; repeat++)
+    {
+        Run run;
+        {
+            WAVFileReader reader(name, repeat);
+            run = play(reader, repeat ? REPEAT_PLAYS * file_frames : file_frames + NUM_FRAMES_TO_SEND);
+        }
+        // on repeat the last block runs over the end of the last play
+        Run expected_run;
+        for (int play = 0; play < (repeat ? REPEAT_PLAYS + 1 : 1); play++)
+        {
+            expected_run.frames.insert(expected_run.frames.end(), expected.begin(), expected.end());
+        }
+        if (repeat && run.frames.size() >= (size_t)REPEAT_PLAYS * file_frames)
+        {
+            expected_run.frames.resize(run.frames.size());
+        }
+        if (!same_frames(run, expected_run))
+        {
+            fprintf(stderr, "ERROR: %s%s: frames differ from the samples written (%zu and %zu frames)\n", check.label,
+                    repeat ? " on repeat" : "", run.frames.size(), expected_run.frames.size());
+            return false;
+        }
+    }
+    printf("%-40s same frames as the samples written\n", check.label);
+    return true;
+}
+
+#define TONE_AMPLITUDE 16000.0
+// the resampled tone has to be within this of the ideal one
+#define MIN_TONE_SNR_DB 60.0
+// and tones above 8KHz have to be filtered out to at least this far below their amplitude
+#define MIN_ALIAS_REJECTION_DB 50.0
+
+struct ResampleCheck
+{
+    int sample_rate;
+    double frequency;
+};
+
+static const ResampleCheck resample_checks[] = {
+    {8000, 1000}, {11025, 1000}, {22050, 1000}, {32000, 1000}, {44100, 1000}, {48000, 1000},
+    {8000, 2500}, {44100, 5000}, {22050, 11000}, {44100, 11000}, {48000, 12000},
+};
+
+/**
+ * Writes a mono 16 bit tone at the check's rate and plays it through the
+ * reader. Tones below 8KHz have to come out as the same tone at 16KHz - the
+ * first output frame lines up with the first input frame - and tones above
+ * it have to be filtered out rather than aliased down. Prints the time to
+ * resample each second of audio.
+ **/
+static bool check_resample(const char *name, const ResampleCheck &check, int seconds)
+{
+    int file_frames = seconds * check.sample_rate + 77;
+    std::vector<uint8_t> data;
+    for (int i = 0; i < file_frames; i++)
+    {
+        put16(data, lround(TONE_AMPLITUDE * sin(2 * M_PI * check.frequency * i / check.sample_rate)));
+    }
+    if (!save(name, wav_file(WAVE_FORMAT_PCM, 16, 1, check.sample_rate, data, false, false)))
+    {
+        return false;
+    }
+    Run run;
+    {
+        WAVFileReader reader(name, false);
+        run = play(reader, 2 * seconds * SAMPLE_RATE + 1000);
+    }
+    // the output covers the input, give or take a frame
+    int expected_frames = (int)ceil((double)file_frames * SAMPLE_RATE / check.sample_rate);
+    if (abs((int)run.frames.size() - expected_frames) > 1)
+    {
+        fprintf(stderr, "ERROR: %d Hz: %zu frames resampled, expected %d\n", check.sample_rate, run.frames.size(),
+                expected_frames);
+        return false;
+    }
+    // skip the edges, where the filter runs into the silence either side of the file
+    int edge = 100;
+    double signal = 0;
+    double error = 0;
+    for (int i = edge; i < (int)run.frames.size() - edge; i++)
+    {
+        if (run.frames[i].left != run.frames[i].right)
+        {
+            fprintf(stderr, "ERROR: %d Hz: left and right differ for a mono file\n", check.sample_rate);
+            return false;
+        }
+        double ideal = check.frequency < SAMPLE_RATE / 2 ? TONE_AMPLITUDE * sin(2 * M_PI * check.frequency * i / SAMPLE_RATE) : 0;
+        signal += TONE_AMPLITUDE * TONE_AMPLITUDE / 2;
+        error += (run.frames[i].left - ideal) * (run.frames[i].left - ideal);
+    }
+    double db = 10 * log10(signal / std::max(error, 1e-9));
+    bool alias = check.frequency >= SAMPLE_RATE / 2;
+    double ms_per_second = run.ms / ((double)file_frames / check.sample_rate);
+    printf("%5d Hz %6.0f Hz tone  %s %5.1f dB  %6.3f ms per second of audio\n", check.sample_rate, check.frequency,
+           alias ? "rejected" : "SNR     ", db, ms_per_second);
+    if (db < (alias ? MIN_ALIAS_REJECTION_DB : MIN_TONE_SNR_DB))
+    {
+        fprintf(stderr, "ERROR: %d Hz: %s is only %.1f dB\n", check.sample_rate,
+                alias ? "the alias rejection" : "the SNR", db);
+        return false;
+    }
+    return true;
+}
+
+// files the reader has to refuse to play rather than play noise from
+static bool check_rejected(const char *name)
+{
+    std::vector<uint8_t> data(1000, 0x55);
+    std::vector<uint8_t> not_riff = wav_file(WAVE_FORMAT_PCM, 16, 1, SAMPLE_RATE, data, false, false);
+    not_riff[0] = 'X';
+    std::vector<uint8_t> no_data = wav_file(WAVE_FORMAT_PCM, 16, 1, SAMPLE_RATE, data, false, false);
+    no_data.resize(36);
+    std::vector<uint8_t> no_fmt(no_data.begin(), no_data.begin() + 12);
+    put_chunk(no_fmt, "data", data);
+    struct
+    {
+        const char *label;
+        std::vector<uint8_t> bytes;
+    } files[] = {
+        {"not a RIFF file", not_riff},
+        {"no data chunk", no_data},
+        {"no fmt chunk", no_fmt},
+        {"ADPCM", wav_file(2, 4, 1, SAMPLE_RATE, data, false, false)},
+        {"12 bit PCM", wav_file(WAVE_FORMAT_PCM, 12, 1, SAMPLE_RATE, data, true, false)},
+        {"64 bit float", wav_file(WAVE_FORMAT_IEEE_FLOAT, 64, 1, SAMPLE_RATE, data, false, false)},
+        {"0 Hz", wav_file(WAVE_FORMAT_PCM, 16, 1, 0, data, false, false)},
+    };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        if (!save(name, files[i].bytes))
+        {
+            return false;
+        }
+        WAVFileReader reader(name, true);
+        Frame_t frames[NUM_FRAMES_TO_SEND];
+        if (reader.available() || reader.getFrames(frames, NUM_FRAMES_TO_SEND) != 0)
+        {
+            fprintf(stderr, "ERROR: %s: the reader played it\n", files[i].label);
+            return false;
+        }
+        printf("%-40s rejected\n", files[i].label);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 30;
+    if (seconds < 1)
+    {
+        fprintf(stderr, "Usage: %s [seconds] [directory for the test files]\n", argv[0]);
+        return 1;
+    }
+    SPIFFSFS::root() = argc > 2 ? argv[2] : "/tmp";
+    // a few frames over a whole number of blocks so the file ends part way through one
+    int file_frames = seconds * SAMPLE_RATE + 77;
+    const char *names[] = {"/wav_reader_benchmark_mono.wav", "/wav_reader_benchmark_stereo.wav"};
+    bool ok = true;
+    for (int num_channels = 1; num_channels <= 2 && ok; num_channels++)
+    {
+        const char *name = names[num_channels - 1];
+        if (!write_wav(name, num_channels, file_frames))
+        {
+            return 1;
+        }
+        ok = run(name, num_channels, file_frames, false) && run(name, num_channels, file_frames, true);
+        remove((SPIFFSFS::root() + name).c_str());
+    }
+    if (!ok)
+    {
+        return 1;
+    }
+    printf("same frames as the legacy reader, once through and on repeat\n\n");
+    const char *name = "/wav_reader_benchmark_format.wav";
+    for (size_t i = 0; i < sizeof(format_checks) / sizeof(format_checks[0]) && ok; i++)
+    {
+        ok = check_format(name, format_checks[i], SAMPLE_RATE + 77);
+    }
+    ok = ok && check_rejected(name);
+    printf("\n");
+    for (size_t i = 0; i < sizeof(resample_checks) / sizeof(resample_checks[0]) && ok; i++)
+    {
+        ok = check_resample(name, resample_checks[i], seconds);
+    }
+    remove((SPIFFSFS::root() + name).c_str());
+    return ok ? 0 : 1;
+}